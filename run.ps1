@@ -12,11 +12,14 @@ function build_shaders ()
     Set-Location -Path "src/shaders"
 
     glslc blinn.vert -o blinn-vertex.spv
-    glslc blinn.frag -o blinn-fragment.spv
+    glslc -DBINDLESS blinn.frag -o blinn-fragment.spv
+    glslc blinn.frag -o blinn-fragment-array.spv
 
     glslc env.vert -o env-vertex.spv
     glslc env.frag -o env-fragment.spv
 
+    glslc cull.comp -o cull-compute.spv
+
     Set-Location -Path "../.."
 }
 
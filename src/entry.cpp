@@ -1,94 +1,124 @@
 /**
  * @brief Entry point of the program
+ *
+ * @details usage: vulkan-engine [options] [scene file (.scene) or package (.pack)]
+ *
+ *          --sim-thread           run the simulation on its own thread
+ *          --tick-rate <hz>       simulation ticks per second (default 60)
+ *          --gpu-cull             frustum cull instances in a compute pass
+ *          --record-threads <n>   threads recording draw commands (default one per core)
+ *          --frames-in-flight <n> frames recorded ahead of the GPU, 1 to 4 (default 2)
+ *          --present-mode <mode>  immediate (default), mailbox or fifo (vsync)
+ *          --fps-cap <hz>         start at most this many frames per second
+ *          --headless <frames>    render this many frames offscreen without a window and print their timing
+ *          --save-frame <file>    with --headless, write the last frame as PNG
+ *          --gpu-profile <file>   write per pass GPU times and pipeline statistics as CSV on exit
+ *          --no-gpu-profiling     record no timestamp or pipeline statistics queries
+ *          --profile-trace <file> write the CPU profiler zones as Chrome trace JSON on exit
+ *          --no-command-cache     record command buffers every frame
+ *          --no-transfer-queue    upload on the graphics queue even when a transfer queue exists
+ *          --no-pipeline-cache    compile every pipeline from scratch, without reading or writing the cache file
+ *          --no-bindless          bind textures as a plain array and split draws per texture
+ *          --no-texture-streaming keep every mip level of every texture resident
+ *          --no-texture-compression decode block compressed textures to RGBA8 even when the device samples them
+ *          --no-texture-cache     decode every texture image, without reading or writing the texture cache
  */
-#include "game/object.hpp"
+#include "game/game-loop.hpp"
+#include "game/scene-file.hpp"
 #include "game/scene.hpp"
-#include "math/vector.hpp"
+#include "game/texture-loader.hpp"
 #include "renderer/renderer.hpp"
 #include "util/defines.hpp"
+#include "util/profiler.hpp"
 
+#include <cstdlib>
 #include <exception>
 #include <iostream>
+#include <string>
+#include <utility>
+
+int main(int argc, char **argv) {
+  std::string scenePath = "res/scenes/default.scene";
+  Game::GameLoop::Config loopConfig;
+  Renderer::RendererConfig rendererConfig;
+  u32 headlessFrames = 0;
+  std::string framePath;
+  std::string gpuProfilePath;
+  std::string tracePath;
+
+  for (int i = 1; i < argc; i++) {
+    std::string arg = argv[i];
+    if (arg == "--sim-thread") {
+      loopConfig.threaded = true;
+    } else if (arg == "--tick-rate" && i + 1 < argc) {
+      loopConfig.tickRate = std::strtod(argv[++i], nullptr);
+    } else if (arg == "--gpu-cull") {
+      rendererConfig.gpuCulling = true;
+    } else if (arg == "--no-command-cache") {
+      rendererConfig.cacheCommands = false;
+    } else if (arg == "--no-transfer-queue") {
+      rendererConfig.transferQueue = false;
+    } else if (arg == "--no-pipeline-cache") {
+      rendererConfig.pipelineCachePath.clear();
+    } else if (arg == "--no-bindless") {
+      rendererConfig.bindlessTextures = false;
+    } else if (arg == "--no-texture-streaming") {
+      rendererConfig.textureStreaming = false;
+    } else if (arg == "--no-texture-compression") {
+      rendererConfig.textureCompression = false;
+    } else if (arg == "--no-texture-cache") {
+      Game::TextureLoader::global().setCacheDirectory("");
+    } else if (arg == "--record-threads" && i + 1 < argc) {
+      rendererConfig.recordThreads = (u32)std::strtoul(argv[++i], nullptr, 10);
+    } else if (arg == "--frames-in-flight" && i + 1 < argc) {
+      rendererConfig.framesInFlight = (u32)std::strtoul(argv[++i], nullptr, 10);
+    } else if (arg == "--present-mode" && i + 1 < argc) {
+      std::string mode = argv[++i];
+      if (mode == "immediate")
+        rendererConfig.presentPolicy = Renderer::PresentPolicy::IMMEDIATE;
+      else if (mode == "mailbox")
+        rendererConfig.presentPolicy = Renderer::PresentPolicy::MAILBOX;
+      else if (mode == "fifo")
+        rendererConfig.presentPolicy = Renderer::PresentPolicy::FIFO;
+      else
+        std::cerr << "Unknown present mode " << mode << ", using immediate\n";
+    } else if (arg == "--fps-cap" && i + 1 < argc) {
+      rendererConfig.frameRateCap = std::strtod(argv[++i], nullptr);
+    } else if (arg == "--headless" && i + 1 < argc) {
+      rendererConfig.headless = true;
+      headlessFrames = (u32)std::strtoul(argv[++i], nullptr, 10);
+    } else if (arg == "--save-frame" && i + 1 < argc) {
+      framePath = argv[++i];
+    } else if (arg == "--gpu-profile" && i + 1 < argc) {
+      gpuProfilePath = argv[++i];
+    } else if (arg == "--no-gpu-profiling") {
+      rendererConfig.gpuProfiling = false;
+    } else if (arg == "--profile-trace" && i + 1 < argc) {
+      tracePath = argv[++i];
+    } else {
+      scenePath = arg;
+    }
+  }
 
-int main(void) {
-
-  std::string cubePath = "res/cube/cube.obj";
-  std::string teapotPath = "res/teapot/teapot.obj";
-  std::string spherePath = "res/sphere/sphere.obj";
+  Util::Profiler::global().setThreadName("main");
 
   try {
-    std::vector<Game::ModelInfo> models;
-    Game::ModelInfo sphere;
-    sphere.meshFilePath = spherePath;
-    sphere.scale = {0.5, 0.5, 0.5};
-    sphere.position = {-10.0, 10.0, 0.0};
-    sphere.rotation = {0.0, 0, 0.0};
-    sphere.textureFilePath = "";
-    sphere.renderMode = Game::Object::RenderMode::BLINN_SHADING;
-
-    Game::ModelInfo cube;
-    cube.meshFilePath = cubePath;
-    cube.scale = {18.5, 18.5, 18.5};
-    cube.position = {-10.0, 0.0, 0.0};
-    cube.rotation = {0.0, 0.0, 0.0};
-    cube.textureFilePath = "";
-    cube.renderMode = Game::Object::RenderMode::BLINN_SHADING;
-
-    Game::ModelInfo teapot;
-    teapot.meshFilePath = teapotPath;
-    teapot.scale = {0.5, 0.5, 0.5};
-    teapot.position = {0.0, 0.0, 0.0};
-    teapot.rotation = {0.0, 0.0, 0.0};
-    teapot.textureFilePath = "";
-    teapot.renderMode = Game::Object::RenderMode::BLINN_SHADING;
-
-    Game::ModelInfo sphere2;
-    sphere2.meshFilePath = spherePath;
-    sphere2.scale = {0.5, 0.5, 0.5};
-    sphere2.position = {10.0, 10.0, 0.0};
-    sphere2.rotation = {0.0, 0, 0.0};
-    sphere2.textureFilePath = "";
-    sphere2.renderMode = Game::Object::RenderMode::BLINN_SHADING;
-
-    Game::ModelInfo cube2;
-    cube2.meshFilePath = cubePath;
-    cube2.scale = {18.5, 18.5, 18.5};
-    cube2.position = {10.0, 0.0, 0.0};
-    cube2.rotation = {0.0, 0.0, 0.0};
-    cube2.textureFilePath = "";
-    cube2.renderMode = Game::Object::RenderMode::BLINN_SHADING;
-
-    Game::ModelInfo teapot2;
-    teapot2.meshFilePath = teapotPath;
-    teapot2.scale = {0.5, 0.5, 0.5};
-    teapot2.position = {-10.0, -20.0, 0.0};
-    teapot2.rotation = {0.0, 0.0, 0.0};
-    teapot2.textureFilePath = "";
-    teapot2.renderMode = Game::Object::RenderMode::BLINN_SHADING;
-
-    models.push_back(teapot);
-    models.push_back(sphere);
-    models.push_back(cube);
-
-    models.push_back(teapot2);
-    models.push_back(sphere2);
-    models.push_back(cube2);
-
-    std::array<std::string, 6> env = {
-        "res/env/dark-desert/dark_sand_front.png", "res/env/dark-desert/dark_sand_back.png",
-        "res/env/dark-desert/dark_sand_top.png",   "res/env/dark-desert/dark_sand_bottom.png",
-        "res/env/dark-desert/dark_sand_right.png", "res/env/dark-desert/dark_sand_left.png"};
-
-    Game::Scene scene(models, env);
-    //Game::Scene scene(models);
-
-    Renderer::Renderer renderer(SCREEN_WIDTH, SCREEN_HEIGHT, scene);
-    while (renderer.running()) {
-      renderer.FPS();
-      renderer.draw();
-
-      renderer.poll();
+    Game::Scene scene = Game::loadScene(scenePath);
+
+    Renderer::Renderer renderer(SCREEN_WIDTH, SCREEN_HEIGHT, std::move(scene), loopConfig, rendererConfig);
+    if (rendererConfig.headless) {
+      renderer.runHeadless(headlessFrames, framePath);
+    } else {
+      while (renderer.running()) {
+        renderer.FPS();
+        renderer.draw();
+
+        renderer.poll();
+      }
     }
+    renderer.gpuReport(gpuProfilePath);
+    if (!tracePath.empty())
+      Util::Profiler::global().exportChromeTrace(tracePath);
   } catch (std::exception &e) {
     std::cerr << e.what() << std::endl;
     return -1;
@@ -2,17 +2,20 @@
 #include <cmath>
 
 namespace Game {
-Camera::Camera() : position{0, 0, 10}, target{0, 0, 0}, up{0, 1, 0}, direction{0, 0, 1} { update(); }
+Camera::Camera() : position{0, 0, 10}, target{0, 0, 0}, up{0, 1, 0}, direction{0, 0, 1} {
+  update();
+  storePreviousState();
+}
 
 Camera::Camera(const Camera &other)
     : position(other.position), target(other.target), up(other.up), direction(other.direction), yaw(other.yaw),
       pitch(other.pitch), view(other.view), right(other.right), cameraUp(other.cameraUp), forward(other.forward),
-      freecam(other.freecam) {}
+      previousPosition(other.previousPosition), freecam(other.freecam) {}
 
 Camera::Camera(Camera &&other) noexcept
     : position(other.position), target(other.target), up(other.up), direction(other.direction), yaw(other.yaw),
       pitch(other.pitch), view(other.view), right(other.right), cameraUp(other.cameraUp), forward(other.forward),
-      freecam(other.freecam) {}
+      previousPosition(other.previousPosition), freecam(other.freecam) {}
 
 Camera &Camera::operator=(const Camera &other) {
   if (this == &other)
@@ -28,6 +31,7 @@ Camera &Camera::operator=(const Camera &other) {
   this->right = other.right;
   this->cameraUp = other.cameraUp;
   this->forward = other.forward;
+  this->previousPosition = other.previousPosition;
   this->freecam = other.freecam;
 
   return *this;
@@ -47,6 +51,7 @@ Camera &Camera::operator=(Camera &&other) noexcept {
   this->right = other.right;
   this->cameraUp = other.cameraUp;
   this->forward = other.forward;
+  this->previousPosition = other.previousPosition;
   this->freecam = other.freecam;
 
   return *this;
@@ -63,42 +68,58 @@ Math::Vector3 Camera::getRightVector() const { return right; }
 Math::Vector3 Camera::getForwardVector() const { return forward; }
 Math::Vector3 Camera::getUpVector() const { return cameraUp; }
 
-void Camera::update() {
+void Camera::computeBasis(const Math::Vector3 &eye, Math::Vector3 &f, Math::Vector3 &r, Math::Vector3 &u) const {
+  Math::Vector3 worldUp = up;
+
   if (freecam) {
     // free fly camera
-    forward = direction;
-    forward.normalize();
+    f = direction;
+    f.normalize();
     /* forward = position - (position + direction); */
     /* forward.normalize(); */
-
-    right = up.cross(forward);
-    right.normalize();
-
-    cameraUp = forward.cross(right);
-    cameraUp.normalize();
   } else {
     // Look at target
-    forward = position - target;
-    forward.normalize();
+    f = eye - target;
+    f.normalize();
+  }
 
-    right = up.cross(forward);
-    right.normalize();
+  r = worldUp.cross(f);
+  r.normalize();
 
-    cameraUp = forward.cross(right);
-    cameraUp.normalize();
-  }
+  u = f.cross(r);
+  u.normalize();
+}
 
-  Math::Matrix4 view(right.x, right.y, right.z, 0.0f,          //
-                     cameraUp.x, cameraUp.y, cameraUp.z, 0.0f, //
-                     forward.x, forward.y, forward.z, 0.0f,    //
+Math::Matrix4 Camera::buildView(const Math::Vector3 &eye, const Math::Vector3 &f, const Math::Vector3 &r,
+                                const Math::Vector3 &u) const {
+  Math::Matrix4 view(r.x, r.y, r.z, 0.0f, //
+                     u.x, u.y, u.z, 0.0f, //
+                     f.x, f.y, f.z, 0.0f, //
                      0, 0, 0, 1);
 
-  Math::Matrix4 transform(1.0f, 0, 0, -position.x, //
-                          0, 1.0f, 0, -position.y, //
-                          0, 0, 1.0f, -position.z, //
+  Math::Matrix4 transform(1.0f, 0, 0, -eye.x, //
+                          0, 1.0f, 0, -eye.y, //
+                          0, 0, 1.0f, -eye.z, //
                           0, 0, 0, 1.0f);
 
-  this->view = view * transform;
+  return view * transform;
+}
+
+void Camera::update() {
+  computeBasis(position, forward, right, cameraUp);
+  this->view = buildView(position, forward, right, cameraUp);
+}
+
+void Camera::storePreviousState() { previousPosition = position; }
+
+Math::Matrix4 Camera::getInterpolatedViewMatrix(f32 alpha) const {
+  // only the position is blended, the orientation is this camera's as it was extracted. looking around is not applied
+  // per rendered frame: it reaches the renderer with the next extracted packet, like movement does
+  Math::Vector3 eye = previousPosition + (position - previousPosition) * alpha;
+
+  Math::Vector3 f, r, u;
+  computeBasis(eye, f, r, u);
+  return buildView(eye, f, r, u);
 }
 
 void Camera::toggleFreecam() { freecam = !freecam; }
@@ -44,9 +44,25 @@ public:
 
   void update();
 
+  /**
+   * @brief Remember the current position as the start of the next simulation tick
+   */
+  void storePreviousState();
+
+  /**
+   * @brief View matrix blended between the last two simulation ticks (alpha in [0, 1]), only the position is
+   *        blended
+   */
+  Math::Matrix4 getInterpolatedViewMatrix(f32 alpha) const;
+
   void toggleFreecam();
 
 private:
+  void computeBasis(const Math::Vector3 &eye, Math::Vector3 &f, Math::Vector3 &r, Math::Vector3 &u) const;
+  Math::Matrix4 buildView(const Math::Vector3 &eye, const Math::Vector3 &f, const Math::Vector3 &r,
+                          const Math::Vector3 &u) const;
+
+  Math::Vector3 previousPosition;
   bool freecam = false;
 };
 }; // namespace Game
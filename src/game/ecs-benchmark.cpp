@@ -0,0 +1,125 @@
+/**
+ * @file ecs-benchmark.cpp
+ *
+ * @brief Iteration benchmark for the ECS
+ *
+ * @details Creates 1M entities and times single threaded iteration, chunked
+ *          parallel iteration, two systems on disjoint components running
+ *          in parallel and a deferred destroy of half the entities.
+ *
+ *          usage: ecs-benchmark [entity count]
+ */
+
+#include "ecs.hpp"
+
+#include <chrono>
+#include <cstdlib>
+#include <iostream>
+
+namespace {
+struct Position {
+  f32 x, y, z;
+};
+struct Velocity {
+  f32 x, y, z;
+};
+struct Health {
+  f32 value;
+};
+struct Regen {
+  f32 rate;
+};
+
+using Clock = std::chrono::steady_clock;
+
+double elapsedMs(Clock::time_point start) {
+  return std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+}
+
+void report(const char *name, double ms, size_t count) {
+  std::cout << name << ": " << ms << " ms (" << (ms * 1.0e6) / (double)count << " ns/entity)\n";
+}
+} // namespace
+
+int main(int argc, char **argv) {
+  using namespace Game::ECS;
+
+  size_t count = argc > 1 ? std::strtoull(argv[1], nullptr, 10) : 1000000;
+  const int iterations = 10;
+  const f32 dt = 1.0f / 60.0f;
+
+  Threads::ThreadPool &pool = Threads::ThreadPool::global();
+  Registry registry;
+  registry.reserve(count);
+
+  std::cout << "---------------- ECS BENCHMARK ----------------\n";
+  std::cout << "Entities: " << count << ", Worker threads: " << pool.size() << "\n";
+
+  auto start = Clock::now();
+  for (size_t i = 0; i < count; i++) {
+    Entity e = registry.create();
+    registry.emplace<Position>(e, (f32)i, 0.0f, 0.0f);
+    registry.emplace<Velocity>(e, 1.0f, 2.0f, 3.0f);
+    registry.emplace<Health>(e, 100.0f);
+    registry.emplace<Regen>(e, 0.5f);
+  }
+  report("create", elapsedMs(start), count);
+
+  auto movement = registry.view<Velocity, Position>();
+
+  start = Clock::now();
+  for (int i = 0; i < iterations; i++) {
+    movement.each([dt](Entity, Velocity &v, Position &p) {
+      p.x += v.x * dt;
+      p.y += v.y * dt;
+      p.z += v.z * dt;
+    });
+  }
+  report("each (serial)", elapsedMs(start) / iterations, count);
+
+  start = Clock::now();
+  for (int i = 0; i < iterations; i++) {
+    movement.parallelEach(pool, [dt](Entity, Velocity &v, Position &p) {
+      p.x += v.x * dt;
+      p.y += v.y * dt;
+      p.z += v.z * dt;
+    });
+  }
+  report("each (parallel)", elapsedMs(start) / iterations, count);
+
+  Schedule schedule;
+  schedule.add("movement", access(Read<Velocity>{}, Write<Position>{}), [dt](Registry &r, Commands &) {
+    r.view<Velocity, Position>().each([dt](Entity, Velocity &v, Position &p) {
+      p.x += v.x * dt;
+      p.y += v.y * dt;
+      p.z += v.z * dt;
+    });
+  });
+  schedule.add("regen", access(Read<Regen>{}, Write<Health>{}), [dt](Registry &r, Commands &) {
+    r.view<Regen, Health>().each([dt](Entity, Regen &regen, Health &h) { h.value += regen.rate * dt; });
+  });
+
+  std::cout << "Schedule batches: " << schedule.getBatches().size() << "\n";
+
+  start = Clock::now();
+  for (int i = 0; i < iterations; i++)
+    schedule.run(registry, pool);
+  report("schedule (2 disjoint systems)", elapsedMs(start) / iterations, count);
+
+  Schedule cleanup;
+  cleanup.add("cull", access(Read<Position>{}), [](Registry &r, Commands &commands) {
+    r.view<Position>().each([&](Entity e, Position &) {
+      if (e.index % 2 == 0)
+        commands.destroy(e);
+    });
+  });
+
+  start = Clock::now();
+  cleanup.run(registry, pool);
+  report("deferred destroy (half)", elapsedMs(start), count);
+
+  std::cout << "Alive entities: " << registry.size() << "\n";
+  std::cout << "-----------------------------------------------\n";
+
+  return 0;
+}
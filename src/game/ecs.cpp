@@ -0,0 +1,138 @@
+/**
+ * @file ecs.cpp
+ */
+
+#include "ecs.hpp"
+#include "../util/util.hpp"
+
+namespace Game::ECS {
+
+u32 nextComponentId() {
+  static std::atomic<u32> counter{0};
+  u32 id = counter.fetch_add(1, std::memory_order_relaxed);
+  if (id >= ECS_MAX_COMPONENTS)
+    Util::Error("ECS: too many component types, raise ECS_MAX_COMPONENTS");
+  return id;
+}
+
+// ====================================================================================================================
+// Registry
+// ====================================================================================================================
+Entity Registry::create() {
+  u32 index;
+  if (!freeList.empty()) {
+    index = freeList.back();
+    freeList.pop_back();
+  } else {
+    index = (u32)generations.size();
+    generations.push_back(0);
+    alive.push_back(false);
+  }
+
+  alive[index] = true;
+  aliveCount++;
+  return {index, generations[index]};
+}
+
+void Registry::destroy(Entity entity) {
+  if (!valid(entity))
+    return;
+
+  for (auto &pool : ownedPools)
+    pool->remove(entity.index);
+
+  alive[entity.index] = false;
+  generations[entity.index]++;
+  freeList.push_back(entity.index);
+  aliveCount--;
+}
+
+bool Registry::valid(Entity entity) const {
+  return entity.index < generations.size() && alive[entity.index] && generations[entity.index] == entity.generation;
+}
+
+size_t Registry::size() const { return aliveCount; }
+
+void Registry::reserve(size_t count) {
+  generations.reserve(generations.size() + count);
+  alive.reserve(alive.size() + count);
+}
+
+// ====================================================================================================================
+// Commands
+// ====================================================================================================================
+void Commands::destroy(Entity entity) {
+  queued.emplace_back([entity](Registry &registry) { registry.destroy(entity); });
+}
+
+void Commands::flush(Registry &registry) {
+  for (auto &command : queued)
+    command(registry);
+
+  queued.clear();
+}
+
+// ====================================================================================================================
+// Schedule
+// ====================================================================================================================
+void Schedule::add(const std::string &name, Access access, SystemFn fn) {
+  systems.push_back({name, access, std::move(fn), {}});
+  dirty = true;
+}
+
+void Schedule::buildBatches() {
+  batches.clear();
+
+  for (size_t i = 0; i < systems.size(); i++) {
+    bool fits = !batches.empty();
+    if (fits) {
+      for (size_t other : batches.back()) {
+        if (systems[i].access.conflicts(systems[other].access)) {
+          fits = false;
+          break;
+        }
+      }
+    }
+
+    if (fits)
+      batches.back().push_back(i);
+    else
+      batches.push_back({i});
+  }
+
+  dirty = false;
+}
+
+const std::vector<std::vector<size_t>> &Schedule::getBatches() {
+  if (dirty)
+    buildBatches();
+  return batches;
+}
+
+void Schedule::run(Registry &registry, Threads::ThreadPool &pool) {
+  if (dirty)
+    buildBatches();
+
+  for (const auto &batch : batches) {
+    if (batch.size() == 1) {
+      System &system = systems[batch[0]];
+      system.fn(registry, system.commands);
+      continue;
+    }
+
+    Threads::ThreadPool::TaskGroup group;
+    for (size_t i = 1; i < batch.size(); i++) {
+      System &system = systems[batch[i]];
+      pool.submit([&registry, &system]() { system.fn(registry, system.commands); }, &group);
+    }
+
+    System &first = systems[batch[0]];
+    first.fn(registry, first.commands);
+    pool.wait(group);
+  }
+
+  for (auto &system : systems)
+    system.commands.flush(registry);
+}
+
+} // namespace Game::ECS
@@ -0,0 +1,472 @@
+/**
+ * @file ecs.hpp
+ *
+ * @brief header file for the entity component system
+ *
+ * @details Sparse set based ECS.
+ *
+ *          Every component type gets its own pool. A pool maps an entity
+ *          index to a slot in a densely packed array through a paged sparse
+ *          array. The dense components live in fixed size chunks, so growing
+ *          a pool never moves existing components and iterating a pool walks
+ *          contiguous memory chunk by chunk.
+ *
+ *          Structural changes (creating/destroying entities, adding/removing
+ *          components) made while systems run go through a Commands buffer
+ *          and are applied once the systems are done.
+ *
+ *          Systems declare which components they read and write, the
+ *          Schedule runs systems that touch disjoint component sets in
+ *          parallel.
+ */
+
+#pragma once
+
+#include "../threads/threads.hpp"
+#include "../util/defines.hpp"
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <bitset>
+#include <cstddef>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <new>
+#include <string>
+#include <tuple>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+namespace Game::ECS {
+
+#define ECS_MAX_COMPONENTS 64
+
+// entities per sparse page
+#define ECS_SPARSE_PAGE_SIZE 4096
+
+// components per dense chunk
+#define ECS_CHUNK_SIZE 1024
+
+// ====================================================================================================================
+// Entity
+// ====================================================================================================================
+/**
+ * @brief Handle to an entity
+ *
+ * @details The generation is bumped every time an index is recycled, so stale
+ *          handles to destroyed entities are detected.
+ */
+struct Entity {
+  u32 index = UINT32_MAX;
+  u32 generation = 0;
+
+  bool operator==(const Entity &other) const { return index == other.index && generation == other.generation; }
+  bool operator!=(const Entity &other) const { return !(*this == other); }
+};
+
+inline constexpr Entity NullEntity{};
+
+using ComponentMask = std::bitset<ECS_MAX_COMPONENTS>;
+
+/**
+ * @brief Per type component id, assigned on first use
+ */
+u32 nextComponentId();
+
+template <typename T> u32 componentId() {
+  static const u32 id = nextComponentId();
+  return id;
+}
+
+template <typename... Ts> ComponentMask componentMask() {
+  ComponentMask mask;
+  (mask.set(componentId<Ts>()), ...);
+  return mask;
+}
+
+// ====================================================================================================================
+// Component Pool
+// ====================================================================================================================
+class PoolBase {
+public:
+  virtual ~PoolBase() = default;
+
+  virtual void remove(u32 entityIndex) = 0;
+  virtual bool contains(u32 entityIndex) const = 0;
+  virtual size_t size() const = 0;
+
+protected:
+  static constexpr u32 TOMBSTONE = UINT32_MAX;
+};
+
+template <typename T> class Pool : public PoolBase {
+public:
+  Pool() = default;
+  ~Pool() override { clear(); }
+  Pool(const Pool &other) = delete;
+  Pool &operator=(const Pool &other) = delete;
+
+  template <typename... Args> T &emplace(Entity entity, Args &&...args) {
+    u32 &slot = sparseSlot(entity.index);
+    if (slot != TOMBSTONE) {
+      // already has the component, replace it
+      T &component = at(slot);
+      component = T{std::forward<Args>(args)...};
+      return component;
+    }
+
+    u32 dense = (u32)entities.size();
+    if (dense / ECS_CHUNK_SIZE >= chunks.size())
+      chunks.emplace_back(new Storage[ECS_CHUNK_SIZE]);
+
+    T *component = new (pointer(dense)) T{std::forward<Args>(args)...};
+    entities.push_back(entity);
+    slot = dense;
+    return *component;
+  }
+
+  void remove(u32 entityIndex) override {
+    if (!contains(entityIndex))
+      return;
+
+    u32 &slot = sparse[entityIndex / ECS_SPARSE_PAGE_SIZE][entityIndex % ECS_SPARSE_PAGE_SIZE];
+    u32 last = (u32)entities.size() - 1;
+
+    // swap and pop to keep the dense array packed
+    if (slot != last) {
+      at(slot) = std::move(at(last));
+      entities[slot] = entities[last];
+      sparseSlot(entities[slot].index) = slot;
+    }
+
+    at(last).~T();
+    entities.pop_back();
+    slot = TOMBSTONE;
+  }
+
+  bool contains(u32 entityIndex) const override {
+    size_t page = entityIndex / ECS_SPARSE_PAGE_SIZE;
+    return page < sparse.size() && sparse[page] && sparse[page][entityIndex % ECS_SPARSE_PAGE_SIZE] != TOMBSTONE;
+  }
+
+  size_t size() const override { return entities.size(); }
+
+  T &get(u32 entityIndex) { return at(sparse[entityIndex / ECS_SPARSE_PAGE_SIZE][entityIndex % ECS_SPARSE_PAGE_SIZE]); }
+
+  T *tryGet(u32 entityIndex) { return contains(entityIndex) ? &get(entityIndex) : nullptr; }
+
+  /**
+   * @brief Component at a dense index
+   */
+  T &at(size_t dense) { return *pointer(dense); }
+
+  const std::vector<Entity> &getEntities() const { return entities; }
+
+  /**
+   * @brief Number of dense chunks in use
+   */
+  size_t chunkCount() const { return (entities.size() + ECS_CHUNK_SIZE - 1) / ECS_CHUNK_SIZE; }
+
+  /**
+   * @brief Contiguous components of a chunk and how many of them are alive
+   */
+  std::pair<T *, size_t> chunk(size_t index) {
+    size_t begin = index * ECS_CHUNK_SIZE;
+    size_t count = std::min<size_t>(ECS_CHUNK_SIZE, entities.size() - begin);
+    return {pointer(begin), count};
+  }
+
+  void clear() {
+    for (size_t i = 0; i < entities.size(); i++)
+      at(i).~T();
+
+    for (auto &page : sparse)
+      if (page)
+        std::fill(page.get(), page.get() + ECS_SPARSE_PAGE_SIZE, TOMBSTONE);
+
+    entities.clear();
+  }
+
+private:
+  using Storage = std::aligned_storage_t<sizeof(T), alignof(T)>;
+
+  T *pointer(size_t dense) {
+    return std::launder(reinterpret_cast<T *>(&chunks[dense / ECS_CHUNK_SIZE][dense % ECS_CHUNK_SIZE]));
+  }
+
+  u32 &sparseSlot(u32 entityIndex) {
+    size_t page = entityIndex / ECS_SPARSE_PAGE_SIZE;
+    if (page >= sparse.size())
+      sparse.resize(page + 1);
+
+    if (!sparse[page]) {
+      sparse[page].reset(new u32[ECS_SPARSE_PAGE_SIZE]);
+      std::fill(sparse[page].get(), sparse[page].get() + ECS_SPARSE_PAGE_SIZE, TOMBSTONE);
+    }
+
+    return sparse[page][entityIndex % ECS_SPARSE_PAGE_SIZE];
+  }
+
+  std::vector<std::unique_ptr<u32[]>> sparse;
+  std::vector<std::unique_ptr<Storage[]>> chunks;
+  std::vector<Entity> entities;
+};
+
+class Registry;
+
+// ====================================================================================================================
+// View
+// ====================================================================================================================
+/**
+ * @brief Iterates every entity that has all of the given components
+ *
+ * @details The first component type drives the iteration, so put the
+ *          rarest component first. Views must not be used while entities
+ *          or components are being added/removed, use Commands for that.
+ */
+template <typename Lead, typename... Rest> class View {
+public:
+  View(Pool<Lead> *lead, Pool<Rest> *...rest) : lead(lead), rest(rest...) {}
+
+  /**
+   * @brief Calls fn(Entity, Lead &, Rest &...) for each match
+   */
+  template <typename Fn> void each(Fn &&fn) { eachRange(0, lead->size(), fn); }
+
+  /**
+   * @brief Same as each but splits the lead pool chunk-wise across the thread pool
+   *
+   * @details fn must only touch the entity it was handed
+   */
+  template <typename Fn> void parallelEach(Threads::ThreadPool &pool, Fn &&fn) {
+    pool.parallelFor(lead->size(), ECS_CHUNK_SIZE, [&](size_t begin, size_t end) { eachRange(begin, end, fn); });
+  }
+
+  /**
+   * @brief Upper bound on the number of matches (the lead pool size)
+   */
+  size_t sizeHint() const { return lead->size(); }
+
+private:
+  template <typename Fn> void eachRange(size_t begin, size_t end, Fn &fn) {
+    const auto &entities = lead->getEntities();
+
+    // walk chunk by chunk so the inner loop is over contiguous memory
+    for (size_t chunkBegin = begin; chunkBegin < end;) {
+      size_t chunkEnd = std::min(end, (chunkBegin / ECS_CHUNK_SIZE + 1) * ECS_CHUNK_SIZE);
+      Lead *components = &lead->at(chunkBegin);
+
+      for (size_t i = chunkBegin; i < chunkEnd; i++) {
+        Entity entity = entities[i];
+        if constexpr (sizeof...(Rest) == 0) {
+          fn(entity, components[i - chunkBegin]);
+        } else {
+          if (!std::apply([&](auto *...pools) { return (pools->contains(entity.index) && ...); }, rest))
+            continue;
+
+          std::apply([&](auto *...pools) { fn(entity, components[i - chunkBegin], pools->get(entity.index)...); },
+                     rest);
+        }
+      }
+
+      chunkBegin = chunkEnd;
+    }
+  }
+
+  Pool<Lead> *lead;
+  std::tuple<Pool<Rest> *...> rest;
+};
+
+// ====================================================================================================================
+// Registry
+// ====================================================================================================================
+class Registry {
+public:
+  Registry() = default;
+  ~Registry() = default;
+  Registry(const Registry &other) = delete;
+  Registry &operator=(const Registry &other) = delete;
+
+  Entity create();
+  void destroy(Entity entity);
+  bool valid(Entity entity) const;
+
+  /**
+   * @brief Number of alive entities
+   */
+  size_t size() const;
+
+  /**
+   * @brief Make room for count more entities without reallocating
+   */
+  void reserve(size_t count);
+
+  template <typename T, typename... Args> T &emplace(Entity entity, Args &&...args) {
+    return assure<T>().emplace(entity, std::forward<Args>(args)...);
+  }
+
+  template <typename T> void remove(Entity entity) {
+    if (valid(entity))
+      assure<T>().remove(entity.index);
+  }
+
+  template <typename T> bool has(Entity entity) const {
+    PoolBase *pool = pools[componentId<T>()].load(std::memory_order_acquire);
+    return valid(entity) && pool && pool->contains(entity.index);
+  }
+
+  template <typename T> T &get(Entity entity) { return assure<T>().get(entity.index); }
+
+  template <typename T> T *tryGet(Entity entity) { return valid(entity) ? assure<T>().tryGet(entity.index) : nullptr; }
+
+  template <typename Lead, typename... Rest> View<Lead, Rest...> view() {
+    return View<Lead, Rest...>(&assure<Lead>(), &assure<Rest>()...);
+  }
+
+  /**
+   * @brief Pool for a component type, created on first use
+   *
+   * @details Safe to call from several threads at once
+   */
+  template <typename T> Pool<T> &assure() {
+    u32 id = componentId<T>();
+    PoolBase *pool = pools[id].load(std::memory_order_acquire);
+    if (pool)
+      return *static_cast<Pool<T> *>(pool);
+
+    std::lock_guard<std::mutex> lock(poolMutex);
+    pool = pools[id].load(std::memory_order_relaxed);
+    if (!pool) {
+      ownedPools.emplace_back(new Pool<T>());
+      pool = ownedPools.back().get();
+      pools[id].store(pool, std::memory_order_release);
+    }
+    return *static_cast<Pool<T> *>(pool);
+  }
+
+private:
+  std::vector<u32> generations;
+  std::vector<u32> freeList;
+  std::vector<bool> alive;
+  size_t aliveCount = 0;
+
+  std::array<std::atomic<PoolBase *>, ECS_MAX_COMPONENTS> pools{};
+  std::vector<std::unique_ptr<PoolBase>> ownedPools;
+  std::mutex poolMutex;
+};
+
+// ====================================================================================================================
+// Deferred structural changes
+// ====================================================================================================================
+/**
+ * @brief Records structural changes to apply to a registry later
+ */
+class Commands {
+public:
+  Commands() = default;
+  ~Commands() = default;
+  Commands(const Commands &other) = delete;
+  Commands(Commands &&other) noexcept = default;
+  Commands &operator=(const Commands &other) = delete;
+  Commands &operator=(Commands &&other) noexcept = default;
+
+  /**
+   * @brief Create an entity with the given components on flush
+   */
+  template <typename... Ts> void create(Ts... components) {
+    queued.emplace_back([components = std::make_tuple(std::move(components)...)](Registry &registry) mutable {
+      Entity entity = registry.create();
+      std::apply([&](auto &...c) { (registry.emplace<std::decay_t<decltype(c)>>(entity, std::move(c)), ...); },
+                 components);
+    });
+  }
+
+  void destroy(Entity entity);
+
+  template <typename T> void emplace(Entity entity, T component) {
+    queued.emplace_back([entity, component = std::move(component)](Registry &registry) mutable {
+      if (registry.valid(entity))
+        registry.emplace<T>(entity, std::move(component));
+    });
+  }
+
+  template <typename T> void remove(Entity entity) {
+    queued.emplace_back([entity](Registry &registry) { registry.remove<T>(entity); });
+  }
+
+  /**
+   * @brief Apply everything in recorded order and clear
+   */
+  void flush(Registry &registry);
+
+  bool empty() const { return queued.empty(); }
+
+private:
+  std::vector<std::function<void(Registry &)>> queued;
+};
+
+// ====================================================================================================================
+// Systems
+// ====================================================================================================================
+/**
+ * @brief Component access of a system, used to find systems that can run together
+ */
+struct Access {
+  ComponentMask reads;
+  ComponentMask writes;
+
+  bool conflicts(const Access &other) const {
+    return (writes & (other.reads | other.writes)).any() || (other.writes & reads).any();
+  }
+};
+
+template <typename... Ts> struct Read {};
+template <typename... Ts> struct Write {};
+
+template <typename... Reads, typename... Writes> Access access(Read<Reads...> = {}, Write<Writes...> = {}) {
+  return {componentMask<Reads...>(), componentMask<Writes...>()};
+}
+
+/**
+ * @brief Ordered list of systems
+ *
+ * @details Systems are grouped into batches in the order they were added.
+ *          A system joins the current batch when it does not conflict with
+ *          any system already in it, so conflicting systems still run in
+ *          the order they were added. Systems in a batch run in parallel.
+ */
+class Schedule {
+public:
+  using SystemFn = std::function<void(Registry &, Commands &)>;
+
+  void add(const std::string &name, Access access, SystemFn fn);
+
+  /**
+   * @brief Run all systems then flush their commands in system order
+   */
+  void run(Registry &registry, Threads::ThreadPool &pool);
+
+  /**
+   * @brief Batches of system indices, rebuilt when systems are added
+   */
+  const std::vector<std::vector<size_t>> &getBatches();
+
+private:
+  struct System {
+    std::string name;
+    Access access;
+    SystemFn fn;
+    Commands commands;
+  };
+
+  void buildBatches();
+
+  std::vector<System> systems;
+  std::vector<std::vector<size_t>> batches;
+  bool dirty = true;
+};
+
+} // namespace Game::ECS
@@ -0,0 +1,30 @@
+/**
+ * @file frame-packet.cpp
+ */
+
+#include "frame-packet.hpp"
+#include "object.hpp"
+
+namespace Game {
+
+Math::Matrix4 ObjectState::getModelMatrix(f32 alpha) const {
+  Math::Vector3 p = previousPosition + (position - previousPosition) * alpha;
+  return Object::composeModelMatrix(p, Math::Quaternion::nlerp(previousRotation, rotation, alpha), scale, pivot);
+}
+
+FramePacket &FramePacketBuffer::beginWrite() { return packets[writeIndex]; }
+
+void FramePacketBuffer::publish() {
+  u32 old = spare.exchange(writeIndex | NEW_DATA, std::memory_order_acq_rel);
+  writeIndex = old & ~NEW_DATA;
+}
+
+const FramePacket &FramePacketBuffer::acquire() {
+  if (spare.load(std::memory_order_acquire) & NEW_DATA) {
+    u32 old = spare.exchange(readIndex, std::memory_order_acq_rel);
+    readIndex = old & ~NEW_DATA;
+  }
+  return packets[readIndex];
+}
+
+} // namespace Game
@@ -0,0 +1,91 @@
+/**
+ * @file frame-packet.hpp
+ *
+ * @brief header file for frame packets
+ *
+ * @details A frame packet is a snapshot of everything the renderer needs
+ *          from the scene: the transforms of the last two simulation ticks
+ *          (for interpolation), the camera and the list of objects to draw.
+ *          The simulation fills one after each tick (the extract phase) and
+ *          the renderer builds its frame from the newest one, so the next
+ *          tick can mutate the live scene while a frame is being recorded.
+ */
+
+#pragma once
+
+#include "../math/matrix.hpp"
+#include "../math/vector.hpp"
+#include "../mesh/mesh.hpp"
+#include "../util/defines.hpp"
+#include "camera.hpp"
+
+#include <atomic>
+#include <memory>
+#include <vector>
+
+namespace Game {
+
+struct ObjectState {
+  Math::Vector3 previousPosition;
+  Math::Vector3 position;
+  Math::Quaternion previousRotation{1, 0, 0, 0};
+  Math::Quaternion rotation{1, 0, 0, 0};
+  Math::Vector3 scale;
+  // models rotate around their mesh center
+  Math::Vector3 pivot;
+  // holding a reference keeps a despawned object's mesh alive until no packet draws it
+  std::shared_ptr<const Mesh::Mesh> mesh;
+  // the object's texture pixels, only used to tell textures apart, nullptr when it has none
+  const void *texture = nullptr;
+
+  /**
+   * @brief Model matrix blended between the two ticks (alpha in [0, 1])
+   */
+  Math::Matrix4 getModelMatrix(f32 alpha) const;
+};
+
+struct FramePacket {
+  u64 tick = 0;
+  Camera camera;
+  // indexed like Scene::objects
+  std::vector<ObjectState> objects;
+  // indices into objects that should be drawn this frame
+  std::vector<u32> visible;
+};
+
+/**
+ * @brief Hands packets from the simulation to the renderer without either side waiting
+ *
+ * @details Double buffered with a spare: the writer fills its own packet and
+ *          swaps it with the spare on publish, the reader swaps its packet with
+ *          the spare when a newer one is there. Only one writer thread and one
+ *          reader thread are supported.
+ */
+class FramePacketBuffer {
+public:
+  FramePacketBuffer() = default;
+  FramePacketBuffer(const FramePacketBuffer &other) = delete;
+  FramePacketBuffer &operator=(const FramePacketBuffer &other) = delete;
+
+  /**
+   * @brief Packet owned by the writer until publish
+   */
+  FramePacket &beginWrite();
+  void publish();
+
+  /**
+   * @brief Newest published packet, stays valid (and unchanged) until the next acquire
+   */
+  const FramePacket &acquire();
+
+private:
+  static const u32 NEW_DATA = 4;
+
+  FramePacket packets[3];
+  u32 writeIndex = 0;
+  u32 readIndex = 1;
+  // index of the spare packet, NEW_DATA is set when it holds an unread publish
+  std::atomic<u32> spare{2};
+};
+
+} // namespace Game
@@ -0,0 +1,105 @@
+/**
+ * @file game-loop.cpp
+ */
+
+#include "game-loop.hpp"
+#include "../util/profiler.hpp"
+#include "../util/util.hpp"
+
+#include <algorithm>
+#include <utility>
+
+namespace Game {
+
+GameLoop::GameLoop(Config config) : config(config) {
+  if (config.tickRate <= 0)
+    Util::Error("GameLoop: tick rate must be positive");
+  if (config.maxTicksPerFrame == 0)
+    this->config.maxTicksPerFrame = 1;
+
+  tickDuration = std::chrono::duration_cast<Clock::duration>(std::chrono::duration<f64>(1.0 / config.tickRate));
+}
+
+GameLoop::~GameLoop() { stop(); }
+
+void GameLoop::start(TickFn tick) {
+  stop();
+
+  this->tick = std::move(tick);
+  previousFrame = Clock::now();
+  accumulator = Clock::duration{0};
+  lastTickTime.store(previousFrame.time_since_epoch().count(), std::memory_order_release);
+
+  if (config.threaded) {
+    running.store(true, std::memory_order_release);
+    simulationThread = std::thread(&GameLoop::simulationLoop, this);
+  }
+}
+
+void GameLoop::stop() {
+  running.store(false, std::memory_order_release);
+  if (simulationThread.joinable())
+    simulationThread.join();
+}
+
+f64 GameLoop::frame() {
+  Clock::time_point now = Clock::now();
+
+  if (config.threaded) {
+    // how far we are into the tick the simulation thread is working on
+    Clock::time_point last(Clock::duration(lastTickTime.load(std::memory_order_acquire)));
+    f64 alpha = std::chrono::duration<f64>(now - last).count() * config.tickRate;
+    return std::clamp(alpha, 0.0, 1.0);
+  }
+
+  accumulator += now - previousFrame;
+  previousFrame = now;
+
+  // drop time we can't catch up on instead of spiraling
+  accumulator = std::min(accumulator, tickDuration * config.maxTicksPerFrame);
+
+  if (accumulator >= tickDuration) {
+    std::lock_guard<std::mutex> lock(stateMutex);
+    const f64 dt = 1.0 / config.tickRate;
+    while (accumulator >= tickDuration) {
+      tick(dt);
+      tickCount.fetch_add(1, std::memory_order_relaxed);
+      accumulator -= tickDuration;
+    }
+  }
+
+  return std::chrono::duration<f64>(accumulator).count() * config.tickRate;
+}
+
+void GameLoop::simulationLoop() {
+  Util::Profiler::global().setThreadName("simulation");
+  const f64 dt = 1.0 / config.tickRate;
+  Clock::time_point next = Clock::now() + tickDuration;
+
+  while (running.load(std::memory_order_acquire)) {
+    std::this_thread::sleep_until(next);
+
+    Clock::time_point now = Clock::now();
+    if (now - next > tickDuration * config.maxTicksPerFrame)
+      next = now; // fell too far behind (debugger, suspend), don't try to catch up
+
+    {
+      std::lock_guard<std::mutex> lock(stateMutex);
+      tick(dt);
+    }
+    tickCount.fetch_add(1, std::memory_order_relaxed);
+    lastTickTime.store(next.time_since_epoch().count(), std::memory_order_release);
+
+    next += tickDuration;
+  }
+}
+
+std::mutex &GameLoop::getStateMutex() { return stateMutex; }
+
+f64 GameLoop::getTickDelta() const { return 1.0 / config.tickRate; }
+
+u64 GameLoop::getTickCount() const { return tickCount.load(std::memory_order_relaxed); }
+
+bool GameLoop::isThreaded() const { return config.threaded; }
+
+} // namespace Game
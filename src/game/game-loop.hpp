@@ -0,0 +1,87 @@
+/**
+ * @file game-loop.hpp
+ *
+ * @brief header file for the fixed timestep game loop
+ *
+ * @details The simulation advances in fixed ticks (1 / tickRate seconds)
+ *          no matter how fast frames are rendered. Time left over after the
+ *          last tick is handed to the renderer as an interpolation factor so
+ *          motion stays smooth when the frame rate and tick rate differ.
+ *
+ *          Single threaded, every rendered frame runs the ticks that are due
+ *          (capped so a long stall can't snowball). Threaded, a simulation
+ *          thread ticks on its own clock and frames only read the factor.
+ *          Ticks run with the state mutex held, input handlers on the window
+ *          thread lock it before touching the scene. Rendering reads frame
+ *          packets instead of the scene (see frame-packet.hpp).
+ */
+
+#pragma once
+
+#include "../util/defines.hpp"
+
+#include <atomic>
+#include <chrono>
+#include <functional>
+#include <mutex>
+#include <thread>
+
+namespace Game {
+
+struct GameLoopConfig {
+  f64 tickRate = 60.0;
+  // most ticks run for a single frame before dropping time
+  u32 maxTicksPerFrame = 8;
+  bool threaded = false;
+};
+
+class GameLoop {
+public:
+  using Config = GameLoopConfig;
+
+  using TickFn = std::function<void(f64 dt)>;
+
+  explicit GameLoop(Config config = {});
+  ~GameLoop();
+  GameLoop(const GameLoop &other) = delete;
+  GameLoop &operator=(const GameLoop &other) = delete;
+
+  /**
+   * @brief Start the clock (and the simulation thread when threaded)
+   */
+  void start(TickFn tick);
+  void stop();
+
+  /**
+   * @brief Call once per rendered frame, returns the interpolation factor in [0, 1]
+   */
+  f64 frame();
+
+  std::mutex &getStateMutex();
+  f64 getTickDelta() const;
+  u64 getTickCount() const;
+  bool isThreaded() const;
+
+private:
+  using Clock = std::chrono::steady_clock;
+
+  void simulationLoop();
+
+  Config config;
+  Clock::duration tickDuration;
+  TickFn tick;
+
+  // single threaded
+  Clock::time_point previousFrame;
+  Clock::duration accumulator{0};
+
+  // threaded
+  std::thread simulationThread;
+  std::atomic<bool> running{false};
+  std::atomic<Clock::rep> lastTickTime{0};
+
+  std::atomic<u64> tickCount{0};
+  std::mutex stateMutex;
+};
+
+} // namespace Game
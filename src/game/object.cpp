@@ -1,31 +1,49 @@
 #include "object.hpp"
 #include "../util/util.hpp"
+#include "frame-packet.hpp"
+#include "texture-loader.hpp"
 
 #include <cmath>
+#include <utility>
 
 namespace Game {
 Object::Object(Math::Vector3 p, Math::Quaternion r, Math::Vector3 s, RenderMode m)
-    : position(p), rotation(r), scale(s), renderMode(m) {}
+    : position(p), rotation(r), scale(s), previousPosition(p), previousRotation(r), renderMode(m) {}
+
+Object::~Object() { removeTexture(); }
 
 Object::Object(const Object &other)
-    : position(other.position), rotation(other.rotation), scale(other.scale), mesh(other.mesh),
-      renderMode(other.renderMode) {}
+    : textureLoaded(other.textureLoaded), position(other.position), rotation(other.rotation), scale(other.scale),
+      previousPosition(other.previousPosition), previousRotation(other.previousRotation), mesh(other.mesh),
+      texture(other.texture), pitch(other.pitch), yaw(other.yaw), roll(other.roll), renderMode(other.renderMode) {}
 
 Object &Object::operator=(const Object &other) {
   if (this == &other)
     return *this;
+  removeTexture();
   this->mesh = other.mesh;
+  this->texture = other.texture;
+  this->textureLoaded = other.textureLoaded;
   this->rotation = other.rotation;
   this->position = other.position;
   this->scale = other.scale;
+  this->previousPosition = other.previousPosition;
+  this->previousRotation = other.previousRotation;
+  this->pitch = other.pitch;
+  this->yaw = other.yaw;
+  this->roll = other.roll;
   this->renderMode = other.renderMode;
   return *this;
 }
 
 Object::Object(Object &&other) noexcept
-    : position(other.position), rotation(other.rotation), scale(other.scale), mesh(other.mesh),
-      renderMode(other.renderMode) {
+    : textureLoaded(other.textureLoaded), position(other.position), rotation(other.rotation), scale(other.scale),
+      previousPosition(other.previousPosition), previousRotation(other.previousRotation), mesh(std::move(other.mesh)),
+      texture(other.texture), pitch(other.pitch), yaw(other.yaw), roll(other.roll), renderMode(other.renderMode) {
 
+  // the pixels now belong to this object
+  other.texture = TextureData{};
+  other.textureLoaded = false;
   other.rotation = {0, {0, 0, 0}};
   other.position = {0, 0, 0};
   other.scale = {0, 0, 0};
@@ -35,12 +53,22 @@ Object &Object::operator=(Object &&other) noexcept {
   if (this == &other)
     return *this;
 
-  this->mesh = other.mesh;
+  removeTexture();
+  this->mesh = std::move(other.mesh);
+  this->texture = other.texture;
+  this->textureLoaded = other.textureLoaded;
   this->rotation = other.rotation;
   this->position = other.position;
   this->scale = other.scale;
+  this->previousPosition = other.previousPosition;
+  this->previousRotation = other.previousRotation;
+  this->pitch = other.pitch;
+  this->yaw = other.yaw;
+  this->roll = other.roll;
   this->renderMode = other.renderMode;
 
+  other.texture = TextureData{};
+  other.textureLoaded = false;
   other.rotation = {0, {0, 0, 0}};
   other.position = {0, 0, 0};
   other.scale = {0, 0, 0};
@@ -51,25 +79,93 @@ Object &Object::operator=(Object &&other) noexcept {
 bool Object::operator<(const Object &other) { return this->renderMode < other.renderMode; }
 
 void Object::init(const std::string &meshPath, const std::string &texturePath) {
-  this->mesh.init(meshPath);
+  auto loaded = std::make_shared<Mesh::Mesh>();
+  loaded->init(meshPath);
+
+  init(std::move(loaded), texturePath);
+}
+
+void Object::init(Mesh::Mesh &&loadedMesh, const unsigned char *pixels, int width, int height) {
+  init(std::make_shared<const Mesh::Mesh>(std::move(loadedMesh)), pixels, width, height);
+}
+
+void Object::init(std::shared_ptr<const Mesh::Mesh> sharedMesh, const unsigned char *pixels, int width, int height) {
+  this->mesh = std::move(sharedMesh);
+
+  if (pixels) {
+    texture.pixels = pixels;
+    texture.width = width;
+    texture.height = height;
+    texture.channels = 4;
+    textureLoaded = true;
+  }
+}
+
+void Object::init(std::shared_ptr<const Mesh::Mesh> sharedMesh, const std::string &texturePath) {
+  this->mesh = std::move(sharedMesh);
 
   if (!texturePath.empty())
     loadTexture(texturePath);
 }
 
-Math::Matrix4 Object::getModelMatrix() {
+void Object::init(std::shared_ptr<const Mesh::Mesh> sharedMesh, std::shared_ptr<const Util::TextureFile> textureFile) {
+  this->mesh = std::move(sharedMesh);
+
+  if (textureFile) {
+    texture.file = std::move(textureFile);
+    texture.width = (int)texture.file->width;
+    texture.height = (int)texture.file->height;
+    texture.channels = 4;
+    textureLoaded = true;
+  }
+}
+
+Math::Matrix4 Object::getModelMatrix() { return composeModelMatrix(position, rotation, scale, getPivot()); }
+
+Math::Vector3 Object::getPivot() { return mesh ? mesh->getBoundingBox().mid : Math::Vector3{0, 0, 0}; }
+
+void Object::storePreviousState() {
+  previousPosition = position;
+  previousRotation = rotation;
+}
+
+Math::Matrix4 Object::getInterpolatedModelMatrix(f32 alpha) {
+  Math::Vector3 p = previousPosition + (position - previousPosition) * alpha;
+  return composeModelMatrix(p, Math::Quaternion::nlerp(previousRotation, rotation, alpha), scale, getPivot());
+}
+
+void Object::extract(ObjectState &state) {
+  state.previousPosition = previousPosition;
+  state.position = position;
+  state.previousRotation = previousRotation;
+  state.rotation = rotation;
+  state.scale = scale;
+  state.pivot = getPivot();
+  state.mesh = mesh;
+  state.texture = textureLoaded ? texture.getKey() : nullptr;
+}
+
+Math::Matrix4 Object::composeModelMatrix(const Math::Vector3 &p, Math::Quaternion r, const Math::Vector3 &s,
+                                         const Math::Vector3 &pivot) {
   Math::Matrix4 model(1.0, 0.0, 0.0, 0.0, //
                       0.0, 1.0, 0.0, 0.0, //
                       0.0, 0.0, 1.0, 0.0, //
                       0.0, 0.0, 0.0, 1.0);
-  model = getScaleMatrix(scale) * model;
-  model = getTranslationMatrix(mesh.getBoundingBox().mid * -scale.x) * model;
+  model = getScaleMatrix(s) * model;
+  model = getTranslationMatrix(pivot * -s.x) * model;
   /* model = getRotationMatrix() * model; */
-  model = rotation.toRotationMatrix() * model;
-  model = getTranslationMatrix(position) * model;
+  model = r.toRotationMatrix() * model;
+  model = getTranslationMatrix(p) * model;
   return model;
 }
 
+Math::AABB Object::getWorldBoundingBox() {
+  const auto &box = mesh->getBoundingBox();
+  Math::AABB bounds = Math::AABB(box.min, box.max).transform(getModelMatrix());
+  bounds.merge(Math::AABB(box.min, box.max).transform(getInterpolatedModelMatrix(0.0f)));
+  return bounds;
+}
+
 Math::Matrix4 Object::getTranslationMatrix(Math::Vector3 t) {
   return Math::Matrix4(1, 0, 0, t.x, //
                        0, 1, 0, t.y, //
@@ -98,20 +194,28 @@ Math::Matrix4 Object::getScaleMatrix(Math::Vector3 s) {
 }
 
 void Object::loadTexture(std::string fileName) {
-  Util::loadImage(fileName, texture.pixels, texture.width, texture.height, texture.channels);
+  texture.file = TextureLoader::global().load(fileName);
+  texture.width = (int)texture.file->width;
+  texture.height = (int)texture.file->height;
+  texture.channels = 4;
+  textureLoaded = true;
 }
 bool Object::hasTexture() { return textureLoaded; }
 
 void Object::removeTexture() {
   if (texture.pixels) {
-    stbi_image_free(texture.pixels);
     texture.pixels = nullptr;
     textureLoaded = false;
   }
+  if (texture.file) {
+    texture.file.reset();
+    textureLoaded = false;
+  }
 }
 
 const Object::TextureData &Object::getTextureData() { return texture; }
-const Mesh::Mesh &Object::getMesh() { return mesh; }
+const Mesh::Mesh &Object::getMesh() { return *mesh; }
+const std::shared_ptr<const Mesh::Mesh> &Object::getSharedMesh() { return mesh; }
 
 void Object::setRotation(Math::Vector3 r) {
   pitch = r.x;
@@ -2,32 +2,59 @@
 
 #include "../util/stb_image.h"
 
+#include "../math/bounds.hpp"
 #include "../math/matrix.hpp"
 #include "../math/vector.hpp"
 #include "../mesh/mesh.hpp"
 #include "../util/defines.hpp"
+#include "../util/texture-file.hpp"
+
+#include <memory>
 
 namespace Game {
+struct ObjectState;
+
 class Object {
 public:
   enum RenderMode { BLINN_SHADING, ENVIRONMENT_MAP };
 
 private:
   struct TextureData {
-    stbi_uc *pixels = nullptr;
+    // borrowed, e.g. from a mapped scene package, never written through
+    const stbi_uc *pixels = nullptr;
     int width = 1, height = 1, channels = 1;
+    // set instead of pixels for textures from files, shared by every object naming the same file
+    std::shared_ptr<const Util::TextureFile> file;
+
+    /**
+     * @brief Identifies the texture's data, the same for every object sharing it
+     */
+    const void *getKey() const { return file ? static_cast<const void *>(file.get()) : pixels; }
   };
 
 public:
   Object() = delete;
   Object(Math::Vector3 p, Math::Quaternion o, Math::Vector3 s, RenderMode mode);
-  ~Object() = default;
+  ~Object();
   Object(const Object &other);
   Object &operator=(const Object &other);
   Object(Object &&other) noexcept;
   Object &operator=(Object &&other) noexcept;
 
   void init(const std::string &meshPath, const std::string &texturePath = {});
+  /**
+   * @brief Init from already loaded data, pixels (RGBA8) are borrowed and must outlive the object
+   */
+  void init(Mesh::Mesh &&loadedMesh, const unsigned char *pixels = nullptr, int width = 0, int height = 0);
+  /**
+   * @brief Init from a mesh other objects may use too, it's never copied
+   */
+  void init(std::shared_ptr<const Mesh::Mesh> sharedMesh, const std::string &texturePath = {});
+  void init(std::shared_ptr<const Mesh::Mesh> sharedMesh, const unsigned char *pixels, int width, int height);
+  /**
+   * @brief Init with a texture already loaded (see TextureLoader), shared with whoever else holds it
+   */
+  void init(std::shared_ptr<const Mesh::Mesh> sharedMesh, std::shared_ptr<const Util::TextureFile> textureFile);
 
   void setPosition(Math::Vector3 p);
   void setPositionX(f32 x);
@@ -55,9 +82,36 @@ public:
   bool hasTexture();
 
   Math::Matrix4 getModelMatrix();
+  /**
+   * @brief Mesh bounding box transformed into world space, covering the previous and current tick since frames
+   *        are drawn anywhere between them
+   */
+  Math::AABB getWorldBoundingBox();
+
+  /**
+   * @brief Remember the current transform as the start of the next simulation tick
+   */
+  void storePreviousState();
+
+  /**
+   * @brief Model matrix blended between the last two simulation ticks (alpha in [0, 1])
+   */
+  Math::Matrix4 getInterpolatedModelMatrix(f32 alpha);
+
+  /**
+   * @brief Copy what the renderer needs (last two tick transforms) into a frame packet entry
+   */
+  void extract(ObjectState &state);
+
+  /**
+   * @brief scale, move pivot (mesh center) to the origin, rotate, then translate
+   */
+  static Math::Matrix4 composeModelMatrix(const Math::Vector3 &p, Math::Quaternion r, const Math::Vector3 &s,
+                                         const Math::Vector3 &pivot);
 
   const TextureData &getTextureData();
   const Mesh::Mesh &getMesh();
+  const std::shared_ptr<const Mesh::Mesh> &getSharedMesh();
 
   bool operator<(const Object &other);
 
@@ -69,11 +123,18 @@ private:
   Math::Quaternion rotation;
   Math::Vector3 scale;
 
-  Math::Matrix4 getTranslationMatrix(Math::Vector3 t);
+  // transform at the start of the current simulation tick
+  Math::Vector3 previousPosition;
+  Math::Quaternion previousRotation;
+
+  static Math::Matrix4 getTranslationMatrix(Math::Vector3 t);
   Math::Matrix4 getRotationMatrix();
-  Math::Matrix4 getScaleMatrix(Math::Vector3 s);
+  static Math::Matrix4 getScaleMatrix(Math::Vector3 s);
+
+  Math::Vector3 getPivot();
 
-  Mesh::Mesh mesh;
+  // shared between copies of the object (and objects spawned from the same model)
+  std::shared_ptr<const Mesh::Mesh> mesh;
   TextureData texture;
 
   f32 pitch = 0, yaw = 0, roll = 0;
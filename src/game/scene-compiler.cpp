@@ -0,0 +1,48 @@
+/**
+ * @file scene-compiler.cpp
+ *
+ * @brief Bakes a text scene into a binary scene package
+ *
+ * @details usage: scene-compiler <input.scene> <output.pack>
+ */
+
+#include "scene-file.hpp"
+
+#include <chrono>
+#include <exception>
+#include <iostream>
+
+int main(int argc, char **argv) {
+  if (argc != 3) {
+    std::cerr << "usage: " << argv[0] << " <input.scene> <output.pack>" << std::endl;
+    return -1;
+  }
+
+  try {
+    auto start = std::chrono::steady_clock::now();
+
+    Game::SceneDescription description = Game::parseSceneFile(argv[1]);
+    Game::compileScenePackage(description, argv[2]);
+
+    // time a load of the result so text vs package startup can be compared
+    auto compiled = std::chrono::steady_clock::now();
+    Game::Scene scene = Game::loadScene(argv[2]);
+    scene.init();
+    auto loaded = std::chrono::steady_clock::now();
+
+    Game::Scene text = Game::loadScene(argv[1]);
+    text.init();
+    auto textLoaded = std::chrono::steady_clock::now();
+
+    using Ms = std::chrono::duration<double, std::milli>;
+    std::cout << "Compiled " << description.models.size() << " models into " << argv[2] << " in "
+              << Ms(compiled - start).count() << " ms\n";
+    std::cout << "Load from package: " << Ms(loaded - compiled).count() << " ms\n";
+    std::cout << "Load from text scene: " << Ms(textLoaded - loaded).count() << " ms\n";
+  } catch (std::exception &e) {
+    std::cerr << e.what() << std::endl;
+    return -1;
+  }
+
+  return 0;
+}
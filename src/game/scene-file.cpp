@@ -0,0 +1,530 @@
+/**
+ * @file scene-file.cpp
+ */
+
+#include "scene-file.hpp"
+#include "../mesh/mesh.hpp"
+#include "../util/profiler.hpp"
+#include "../util/texture-file.hpp"
+
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <memory>
+#include <sstream>
+#include <unordered_map>
+#include <utility>
+
+namespace Game {
+
+namespace {
+// ====================================================================================================================
+// Package layout
+// ====================================================================================================================
+//
+//  [PackageHeader][PackageModel * modelCount][PackageMesh * meshCount][PackageTexture * textureCount][blobs...]
+//
+// Vertices are stored as 8 floats (position, normal, uv), indices as u32 and textures as RGBA8.
+// Every blob starts on a 16 byte boundary.
+
+const char PACKAGE_MAGIC[4] = {'V', 'E', 'P', 'K'};
+const u32 PACKAGE_VERSION = 1;
+const u32 NO_INDEX = UINT32_MAX;
+const u64 BLOB_ALIGNMENT = 16;
+
+struct PackageHeader {
+  char magic[4];
+  u32 version;
+  u64 fileSize;
+  u32 modelCount;
+  u32 meshCount;
+  u32 textureCount;
+  u32 environmentMap[6];
+  f32 cameraPosition[3];
+  f32 cameraTarget[3];
+  u32 padding;
+};
+
+struct PackageModel {
+  u32 mesh;
+  u32 texture;
+  u32 renderMode;
+  f32 position[3];
+  f32 rotation[3];
+  f32 scale[3];
+};
+
+struct PackageMesh {
+  u64 vertexOffset;
+  u64 vertexCount;
+  u64 indexOffset;
+  u64 indexCount;
+  u32 hasNormals;
+  u32 hasUV;
+};
+
+struct PackageTexture {
+  u64 pixelOffset;
+  u32 width;
+  u32 height;
+};
+
+const size_t FLOATS_PER_VERTEX = 8;
+
+u64 alignUp(u64 value, u64 alignment) { return (value + alignment - 1) & ~(alignment - 1); }
+
+// ====================================================================================================================
+// Text parsing helpers
+// ====================================================================================================================
+[[noreturn]] void parseError(const std::string &filename, size_t line, const std::string &message) {
+  Util::Error(filename + ":" + std::to_string(line) + ": " + message);
+  std::abort(); // unreachable, Util::Error always throws
+}
+
+Math::Vector3 readVector(std::istringstream &in, const std::string &filename, size_t line, bool allowUniform) {
+  f32 x, y, z;
+  if (!(in >> x))
+    parseError(filename, line, "expected a number");
+
+  if (!(in >> y)) {
+    if (!allowUniform)
+      parseError(filename, line, "expected 3 numbers");
+    return {x, x, x};
+  }
+
+  if (!(in >> z))
+    parseError(filename, line, "expected 3 numbers");
+
+  return {x, y, z};
+}
+
+Object::RenderMode readRenderMode(const std::string &mode, const std::string &filename, size_t line) {
+  if (mode == "blinn")
+    return Object::RenderMode::BLINN_SHADING;
+  if (mode == "environment")
+    return Object::RenderMode::ENVIRONMENT_MAP;
+
+  parseError(filename, line, "unknown render mode '" + mode + "'");
+}
+
+void writeVector(f32 out[3], const Math::Vector3 &v) {
+  out[0] = v.x;
+  out[1] = v.y;
+  out[2] = v.z;
+}
+} // namespace
+
+// ====================================================================================================================
+// Text format
+// ====================================================================================================================
+SceneDescription parseSceneFile(const std::string &filename) {
+  std::ifstream file(filename);
+  if (!file.is_open())
+    Util::Error("Failed to open scene file: " + filename);
+
+  SceneDescription description;
+  ModelInfo current;
+  bool inModel = false;
+
+  std::string text;
+  size_t line = 0;
+  while (std::getline(file, text)) {
+    line++;
+
+    size_t comment = text.find('#');
+    if (comment != std::string::npos)
+      text.erase(comment);
+
+    std::istringstream in(text);
+    std::string keyword;
+    if (!(in >> keyword))
+      continue;
+
+    if (keyword == "model") {
+      if (inModel)
+        parseError(filename, line, "missing 'end' before next model");
+
+      current = ModelInfo{};
+      current.position = {0, 0, 0};
+      current.rotation = {0, 0, 0};
+      current.scale = {1, 1, 1};
+      current.renderMode = Object::RenderMode::BLINN_SHADING;
+      if (!(in >> current.meshFilePath))
+        parseError(filename, line, "model needs a mesh path");
+      inModel = true;
+    } else if (keyword == "end") {
+      if (!inModel)
+        parseError(filename, line, "'end' outside of a model");
+      description.models.push_back(current);
+      inModel = false;
+    } else if (inModel && keyword == "texture") {
+      if (!(in >> current.textureFilePath))
+        parseError(filename, line, "texture needs an image path");
+    } else if (inModel && keyword == "position") {
+      current.position = readVector(in, filename, line, false);
+    } else if (inModel && keyword == "rotation") {
+      current.rotation = readVector(in, filename, line, false);
+    } else if (inModel && keyword == "scale") {
+      current.scale = readVector(in, filename, line, true);
+    } else if (inModel && keyword == "mode") {
+      std::string mode;
+      in >> mode;
+      current.renderMode = readRenderMode(mode, filename, line);
+    } else if (!inModel && keyword == "environment") {
+      std::vector<std::string> paths;
+      std::string path;
+      while (in >> path)
+        paths.push_back(path);
+      if (paths.size() == 1 && Util::isTextureFile(paths[0]))
+        description.environmentMap[0] = paths[0];
+      else if (paths.size() == 6)
+        std::copy(paths.begin(), paths.end(), description.environmentMap.begin());
+      else
+        parseError(filename, line,
+                   "environment needs 6 image paths (front back top bottom right left) or a DDS/KTX2 cubemap");
+      description.hasEnvironmentMap = true;
+    } else if (!inModel && keyword == "camera") {
+      description.cameraPosition = readVector(in, filename, line, false);
+      description.cameraTarget = readVector(in, filename, line, false);
+    } else {
+      parseError(filename, line, "unexpected '" + keyword + "'");
+    }
+
+    std::string extra;
+    if (in >> extra)
+      parseError(filename, line, "unexpected '" + extra + "'");
+  }
+
+  if (inModel)
+    parseError(filename, line, "missing 'end' for last model");
+
+  return description;
+}
+
+// ====================================================================================================================
+// Package compiler
+// ====================================================================================================================
+void compileScenePackage(const SceneDescription &description, const std::string &filename) {
+  std::vector<PackageModel> models;
+  std::vector<PackageMesh> meshes;
+  std::vector<PackageTexture> textures;
+  std::vector<std::vector<unsigned char>> blobs;
+
+  std::unordered_map<std::string, u32> meshIndex;
+  std::unordered_map<std::string, u32> textureIndex;
+
+  // blobs are laid out after the tables, the table sizes are only known at the end so offsets are
+  // relative to the start of the blob area for now
+  u64 blobOffset = 0;
+  auto addBlob = [&](std::vector<unsigned char> &&bytes) {
+    u64 at = blobOffset;
+    blobOffset = alignUp(blobOffset + bytes.size(), BLOB_ALIGNMENT);
+    bytes.resize(blobOffset - at, 0);
+    blobs.push_back(std::move(bytes));
+    return at;
+  };
+
+  auto addPixels = [&](std::vector<unsigned char> &&bytes, u32 width, u32 height) -> u32 {
+    PackageTexture texture{};
+    texture.pixelOffset = addBlob(std::move(bytes));
+    texture.width = width;
+    texture.height = height;
+    textures.push_back(texture);
+    return (u32)textures.size() - 1;
+  };
+
+  // packages hold RGBA8, DDS/KTX2 textures are decoded and keep their first level
+  auto addFileFace = [&](const Util::TextureFile &file, u32 face) -> u32 {
+    std::vector<unsigned char> bytes(Util::getImageSize(Util::TextureFormat::RGBA8, file.width, file.height));
+    Util::decompressImage(file.format, file.getLevel(face, 0), file.width, file.height, bytes.data());
+    return addPixels(std::move(bytes), file.width, file.height);
+  };
+
+  auto addTexture = [&](const std::string &path) -> u32 {
+    auto found = textureIndex.find(path);
+    if (found != textureIndex.end())
+      return found->second;
+
+    if (Util::isTextureFile(path))
+      return textureIndex[path] = addFileFace(Util::loadTextureFile(path), 0);
+
+    unsigned char *pixels;
+    int width, height, channels;
+    Util::loadImage(path, pixels, width, height, channels);
+
+    size_t size = (size_t)width * height * 4;
+    std::vector<unsigned char> bytes(pixels, pixels + size);
+    stbi_image_free(pixels);
+
+    return textureIndex[path] = addPixels(std::move(bytes), (u32)width, (u32)height);
+  };
+
+  auto addMesh = [&](const std::string &path) -> u32 {
+    auto found = meshIndex.find(path);
+    if (found != meshIndex.end())
+      return found->second;
+
+    Mesh::Mesh mesh;
+    mesh.init(path);
+
+    const auto &vertices = mesh.getVertexData();
+    std::vector<f32> floats;
+    floats.reserve(vertices.size() * FLOATS_PER_VERTEX);
+    for (const auto &v : vertices) {
+      floats.insert(floats.end(), {v.position.x, v.position.y, v.position.z, //
+                                   v.normal.x, v.normal.y, v.normal.z,       //
+                                   v.uv.x, v.uv.y});
+    }
+
+    std::vector<unsigned char> vertexBytes(floats.size() * sizeof(f32));
+    memcpy(vertexBytes.data(), floats.data(), vertexBytes.size());
+
+    const auto &indices = mesh.getIndices();
+    std::vector<unsigned char> indexBytes(indices.size() * sizeof(u32));
+    memcpy(indexBytes.data(), indices.data(), indexBytes.size());
+
+    PackageMesh packed{};
+    packed.vertexCount = vertices.size();
+    packed.vertexOffset = addBlob(std::move(vertexBytes));
+    packed.indexCount = indices.size();
+    packed.indexOffset = addBlob(std::move(indexBytes));
+    packed.hasNormals = mesh.hasNormals();
+    packed.hasUV = mesh.hasUV();
+    meshes.push_back(packed);
+
+    meshIndex[path] = (u32)meshes.size() - 1;
+    return (u32)meshes.size() - 1;
+  };
+
+  for (const auto &info : description.models) {
+    PackageModel model{};
+    model.mesh = addMesh(info.meshFilePath);
+    model.texture = info.textureFilePath.empty() ? NO_INDEX : addTexture(info.textureFilePath);
+    model.renderMode = (u32)info.renderMode;
+    writeVector(model.position, info.position);
+    writeVector(model.rotation, info.rotation);
+    writeVector(model.scale, info.scale);
+    models.push_back(model);
+  }
+
+  PackageHeader header{};
+  memcpy(header.magic, PACKAGE_MAGIC, sizeof(PACKAGE_MAGIC));
+  header.version = PACKAGE_VERSION;
+  header.modelCount = (u32)models.size();
+  if (description.hasEnvironmentMap && description.environmentMap[1].empty()) {
+    Util::TextureFile cubemap = Util::loadTextureFile(description.environmentMap[0]);
+    if (cubemap.faces != 6)
+      Util::Error("Environment map isn't a cubemap: " + description.environmentMap[0]);
+    for (u32 i = 0; i < 6; i++)
+      header.environmentMap[i] = addFileFace(cubemap, i);
+  } else {
+    for (size_t i = 0; i < 6; i++)
+      header.environmentMap[i] = description.hasEnvironmentMap ? addTexture(description.environmentMap[i]) : NO_INDEX;
+  }
+  writeVector(header.cameraPosition, description.cameraPosition);
+  writeVector(header.cameraTarget, description.cameraTarget);
+  header.meshCount = (u32)meshes.size();
+  header.textureCount = (u32)textures.size();
+
+  const u64 offset = alignUp(sizeof(PackageHeader) + models.size() * sizeof(PackageModel) +
+                                 meshes.size() * sizeof(PackageMesh) + textures.size() * sizeof(PackageTexture),
+                             BLOB_ALIGNMENT);
+
+  // make blob offsets absolute
+  for (auto &mesh : meshes) {
+    mesh.vertexOffset += offset;
+    mesh.indexOffset += offset;
+  }
+  for (auto &texture : textures)
+    texture.pixelOffset += offset;
+
+  header.fileSize = offset + blobOffset;
+
+  std::ofstream out(filename, std::ios::binary | std::ios::trunc);
+  if (!out.is_open())
+    Util::Error("Failed to open package for writing: " + filename);
+
+  out.write(reinterpret_cast<const char *>(&header), sizeof(header));
+  out.write(reinterpret_cast<const char *>(models.data()), models.size() * sizeof(PackageModel));
+  out.write(reinterpret_cast<const char *>(meshes.data()), meshes.size() * sizeof(PackageMesh));
+  out.write(reinterpret_cast<const char *>(textures.data()), textures.size() * sizeof(PackageTexture));
+
+  u64 written = sizeof(header) + models.size() * sizeof(PackageModel) + meshes.size() * sizeof(PackageMesh) +
+                textures.size() * sizeof(PackageTexture);
+  std::vector<char> padding(offset - written, 0);
+  out.write(padding.data(), padding.size());
+
+  for (const auto &blob : blobs)
+    out.write(reinterpret_cast<const char *>(blob.data()), blob.size());
+
+  if (!out)
+    Util::Error("Failed to write package: " + filename);
+}
+
+// ====================================================================================================================
+// Package loading
+// ====================================================================================================================
+ScenePackage::ScenePackage(const std::string &filename) : file(filename) {
+  if (file.size() < sizeof(PackageHeader))
+    Util::Error("Scene package is too small: " + filename);
+
+  const auto *header = reinterpret_cast<const PackageHeader *>(file.data());
+  if (memcmp(header->magic, PACKAGE_MAGIC, sizeof(PACKAGE_MAGIC)) != 0)
+    Util::Error("Not a scene package: " + filename);
+  if (header->version != PACKAGE_VERSION)
+    Util::Error("Unsupported scene package version " + std::to_string(header->version) + ": " + filename);
+  if (header->fileSize != file.size())
+    Util::Error("Scene package is truncated: " + filename);
+
+  // validate every table and blob up front so the accessors can trust the data
+  u64 tables = sizeof(PackageHeader) + (u64)header->modelCount * sizeof(PackageModel) +
+               (u64)header->meshCount * sizeof(PackageMesh) + (u64)header->textureCount * sizeof(PackageTexture);
+  at(0, tables);
+
+  const auto *models = reinterpret_cast<const PackageModel *>(file.data() + sizeof(PackageHeader));
+  const auto *meshes = reinterpret_cast<const PackageMesh *>(models + header->modelCount);
+  const auto *textures = reinterpret_cast<const PackageTexture *>(meshes + header->meshCount);
+
+  for (u32 i = 0; i < header->modelCount; i++) {
+    if (models[i].mesh >= header->meshCount ||
+        (models[i].texture != NO_INDEX && models[i].texture >= header->textureCount))
+      Util::Error("Scene package has a bad model record: " + filename);
+  }
+  for (u32 i = 0; i < header->meshCount; i++) {
+    at(meshes[i].vertexOffset, meshes[i].vertexCount * FLOATS_PER_VERTEX * sizeof(f32));
+    at(meshes[i].indexOffset, meshes[i].indexCount * sizeof(u32));
+  }
+  for (u32 i = 0; i < header->textureCount; i++)
+    at(textures[i].pixelOffset, (u64)textures[i].width * textures[i].height * 4);
+  for (u32 face : header->environmentMap)
+    if (face != NO_INDEX && face >= header->textureCount)
+      Util::Error("Scene package has a bad environment map: " + filename);
+}
+
+const unsigned char *ScenePackage::at(u64 offset, u64 size) const {
+  if (offset > file.size() || size > file.size() - offset)
+    Util::Error("Scene package is corrupt (out of range data)");
+  return file.data() + offset;
+}
+
+size_t ScenePackage::getModelCount() const {
+  return reinterpret_cast<const PackageHeader *>(file.data())->modelCount;
+}
+
+bool ScenePackage::modelHasTexture(size_t model) const {
+  const auto *models = reinterpret_cast<const PackageModel *>(file.data() + sizeof(PackageHeader));
+  return models[model].texture != NO_INDEX;
+}
+
+Object ScenePackage::createObject(size_t model) const {
+  const auto *header = reinterpret_cast<const PackageHeader *>(file.data());
+  const auto *models = reinterpret_cast<const PackageModel *>(file.data() + sizeof(PackageHeader));
+  const auto *meshes = reinterpret_cast<const PackageMesh *>(models + header->modelCount);
+  const auto *textures = reinterpret_cast<const PackageTexture *>(meshes + header->meshCount);
+
+  const PackageModel &info = models[model];
+  const PackageMesh &packed = meshes[info.mesh];
+
+  Math::Quaternion q = {0, {0, 0, 0}};
+  q.rotate({info.rotation[0], info.rotation[1], info.rotation[2]});
+  Object obj({info.position[0], info.position[1], info.position[2]}, q,
+             {info.scale[0], info.scale[1], info.scale[2]}, (Object::RenderMode)info.renderMode);
+
+  if (decodedMeshes.size() < header->meshCount)
+    decodedMeshes.resize(header->meshCount);
+
+  std::shared_ptr<const Mesh::Mesh> &shared = decodedMeshes[info.mesh];
+  if (!shared) {
+    const f32 *floats = reinterpret_cast<const f32 *>(file.data() + packed.vertexOffset);
+    std::vector<Mesh::Vertex> vertices(packed.vertexCount);
+    for (size_t i = 0; i < vertices.size(); i++) {
+      const f32 *v = floats + i * FLOATS_PER_VERTEX;
+      vertices[i].position = {v[0], v[1], v[2]};
+      vertices[i].normal = {v[3], v[4], v[5]};
+      vertices[i].uv = {v[6], v[7]};
+    }
+
+    const u32 *firstIndex = reinterpret_cast<const u32 *>(file.data() + packed.indexOffset);
+    std::vector<u32> indices(firstIndex, firstIndex + packed.indexCount);
+
+    auto mesh = std::make_shared<Mesh::Mesh>();
+    mesh->init(std::move(vertices), std::move(indices), packed.hasNormals != 0, packed.hasUV != 0);
+    shared = std::move(mesh);
+  }
+
+  if (info.texture == NO_INDEX) {
+    obj.init(shared);
+  } else {
+    const PackageTexture &texture = textures[info.texture];
+    obj.init(shared, file.data() + texture.pixelOffset, (int)texture.width, (int)texture.height);
+  }
+
+  return obj;
+}
+
+bool ScenePackage::hasEnvironmentMap() const {
+  const auto *header = reinterpret_cast<const PackageHeader *>(file.data());
+  return header->environmentMap[0] != NO_INDEX;
+}
+
+bool ScenePackage::getEnvironmentMap(const unsigned char *data[6], int &width, int &height) const {
+  const auto *header = reinterpret_cast<const PackageHeader *>(file.data());
+  if (header->environmentMap[0] == NO_INDEX)
+    return false;
+
+  const auto *models = reinterpret_cast<const PackageModel *>(file.data() + sizeof(PackageHeader));
+  const auto *meshes = reinterpret_cast<const PackageMesh *>(models + header->modelCount);
+  const auto *textures = reinterpret_cast<const PackageTexture *>(meshes + header->meshCount);
+
+  for (size_t i = 0; i < 6; i++) {
+    const PackageTexture &face = textures[header->environmentMap[i]];
+    if (i > 0 && ((int)face.width != width || (int)face.height != height))
+      Util::Error("Cubemap faces have different sizes");
+    data[i] = file.data() + face.pixelOffset;
+    width = (int)face.width;
+    height = (int)face.height;
+  }
+  return true;
+}
+
+Math::Vector3 ScenePackage::getCameraPosition() const {
+  const auto *header = reinterpret_cast<const PackageHeader *>(file.data());
+  return {header->cameraPosition[0], header->cameraPosition[1], header->cameraPosition[2]};
+}
+
+Math::Vector3 ScenePackage::getCameraTarget() const {
+  const auto *header = reinterpret_cast<const PackageHeader *>(file.data());
+  return {header->cameraTarget[0], header->cameraTarget[1], header->cameraTarget[2]};
+}
+
+// ====================================================================================================================
+// Loading
+// ====================================================================================================================
+Scene loadScene(const std::string &filename) {
+  PROFILE_FUNCTION();
+  const std::string extension = ".pack";
+  bool isPackage = filename.size() >= extension.size() &&
+                   filename.compare(filename.size() - extension.size(), extension.size(), extension) == 0;
+
+  if (isPackage) {
+    auto package = std::make_shared<const ScenePackage>(filename);
+    Scene scene(package);
+    scene.camera.position = package->getCameraPosition();
+    scene.camera.setTarget(package->getCameraTarget());
+    scene.camera.update();
+    scene.camera.storePreviousState();
+    return scene;
+  }
+
+  SceneDescription description = parseSceneFile(filename);
+  Scene scene = description.hasEnvironmentMap ? Scene(description.models, description.environmentMap)
+                                              : Scene(description.models);
+  scene.camera.position = description.cameraPosition;
+  scene.camera.setTarget(description.cameraTarget);
+  scene.camera.update();
+  scene.camera.storePreviousState();
+  return scene;
+}
+
+} // namespace Game
@@ -0,0 +1,108 @@
+/**
+ * @file scene-file.hpp
+ *
+ * @brief header file for the scene description format
+ *
+ * @details Scenes are written in a small line based text format:
+ *
+ *            # comment
+ *            environment <front> <back> <top> <bottom> <right> <left> | <cubemap.dds/ktx2>
+ *            camera <position x y z> <target x y z>
+ *            model <mesh path>
+ *              texture <image path>
+ *              position <x y z>
+ *              rotation <x y z>          (degrees)
+ *              scale <x y z> | <s>
+ *              mode blinn | environment
+ *            end
+ *
+ *          Everything but "model ... end" is optional, a scene without an
+ *          environment has no sky box. Paths are relative to the working
+ *          directory, like every other asset path in the engine.
+ *          Textures and the environment map can be DDS/KTX2 files made with
+ *          texture-compressor, packages store those decoded to RGBA8.
+ *
+ *          A text scene can be compiled (see scene-compiler) into a binary
+ *          package holding the decoded meshes and textures. A package is
+ *          loaded with a single memory mapping, so large levels skip OBJ
+ *          parsing and PNG decoding at startup.
+ */
+
+#pragma once
+
+#include "../math/vector.hpp"
+#include "../util/util.hpp"
+#include "scene.hpp"
+
+#include <array>
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace Game {
+
+/**
+ * @brief Everything a scene file describes
+ */
+struct SceneDescription {
+  std::vector<ModelInfo> models;
+  // six face images, or a cubemap texture file in the first with the rest empty
+  std::array<std::string, 6> environmentMap;
+  bool hasEnvironmentMap = false;
+  Math::Vector3 cameraPosition{0, 0, 10};
+  Math::Vector3 cameraTarget{0, 0, 0};
+};
+
+/**
+ * @brief Parse a text scene file
+ */
+SceneDescription parseSceneFile(const std::string &filename);
+
+/**
+ * @brief Bake a scene description and the meshes/textures it references into a package
+ */
+void compileScenePackage(const SceneDescription &description, const std::string &filename);
+
+/**
+ * @brief Load a scene from a text scene (.scene) or a compiled package (.pack)
+ */
+Scene loadScene(const std::string &filename);
+
+/**
+ * @brief A compiled scene, memory mapped
+ */
+class ScenePackage {
+public:
+  explicit ScenePackage(const std::string &filename);
+  ~ScenePackage() = default;
+  ScenePackage(const ScenePackage &other) = delete;
+  ScenePackage &operator=(const ScenePackage &other) = delete;
+
+  size_t getModelCount() const;
+
+  /**
+   * @brief Build the object for a model, mesh data is copied out of the mapping (once per mesh, models using
+   *        the same mesh share it) and texture pixels are borrowed
+   */
+  Object createObject(size_t model) const;
+
+  bool modelHasTexture(size_t model) const;
+
+  bool hasEnvironmentMap() const;
+  /**
+   * @brief Borrow the six environment map faces, returns false if the package has none
+   */
+  bool getEnvironmentMap(const unsigned char *data[6], int &width, int &height) const;
+
+  Math::Vector3 getCameraPosition() const;
+  Math::Vector3 getCameraTarget() const;
+
+private:
+  const unsigned char *at(u64 offset, u64 size) const;
+
+  Util::MappedFile file;
+  // decoded meshes by package mesh index, filled as models ask for them
+  mutable std::vector<std::shared_ptr<const Mesh::Mesh>> decodedMeshes;
+};
+
+} // namespace Game
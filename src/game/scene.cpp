@@ -3,32 +3,60 @@
  */
 
 #include "scene.hpp"
+#include "../util/profiler.hpp"
+#include "../util/util.hpp"
+#include "scene-file.hpp"
+#include "texture-loader.hpp"
 
 #include <algorithm>
+#include <utility>
 #include <vector>
 
 namespace Game {
 
+namespace {
+// room for runtime spawns when no capacity was asked for
+const size_t DEFAULT_SPARE_OBJECTS = 1024;
+} // namespace
+
 Scene::~Scene() { objects.clear(); }
 
 Scene::Scene(const std::vector<ModelInfo> &models, std::array<std::string, 6> environmentMapImagePaths)
     : models(models) {
   camera = Camera();
-  if (!environmentMapImagePaths.empty()) {
+  // the environment line is optional, without it there's no sky box
+  if (!environmentMapImagePaths[0].empty()) {
     hasEnvironmentMap = true;
     envMapImagePaths = environmentMapImagePaths;
   }
 }
 
+Scene::Scene(std::shared_ptr<const ScenePackage> package) : package(std::move(package)) {
+  camera = Camera();
+  hasEnvironmentMap = this->package->hasEnvironmentMap();
+}
+
 Scene::Scene(const Scene &other)
-    : models(other.models), textureCount(other.textureCount), hasEnvironmentMap(other.hasEnvironmentMap),
-      envMapImagePaths(other.envMapImagePaths), objects(other.objects), camera(other.camera) {}
+    : models(other.models), package(other.package), textureCount(other.textureCount),
+      hasEnvironmentMap(other.hasEnvironmentMap), capacity(other.capacity), slotToObject(other.slotToObject),
+      slotGeneration(other.slotGeneration), freeSlots(other.freeSlots), objectToSlot(other.objectToSlot),
+      projection(other.projection), hasProjection(other.hasProjection), meshCache(other.meshCache),
+      envMapImagePaths(other.envMapImagePaths), objects(other.objects), camera(other.camera), spatial(other.spatial) {}
 
 Scene::Scene(Scene &&other) noexcept
-    : models(other.models), textureCount(other.textureCount), hasEnvironmentMap(other.hasEnvironmentMap),
-      envMapImagePaths(other.envMapImagePaths), objects(other.objects), camera(other.camera) {
+    : models(std::move(other.models)), package(std::move(other.package)), textureCount(other.textureCount),
+      hasEnvironmentMap(other.hasEnvironmentMap), capacity(other.capacity),
+      slotToObject(std::move(other.slotToObject)), slotGeneration(std::move(other.slotGeneration)),
+      freeSlots(std::move(other.freeSlots)), objectToSlot(std::move(other.objectToSlot)),
+      projection(other.projection), hasProjection(other.hasProjection), meshCache(std::move(other.meshCache)),
+      envMapImagePaths(std::move(other.envMapImagePaths)), objects(std::move(other.objects)), camera(other.camera),
+      spatial(std::move(other.spatial)) {
   other.models.clear();
   other.objects.clear();
+  other.slotToObject.clear();
+  other.slotGeneration.clear();
+  other.freeSlots.clear();
+  other.objectToSlot.clear();
 }
 
 Scene &Scene::operator=(const Scene &other) {
@@ -36,9 +64,19 @@ Scene &Scene::operator=(const Scene &other) {
     return *this;
 
   this->models = other.models;
+  this->package = other.package;
   this->textureCount = other.textureCount;
+  this->capacity = other.capacity;
+  this->slotToObject = other.slotToObject;
+  this->slotGeneration = other.slotGeneration;
+  this->freeSlots = other.freeSlots;
+  this->objectToSlot = other.objectToSlot;
+  this->projection = other.projection;
+  this->hasProjection = other.hasProjection;
+  this->meshCache = other.meshCache;
   this->objects = other.objects;
   this->camera = other.camera;
+  this->spatial = other.spatial;
   this->hasEnvironmentMap = other.hasEnvironmentMap;
   this->envMapImagePaths = other.envMapImagePaths;
 
@@ -49,15 +87,29 @@ Scene &Scene::operator=(Scene &&other) noexcept {
   if (this == &other)
     return *this;
 
-  this->models = other.models;
+  this->models = std::move(other.models);
+  this->package = std::move(other.package);
   this->textureCount = other.textureCount;
-  this->objects = other.objects;
+  this->capacity = other.capacity;
+  this->slotToObject = std::move(other.slotToObject);
+  this->slotGeneration = std::move(other.slotGeneration);
+  this->freeSlots = std::move(other.freeSlots);
+  this->objectToSlot = std::move(other.objectToSlot);
+  this->projection = other.projection;
+  this->hasProjection = other.hasProjection;
+  this->meshCache = std::move(other.meshCache);
+  this->objects = std::move(other.objects);
   this->camera = other.camera;
+  this->spatial = std::move(other.spatial);
   this->hasEnvironmentMap = other.hasEnvironmentMap;
-  this->envMapImagePaths = other.envMapImagePaths;
+  this->envMapImagePaths = std::move(other.envMapImagePaths);
 
   other.models.clear();
   other.objects.clear();
+  other.slotToObject.clear();
+  other.slotGeneration.clear();
+  other.freeSlots.clear();
+  other.objectToSlot.clear();
 
   return *this;
 }
@@ -66,20 +118,205 @@ const Object &Scene::operator[](int32_t index) { return objects[index]; }
 
 size_t Scene::getTextureCount() { return textureCount; }
 
+void Scene::setCapacity(size_t maxObjects) { capacity = maxObjects; }
+
+size_t Scene::getCapacity() const { return capacity; }
+
 void Scene::init() {
-  for (const auto &modelInfo : models) {
-    Math::Quaternion q = {0, {0, 0, 0}};
-    q.rotate(modelInfo.rotation);
-    Object obj(modelInfo.position, q, modelInfo.scale, modelInfo.renderMode);
-    obj.init(modelInfo.meshFilePath, modelInfo.textureFilePath);
-    objects.push_back(obj);
-
-    if (!modelInfo.textureFilePath.empty())
-      textureCount++;
+  PROFILE_FUNCTION();
+  size_t initialCount = package ? package->getModelCount() : models.size();
+  capacity = std::max(capacity == 0 ? initialCount + DEFAULT_SPARE_OBJECTS : capacity, initialCount);
+
+  // the whole pool up front, spawning never reallocates (or moves) objects
+  objects.reserve(capacity);
+
+  if (package) {
+    for (size_t i = 0; i < package->getModelCount(); i++) {
+      objects.push_back(package->createObject(i));
+
+      if (package->modelHasTexture(i))
+        textureCount++;
+    }
+  } else {
+    // every texture is decoded up front in one parallel batch, objects naming the same file share it
+    std::vector<std::string> texturePaths;
+    for (const auto &modelInfo : models)
+      if (!modelInfo.textureFilePath.empty())
+        texturePaths.push_back(modelInfo.textureFilePath);
+    std::vector<std::shared_ptr<const Util::TextureFile>> textures = TextureLoader::global().load(texturePaths);
+
+    // construct in place, meshes are loaded once per path and shared
+    size_t nextTexture = 0;
+    for (const auto &modelInfo : models) {
+      Math::Quaternion q = {0, {0, 0, 0}};
+      q.rotate(modelInfo.rotation);
+      Object &obj = objects.emplace_back(modelInfo.position, q, modelInfo.scale, modelInfo.renderMode);
+      obj.init(loadMesh(modelInfo.meshFilePath),
+               modelInfo.textureFilePath.empty() ? nullptr : textures[nextTexture++]);
+
+      if (!modelInfo.textureFilePath.empty())
+        textureCount++;
+    }
   }
 
   // sort by render mode
   std::sort(objects.begin(), objects.end());
+
+  // handles are handed out after sorting so they point at the right place
+  for (size_t i = 0; i < objects.size(); i++)
+    addToPool((u32)i);
+
+  updateSpatialIndex(Threads::ThreadPool::global());
+}
+
+std::shared_ptr<const Mesh::Mesh> Scene::loadMesh(const std::string &path) {
+  auto &mesh = meshCache[path];
+  if (!mesh) {
+    auto loaded = std::make_shared<Mesh::Mesh>();
+    loaded->init(path);
+    mesh = std::move(loaded);
+  }
+  return mesh;
+}
+
+ObjectHandle Scene::addToPool(u32 index) {
+  u32 slot;
+  if (!freeSlots.empty()) {
+    slot = freeSlots.back();
+    freeSlots.pop_back();
+  } else {
+    slot = (u32)slotToObject.size();
+    slotToObject.push_back(0);
+    slotGeneration.push_back(0);
+  }
+
+  slotToObject[slot] = index;
+  objectToSlot.push_back(slot);
+  return {slot, slotGeneration[slot]};
+}
+
+ObjectHandle Scene::spawn(const ModelInfo &model) {
+  if (objects.size() >= capacity)
+    return {};
+
+  Math::Quaternion q = {0, {0, 0, 0}};
+  q.rotate(model.rotation);
+  Object &obj = objects.emplace_back(model.position, q, model.scale, model.renderMode);
+  obj.init(loadMesh(model.meshFilePath));
+
+  u32 index = (u32)objects.size() - 1;
+  spatial.insert(index, obj.getWorldBoundingBox());
+  return addToPool(index);
+}
+
+ObjectHandle Scene::spawn(const Object &prototype) {
+  if (objects.size() >= capacity)
+    return {};
+
+  // capacity is reserved, so the prototype can't move even if it lives in objects
+  Object &obj = objects.emplace_back(prototype);
+
+  u32 index = (u32)objects.size() - 1;
+  spatial.insert(index, obj.getWorldBoundingBox());
+  return addToPool(index);
+}
+
+void Scene::despawn(ObjectHandle handle) {
+  if (!isAlive(handle))
+    return;
+
+  u32 index = slotToObject[handle.slot];
+  u32 last = (u32)objects.size() - 1;
+
+  // swap and pop, the last object takes the freed index
+  spatial.remove(last);
+  if (index != last) {
+    objects[index] = std::move(objects[last]);
+    objectToSlot[index] = objectToSlot[last];
+    slotToObject[objectToSlot[index]] = index;
+    spatial.update(index, objects[index].getWorldBoundingBox());
+  }
+  objects.pop_back();
+  objectToSlot.pop_back();
+
+  slotGeneration[handle.slot]++;
+  freeSlots.push_back(handle.slot);
+}
+
+bool Scene::isAlive(ObjectHandle handle) const {
+  return handle.slot < slotGeneration.size() && slotGeneration[handle.slot] == handle.generation &&
+         slotToObject[handle.slot] < objectToSlot.size() && objectToSlot[slotToObject[handle.slot]] == handle.slot;
+}
+
+Object *Scene::get(ObjectHandle handle) { return isAlive(handle) ? &objects[slotToObject[handle.slot]] : nullptr; }
+
+ObjectHandle Scene::getHandle(size_t index) const {
+  if (index >= objectToSlot.size())
+    return {};
+
+  u32 slot = objectToSlot[index];
+  return {slot, slotGeneration[slot]};
+}
+
+void Scene::updateSpatialIndex(Threads::ThreadPool &pool) {
+  std::vector<Math::AABB> bounds(objects.size());
+  pool.parallelFor(objects.size(), 256, [&](size_t begin, size_t end) {
+    for (size_t i = begin; i < end; i++)
+      bounds[i] = objects[i].getWorldBoundingBox();
+  });
+
+  spatial.refit(bounds, pool);
+}
+
+void Scene::setProjection(const Math::Matrix4 &projection) {
+  this->projection = projection;
+  hasProjection = true;
+}
+
+void Scene::extract(FramePacket &packet, u64 tick) {
+  packet.tick = tick;
+  packet.camera = camera;
+
+  packet.objects.resize(objects.size());
+  for (size_t i = 0; i < objects.size(); i++)
+    objects[i].extract(packet.objects[i]);
+
+  packet.visible.clear();
+  if (!hasProjection) {
+    for (u32 i = 0; i < (u32)objects.size(); i++)
+      packet.visible.push_back(i);
+    return;
+  }
+
+  // the renderer blends the camera between the two ticks, candidates are what any view on the way can see and
+  // the renderer tests them exactly
+  Math::Frustum from = Math::Frustum::fromMatrix(projection * camera.getInterpolatedViewMatrix(0.0f));
+  Math::Frustum to = Math::Frustum::fromMatrix(projection * camera.getInterpolatedViewMatrix(1.0f));
+  spatial.queryFrustum(from, to, packet.visible);
+  std::sort(packet.visible.begin(), packet.visible.end());
+}
+
+void Scene::loadEnvironmentMap(const unsigned char *data[6], int &width, int &height) {
+  if (!package)
+    Util::Error("Only scene packages have their environment map faces as pixels, use loadEnvironmentTexture");
+  if (!package->getEnvironmentMap(data, width, height))
+    Util::Error("Scene package has no environment map");
+}
+
+bool Scene::hasEnvironment() const { return hasEnvironmentMap; }
+
+std::shared_ptr<const Util::TextureFile> Scene::loadEnvironmentTexture() {
+  if (package || !hasEnvironmentMap)
+    return nullptr;
+
+  TextureLoader &loader = TextureLoader::global();
+  if (!envMapImagePaths[1].empty())
+    return loader.loadCubemap(envMapImagePaths);
+
+  std::shared_ptr<const Util::TextureFile> cubemap = loader.load(envMapImagePaths[0]);
+  if (cubemap->faces != 6)
+    Util::Error("Environment map isn't a cubemap: " + envMapImagePaths[0]);
+  return cubemap;
 }
 
 } // namespace Game
@@ -13,9 +13,16 @@
 
 #include "../game/camera.hpp"
 #include "../math/vector.hpp"
+#include "../threads/threads.hpp"
+#include "../util/texture-file.hpp"
+#include "frame-packet.hpp"
 #include "object.hpp"
+#include "spatial.hpp"
 
 #include <array>
+#include <memory>
+#include <string>
+#include <unordered_map>
 #include <vector>
 
 namespace Game {
@@ -29,27 +36,133 @@ struct ModelInfo {
   Object::RenderMode renderMode;
 };
 
+/**
+ * @brief Names a spawned object, stays valid until that object is despawned
+ *
+ * @details The slot never moves while the object is alive, the generation
+ *          tells a stale handle apart from a newer object reusing the slot.
+ */
+struct ObjectHandle {
+  static const u32 INVALID = UINT32_MAX;
+
+  u32 slot = INVALID;
+  u32 generation = 0;
+
+  bool valid() const { return slot != INVALID; }
+};
+
+class ScenePackage;
+
 class Scene {
 private:
   std::vector<ModelInfo> models;
+  std::shared_ptr<const ScenePackage> package;
   size_t textureCount = 0;
   bool hasEnvironmentMap = false;
 
+  // object pool: objects stay densely packed, handles go through the slot tables
+  size_t capacity = 0;
+  std::vector<u32> slotToObject;
+  std::vector<u32> slotGeneration;
+  std::vector<u32> freeSlots;
+  std::vector<u32> objectToSlot;
+
+  // frames are culled against it once the renderer set it
+  Math::Matrix4 projection;
+  bool hasProjection = false;
+
+  // meshes by file path so every spawn of a model shares one copy
+  std::unordered_map<std::string, std::shared_ptr<const Mesh::Mesh>> meshCache;
+
+  std::shared_ptr<const Mesh::Mesh> loadMesh(const std::string &path);
+  ObjectHandle addToPool(u32 index);
+
 public:
   Scene() = default;
   ~Scene();
   Scene(const std::vector<ModelInfo> &models, std::array<std::string, 6> environmentMapImagePaths = {});
+  explicit Scene(std::shared_ptr<const ScenePackage> package);
   Scene(const Scene &other);
   Scene(Scene &&other) noexcept;
   Scene &operator=(const Scene &other);
   Scene &operator=(Scene &&other) noexcept;
   const Object &operator[](int32_t index);
 
+  /**
+   * @brief Most objects alive at once, the renderer sizes its buffers for this. Set before init, 0 picks a
+   *        default with room to spare over the initial objects
+   */
+  void setCapacity(size_t maxObjects);
+  size_t getCapacity() const;
+
   void init();
   size_t getTextureCount();
 
+  /**
+   * @brief Add an object at runtime, returns an invalid handle when the scene is at capacity
+   *
+   * @details Meshes are loaded once per path and shared, textures aren't
+   *          supported on spawned objects. The new object is drawn from the
+   *          next extracted frame packet on.
+   */
+  ObjectHandle spawn(const ModelInfo &model);
+  /**
+   * @brief Add a copy of an existing object, sharing its mesh
+   */
+  ObjectHandle spawn(const Object &prototype);
+  /**
+   * @brief Remove a spawned (or initial) object, stale handles are ignored
+   *
+   * @details The last object is moved into the freed place, so object
+   *          indices change but handles don't.
+   */
+  void despawn(ObjectHandle handle);
+  bool isAlive(ObjectHandle handle) const;
+  /**
+   * @brief The object behind a handle, nullptr if it's been despawned
+   */
+  Object *get(ObjectHandle handle);
+  /**
+   * @brief Handle of the object currently at an index into objects
+   */
+  ObjectHandle getHandle(size_t index) const;
+
+  /**
+   * @brief The scene has an environment map, the load functions below fail without one
+   */
+  bool hasEnvironment() const;
+  /**
+   * @brief Borrow a scene package's six cube map faces (RGBA8) from its mapping, other scenes load theirs with
+   *        loadEnvironmentTexture
+   */
+  void loadEnvironmentMap(const unsigned char *data[6], int &width, int &height);
+  /**
+   * @brief The environment map as one cubemap (a DDS/KTX2 file, or six images through the TextureLoader), nullptr
+   *        for a scene package (use loadEnvironmentMap then, its faces are read from the mapping)
+   */
+  std::shared_ptr<const Util::TextureFile> loadEnvironmentTexture();
+
+  /**
+   * @brief Refit the spatial index to the current object transforms, world bounds are computed in parallel
+   */
+  void updateSpatialIndex(Threads::ThreadPool &pool);
+
+  /**
+   * @brief Projection the renderer draws with, extract only lists objects the spatial index finds in its view
+   *        frustum once it's set
+   */
+  void setProjection(const Math::Matrix4 &projection);
+
+  /**
+   * @brief Snapshot the render relevant state into a frame packet
+   */
+  void extract(FramePacket &packet, u64 tick);
+
   std::array<std::string, 6> envMapImagePaths;
+  // densely packed, despawning reorders it
   std::vector<Object> objects;
   Camera camera;
+  // ids are indices into objects
+  SpatialGrid spatial;
 };
 } // namespace Game
@@ -0,0 +1,395 @@
+/**
+ * @file spatial.cpp
+ */
+
+#include "spatial.hpp"
+#include "../util/util.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <string>
+#include <utility>
+
+namespace Game {
+
+namespace {
+// keys pack three signed 21 bit cell coordinates, the all ones key never comes out of that
+const u64 OVERSIZED_KEY = UINT64_MAX;
+const u64 COORD_MASK = (1ull << 21) - 1;
+// cells past this many from the origin would wrap around and share keys, their items go to the oversized list
+const i32 COORD_LIMIT = 1 << 20;
+
+// items with a half extent past this many cells skip the grid
+const f32 OVERSIZED_CELLS = 1.0f;
+
+const size_t GRAIN = 1024;
+
+u64 packKey(i32 x, i32 y, i32 z) {
+  return (((u64)x & COORD_MASK) << 42) | (((u64)y & COORD_MASK) << 21) | ((u64)z & COORD_MASK);
+}
+
+// floor(v / cellSize), out of range (and NaN) coordinates come back as COORD_LIMIT
+i32 cellCoord(f32 v, f32 cellSize) {
+  f32 c = std::floor(v / cellSize);
+  return c >= -(f32)COORD_LIMIT && c < (f32)COORD_LIMIT ? (i32)c : COORD_LIMIT;
+}
+} // namespace
+
+SpatialGrid::SpatialGrid(f32 cellSize) : cellSize(cellSize) {
+  if (cellSize <= 0)
+    Util::Error("SpatialGrid: cell size must be positive");
+}
+
+void SpatialGrid::clear() {
+  entries.clear();
+  cells.clear();
+  cellLookup.clear();
+  oversized.clear();
+  maxLoose = 0;
+  count = 0;
+}
+
+// ====================================================================================================================
+// Items
+// ====================================================================================================================
+bool SpatialGrid::isOversized(const Math::AABB &bounds) const {
+  Math::Vector3 e = bounds.extents();
+  return std::max(e.x, std::max(e.y, e.z)) > cellSize * OVERSIZED_CELLS;
+}
+
+u64 SpatialGrid::keyFor(const Math::AABB &bounds) const {
+  if (isOversized(bounds))
+    return OVERSIZED_KEY;
+
+  Math::Vector3 c = bounds.center();
+  i32 x = cellCoord(c.x, cellSize), y = cellCoord(c.y, cellSize), z = cellCoord(c.z, cellSize);
+  if (x == COORD_LIMIT || y == COORD_LIMIT || z == COORD_LIMIT)
+    return OVERSIZED_KEY;
+  return packKey(x, y, z);
+}
+
+f32 SpatialGrid::reach(const Cell &cell, const Math::AABB &bounds) const {
+  f32 minX = cell.x * cellSize, minY = cell.y * cellSize, minZ = cell.z * cellSize;
+  return std::max({minX - bounds.min.x, minY - bounds.min.y, minZ - bounds.min.z, //
+                   bounds.max.x - (minX + cellSize), bounds.max.y - (minY + cellSize),
+                   bounds.max.z - (minZ + cellSize), 0.0f});
+}
+
+void SpatialGrid::grow(Cell &cell, const Math::AABB &bounds) {
+  cell.loose = std::max(cell.loose, reach(cell, bounds));
+  maxLoose = std::max(maxLoose, cell.loose);
+}
+
+void SpatialGrid::shrink(Cell &cell) const {
+  cell.loose = 0;
+  for (u32 id : cell.items)
+    cell.loose = std::max(cell.loose, reach(cell, entries[id].bounds));
+}
+
+void SpatialGrid::updateMaxLoose() {
+  maxLoose = 0;
+  for (const Cell &cell : cells)
+    maxLoose = std::max(maxLoose, cell.loose);
+}
+
+void SpatialGrid::link(u32 id) {
+  Entry &entry = entries[id];
+
+  if (entry.key == OVERSIZED_KEY) {
+    entry.cell = OVERSIZED;
+    entry.slot = (u32)oversized.size();
+    oversized.push_back(id);
+    return;
+  }
+
+  auto found = cellLookup.find(entry.key);
+  if (found == cellLookup.end()) {
+    Math::Vector3 c = entry.bounds.center();
+    Cell cell;
+    cell.key = entry.key;
+    cell.x = cellCoord(c.x, cellSize);
+    cell.y = cellCoord(c.y, cellSize);
+    cell.z = cellCoord(c.z, cellSize);
+    cells.push_back(std::move(cell));
+    found = cellLookup.emplace(entry.key, (u32)cells.size() - 1).first;
+  }
+
+  Cell &cell = cells[found->second];
+  entry.cell = found->second;
+  entry.slot = (u32)cell.items.size();
+  cell.items.push_back(id);
+  grow(cell, entry.bounds);
+}
+
+void SpatialGrid::unlink(u32 id) {
+  Entry &entry = entries[id];
+  std::vector<u32> &items = entry.cell == OVERSIZED ? oversized : cells[entry.cell].items;
+
+  // swap and pop
+  u32 last = items.back();
+  items[entry.slot] = last;
+  entries[last].slot = entry.slot;
+  items.pop_back();
+
+  u32 cell = entry.cell;
+  entry.cell = NO_CELL;
+  if (cell == OVERSIZED)
+    return;
+
+  if (items.empty())
+    eraseCell(cell);
+  else
+    shrink(cells[cell]);
+}
+
+void SpatialGrid::eraseCell(u32 index) {
+  cellLookup.erase(cells[index].key);
+
+  // swap and pop, the last cell's items follow it to the freed index
+  u32 last = (u32)cells.size() - 1;
+  if (index != last) {
+    cells[index] = std::move(cells[last]);
+    cellLookup[cells[index].key] = index;
+    for (u32 id : cells[index].items)
+      entries[id].cell = index;
+  }
+  cells.pop_back();
+}
+
+void SpatialGrid::insert(u32 id, const Math::AABB &bounds) {
+  if (contains(id))
+    Util::Error("SpatialGrid: id " + std::to_string(id) + " is already in the grid");
+
+  if (id >= entries.size())
+    entries.resize((size_t)id + 1);
+
+  entries[id].bounds = bounds;
+  entries[id].key = keyFor(bounds);
+  link(id);
+  count++;
+}
+
+void SpatialGrid::update(u32 id, const Math::AABB &bounds) {
+  if (!contains(id)) {
+    insert(id, bounds);
+    return;
+  }
+
+  Entry &entry = entries[id];
+  u64 key = keyFor(bounds);
+  entry.bounds = bounds;
+
+  if (key == entry.key) {
+    if (entry.cell != OVERSIZED)
+      grow(cells[entry.cell], bounds);
+    return;
+  }
+
+  unlink(id);
+  entry.key = key;
+  link(id);
+}
+
+void SpatialGrid::remove(u32 id) {
+  if (!contains(id))
+    return;
+
+  unlink(id);
+  count--;
+  updateMaxLoose();
+
+  // keep ids dense when the highest ones go away, refit stays incremental for a scene that despawns
+  while (!entries.empty() && entries.back().cell == NO_CELL)
+    entries.pop_back();
+}
+
+bool SpatialGrid::contains(u32 id) const { return id < entries.size() && entries[id].cell != NO_CELL; }
+
+const Math::AABB &SpatialGrid::getBounds(u32 id) const { return entries[id].bounds; }
+
+size_t SpatialGrid::size() const { return count; }
+
+size_t SpatialGrid::getCellCount() const { return cellLookup.size(); }
+
+// ====================================================================================================================
+// Bulk updates
+// ====================================================================================================================
+void SpatialGrid::rebuild(const std::vector<Math::AABB> &bounds, Threads::ThreadPool &pool) {
+  clear();
+  entries.resize(bounds.size());
+
+  pool.parallelFor(bounds.size(), GRAIN, [&](size_t begin, size_t end) {
+    for (size_t i = begin; i < end; i++) {
+      entries[i].bounds = bounds[i];
+      entries[i].key = keyFor(bounds[i]);
+    }
+  });
+
+  // the hash map is not thread safe, bucket serially using the precomputed keys
+  for (u32 i = 0; i < (u32)bounds.size(); i++)
+    link(i);
+
+  count = bounds.size();
+}
+
+void SpatialGrid::refit(const std::vector<Math::AABB> &bounds, Threads::ThreadPool &pool) {
+  bool dense = count == bounds.size() && entries.size() == bounds.size();
+  if (!dense) {
+    rebuild(bounds, pool);
+    return;
+  }
+
+  // the new key goes in right away, the old one is only needed to tell whether the item moved
+  std::vector<unsigned char> moved(bounds.size(), 0);
+
+  pool.parallelFor(bounds.size(), GRAIN, [&](size_t begin, size_t end) {
+    for (size_t i = begin; i < end; i++) {
+      Entry &entry = entries[i];
+      u64 key = keyFor(bounds[i]);
+      entry.bounds = bounds[i];
+
+      if (key != entry.key) {
+        entry.key = key;
+        moved[i] = 1;
+      }
+    }
+  });
+
+  for (u32 i = 0; i < (u32)moved.size(); i++) {
+    if (moved[i]) {
+      unlink(i);
+      link(i);
+    }
+  }
+
+  // items that stayed may have grown or shrunk, every cell's looseness is recomputed
+  pool.parallelFor(cells.size(), 64, [&](size_t begin, size_t end) {
+    for (size_t i = begin; i < end; i++)
+      shrink(cells[i]);
+  });
+  updateMaxLoose();
+}
+
+// ====================================================================================================================
+// Queries
+// ====================================================================================================================
+Math::AABB SpatialGrid::looseBounds(const Cell &cell) const {
+  Math::Vector3 min(cell.x * cellSize - cell.loose, cell.y * cellSize - cell.loose, cell.z * cellSize - cell.loose);
+  f32 size = cellSize + cell.loose * 2;
+  return Math::AABB(min, min + Math::Vector3(size, size, size));
+}
+
+template <typename CellTest, typename ItemTest>
+void SpatialGrid::query(CellTest cellTest, ItemTest itemTest, std::vector<u32> &out) const {
+  for (u32 id : oversized)
+    if (itemTest(entries[id].bounds))
+      out.push_back(id);
+
+  for (const auto &cell : cells) {
+    if (cell.items.empty() || !cellTest(looseBounds(cell)))
+      continue;
+
+    for (u32 id : cell.items)
+      if (itemTest(entries[id].bounds))
+        out.push_back(id);
+  }
+}
+
+void SpatialGrid::queryFrustum(const Math::Frustum &frustum, std::vector<u32> &out) const {
+  auto test = [&frustum](const Math::AABB &box) { return frustum.intersects(box); };
+  query(test, test, out);
+}
+
+void SpatialGrid::queryFrustum(const Math::Frustum &from, const Math::Frustum &to, std::vector<u32> &out) const {
+  auto test = [&from, &to](const Math::AABB &box) { return Math::Frustum::intersectsBetween(from, to, box); };
+  query(test, test, out);
+}
+
+void SpatialGrid::queryRadius(const Math::Vector3 &center, f32 radius, std::vector<u32> &out) const {
+  auto test = [&center, radius](const Math::AABB &box) { return box.intersectsSphere(center, radius); };
+
+  // small radius: look up the handful of cells it can touch, otherwise walk every occupied cell
+  // cells out of key range hold nothing, their items are in the oversized list
+  f32 distance = radius + maxLoose;
+  auto coord = [this](f32 v) {
+    return (i32)std::clamp(std::floor(v / cellSize), -(f32)COORD_LIMIT, (f32)(COORD_LIMIT - 1));
+  };
+  i32 lo[3] = {coord(center.x - distance), coord(center.y - distance), coord(center.z - distance)};
+  i32 hi[3] = {coord(center.x + distance), coord(center.y + distance), coord(center.z + distance)};
+
+  f64 volume = (f64)(hi[0] - lo[0] + 1) * (hi[1] - lo[1] + 1) * (hi[2] - lo[2] + 1);
+  if (volume > (f64)cellLookup.size()) {
+    query(test, test, out);
+    return;
+  }
+
+  for (u32 id : oversized)
+    if (test(entries[id].bounds))
+      out.push_back(id);
+
+  for (i32 x = lo[0]; x <= hi[0]; x++) {
+    for (i32 y = lo[1]; y <= hi[1]; y++) {
+      for (i32 z = lo[2]; z <= hi[2]; z++) {
+        auto found = cellLookup.find(packKey(x, y, z));
+        if (found == cellLookup.end())
+          continue;
+
+        const Cell &cell = cells[found->second];
+        if (cell.items.empty() || !test(looseBounds(cell)))
+          continue;
+
+        for (u32 id : cell.items)
+          if (test(entries[id].bounds))
+            out.push_back(id);
+      }
+    }
+  }
+}
+
+void SpatialGrid::queryRay(const Math::Ray &ray, f32 maxDistance, std::vector<u32> &out) const {
+  auto test = [&ray, maxDistance](const Math::AABB &box) {
+    f32 t;
+    return ray.intersects(box, maxDistance, t);
+  };
+  query(test, test, out);
+}
+
+bool SpatialGrid::raycast(const Math::Ray &ray, f32 maxDistance, u32 &hit, f32 &distance) const {
+  f32 best = maxDistance;
+  bool found = false;
+  f32 t;
+
+  for (u32 id : oversized) {
+    if (ray.intersects(entries[id].bounds, best, t) && (!found || t < best)) {
+      best = t;
+      hit = id;
+      found = true;
+    }
+  }
+
+  // visit cells front to back and stop once a cell starts behind the closest hit
+  std::vector<std::pair<f32, u32>> order;
+  for (u32 i = 0; i < (u32)cells.size(); i++)
+    if (!cells[i].items.empty() && ray.intersects(looseBounds(cells[i]), best, t))
+      order.push_back({t, i});
+  std::sort(order.begin(), order.end());
+
+  for (const auto &[cellDistance, index] : order) {
+    if (found && cellDistance > best)
+      break;
+
+    for (u32 id : cells[index].items) {
+      if (ray.intersects(entries[id].bounds, best, t) && (!found || t < best)) {
+        best = t;
+        hit = id;
+        found = true;
+      }
+    }
+  }
+
+  if (found)
+    distance = best;
+  return found;
+}
+
+} // namespace Game
@@ -0,0 +1,116 @@
+/**
+ * @file spatial.hpp
+ *
+ * @brief header file for the scene spatial index
+ *
+ * @details A hashed loose grid. Every item lives in the single cell that
+ *          holds the center of its world bounds, and each cell remembers
+ *          how far its items stick out of it (the looseness). Moving an item
+ *          only touches the grid when its center changes cell, so refitting
+ *          a mostly static scene is cheap. Items much larger than a cell, or
+ *          too far out for a cell key, are kept in a separate list that every
+ *          query tests. Cells go away when their last item leaves, and their
+ *          looseness is recomputed on refit, so it shrinks back when items do.
+ *
+ *          Items are identified by a caller chosen id, the scene uses the
+ *          object index.
+ */
+
+#pragma once
+
+#include "../math/bounds.hpp"
+#include "../threads/threads.hpp"
+#include "../util/defines.hpp"
+
+#include <unordered_map>
+#include <vector>
+
+namespace Game {
+
+class SpatialGrid {
+public:
+  explicit SpatialGrid(f32 cellSize = 16.0f);
+
+  void clear();
+
+  void insert(u32 id, const Math::AABB &bounds);
+  void update(u32 id, const Math::AABB &bounds);
+  void remove(u32 id);
+
+  bool contains(u32 id) const;
+  const Math::AABB &getBounds(u32 id) const;
+  size_t size() const;
+  size_t getCellCount() const;
+
+  /**
+   * @brief Replace the contents with bounds[i] for id i, cell keys are computed in parallel
+   */
+  void rebuild(const std::vector<Math::AABB> &bounds, Threads::ThreadPool &pool);
+
+  /**
+   * @brief Update every id i with bounds[i], only items that changed cell are moved
+   */
+  void refit(const std::vector<Math::AABB> &bounds, Threads::ThreadPool &pool);
+
+  // queries append matching ids to out
+  void queryFrustum(const Math::Frustum &frustum, std::vector<u32> &out) const;
+  /**
+   * @brief Items in any frustum on the way from one to the other, see Math::Frustum::intersectsBetween
+   */
+  void queryFrustum(const Math::Frustum &from, const Math::Frustum &to, std::vector<u32> &out) const;
+  void queryRadius(const Math::Vector3 &center, f32 radius, std::vector<u32> &out) const;
+  void queryRay(const Math::Ray &ray, f32 maxDistance, std::vector<u32> &out) const;
+
+  /**
+   * @brief Closest item whose bounds the ray hits, returns false on a miss
+   */
+  bool raycast(const Math::Ray &ray, f32 maxDistance, u32 &hit, f32 &distance) const;
+
+private:
+  static const u32 NO_CELL = UINT32_MAX;
+  static const u32 OVERSIZED = UINT32_MAX - 1;
+
+  struct Entry {
+    Math::AABB bounds;
+    u64 key = 0;
+    u32 cell = NO_CELL;
+    u32 slot = 0;
+  };
+
+  struct Cell {
+    u64 key;
+    i32 x, y, z;
+    // how far items in this cell reach outside of it
+    f32 loose = 0;
+    std::vector<u32> items;
+  };
+
+  u64 keyFor(const Math::AABB &bounds) const;
+  bool isOversized(const Math::AABB &bounds) const;
+  Math::AABB looseBounds(const Cell &cell) const;
+
+  void link(u32 id);
+  void unlink(u32 id);
+  void eraseCell(u32 index);
+  f32 reach(const Cell &cell, const Math::AABB &bounds) const;
+  void grow(Cell &cell, const Math::AABB &bounds);
+  /**
+   * @brief Recompute the looseness of a cell from its items, which may have shrunk or left
+   */
+  void shrink(Cell &cell) const;
+  void updateMaxLoose();
+
+  template <typename CellTest, typename ItemTest>
+  void query(CellTest cellTest, ItemTest itemTest, std::vector<u32> &out) const;
+
+  f32 cellSize;
+  f32 maxLoose = 0;
+  size_t count = 0;
+
+  std::vector<Entry> entries;
+  std::vector<Cell> cells;
+  std::unordered_map<u64, u32> cellLookup;
+  std::vector<u32> oversized;
+};
+
+} // namespace Game
@@ -0,0 +1,291 @@
+/**
+ * @file texture-loader.cpp
+ */
+
+#include "texture-loader.hpp"
+#include "../util/mipmap.hpp"
+#include "../util/profiler.hpp"
+#include "../util/stb_image.h"
+#include "../util/util.hpp"
+
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <exception>
+#include <filesystem>
+#include <functional>
+#include <iostream>
+#include <thread>
+#include <utility>
+
+namespace Game {
+
+namespace {
+// FNV-1a, continued from a previous hash
+u64 hashBytes(const void *data, size_t size, u64 hash = 14695981039346656037ull) {
+  const unsigned char *bytes = static_cast<const unsigned char *>(data);
+  for (size_t i = 0; i < size; i++) {
+    hash ^= bytes[i];
+    hash *= 1099511628211ull;
+  }
+  return hash;
+}
+
+/**
+ * @brief Decode an image file's bytes to sRGB RGBA8, with the full mip chain when mips is set
+ */
+Util::TextureFile decodeImage(const std::vector<char> &bytes, const std::string &path, bool mips) {
+  int width, height, channels;
+  stbi_uc *pixels = stbi_load_from_memory(reinterpret_cast<const stbi_uc *>(bytes.data()), (int)bytes.size(), &width,
+                                          &height, &channels, STBI_rgb_alpha);
+  if (!pixels)
+    Util::Error("Failed to load texture image: " + path);
+
+  Util::TextureFile texture;
+  texture.width = (u32)width;
+  texture.height = (u32)height;
+  texture.levels = mips ? Util::mipLevelCount(texture.width, texture.height) : 1;
+  Util::allocateTextureFile(texture);
+
+  std::memcpy(texture.data.data(), pixels, texture.getLevelSize(0));
+  stbi_image_free(pixels);
+
+  for (u32 level = 1; level < texture.levels; level++)
+    Util::downsampleRGBA8(texture.getLevel(0, level - 1), texture.getLevelWidth(level - 1),
+                          texture.getLevelHeight(level - 1), texture.data.data() + texture.offsets[level], true);
+  return texture;
+}
+} // namespace
+
+// ====================================================================================================================
+// Setup
+// ====================================================================================================================
+TextureLoader::TextureLoader(Threads::ThreadPool &pool, std::string cacheDirectory)
+    : pool(pool), cacheDirectory(std::move(cacheDirectory)) {}
+
+void TextureLoader::setCacheDirectory(const std::string &directory) { cacheDirectory = directory; }
+
+TextureLoader &TextureLoader::global() {
+  static TextureLoader loader(Threads::ThreadPool::global());
+  return loader;
+}
+
+// ====================================================================================================================
+// Loading
+// ====================================================================================================================
+std::vector<std::shared_ptr<const Util::TextureFile>> TextureLoader::load(const std::vector<std::string> &paths) {
+  PROFILE_FUNCTION();
+  auto start = std::chrono::steady_clock::now();
+  std::vector<std::shared_ptr<const Util::TextureFile>> textures(paths.size());
+
+  // only the first request for a path that isn't loaded yet goes to the workers
+  std::unordered_map<std::string, size_t> first;
+  std::vector<size_t> pending;
+  for (size_t i = 0; i < paths.size(); i++) {
+    stats.requested++;
+    auto found = loaded.find(paths[i]);
+    if (found != loaded.end() && (textures[i] = found->second.lock())) {
+      stats.shared++;
+      continue;
+    }
+    if (!first.emplace(paths[i], i).second) {
+      stats.shared++;
+      continue;
+    }
+    pending.push_back(i);
+  }
+
+  std::vector<Result> results(pending.size());
+  pool.parallelFor(pending.size(), 1, [&](size_t begin, size_t end) {
+    for (size_t i = begin; i < end; i++) {
+      try {
+        results[i] = loadOne(paths[pending[i]]);
+      } catch (std::exception &e) {
+        results[i].error = e.what();
+      }
+    }
+  });
+
+  for (size_t i = 0; i < pending.size(); i++) {
+    if (!results[i].texture)
+      Util::Error(results[i].error);
+    stats.cacheHits += results[i].cacheHit ? 1 : 0;
+    stats.decoded += results[i].decoded;
+    textures[pending[i]] = results[i].texture;
+    loaded[paths[pending[i]]] = results[i].texture;
+  }
+
+  for (size_t i = 0; i < paths.size(); i++)
+    if (!textures[i])
+      textures[i] = textures[first[paths[i]]];
+
+  stats.milliseconds += std::chrono::duration<f64, std::milli>(std::chrono::steady_clock::now() - start).count();
+  return textures;
+}
+
+std::shared_ptr<const Util::TextureFile> TextureLoader::load(const std::string &path) {
+  return load(std::vector<std::string>{path})[0];
+}
+
+std::shared_ptr<const Util::TextureFile> TextureLoader::loadCubemap(const std::array<std::string, 6> &paths) {
+  PROFILE_FUNCTION();
+  auto start = std::chrono::steady_clock::now();
+  stats.requested++;
+
+  std::string name = "cubemap";
+  for (const auto &path : paths)
+    name += "\n" + path;
+  auto found = loaded.find(name);
+  if (found != loaded.end()) {
+    if (auto texture = found->second.lock()) {
+      stats.shared++;
+      return texture;
+    }
+  }
+
+  // the faces are read and, on a miss, decoded in parallel
+  std::array<std::vector<char>, 6> bytes;
+  std::array<Util::TextureFile, 6> faces;
+  std::array<std::string, 6> errors;
+  auto forEachFace = [&](const std::function<void(size_t face)> &fn) {
+    pool.parallelFor(6, 1, [&](size_t begin, size_t end) {
+      for (size_t face = begin; face < end; face++) {
+        try {
+          fn(face);
+        } catch (std::exception &e) {
+          errors[face] = e.what();
+        }
+      }
+    });
+    for (const auto &error : errors)
+      if (!error.empty())
+        Util::Error(error);
+  };
+
+  forEachFace([&](size_t face) { bytes[face] = Util::readFile(paths[face]); });
+
+  u64 key = hashBytes(&CACHE_VERSION, sizeof(CACHE_VERSION));
+  key = hashBytes("cubemap", 7, key);
+  for (const auto &face : bytes)
+    key = hashBytes(face.data(), face.size(), key);
+
+  std::shared_ptr<const Util::TextureFile> texture = readCache(key);
+  if (texture && texture->faces == 6 && texture->format == Util::TextureFormat::RGBA8) {
+    stats.cacheHits++;
+  } else {
+    forEachFace([&](size_t face) { faces[face] = decodeImage(bytes[face], paths[face], false); });
+    stats.decoded += 6;
+
+    Util::TextureFile cubemap;
+    cubemap.width = faces[0].width;
+    cubemap.height = faces[0].height;
+    cubemap.faces = 6;
+    Util::allocateTextureFile(cubemap);
+    for (u32 face = 0; face < 6; face++) {
+      if (faces[face].width != cubemap.width || faces[face].height != cubemap.height)
+        Util::Error("Cubemap faces have different sizes: " + paths[face]);
+      std::memcpy(cubemap.data.data() + cubemap.offsets[face], faces[face].data.data(), cubemap.getLevelSize(0));
+    }
+
+    writeCache(key, cubemap);
+    texture = std::make_shared<const Util::TextureFile>(std::move(cubemap));
+  }
+
+  loaded[name] = texture;
+  stats.milliseconds += std::chrono::duration<f64, std::milli>(std::chrono::steady_clock::now() - start).count();
+  return texture;
+}
+
+TextureLoader::Result TextureLoader::loadOne(const std::string &path) const {
+  PROFILE_FUNCTION();
+  Result result;
+
+  // already in the format the GPU samples
+  if (Util::isTextureFile(path)) {
+    result.texture = std::make_shared<const Util::TextureFile>(Util::loadTextureFile(path));
+    return result;
+  }
+
+  std::vector<char> bytes = Util::readFile(path);
+  u64 key = hashBytes(&CACHE_VERSION, sizeof(CACHE_VERSION));
+  key = hashBytes(bytes.data(), bytes.size(), key);
+
+  // an entry that isn't the full RGBA8 chain decodeImage builds is decoded again and overwritten
+  std::shared_ptr<const Util::TextureFile> cached = readCache(key);
+  if (cached && cached->format == Util::TextureFormat::RGBA8 && cached->faces == 1 &&
+      cached->levels == Util::mipLevelCount(cached->width, cached->height)) {
+    result.texture = std::move(cached);
+    result.cacheHit = true;
+    return result;
+  }
+
+  Util::TextureFile texture = decodeImage(bytes, path, true);
+  writeCache(key, texture);
+  result.texture = std::make_shared<const Util::TextureFile>(std::move(texture));
+  result.decoded = 1;
+  return result;
+}
+
+// ====================================================================================================================
+// Cache
+// ====================================================================================================================
+std::string TextureLoader::getCachePath(u64 key) const {
+  char name[32];
+  std::snprintf(name, sizeof(name), "%016llx.dds", key);
+  return cacheDirectory + "/" + name;
+}
+
+std::shared_ptr<const Util::TextureFile> TextureLoader::readCache(u64 key) const {
+  if (cacheDirectory.empty())
+    return nullptr;
+
+  std::string path = getCachePath(key);
+  std::error_code error;
+  if (!std::filesystem::exists(path, error))
+    return nullptr;
+
+  // a broken entry is decoded again and overwritten
+  try {
+    return std::make_shared<const Util::TextureFile>(Util::loadTextureFile(path));
+  } catch (std::exception &e) {
+    return nullptr;
+  }
+}
+
+void TextureLoader::writeCache(u64 key, const Util::TextureFile &texture) const {
+  if (cacheDirectory.empty())
+    return;
+
+  std::error_code error;
+  std::filesystem::create_directories(cacheDirectory, error);
+
+  // written next to the entry and swapped in, so a reader never sees half a file, workers writing the same content
+  // under different paths each get their own temporary file
+  std::string path = getCachePath(key);
+  std::string tempPath = path + "." + std::to_string(std::hash<std::thread::id>{}(std::this_thread::get_id())) + ".tmp";
+  try {
+    Util::saveTextureFile(texture, tempPath);
+  } catch (std::exception &e) {
+    std::cout << "Texture cache: " << e.what() << "\n";
+    std::filesystem::remove(tempPath, error);
+    return;
+  }
+
+  std::filesystem::rename(tempPath, path, error);
+  if (error) {
+    std::cout << "Texture cache: failed to replace " << path << ": " << error.message() << "\n";
+    std::filesystem::remove(tempPath, error);
+  }
+}
+
+// ====================================================================================================================
+// Stats
+// ====================================================================================================================
+TextureLoaderStats TextureLoader::getStats() const { return stats; }
+
+void TextureLoader::printStats() const {
+  std::cout << "Texture loads: " << stats.requested << " requested, " << stats.shared << " shared, " << stats.cacheHits
+            << " from the cache, " << stats.decoded << " images decoded in " << stats.milliseconds << " ms\n";
+}
+
+} // namespace Game
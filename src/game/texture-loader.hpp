@@ -0,0 +1,108 @@
+/**
+ * @file texture-loader.hpp
+ *
+ * @brief header file for the texture loading service
+ *
+ * @details Loads object textures and environment maps as Util::TextureFile,
+ *          decoding images in parallel on a thread pool. Images (PNG, JPG,
+ *          ...) are decoded to RGBA8 with their mip chain; DDS/KTX2 files
+ *          are read as they are.
+ *
+ *          What decoding produces is kept in a cache directory as a DDS file
+ *          named after a hash of the source file's contents, so the next run
+ *          reads it back instead of decoding and filtering again, and an edited
+ *          image gets a new entry. A cubemap from six images is one entry
+ *          keyed by all six. Entries that fail to load are rebuilt.
+ *
+ *          A path is loaded once while its texture is in use, every object
+ *          naming it shares the same texture (and so one slot on the GPU).
+ *          load() is called from one thread at a time, it blocks until its
+ *          batch is done.
+ */
+
+#pragma once
+
+#include "../threads/threads.hpp"
+#include "../util/defines.hpp"
+#include "../util/texture-file.hpp"
+
+#include <array>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace Game {
+
+struct TextureLoaderStats {
+  // paths asked for, and the ones that were already loaded (or repeated in a batch)
+  u64 requested = 0;
+  u64 shared = 0;
+  // loads served from the cache directory, and images decoded
+  u64 cacheHits = 0;
+  u64 decoded = 0;
+  f64 milliseconds = 0.0;
+};
+
+class TextureLoader {
+public:
+  static constexpr const char *DEFAULT_CACHE_DIRECTORY = "texture-cache";
+
+  /**
+   * @param cacheDirectory where decoded textures are kept, empty decodes every time
+   */
+  explicit TextureLoader(Threads::ThreadPool &pool, std::string cacheDirectory = DEFAULT_CACHE_DIRECTORY);
+  TextureLoader(const TextureLoader &other) = delete;
+  TextureLoader &operator=(const TextureLoader &other) = delete;
+
+  void setCacheDirectory(const std::string &directory);
+
+  /**
+   * @brief Load a texture per path, in parallel, in the order of paths
+   */
+  std::vector<std::shared_ptr<const Util::TextureFile>> load(const std::vector<std::string> &paths);
+  std::shared_ptr<const Util::TextureFile> load(const std::string &path);
+
+  /**
+   * @brief Six RGBA8 images as the faces of one cubemap, in the order given, without mips
+   */
+  std::shared_ptr<const Util::TextureFile> loadCubemap(const std::array<std::string, 6> &paths);
+
+  TextureLoaderStats getStats() const;
+  void printStats() const;
+
+  /**
+   * @brief Shared loader on the global thread pool
+   */
+  static TextureLoader &global();
+
+private:
+  // bumped when what gets cached changes, old entries are simply never looked up again
+  static constexpr u64 CACHE_VERSION = 1;
+
+  struct Result {
+    std::shared_ptr<const Util::TextureFile> texture;
+    bool cacheHit = false;
+    u32 decoded = 0;
+    // set instead of texture when loading failed on a worker
+    std::string error;
+  };
+
+  /**
+   * @brief Load one path, runs on the workers
+   */
+  Result loadOne(const std::string &path) const;
+  std::shared_ptr<const Util::TextureFile> readCache(u64 key) const;
+  void writeCache(u64 key, const Util::TextureFile &texture) const;
+  std::string getCachePath(u64 key) const;
+
+  Threads::ThreadPool &pool;
+  std::string cacheDirectory;
+
+  // every texture handed out and still in use, by path
+  std::unordered_map<std::string, std::weak_ptr<const Util::TextureFile>> loaded;
+
+  TextureLoaderStats stats;
+};
+
+} // namespace Game
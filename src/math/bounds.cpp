@@ -0,0 +1,178 @@
+/**
+ * @file bounds.cpp
+ */
+
+#include "bounds.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+namespace Math {
+
+// =============================================================================
+// Axis Aligned Bounding Box
+// =============================================================================
+AABB::AABB(const Vector3 &min, const Vector3 &max) : min(min), max(max) {}
+
+AABB AABB::fromCenterExtents(const Vector3 &center, const Vector3 &extents) {
+  return AABB(center - extents, center + extents);
+}
+
+Vector3 AABB::center() const { return (min + max) * 0.5f; }
+
+Vector3 AABB::extents() const { return (max - min) * 0.5f; }
+
+bool AABB::contains(const Vector3 &point) const {
+  return point.x >= min.x && point.x <= max.x && //
+         point.y >= min.y && point.y <= max.y && //
+         point.z >= min.z && point.z <= max.z;
+}
+
+bool AABB::intersects(const AABB &other) const {
+  return min.x <= other.max.x && max.x >= other.min.x && //
+         min.y <= other.max.y && max.y >= other.min.y && //
+         min.z <= other.max.z && max.z >= other.min.z;
+}
+
+bool AABB::intersectsSphere(const Vector3 &center, f32 radius) const {
+  // distance from the sphere center to the closest point on the box
+  f32 dx = std::max(std::max(min.x - center.x, 0.0f), center.x - max.x);
+  f32 dy = std::max(std::max(min.y - center.y, 0.0f), center.y - max.y);
+  f32 dz = std::max(std::max(min.z - center.z, 0.0f), center.z - max.z);
+  return dx * dx + dy * dy + dz * dz <= radius * radius;
+}
+
+void AABB::merge(const AABB &other) {
+  min = {std::min(min.x, other.min.x), std::min(min.y, other.min.y), std::min(min.z, other.min.z)};
+  max = {std::max(max.x, other.max.x), std::max(max.y, other.max.y), std::max(max.z, other.max.z)};
+}
+
+AABB AABB::transform(const Matrix4 &m) const {
+  // transform the center and project the extents onto the world axes (Arvo)
+  Vector3 c = center();
+  Vector3 e = extents();
+
+  Vector3 worldCenter(m(0, 0) * c.x + m(0, 1) * c.y + m(0, 2) * c.z + m(0, 3),
+                      m(1, 0) * c.x + m(1, 1) * c.y + m(1, 2) * c.z + m(1, 3),
+                      m(2, 0) * c.x + m(2, 1) * c.y + m(2, 2) * c.z + m(2, 3));
+
+  Vector3 worldExtents(std::fabs(m(0, 0)) * e.x + std::fabs(m(0, 1)) * e.y + std::fabs(m(0, 2)) * e.z,
+                       std::fabs(m(1, 0)) * e.x + std::fabs(m(1, 1)) * e.y + std::fabs(m(1, 2)) * e.z,
+                       std::fabs(m(2, 0)) * e.x + std::fabs(m(2, 1)) * e.y + std::fabs(m(2, 2)) * e.z);
+
+  return fromCenterExtents(worldCenter, worldExtents);
+}
+
+// =============================================================================
+// Plane
+// =============================================================================
+f32 Plane::distance(const Vector3 &point) const {
+  return normal.x * point.x + normal.y * point.y + normal.z * point.z + d;
+}
+
+void Plane::normalize() {
+  f32 length = std::sqrt(normal.x * normal.x + normal.y * normal.y + normal.z * normal.z);
+  if (length == 0)
+    return;
+
+  normal = normal * (1.0f / length);
+  d /= length;
+}
+
+// =============================================================================
+// Frustum
+// =============================================================================
+Frustum Frustum::fromMatrix(const Matrix4 &m) {
+  // Gribb/Hartmann plane extraction, rows of the clip matrix
+  auto plane = [&m](f32 a0, f32 a1, f32 a2, f32 a3, i32 row, f32 sign) {
+    Plane p;
+    p.normal = {a0 + sign * m(row, 0), a1 + sign * m(row, 1), a2 + sign * m(row, 2)};
+    p.d = a3 + sign * m(row, 3);
+    p.normalize();
+    return p;
+  };
+
+  Frustum f;
+  f.planes[PLANE_LEFT] = plane(m(3, 0), m(3, 1), m(3, 2), m(3, 3), 0, 1);
+  f.planes[PLANE_RIGHT] = plane(m(3, 0), m(3, 1), m(3, 2), m(3, 3), 0, -1);
+  f.planes[PLANE_BOTTOM] = plane(m(3, 0), m(3, 1), m(3, 2), m(3, 3), 1, 1);
+  f.planes[PLANE_TOP] = plane(m(3, 0), m(3, 1), m(3, 2), m(3, 3), 1, -1);
+  // clip depth is 0..w so the near plane is just the z row
+  f.planes[PLANE_NEAR] = plane(0, 0, 0, 0, 2, 1);
+  f.planes[PLANE_FAR] = plane(m(3, 0), m(3, 1), m(3, 2), m(3, 3), 2, -1);
+  return f;
+}
+
+namespace {
+bool outside(const Plane &p, const AABB &box) {
+  // the box corner furthest along the plane normal
+  Vector3 positive(p.normal.x >= 0 ? box.max.x : box.min.x, //
+                   p.normal.y >= 0 ? box.max.y : box.min.y, //
+                   p.normal.z >= 0 ? box.max.z : box.min.z);
+  return p.distance(positive) < 0;
+}
+} // namespace
+
+bool Frustum::intersects(const AABB &box) const {
+  for (const auto &p : planes)
+    if (outside(p, box))
+      return false;
+  return true;
+}
+
+bool Frustum::intersectsBetween(const Frustum &from, const Frustum &to, const AABB &box) {
+  for (u32 side = 0; side < 6; side++)
+    if (outside(from.planes[side], box) && outside(to.planes[side], box))
+      return false;
+  return true;
+}
+
+bool Frustum::intersectsSphere(const Vector3 &center, f32 radius) const {
+  for (const auto &p : planes)
+    if (p.distance(center) < -radius)
+      return false;
+  return true;
+}
+
+// =============================================================================
+// Ray
+// =============================================================================
+Ray::Ray(const Vector3 &origin, const Vector3 &direction) : origin(origin), direction(direction) {}
+
+Vector3 Ray::at(f32 t) const { return origin + direction * t; }
+
+bool Ray::intersects(const AABB &box, f32 maxDistance, f32 &t) const {
+  f32 tMin = 0;
+  f32 tMax = maxDistance;
+
+  const f32 o[3] = {origin.x, origin.y, origin.z};
+  const f32 dir[3] = {direction.x, direction.y, direction.z};
+  const f32 lo[3] = {box.min.x, box.min.y, box.min.z};
+  const f32 hi[3] = {box.max.x, box.max.y, box.max.z};
+
+  for (int i = 0; i < 3; i++) {
+    if (std::fabs(dir[i]) < std::numeric_limits<f32>::epsilon()) {
+      // parallel to the slab
+      if (o[i] < lo[i] || o[i] > hi[i])
+        return false;
+      continue;
+    }
+
+    f32 inv = 1.0f / dir[i];
+    f32 t0 = (lo[i] - o[i]) * inv;
+    f32 t1 = (hi[i] - o[i]) * inv;
+    if (t0 > t1)
+      std::swap(t0, t1);
+
+    tMin = std::max(tMin, t0);
+    tMax = std::min(tMax, t1);
+    if (tMin > tMax)
+      return false;
+  }
+
+  t = tMin;
+  return true;
+}
+
+} // namespace Math
@@ -0,0 +1,99 @@
+/**
+ * @file bounds.hpp
+ *
+ * @brief header file for bounding volumes
+ *
+ * @details Axis aligned boxes, planes, view frustums and rays along with the
+ *          intersection tests used by spatial queries and culling
+ */
+
+#pragma once
+
+#include "../util/defines.hpp"
+#include "matrix.hpp"
+#include "vector.hpp"
+
+namespace Math {
+
+// =============================================================================
+// Axis Aligned Bounding Box
+// =============================================================================
+struct AABB {
+  Vector3 min;
+  Vector3 max;
+
+  AABB() = default;
+  AABB(const Vector3 &min, const Vector3 &max);
+
+  static AABB fromCenterExtents(const Vector3 &center, const Vector3 &extents);
+
+  Vector3 center() const;
+  Vector3 extents() const;
+
+  bool contains(const Vector3 &point) const;
+  bool intersects(const AABB &other) const;
+  bool intersectsSphere(const Vector3 &center, f32 radius) const;
+
+  void merge(const AABB &other);
+
+  /**
+   * @brief Box enclosing this box after being transformed by m (column vector convention)
+   */
+  AABB transform(const Matrix4 &m) const;
+};
+
+// =============================================================================
+// Plane
+// =============================================================================
+struct Plane {
+  // points p on the plane satisfy dot(normal, p) + d = 0
+  Vector3 normal;
+  f32 d = 0;
+
+  f32 distance(const Vector3 &point) const;
+  void normalize();
+};
+
+// =============================================================================
+// Frustum
+// =============================================================================
+struct Frustum {
+  enum Side { PLANE_LEFT, PLANE_RIGHT, PLANE_BOTTOM, PLANE_TOP, PLANE_NEAR, PLANE_FAR };
+
+  // normals point into the frustum
+  Plane planes[6];
+
+  /**
+   * @brief Extract the planes from a projection * view matrix (Vulkan 0..1 clip depth)
+   */
+  static Frustum fromMatrix(const Matrix4 &viewProjection);
+
+  bool intersects(const AABB &box) const;
+  bool intersectsSphere(const Vector3 &center, f32 radius) const;
+
+  /**
+   * @brief Conservative test against every frustum on the way from one to another (a camera moving between two
+   *        ticks), the box is only rejected when it's outside the same plane at both ends
+   */
+  static bool intersectsBetween(const Frustum &from, const Frustum &to, const AABB &box);
+};
+
+// =============================================================================
+// Ray
+// =============================================================================
+struct Ray {
+  Vector3 origin;
+  Vector3 direction;
+
+  Ray() = default;
+  Ray(const Vector3 &origin, const Vector3 &direction);
+
+  Vector3 at(f32 t) const;
+
+  /**
+   * @brief Slab test, t is the entry distance (0 if the origin is inside the box)
+   */
+  bool intersects(const AABB &box, f32 maxDistance, f32 &t) const;
+};
+
+} // namespace Math
@@ -422,4 +422,16 @@ Matrix4 Quaternion::toRotationMatrix() {
                  2 * x * z - 2 * w * y, 2 * y * z + 2 * w * x, ww - xx - yy + zz, 0, //
                  0, 0, 0, 1);
 }
+
+Quaternion Quaternion::nlerp(const Quaternion &a, const Quaternion &b, f32 t) {
+  f32 dot = a.w * b.w + a.v.x * b.v.x + a.v.y * b.v.y + a.v.z * b.v.z;
+  f32 sign = dot < 0 ? -1.0f : 1.0f;
+
+  Quaternion result(a.w + (b.w * sign - a.w) * t,       //
+                    a.v.x + (b.v.x * sign - a.v.x) * t, //
+                    a.v.y + (b.v.y * sign - a.v.y) * t, //
+                    a.v.z + (b.v.z * sign - a.v.z) * t);
+  result.normalize();
+  return result;
+}
 }; // namespace Math
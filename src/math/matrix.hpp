@@ -125,6 +125,11 @@ struct Quaternion {
 
   Matrix4 toRotationMatrix();
 
+  /**
+   * @brief Normalized linear blend along the shortest arc, good enough for small steps between ticks
+   */
+  static Quaternion nlerp(const Quaternion &a, const Quaternion &b, f32 t);
+
   f32 w;
   Vector3 v;
 };
@@ -6,13 +6,27 @@
 #include "../util/tiny_obj_loader.h"
 
 #include "../math/vector.hpp"
+#include "../util/profiler.hpp"
 #include "../util/util.hpp"
 #include "mesh.hpp"
 
+#include <atomic>
 #include <string>
 #include <unordered_map>
+#include <utility>
 
 namespace Mesh {
+namespace {
+// every deep copy is counted so the startup report can show meshes are only ever moved
+std::atomic<size_t> copyCount{0};
+std::atomic<size_t> copiedBytes{0};
+
+void countCopy(const Mesh &mesh) {
+  copyCount.fetch_add(1, std::memory_order_relaxed);
+  copiedBytes.fetch_add(mesh.getVertexDataSize() + mesh.getIndexDataSize(), std::memory_order_relaxed);
+}
+} // namespace
+
 Mesh::~Mesh() {
   indices.clear();
   vertexData.clear();
@@ -20,15 +34,20 @@ Mesh::~Mesh() {
 Mesh::Mesh(const Mesh &other)
     : _hasNormals(other._hasNormals), _hasUV(other._hasUV), vertexCount(other.vertexCount),
       vertexDataSize(other.vertexDataSize), indexDataSize(other.indexDataSize), indices(other.indices),
-      vertexData(other.vertexData), box(other.box) {}
+      vertexData(other.vertexData), box(other.box) {
+  countCopy(other);
+}
 
 Mesh::Mesh(Mesh &&other) noexcept
     : _hasNormals(other._hasNormals), _hasUV(other._hasUV), vertexCount(other.vertexCount),
-      vertexDataSize(other.vertexDataSize), indexDataSize(other.indexDataSize), indices(other.indices),
-      vertexData(other.vertexData), box(other.box) {
+      vertexDataSize(other.vertexDataSize), indexDataSize(other.indexDataSize), indices(std::move(other.indices)),
+      vertexData(std::move(other.vertexData)), box(other.box) {
 
   other.indices.clear();
   other.vertexData.clear();
+  other.vertexCount = 0;
+  other.vertexDataSize = 0;
+  other.indexDataSize = 0;
 }
 Mesh &Mesh::operator=(Mesh &&other) noexcept {
   if (this == &other)
@@ -40,12 +59,15 @@ Mesh &Mesh::operator=(Mesh &&other) noexcept {
   this->vertexCount = other.vertexCount;
   this->vertexDataSize = other.vertexDataSize;
   this->indexDataSize = other.indexDataSize;
-  this->indices = other.indices;
-  this->vertexData = other.vertexData;
+  this->indices = std::move(other.indices);
+  this->vertexData = std::move(other.vertexData);
   this->box = other.box;
 
   other.indices.clear();
   other.vertexData.clear();
+  other.vertexCount = 0;
+  other.vertexDataSize = 0;
+  other.indexDataSize = 0;
 
   return *this;
 }
@@ -63,14 +85,33 @@ Mesh &Mesh::operator=(const Mesh &other) {
   this->vertexData = other.vertexData;
   this->box = other.box;
 
+  countCopy(other);
+
   return *this;
 }
 
+size_t Mesh::getCopyCount() { return copyCount.load(std::memory_order_relaxed); }
+size_t Mesh::getCopiedBytes() { return copiedBytes.load(std::memory_order_relaxed); }
+
 void Mesh::init(const std::string& meshPath) {
+  PROFILE_FUNCTION();
   loadOBJFile(meshPath);
   computeBoundingBox();
 }
 
+void Mesh::init(std::vector<Vertex> &&vertices, std::vector<u32> &&meshIndices, bool normals, bool uv) {
+  vertexData = std::move(vertices);
+  indices = std::move(meshIndices);
+  _hasNormals = normals;
+  _hasUV = uv;
+
+  vertexCount = indices.size();
+  vertexDataSize = vertexData.size() * sizeof(Vertex);
+  indexDataSize = indices.size() * sizeof(u32);
+
+  computeBoundingBox();
+}
+
 void Mesh::loadOBJFile(const std::string& filename) {
   tinyobj::attrib_t attrib;
   std::vector<tinyobj::shape_t> shapes;
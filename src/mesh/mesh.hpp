@@ -61,6 +61,10 @@ public:
   Mesh &operator=(Mesh &&other) noexcept;
 
   void init(const std::string& meshPath);
+  /**
+   * @brief Init from already loaded data (e.g. a baked scene package)
+   */
+  void init(std::vector<Vertex> &&vertices, std::vector<u32> &&meshIndices, bool normals, bool uv);
 
   void computeBoundingBox();
   bool hasNormals();
@@ -74,6 +78,12 @@ public:
   size_t getVertexDataSize() const;
   size_t getIndexDataSize() const;
 
+  /**
+   * @brief Number of deep copies (and bytes copied) of any mesh since startup
+   */
+  static size_t getCopyCount();
+  static size_t getCopiedBytes();
+
   // VULKAN ONLY ----------------------------------------------
   static VkVertexInputBindingDescription getBindingDescriptions() {
     VkVertexInputBindingDescription result;
@@ -0,0 +1,298 @@
+/**
+ * @brief Checks the GPU culling pass against its CPU reference
+ *
+ * @details usage: cull-check [instances] [seed]
+ *
+ *          Runs cull.comp headless (no window or surface, any device with a
+ *          compute queue) over random instances and cameras, reads the
+ *          visible lists back and compares them per draw with
+ *          GpuCulling::cullReference. Boxes within a hair of a frustum plane
+ *          may land on either side from float rounding and are not counted as
+ *          mismatches. Exits nonzero on any other difference.
+ *
+ *          Without a GPU, point the loader at a software implementation:
+ *          VK_ICD_FILENAMES=/usr/share/vulkan/icd.d/lvp_icd.x86_64.json ./build/cull-check
+ */
+#include "gpu-culling.hpp"
+#include "../math/matrix.hpp"
+#include "../util/util.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include <exception>
+#include <iostream>
+#include <iterator>
+#include <random>
+#include <vector>
+
+namespace {
+const u32 DRAW_COUNT = 16;
+const u32 VIEW_COUNT = 32;
+// plane distance under which a box counts as touching the plane
+const f32 BORDERLINE = 1e-3f;
+
+struct Context {
+  VkInstance instance = VK_NULL_HANDLE;
+  VkPhysicalDevice physicalDevice = VK_NULL_HANDLE;
+  VkDevice device = VK_NULL_HANDLE;
+  VkQueue queue = VK_NULL_HANDLE;
+  VkCommandPool commandPool = VK_NULL_HANDLE;
+  VkCommandBuffer commandBuffer = VK_NULL_HANDLE;
+  VkFence fence = VK_NULL_HANDLE;
+};
+
+void createContext(Context &ctx) {
+  VkApplicationInfo appInfo{};
+  appInfo.sType = VK_STRUCTURE_TYPE_APPLICATION_INFO;
+  appInfo.pApplicationName = "cull-check";
+  appInfo.apiVersion = VK_API_VERSION_1_0;
+
+  VkInstanceCreateInfo instanceInfo{};
+  instanceInfo.sType = VK_STRUCTURE_TYPE_INSTANCE_CREATE_INFO;
+  instanceInfo.pApplicationInfo = &appInfo;
+
+  if (vkCreateInstance(&instanceInfo, nullptr, &ctx.instance) != VK_SUCCESS)
+    Util::Error("Failed to create instance");
+
+  uint32_t deviceCount = 0;
+  vkEnumeratePhysicalDevices(ctx.instance, &deviceCount, nullptr);
+  std::vector<VkPhysicalDevice> devices(deviceCount);
+  vkEnumeratePhysicalDevices(ctx.instance, &deviceCount, devices.data());
+
+  uint32_t queueFamily = UINT32_MAX;
+  for (VkPhysicalDevice candidate : devices) {
+    uint32_t familyCount = 0;
+    vkGetPhysicalDeviceQueueFamilyProperties(candidate, &familyCount, nullptr);
+    std::vector<VkQueueFamilyProperties> families(familyCount);
+    vkGetPhysicalDeviceQueueFamilyProperties(candidate, &familyCount, families.data());
+
+    for (uint32_t i = 0; i < familyCount; i++) {
+      if (families[i].queueFlags & VK_QUEUE_COMPUTE_BIT) {
+        ctx.physicalDevice = candidate;
+        queueFamily = i;
+        break;
+      }
+    }
+    if (ctx.physicalDevice != VK_NULL_HANDLE)
+      break;
+  }
+
+  if (ctx.physicalDevice == VK_NULL_HANDLE)
+    Util::Error("No device with a compute queue");
+
+  VkPhysicalDeviceProperties properties;
+  vkGetPhysicalDeviceProperties(ctx.physicalDevice, &properties);
+  std::cout << "Device: " << properties.deviceName << "\n";
+
+  f32 priority = 1.0f;
+  VkDeviceQueueCreateInfo queueInfo{};
+  queueInfo.sType = VK_STRUCTURE_TYPE_DEVICE_QUEUE_CREATE_INFO;
+  queueInfo.queueFamilyIndex = queueFamily;
+  queueInfo.queueCount = 1;
+  queueInfo.pQueuePriorities = &priority;
+
+  VkDeviceCreateInfo deviceInfo{};
+  deviceInfo.sType = VK_STRUCTURE_TYPE_DEVICE_CREATE_INFO;
+  deviceInfo.queueCreateInfoCount = 1;
+  deviceInfo.pQueueCreateInfos = &queueInfo;
+
+  if (vkCreateDevice(ctx.physicalDevice, &deviceInfo, nullptr, &ctx.device) != VK_SUCCESS)
+    Util::Error("Failed to create device");
+
+  vkGetDeviceQueue(ctx.device, queueFamily, 0, &ctx.queue);
+
+  VkCommandPoolCreateInfo poolInfo{};
+  poolInfo.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
+  poolInfo.flags = VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT;
+  poolInfo.queueFamilyIndex = queueFamily;
+
+  if (vkCreateCommandPool(ctx.device, &poolInfo, nullptr, &ctx.commandPool) != VK_SUCCESS)
+    Util::Error("Failed to create command pool");
+
+  VkCommandBufferAllocateInfo allocInfo{};
+  allocInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+  allocInfo.commandPool = ctx.commandPool;
+  allocInfo.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+  allocInfo.commandBufferCount = 1;
+
+  if (vkAllocateCommandBuffers(ctx.device, &allocInfo, &ctx.commandBuffer) != VK_SUCCESS)
+    Util::Error("Failed to allocate command buffer");
+
+  VkFenceCreateInfo fenceInfo{};
+  fenceInfo.sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO;
+
+  if (vkCreateFence(ctx.device, &fenceInfo, nullptr, &ctx.fence) != VK_SUCCESS)
+    Util::Error("Failed to create fence");
+}
+
+void destroyContext(Context &ctx) {
+  vkDestroyFence(ctx.device, ctx.fence, nullptr);
+  vkDestroyCommandPool(ctx.device, ctx.commandPool, nullptr);
+  vkDestroyDevice(ctx.device, nullptr);
+  vkDestroyInstance(ctx.instance, nullptr);
+}
+
+// same projection as the renderer (0..1 depth, y flipped)
+Math::Matrix4 perspective(f32 fov, f32 aspect, f32 n, f32 f) {
+  f32 focalLength = 1.0f / std::tan(TO_RADIANS(fov) * 0.5f);
+  f32 A = f / (-f + n);
+  f32 B = (f * n) / (-f + n);
+  return Math::Matrix4(focalLength / aspect, 0, 0, 0, //
+                       0, -focalLength, 0, 0,         //
+                       0, 0, A, B,                    //
+                       0, 0, -1, 0);
+}
+
+/**
+ * @brief Smallest distance of the box to a frustum plane, near zero means the result can go either way
+ */
+f32 planeMargin(const Renderer::GpuCulling::Bounds &b, const Math::Matrix4 &model, const Math::Frustum &frustum) {
+  Math::AABB world = Math::AABB({b.min[0], b.min[1], b.min[2]}, {b.max[0], b.max[1], b.max[2]}).transform(model);
+
+  f32 margin = INFINITY;
+  for (const auto &p : frustum.planes) {
+    Math::Vector3 positive(p.normal.x >= 0 ? world.max.x : world.min.x, //
+                           p.normal.y >= 0 ? world.max.y : world.min.y, //
+                           p.normal.z >= 0 ? world.max.z : world.min.z);
+    margin = std::min(margin, std::fabs(p.distance(positive)));
+  }
+  return margin;
+}
+} // namespace
+
+int main(int argc, char **argv) {
+  u32 instanceCount = argc > 1 ? (u32)std::strtoul(argv[1], nullptr, 10) : 100000;
+  u32 seed = argc > 2 ? (u32)std::strtoul(argv[2], nullptr, 10) : 1;
+
+  try {
+    Context ctx;
+    createContext(ctx);
+
+    Renderer::MemoryAllocator allocator;
+    allocator.init(ctx.physicalDevice, ctx.device);
+
+    Renderer::MappedBuffer instances;
+    Renderer::MappedBuffer draws;
+    instances.create(allocator, std::max<u32>(instanceCount, 1) * sizeof(Renderer::InstanceData),
+                     VK_BUFFER_USAGE_STORAGE_BUFFER_BIT);
+    draws.create(allocator, DRAW_COUNT * sizeof(VkDrawIndexedIndirectCommand),
+                 VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT);
+
+    Renderer::GpuCulling culling;
+    culling.init(ctx.device, allocator, 1, instanceCount);
+    culling.setBuffers(0, instances.buffer, draws.buffer);
+
+    // instances are grouped by draw, like the renderer lays them out
+    std::mt19937 rng(seed);
+    std::uniform_real_distribution<f32> position(-200.0f, 200.0f);
+    std::uniform_real_distribution<f32> angle(0.0f, 360.0f);
+    std::uniform_real_distribution<f32> size(0.1f, 4.0f);
+    std::uniform_int_distribution<u32> drawOf(0, DRAW_COUNT - 1);
+
+    std::vector<u32> drawCounts(DRAW_COUNT, 0);
+    std::vector<u32> instanceDraw(instanceCount);
+    for (u32 i = 0; i < instanceCount; i++)
+      drawCounts[instanceDraw[i] = drawOf(rng)]++;
+    std::sort(instanceDraw.begin(), instanceDraw.end());
+
+    std::vector<VkDrawIndexedIndirectCommand> commands(DRAW_COUNT);
+    for (u32 d = 0, first = 0; d < DRAW_COUNT; first += drawCounts[d], d++)
+      commands[d] = {36, 0, 0, 0, first};
+
+    auto *instanceData = static_cast<Renderer::InstanceData *>(instances.mapped);
+    Renderer::GpuCulling::Bounds *bounds = culling.getBounds(0);
+    for (u32 i = 0; i < instanceCount; i++) {
+      Math::Vector3 half(size(rng), size(rng), size(rng));
+      bounds[i] = {{-half.x, -half.y, -half.z}, instanceDraw[i], {half.x, half.y, half.z}, 0};
+      instanceData[i].model = Math::modelMatrix({position(rng), position(rng), position(rng)},
+                                                {angle(rng), angle(rng), angle(rng)}, {1, 1, 1});
+    }
+
+    u32 mismatches = 0;
+    u32 borderline = 0;
+    u64 visibleTotal = 0;
+    std::vector<u32> reference;
+    for (u32 v = 0; v < VIEW_COUNT; v++) {
+      Math::Vector3 eye(position(rng), position(rng) * 0.25f, position(rng));
+      Math::Vector3 target(position(rng), 0, position(rng));
+      Math::Matrix4 viewProj = perspective(45.0f + angle(rng) / 8.0f, 16.0f / 9.0f, 0.1f, 1000.0f) *
+                               Math::viewMatrix(eye, target, {0, 1, 0});
+      Math::Frustum frustum = Math::Frustum::fromMatrix(viewProj);
+
+      memcpy(draws.mapped, commands.data(), commands.size() * sizeof(VkDrawIndexedIndirectCommand));
+      culling.setFrustum(0, frustum, instanceCount);
+
+      VkCommandBufferBeginInfo beginInfo{};
+      beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+      beginInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+
+      vkResetCommandBuffer(ctx.commandBuffer, 0);
+      vkBeginCommandBuffer(ctx.commandBuffer, &beginInfo);
+      culling.record(ctx.commandBuffer, 0, instanceCount);
+      vkEndCommandBuffer(ctx.commandBuffer);
+
+      VkSubmitInfo submitInfo{};
+      submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+      submitInfo.commandBufferCount = 1;
+      submitInfo.pCommandBuffers = &ctx.commandBuffer;
+
+      vkResetFences(ctx.device, 1, &ctx.fence);
+      if (vkQueueSubmit(ctx.queue, 1, &submitInfo, ctx.fence) != VK_SUCCESS)
+        Util::Error("Failed to submit culling pass");
+      vkWaitForFences(ctx.device, 1, &ctx.fence, VK_TRUE, UINT64_MAX);
+
+      reference.clear();
+      Renderer::GpuCulling::cullReference(bounds, instanceData, instanceCount, frustum, reference);
+
+      // order within a draw depends on scheduling, compare the sets
+      const auto *gpuDraws = static_cast<const VkDrawIndexedIndirectCommand *>(draws.mapped);
+      const u32 *visible = culling.getVisible(0);
+      u32 gpuTotal = 0;
+      for (u32 d = 0; d < DRAW_COUNT; d++) {
+        std::vector<u32> gpu(visible + commands[d].firstInstance,
+                             visible + commands[d].firstInstance + gpuDraws[d].instanceCount);
+        std::vector<u32> cpu;
+        for (u32 i : reference)
+          if (instanceDraw[i] == d)
+            cpu.push_back(i);
+        std::sort(gpu.begin(), gpu.end());
+        gpuTotal += gpuDraws[d].instanceCount;
+
+        std::vector<u32> different;
+        std::set_symmetric_difference(gpu.begin(), gpu.end(), cpu.begin(), cpu.end(), std::back_inserter(different));
+        for (u32 i : different) {
+          if (i < instanceCount && planeMargin(bounds[i], instanceData[i].model, frustum) < BORDERLINE) {
+            borderline++;
+          } else {
+            if (mismatches < 10)
+              std::cerr << "view " << v << " draw " << d << ": instance " << i << " differs\n";
+            mismatches++;
+          }
+        }
+      }
+
+      if (gpuTotal != culling.getVisibleCount(0)) {
+        std::cerr << "view " << v << ": visible count " << culling.getVisibleCount(0) << " but draws hold " << gpuTotal
+                  << "\n";
+        mismatches++;
+      }
+      visibleTotal += gpuTotal;
+    }
+
+    std::cout << VIEW_COUNT << " views of " << instanceCount << " instances, " << visibleTotal / VIEW_COUNT
+              << " visible on average, " << borderline << " borderline, " << mismatches << " mismatches\n";
+
+    culling.destroy();
+    draws.destroy(allocator);
+    instances.destroy(allocator);
+    allocator.destroy();
+    destroyContext(ctx);
+
+    return mismatches == 0 ? 0 : 1;
+  } catch (std::exception &e) {
+    std::cerr << e.what() << std::endl;
+    return -1;
+  }
+}
@@ -0,0 +1,69 @@
+/**
+ * @file frame-pacer.cpp
+ */
+
+#include "frame-pacer.hpp"
+
+#include <algorithm>
+#include <thread>
+
+namespace Renderer {
+
+namespace {
+// the scheduler can wake this much late, the rest of the wait is spun
+constexpr std::chrono::microseconds SPIN_MARGIN{1500};
+} // namespace
+
+void FramePacer::setFrameRateCap(f64 frameRateCap) {
+  this->frameRateCap = std::max(frameRateCap, 0.0);
+  frameDuration = this->frameRateCap > 0.0 ? std::chrono::duration_cast<Clock::duration>(
+                                                 std::chrono::duration<f64>(1.0 / this->frameRateCap))
+                                           : Clock::duration{0};
+  nextFrame = Clock::now();
+}
+
+f64 FramePacer::getFrameRateCap() const { return frameRateCap; }
+
+void FramePacer::waitForNextFrame() {
+  if (frameRateCap <= 0.0)
+    return;
+
+  Clock::time_point start = Clock::now();
+  if (start < nextFrame) {
+    sleepUntil(nextFrame);
+    stats.waitMs += std::chrono::duration<f64, std::milli>(Clock::now() - start).count();
+    nextFrame += frameDuration;
+  } else {
+    // late, start the schedule over from now rather than catching up with short frames
+    nextFrame = start + frameDuration;
+  }
+}
+
+void FramePacer::markInput() {
+  inputTime = Clock::now();
+  inputMarked = true;
+}
+
+void FramePacer::markPresent() {
+  if (!inputMarked)
+    return;
+
+  f64 latency = std::chrono::duration<f64, std::milli>(Clock::now() - inputTime).count();
+  stats.frames++;
+  stats.latencyMs += latency;
+  stats.maxLatencyMs = std::max(stats.maxLatencyMs, latency);
+  inputMarked = false;
+}
+
+FramePacerStats FramePacer::getStats() const { return stats; }
+
+void FramePacer::sleepUntil(Clock::time_point deadline) {
+  Clock::time_point now = Clock::now();
+  if (deadline - now > SPIN_MARGIN)
+    std::this_thread::sleep_until(deadline - SPIN_MARGIN);
+
+  while (Clock::now() < deadline)
+    std::this_thread::yield();
+}
+
+} // namespace Renderer
@@ -0,0 +1,79 @@
+/**
+ * @file frame-pacer.hpp
+ *
+ * @brief header file for frame rate capping and input latency measurement
+ *
+ * @details Frames start on a fixed schedule (1 / frameRateCap seconds apart)
+ *          when a cap is set. The wait sleeps most of the way and spins the
+ *          last stretch, a plain sleep overshoots by the scheduler's
+ *          granularity (a millisecond or more). A frame that starts late moves
+ *          the schedule instead of rushing the next ones to catch up.
+ *
+ *          The wait happens before input is polled, so the frame sees input as
+ *          fresh as it can be. Latency is measured from that poll until the
+ *          frame's present was queued: it covers waiting for a frame in flight
+ *          to finish, recording and submitting, but not the GPU work or the
+ *          display after it, which the driver doesn't report here. Fewer frames
+ *          in flight and MAILBOX/FIFO present modes shorten it at the cost of
+ *          throughput.
+ */
+
+#pragma once
+
+#include "../util/defines.hpp"
+
+#include <chrono>
+
+namespace Renderer {
+
+/**
+ * @brief Totals since startup, averages are over the difference of two reads
+ */
+struct FramePacerStats {
+  u64 frames = 0;
+  // poll to present
+  f64 latencyMs = 0.0;
+  f64 maxLatencyMs = 0.0;
+  // time spent waiting for the cap
+  f64 waitMs = 0.0;
+};
+
+class FramePacer {
+public:
+  /**
+   * @param frameRateCap frames per second, 0 doesn't limit
+   */
+  void setFrameRateCap(f64 frameRateCap);
+  f64 getFrameRateCap() const;
+
+  /**
+   * @brief Wait until the next frame may start, then call markInput right after polling input
+   */
+  void waitForNextFrame();
+  void markInput();
+  /**
+   * @brief Call once the frame's present was queued
+   */
+  void markPresent();
+
+  FramePacerStats getStats() const;
+
+private:
+  using Clock = std::chrono::steady_clock;
+
+  /**
+   * @brief Sleep until shortly before deadline and spin the rest
+   */
+  static void sleepUntil(Clock::time_point deadline);
+
+  f64 frameRateCap = 0.0;
+  Clock::duration frameDuration{0};
+  Clock::time_point nextFrame;
+
+  Clock::time_point inputTime;
+  bool inputMarked = false;
+
+  FramePacerStats stats;
+};
+
+} // namespace Renderer
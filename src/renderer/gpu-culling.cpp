@@ -0,0 +1,244 @@
+/**
+ * @file gpu-culling.cpp
+ */
+
+#include "gpu-culling.hpp"
+#include "../util/util.hpp"
+
+#include <algorithm>
+#include <array>
+
+namespace Renderer {
+
+namespace {
+// matches local_size_x in cull.comp
+const u32 GROUP_SIZE = 64;
+} // namespace
+
+// ====================================================================================================================
+// Mapped Buffer
+// ====================================================================================================================
+void MappedBuffer::create(MemoryAllocator &allocator, VkDeviceSize size, VkBufferUsageFlags usage) {
+  VkMemoryPropertyFlags properties = VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT;
+  allocator.createBuffer(size, usage, properties, buffer, memory);
+  mapped = memory.mapped;
+}
+
+void MappedBuffer::destroy(MemoryAllocator &allocator) {
+  if (buffer == VK_NULL_HANDLE)
+    return;
+
+  allocator.destroyBuffer(buffer, memory);
+  mapped = nullptr;
+}
+
+// ====================================================================================================================
+// Setup
+// ====================================================================================================================
+void GpuCulling::init(VkDevice device, MemoryAllocator &allocator, u32 frameCount, size_t maxInstances, bool pass,
+                      VkPipelineCache pipelineCache, const std::string &shaderPath) {
+  this->device = device;
+  this->allocator = &allocator;
+  maxInstances = std::max<size_t>(maxInstances, 1);
+
+  // the vertex shader reads its instances through the visible lists, with or without the pass
+  frames.resize(frameCount);
+  for (Frame &frame : frames)
+    frame.visible.create(allocator, maxInstances * sizeof(u32), VK_BUFFER_USAGE_STORAGE_BUFFER_BIT);
+  if (!pass)
+    return;
+
+  // instances, bounds, draws, visible, params
+  std::array<VkDescriptorSetLayoutBinding, 5> bindings{};
+  for (u32 i = 0; i < bindings.size(); i++) {
+    bindings[i].binding = i;
+    bindings[i].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+    bindings[i].descriptorCount = 1;
+    bindings[i].stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+    bindings[i].pImmutableSamplers = nullptr;
+  }
+
+  VkDescriptorSetLayoutCreateInfo layoutInfo{};
+  layoutInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
+  layoutInfo.bindingCount = (uint32_t)bindings.size();
+  layoutInfo.pBindings = bindings.data();
+
+  if (vkCreateDescriptorSetLayout(device, &layoutInfo, nullptr, &descriptorSetLayout) != VK_SUCCESS)
+    Util::Error("Failed to create culling descriptor set layout");
+
+  VkPipelineLayoutCreateInfo pipelineLayoutInfo{};
+  pipelineLayoutInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
+  pipelineLayoutInfo.setLayoutCount = 1;
+  pipelineLayoutInfo.pSetLayouts = &descriptorSetLayout;
+  pipelineLayoutInfo.pushConstantRangeCount = 0;
+  pipelineLayoutInfo.pPushConstantRanges = nullptr;
+
+  if (vkCreatePipelineLayout(device, &pipelineLayoutInfo, nullptr, &pipelineLayout) != VK_SUCCESS)
+    Util::Error("Failed to create culling pipeline layout");
+
+  std::vector<char> code = Util::readFile(shaderPath);
+
+  VkShaderModuleCreateInfo moduleInfo{};
+  moduleInfo.sType = VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO;
+  moduleInfo.codeSize = code.size();
+  moduleInfo.pCode = reinterpret_cast<const uint32_t *>(code.data());
+
+  VkShaderModule module;
+  if (vkCreateShaderModule(device, &moduleInfo, nullptr, &module) != VK_SUCCESS)
+    Util::Error("Failed to create culling shader module");
+
+  VkComputePipelineCreateInfo pipelineInfo{};
+  pipelineInfo.sType = VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO;
+  pipelineInfo.stage.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+  pipelineInfo.stage.stage = VK_SHADER_STAGE_COMPUTE_BIT;
+  pipelineInfo.stage.module = module;
+  pipelineInfo.stage.pName = "main";
+  pipelineInfo.layout = pipelineLayout;
+
+  VkResult result = vkCreateComputePipelines(device, pipelineCache, 1, &pipelineInfo, nullptr, &pipeline);
+  vkDestroyShaderModule(device, module, nullptr);
+  if (result != VK_SUCCESS)
+    Util::Error("Failed to create culling pipeline");
+
+  VkDescriptorPoolSize poolSize{};
+  poolSize.type = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+  poolSize.descriptorCount = (uint32_t)(bindings.size() * frameCount);
+
+  VkDescriptorPoolCreateInfo poolInfo{};
+  poolInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
+  poolInfo.poolSizeCount = 1;
+  poolInfo.pPoolSizes = &poolSize;
+  poolInfo.maxSets = frameCount;
+
+  if (vkCreateDescriptorPool(device, &poolInfo, nullptr, &descriptorPool) != VK_SUCCESS)
+    Util::Error("Failed to create culling descriptor pool");
+
+  for (Frame &frame : frames) {
+    frame.bounds.create(allocator, maxInstances * sizeof(Bounds), VK_BUFFER_USAGE_STORAGE_BUFFER_BIT);
+    frame.params.create(allocator, sizeof(Params), VK_BUFFER_USAGE_STORAGE_BUFFER_BIT);
+    *static_cast<Params *>(frame.params.mapped) = {};
+
+    VkDescriptorSetAllocateInfo allocInfo{};
+    allocInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+    allocInfo.descriptorPool = descriptorPool;
+    allocInfo.descriptorSetCount = 1;
+    allocInfo.pSetLayouts = &descriptorSetLayout;
+
+    if (vkAllocateDescriptorSets(device, &allocInfo, &frame.descriptorSet) != VK_SUCCESS)
+      Util::Error("Failed to allocate culling descriptor set");
+  }
+}
+
+void GpuCulling::destroy() {
+  if (device == VK_NULL_HANDLE)
+    return;
+
+  for (Frame &frame : frames) {
+    frame.bounds.destroy(*allocator);
+    frame.visible.destroy(*allocator);
+    frame.params.destroy(*allocator);
+  }
+  frames.clear();
+
+  vkDestroyPipeline(device, pipeline, nullptr);
+  vkDestroyPipelineLayout(device, pipelineLayout, nullptr);
+  vkDestroyDescriptorPool(device, descriptorPool, nullptr);
+  vkDestroyDescriptorSetLayout(device, descriptorSetLayout, nullptr);
+  device = VK_NULL_HANDLE;
+}
+
+void GpuCulling::setBuffers(u32 frame, VkBuffer instances, VkBuffer draws) {
+  Frame &f = frames[frame];
+  std::array<VkBuffer, 5> buffers = {instances, f.bounds.buffer, draws, f.visible.buffer, f.params.buffer};
+
+  std::array<VkDescriptorBufferInfo, 5> infos{};
+  std::array<VkWriteDescriptorSet, 5> writes{};
+  for (u32 i = 0; i < buffers.size(); i++) {
+    infos[i].buffer = buffers[i];
+    infos[i].offset = 0;
+    infos[i].range = VK_WHOLE_SIZE;
+
+    writes[i].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+    writes[i].dstSet = f.descriptorSet;
+    writes[i].dstBinding = i;
+    writes[i].dstArrayElement = 0;
+    writes[i].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+    writes[i].descriptorCount = 1;
+    writes[i].pBufferInfo = &infos[i];
+  }
+
+  vkUpdateDescriptorSets(device, (uint32_t)writes.size(), writes.data(), 0, nullptr);
+}
+
+// ====================================================================================================================
+// Per Frame
+// ====================================================================================================================
+GpuCulling::Bounds *GpuCulling::getBounds(u32 frame) { return static_cast<Bounds *>(frames[frame].bounds.mapped); }
+
+const u32 *GpuCulling::getVisible(u32 frame) { return static_cast<const u32 *>(frames[frame].visible.mapped); }
+
+VkBuffer GpuCulling::getVisibleBuffer(u32 frame) { return frames[frame].visible.buffer; }
+
+u32 GpuCulling::getVisibleCount(u32 frame) {
+  return static_cast<const Params *>(frames[frame].params.mapped)->visibleCount;
+}
+
+void GpuCulling::setFrustum(u32 frame, const Math::Frustum &frustum, u32 instanceCount) {
+  Params *params = static_cast<Params *>(frames[frame].params.mapped);
+  for (u32 i = 0; i < 6; i++) {
+    const Math::Plane &plane = frustum.planes[i];
+    params->planes[i][0] = plane.normal.x;
+    params->planes[i][1] = plane.normal.y;
+    params->planes[i][2] = plane.normal.z;
+    params->planes[i][3] = plane.d;
+  }
+  params->instanceCount = instanceCount;
+  params->visibleCount = 0;
+}
+
+void GpuCulling::record(VkCommandBuffer commandBuffer, u32 frame, u32 instanceCount) {
+  Frame &f = frames[frame];
+  if (instanceCount == 0)
+    return;
+
+  vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, pipeline);
+  vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, pipelineLayout, 0, 1, &f.descriptorSet, 0,
+                          nullptr);
+  vkCmdDispatch(commandBuffer, (instanceCount + GROUP_SIZE - 1) / GROUP_SIZE, 1, 1);
+
+  // instance counts feed the indirect draws, the visible list feeds the vertex shader (and host readback)
+  VkMemoryBarrier barrier{};
+  barrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+  barrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+  barrier.dstAccessMask = VK_ACCESS_INDIRECT_COMMAND_READ_BIT | VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_HOST_READ_BIT;
+
+  vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+                       VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT | VK_PIPELINE_STAGE_VERTEX_SHADER_BIT |
+                           VK_PIPELINE_STAGE_HOST_BIT,
+                       0, 1, &barrier, 0, nullptr, 0, nullptr);
+}
+
+void GpuCulling::writeIdentity(u32 frame, u32 instanceCount) {
+  u32 *visible = static_cast<u32 *>(frames[frame].visible.mapped);
+  for (u32 i = 0; i < instanceCount; i++)
+    visible[i] = i;
+  if (frames[frame].params.mapped)
+    static_cast<Params *>(frames[frame].params.mapped)->visibleCount = instanceCount;
+}
+
+// ====================================================================================================================
+// Reference
+// ====================================================================================================================
+void GpuCulling::cullReference(const Bounds *bounds, const InstanceData *instances, size_t count,
+                               const Math::Frustum &frustum, std::vector<u32> &visible) {
+  // same steps as cull.comp: bounds to world space (center and projected extents), then the positive vertex test
+  for (size_t i = 0; i < count; i++) {
+    const Bounds &b = bounds[i];
+    Math::AABB local({b.min[0], b.min[1], b.min[2]}, {b.max[0], b.max[1], b.max[2]});
+
+    if (frustum.intersects(local.transform(instances[i].model)))
+      visible.push_back((u32)i);
+  }
+}
+
+} // namespace Renderer
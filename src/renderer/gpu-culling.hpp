@@ -0,0 +1,155 @@
+/**
+ * @file gpu-culling.hpp
+ *
+ * @brief header file for GPU frustum culling
+ *
+ * @details A compute pass that tests every instance's bounds against the
+ *          camera frustum and builds the draws from what's left: each
+ *          visible instance bumps its draw's instanceCount in the indirect
+ *          buffer and writes its index into the draw's range of the visible
+ *          list, which the vertex shader reads its instance through. The
+ *          host writes the draws with instanceCount 0, the pass fills them
+ *          in, so drawing needs no readback.
+ *
+ *          cullReference runs the same test on the CPU so results can be
+ *          compared (see cull-check.cpp), it needs only a compute queue and
+ *          runs on software implementations like lavapipe.
+ */
+
+#pragma once
+
+#include <vulkan/vulkan.h>
+
+#include "../math/bounds.hpp"
+#include "../math/matrix.hpp"
+#include "../util/defines.hpp"
+#include "memory-allocator.hpp"
+
+#include <string>
+#include <vector>
+
+namespace Renderer {
+
+/**
+ * @brief Per object data read by the blinn vertex shader and the culling pass (std430)
+ */
+struct InstanceData {
+  alignas(16) Math::Matrix4 model;
+  // inverse transpose of the model view matrix, a mat3 padded to a mat4
+  alignas(16) Math::Matrix4 normal;
+  // slot in the texture table, 0 is the default texture (untextured)
+  alignas(16) u32 texture;
+  u32 padding[3];
+};
+
+/**
+ * @brief Host visible, host coherent buffer that stays mapped for its whole life
+ */
+struct MappedBuffer {
+  VkBuffer buffer = VK_NULL_HANDLE;
+  Allocation memory;
+  void *mapped = nullptr;
+
+  void create(MemoryAllocator &allocator, VkDeviceSize size, VkBufferUsageFlags usage);
+  void destroy(MemoryAllocator &allocator);
+};
+
+class GpuCulling {
+public:
+  /**
+   * @brief Mesh space bounds of an instance and the draw it belongs to (std430)
+   */
+  struct Bounds {
+    f32 min[3];
+    u32 draw;
+    f32 max[3];
+    u32 padding;
+  };
+
+  GpuCulling() = default;
+  GpuCulling(const GpuCulling &other) = delete;
+  GpuCulling &operator=(const GpuCulling &other) = delete;
+
+  /**
+   * @brief Create each frame's visible list, and the pass itself (pipeline, bounds and descriptor sets) when pass is
+   *        set. Without it only writeIdentity fills the lists
+   */
+  void init(VkDevice device, MemoryAllocator &allocator, u32 frames, size_t maxInstances, bool pass = true,
+            VkPipelineCache pipelineCache = VK_NULL_HANDLE,
+            const std::string &shaderPath = "src/shaders/cull-compute.spv");
+  void destroy();
+
+  /**
+   * @brief Point a frame at the instance data it reads and the indirect draws it fills in
+   */
+  void setBuffers(u32 frame, VkBuffer instances, VkBuffer draws);
+
+  /**
+   * @brief Bounds of every instance, written by the host before recording
+   */
+  Bounds *getBounds(u32 frame);
+
+  /**
+   * @brief Instance indices grouped by draw, compacted to the front of each draw's range
+   */
+  const u32 *getVisible(u32 frame);
+  VkBuffer getVisibleBuffer(u32 frame);
+
+  /**
+   * @brief Instances the frame's last pass kept, valid once its commands completed
+   */
+  u32 getVisibleCount(u32 frame);
+
+  /**
+   * @brief Write the frustum the frame's pass tests against
+   *
+   * @details Goes through memory rather than the command buffer so recorded
+   *          passes can be submitted again. Resets the frame's visible count,
+   *          so read it before.
+   */
+  void setFrustum(u32 frame, const Math::Frustum &frustum, u32 instanceCount);
+
+  /**
+   * @brief Record the culling dispatch and the barrier that makes its output visible to drawing
+   *
+   * @details Must be outside a render pass. The commands only depend on the
+   *          instance count, the frustum is read from what setFrustum wrote.
+   */
+  void record(VkCommandBuffer commandBuffer, u32 frame, u32 instanceCount);
+
+  /**
+   * @brief Fill the visible list with every instance, for frames drawn without the pass
+   */
+  void writeIdentity(u32 frame, u32 instanceCount);
+
+  /**
+   * @brief The pass's test on the CPU, appends the indices of the visible instances
+   */
+  static void cullReference(const Bounds *bounds, const InstanceData *instances, size_t count,
+                            const Math::Frustum &frustum, std::vector<u32> &visible);
+
+private:
+  // matches Params in cull.comp (std430)
+  struct Params {
+    f32 planes[6][4];
+    u32 instanceCount;
+    u32 visibleCount;
+  };
+
+  struct Frame {
+    MappedBuffer bounds;
+    MappedBuffer visible;
+    MappedBuffer params;
+    VkDescriptorSet descriptorSet = VK_NULL_HANDLE;
+  };
+
+  VkDevice device = VK_NULL_HANDLE;
+  MemoryAllocator *allocator = nullptr;
+  VkDescriptorSetLayout descriptorSetLayout = VK_NULL_HANDLE;
+  VkDescriptorPool descriptorPool = VK_NULL_HANDLE;
+  VkPipelineLayout pipelineLayout = VK_NULL_HANDLE;
+  VkPipeline pipeline = VK_NULL_HANDLE;
+  std::vector<Frame> frames;
+};
+
+} // namespace Renderer
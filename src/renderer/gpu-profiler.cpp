@@ -0,0 +1,256 @@
+/**
+ * @file gpu-profiler.cpp
+ */
+
+#include "gpu-profiler.hpp"
+#include "../util/util.hpp"
+
+#include <algorithm>
+#include <fstream>
+#include <iostream>
+
+namespace Renderer {
+
+namespace {
+const VkQueryPipelineStatisticFlags STATISTIC_FLAGS = VK_QUERY_PIPELINE_STATISTIC_INPUT_ASSEMBLY_VERTICES_BIT |
+                                                      VK_QUERY_PIPELINE_STATISTIC_INPUT_ASSEMBLY_PRIMITIVES_BIT |
+                                                      VK_QUERY_PIPELINE_STATISTIC_VERTEX_SHADER_INVOCATIONS_BIT |
+                                                      VK_QUERY_PIPELINE_STATISTIC_CLIPPING_PRIMITIVES_BIT |
+                                                      VK_QUERY_PIPELINE_STATISTIC_FRAGMENT_SHADER_INVOCATIONS_BIT;
+} // namespace
+
+// ====================================================================================================================
+// Setup
+// ====================================================================================================================
+void GpuProfiler::init(VkPhysicalDevice physicalDevice, VkDevice device, u32 queueFamily, u32 frames,
+                       bool pipelineStatistics) {
+  this->device = device;
+  this->frames = frames;
+  pending.assign(frames, false);
+
+  VkPhysicalDeviceProperties properties;
+  vkGetPhysicalDeviceProperties(physicalDevice, &properties);
+
+  u32 familyCount = 0;
+  vkGetPhysicalDeviceQueueFamilyProperties(physicalDevice, &familyCount, nullptr);
+  std::vector<VkQueueFamilyProperties> families(familyCount);
+  vkGetPhysicalDeviceQueueFamilyProperties(physicalDevice, &familyCount, families.data());
+  u32 validBits = queueFamily < familyCount ? families[queueFamily].timestampValidBits : 0;
+
+  if (validBits > 0 && properties.limits.timestampPeriod > 0.0f) {
+    timestampPeriod = properties.limits.timestampPeriod;
+    timestampMask = validBits >= 64 ? ~0ull : (1ull << validBits) - 1;
+
+    VkQueryPoolCreateInfo poolInfo{};
+    poolInfo.sType = VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO;
+    poolInfo.queryType = VK_QUERY_TYPE_TIMESTAMP;
+    poolInfo.queryCount = frames * SCOPE_COUNT * 2;
+    if (vkCreateQueryPool(device, &poolInfo, nullptr, &timestampPool) != VK_SUCCESS)
+      Util::Error("Failed to create timestamp query pool");
+  }
+
+  if (pipelineStatistics) {
+    VkQueryPoolCreateInfo poolInfo{};
+    poolInfo.sType = VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO;
+    poolInfo.queryType = VK_QUERY_TYPE_PIPELINE_STATISTICS;
+    poolInfo.queryCount = frames;
+    poolInfo.pipelineStatistics = STATISTIC_FLAGS;
+    if (vkCreateQueryPool(device, &poolInfo, nullptr, &statisticsPool) != VK_SUCCESS)
+      Util::Error("Failed to create pipeline statistics query pool");
+  }
+
+  std::cout << "GPU profiling: " << (hasTimestamps() ? "timestamps" : "no timestamps") << ", "
+            << (hasPipelineStatistics() ? "pipeline statistics" : "no pipeline statistics") << "\n";
+}
+
+void GpuProfiler::destroy() {
+  if (timestampPool != VK_NULL_HANDLE)
+    vkDestroyQueryPool(device, timestampPool, nullptr);
+  if (statisticsPool != VK_NULL_HANDLE)
+    vkDestroyQueryPool(device, statisticsPool, nullptr);
+  timestampPool = VK_NULL_HANDLE;
+  statisticsPool = VK_NULL_HANDLE;
+}
+
+bool GpuProfiler::hasTimestamps() const { return timestampPool != VK_NULL_HANDLE; }
+
+bool GpuProfiler::hasPipelineStatistics() const { return statisticsPool != VK_NULL_HANDLE; }
+
+VkQueryPipelineStatisticFlags GpuProfiler::getStatisticFlags() const {
+  return hasPipelineStatistics() ? STATISTIC_FLAGS : 0;
+}
+
+// ====================================================================================================================
+// Recording
+// ====================================================================================================================
+u32 GpuProfiler::getQuery(u32 frame, Scope scope, bool end) const {
+  return (frame * SCOPE_COUNT + scope) * 2 + (end ? 1 : 0);
+}
+
+void GpuProfiler::reset(VkCommandBuffer commandBuffer, u32 frame) {
+  if (hasTimestamps())
+    vkCmdResetQueryPool(commandBuffer, timestampPool, getQuery(frame, FRAME, false), SCOPE_COUNT * 2);
+  if (hasPipelineStatistics())
+    vkCmdResetQueryPool(commandBuffer, statisticsPool, frame, 1);
+}
+
+void GpuProfiler::begin(VkCommandBuffer commandBuffer, u32 frame, Scope scope) {
+  if (hasTimestamps())
+    vkCmdWriteTimestamp(commandBuffer, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, timestampPool,
+                        getQuery(frame, scope, false));
+}
+
+void GpuProfiler::end(VkCommandBuffer commandBuffer, u32 frame, Scope scope) {
+  if (hasTimestamps())
+    vkCmdWriteTimestamp(commandBuffer, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, timestampPool,
+                        getQuery(frame, scope, true));
+}
+
+void GpuProfiler::beginStatistics(VkCommandBuffer commandBuffer, u32 frame) {
+  if (hasPipelineStatistics())
+    vkCmdBeginQuery(commandBuffer, statisticsPool, frame, 0);
+}
+
+void GpuProfiler::endStatistics(VkCommandBuffer commandBuffer, u32 frame) {
+  if (hasPipelineStatistics())
+    vkCmdEndQuery(commandBuffer, statisticsPool, frame);
+}
+
+// ====================================================================================================================
+// Results
+// ====================================================================================================================
+void GpuProfiler::submitted(u32 frame) {
+  if (frame < pending.size())
+    pending[frame] = true;
+}
+
+void GpuProfiler::collect(u32 frame) {
+  if (frame >= pending.size() || !pending[frame])
+    return;
+  pending[frame] = false;
+
+  // each result is followed by its availability, nothing waits
+  const VkQueryResultFlags flags = VK_QUERY_RESULT_64_BIT | VK_QUERY_RESULT_WITH_AVAILABILITY_BIT;
+
+  if (hasTimestamps()) {
+    std::array<u64, SCOPE_COUNT * 2 * 2> results{};
+    vkGetQueryPoolResults(device, timestampPool, getQuery(frame, FRAME, false), SCOPE_COUNT * 2, sizeof(results),
+                          results.data(), sizeof(u64) * 2, flags);
+
+    for (u32 scope = 0; scope < SCOPE_COUNT; scope++) {
+      const u64 *begin = &results[scope * 4];
+      const u64 *end = &results[scope * 4 + 2];
+      if (!begin[1] || !end[1])
+        continue;
+
+      u64 ticks = ((end[0] & timestampMask) - (begin[0] & timestampMask)) & timestampMask;
+      scopes[scope].add((f64)ticks * timestampPeriod / 1e6);
+    }
+  }
+
+  if (hasPipelineStatistics()) {
+    std::array<u64, STATISTIC_COUNT + 1> results{};
+    vkGetQueryPoolResults(device, statisticsPool, frame, 1, sizeof(results), results.data(), sizeof(results), flags);
+
+    if (results[STATISTIC_COUNT])
+      for (u32 statistic = 0; statistic < STATISTIC_COUNT; statistic++)
+        statistics[statistic].add((f64)results[statistic]);
+  }
+}
+
+void GpuProfiler::Rolling::add(f64 value) {
+  samples[next] = value;
+  next = (next + 1) % WINDOW;
+  count = std::min(count + 1, WINDOW);
+}
+
+f64 GpuProfiler::Rolling::average() const {
+  f64 sum = 0.0;
+  for (u32 i = 0; i < count; i++)
+    sum += samples[i];
+  return count > 0 ? sum / count : 0.0;
+}
+
+f64 GpuProfiler::Rolling::min() const {
+  return count > 0 ? *std::min_element(samples.begin(), samples.begin() + count) : 0.0;
+}
+
+f64 GpuProfiler::Rolling::max() const {
+  return count > 0 ? *std::max_element(samples.begin(), samples.begin() + count) : 0.0;
+}
+
+f64 GpuProfiler::getAverageMs(Scope scope) const { return scopes[scope].average(); }
+
+f64 GpuProfiler::getAverageStatistic(Statistic statistic) const { return statistics[statistic].average(); }
+
+// ====================================================================================================================
+// Reports
+// ====================================================================================================================
+const char *GpuProfiler::getScopeName(Scope scope) {
+  switch (scope) {
+  case FRAME:
+    return "frame";
+  case CULLING:
+    return "culling";
+  case SKY_BOX:
+    return "sky box";
+  case BLINN:
+    return "blinn";
+  default:
+    return "?";
+  }
+}
+
+const char *GpuProfiler::getStatisticName(Statistic statistic) {
+  switch (statistic) {
+  case INPUT_VERTICES:
+    return "input vertices";
+  case INPUT_PRIMITIVES:
+    return "input primitives";
+  case VERTEX_INVOCATIONS:
+    return "vertex invocations";
+  case CLIPPING_PRIMITIVES:
+    return "clipped primitives";
+  case FRAGMENT_INVOCATIONS:
+    return "fragment invocations";
+  default:
+    return "?";
+  }
+}
+
+void GpuProfiler::print(std::ostream &out) const {
+  if (hasTimestamps()) {
+    out << "GPU time (average of the last " << scopes[FRAME].count << " frames):";
+    for (u32 scope = 0; scope < SCOPE_COUNT; scope++)
+      if (scopes[scope].count > 0)
+        out << " " << getScopeName((Scope)scope) << " " << scopes[scope].average() << " ms";
+    out << "\n";
+  }
+  if (hasPipelineStatistics() && statistics[0].count > 0) {
+    out << "Pipeline statistics per frame:";
+    for (u32 statistic = 0; statistic < STATISTIC_COUNT; statistic++)
+      out << (statistic > 0 ? ", " : " ") << (u64)statistics[statistic].average() << " "
+          << getStatisticName((Statistic)statistic);
+    out << "\n";
+  }
+}
+
+void GpuProfiler::exportCSV(const std::string &path) const {
+  std::ofstream file(path);
+  if (!file) {
+    std::cout << "GPU profile: failed to write " << path << "\n";
+    return;
+  }
+
+  file << "name,average,min,max,samples\n";
+  auto row = [&](const std::string &name, const Rolling &rolling) {
+    file << name << "," << rolling.average() << "," << rolling.min() << "," << rolling.max() << "," << rolling.count
+         << "\n";
+  };
+  for (u32 scope = 0; scope < SCOPE_COUNT; scope++)
+    row(std::string(getScopeName((Scope)scope)) + " ms", scopes[scope]);
+  for (u32 statistic = 0; statistic < STATISTIC_COUNT; statistic++)
+    row(getStatisticName((Statistic)statistic), statistics[statistic]);
+}
+
+} // namespace Renderer
@@ -0,0 +1,141 @@
+/**
+ * @file gpu-profiler.hpp
+ *
+ * @brief header file for GPU timestamp and pipeline statistics queries
+ *
+ * @details Each frame in flight has its own range of timestamp queries, a
+ *          begin and end per scope, and one pipeline statistics query around
+ *          the render pass. The queries are reset and written by the frame's
+ *          own command buffers, so cached command buffers can be submitted
+ *          again as they are.
+ *
+ *          Results are read after the frame's fence signaled, when the frame
+ *          slot comes around again (framesInFlight frames later), and only if
+ *          available, so reading never stalls. Scopes a frame didn't write
+ *          (culling when it's off) stay unavailable and are skipped.
+ *
+ *          Timestamps inside a render pass only bracket when the GPU started
+ *          and finished the commands between them, work of neighbouring scopes
+ *          may overlap, so the scope times are a guide rather than exact.
+ */
+
+#pragma once
+
+#include <vulkan/vulkan.h>
+
+#include "../util/defines.hpp"
+
+#include <array>
+#include <ostream>
+#include <string>
+#include <vector>
+
+namespace Renderer {
+
+class GpuProfiler {
+public:
+  // new passes get a scope here and a name in getScopeName
+  enum Scope : u32 { FRAME, CULLING, SKY_BOX, BLINN, SCOPE_COUNT };
+
+  // counters of the pipeline statistics query, in the order results come back
+  enum Statistic : u32 {
+    INPUT_VERTICES,
+    INPUT_PRIMITIVES,
+    VERTEX_INVOCATIONS,
+    CLIPPING_PRIMITIVES,
+    FRAGMENT_INVOCATIONS,
+    STATISTIC_COUNT
+  };
+
+  // frames the rolling averages cover
+  static constexpr u32 WINDOW = 64;
+
+  GpuProfiler() = default;
+  GpuProfiler(const GpuProfiler &other) = delete;
+  GpuProfiler &operator=(const GpuProfiler &other) = delete;
+
+  /**
+   * @param queueFamily family the frames are submitted to, timestamps need its timestampValidBits
+   * @param pipelineStatistics the device has pipelineStatisticsQuery and inheritedQueries enabled
+   */
+  void init(VkPhysicalDevice physicalDevice, VkDevice device, u32 queueFamily, u32 frames, bool pipelineStatistics);
+  void destroy();
+
+  bool hasTimestamps() const;
+  bool hasPipelineStatistics() const;
+  /**
+   * @brief For the inheritance info of secondaries executed while the statistics query is active
+   */
+  VkQueryPipelineStatisticFlags getStatisticFlags() const;
+
+  /**
+   * @brief Reset the frame's queries, first thing in its primary command buffer (outside a render pass)
+   */
+  void reset(VkCommandBuffer commandBuffer, u32 frame);
+  void begin(VkCommandBuffer commandBuffer, u32 frame, Scope scope);
+  void end(VkCommandBuffer commandBuffer, u32 frame, Scope scope);
+  /**
+   * @brief Around a render pass, in the primary command buffer
+   */
+  void beginStatistics(VkCommandBuffer commandBuffer, u32 frame);
+  void endStatistics(VkCommandBuffer commandBuffer, u32 frame);
+
+  /**
+   * @brief The frame's commands with the queries were submitted
+   */
+  void submitted(u32 frame);
+  /**
+   * @brief Add the frame's results to the averages, call after its fence signaled and before recording it again
+   */
+  void collect(u32 frame);
+
+  /**
+   * @brief Rolling average of a scope in milliseconds, 0 before it has results
+   */
+  f64 getAverageMs(Scope scope) const;
+  f64 getAverageStatistic(Statistic statistic) const;
+
+  void print(std::ostream &out) const;
+  /**
+   * @brief Write the averages as CSV (name, average, min, max, samples), times in milliseconds
+   */
+  void exportCSV(const std::string &path) const;
+
+  static const char *getScopeName(Scope scope);
+  static const char *getStatisticName(Statistic statistic);
+
+private:
+  /**
+   * @brief The last WINDOW samples of one value
+   */
+  struct Rolling {
+    std::array<f64, WINDOW> samples{};
+    u32 count = 0;
+    u32 next = 0;
+
+    void add(f64 value);
+    f64 average() const;
+    f64 min() const;
+    f64 max() const;
+  };
+
+  u32 getQuery(u32 frame, Scope scope, bool end) const;
+
+  VkDevice device = VK_NULL_HANDLE;
+  u32 frames = 0;
+
+  VkQueryPool timestampPool = VK_NULL_HANDLE;
+  // nanoseconds per tick, and the bits a timestamp holds
+  f64 timestampPeriod = 1.0;
+  u64 timestampMask = ~0ull;
+
+  VkQueryPool statisticsPool = VK_NULL_HANDLE;
+
+  // the frame slot has submitted queries that weren't collected yet
+  std::vector<bool> pending;
+
+  std::array<Rolling, SCOPE_COUNT> scopes;
+  std::array<Rolling, STATISTIC_COUNT> statistics;
+};
+
+} // namespace Renderer
@@ -1,13 +1,16 @@
 #pragma once
 
+#include <atomic>
+
 namespace Renderer {
 
-#define DEFINED_KEYS_COUNT 6
-enum Keys { KEY_W = 0, KEY_A, KEY_S, KEY_D, KEY_C, KEY_R };
+#define DEFINED_KEYS_COUNT 9
+enum Keys { KEY_W = 0, KEY_A, KEY_S, KEY_D, KEY_C, KEY_R, KEY_E, KEY_X, KEY_P };
 
 class Input {
 private:
-  bool keys[DEFINED_KEYS_COUNT]{false};
+  // written by the window thread, read by the simulation
+  std::atomic<bool> keys[DEFINED_KEYS_COUNT]{};
 
 public:
   Input() = default;
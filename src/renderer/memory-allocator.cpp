@@ -0,0 +1,327 @@
+/**
+ * @file memory-allocator.cpp
+ */
+
+#include "memory-allocator.hpp"
+#include "../util/util.hpp"
+
+#include <algorithm>
+#include <iostream>
+
+namespace Renderer {
+
+namespace {
+VkDeviceSize alignDown(VkDeviceSize value, VkDeviceSize alignment) { return value / alignment * alignment; }
+
+VkDeviceSize alignUp(VkDeviceSize value, VkDeviceSize alignment) {
+  return (value + alignment - 1) / alignment * alignment;
+}
+
+f64 toMiB(u64 bytes) { return bytes / (1024.0 * 1024.0); }
+} // namespace
+
+// ====================================================================================================================
+// Setup
+// ====================================================================================================================
+void MemoryAllocator::init(VkPhysicalDevice physicalDevice, VkDevice device, VkDeviceSize blockSize) {
+  this->physicalDevice = physicalDevice;
+  this->device = device;
+  this->blockSize = blockSize;
+
+  vkGetPhysicalDeviceMemoryProperties(physicalDevice, &memoryProperties);
+
+  VkPhysicalDeviceProperties properties;
+  vkGetPhysicalDeviceProperties(physicalDevice, &properties);
+  nonCoherentAtomSize = std::max<VkDeviceSize>(properties.limits.nonCoherentAtomSize, 1);
+}
+
+void MemoryAllocator::destroy() {
+  if (device == VK_NULL_HANDLE)
+    return;
+
+  for (Block &block : blocks) {
+    if (block.memory == VK_NULL_HANDLE)
+      continue;
+    if (block.ranges.getAllocationCount() > 0)
+      std::cout << "MemoryAllocator: block of memory type " << block.memoryType << " destroyed with "
+                << block.ranges.getAllocationCount() << " allocations left\n";
+    vkFreeMemory(device, block.memory, nullptr);
+  }
+  blocks.clear();
+
+  if (dedicatedCount > 0)
+    std::cout << "MemoryAllocator: " << dedicatedCount << " dedicated allocations were never freed\n";
+  device = VK_NULL_HANDLE;
+}
+
+// ====================================================================================================================
+// Allocation
+// ====================================================================================================================
+Allocation MemoryAllocator::allocate(const VkMemoryRequirements &requirements, VkMemoryPropertyFlags properties,
+                                     bool linear) {
+  std::lock_guard<std::mutex> lock(mutex);
+
+  Allocation allocation;
+  allocation.memoryType = findMemoryType(requirements.memoryTypeBits, properties);
+  allocation.coherent = isCoherent(allocation.memoryType);
+
+  // flushes work on whole atoms, so non coherent ranges must not share one with a neighbour
+  VkDeviceSize alignment = requirements.alignment;
+  VkDeviceSize size = requirements.size;
+  if (isHostVisible(allocation.memoryType) && !allocation.coherent) {
+    alignment = std::max(alignment, nonCoherentAtomSize);
+    size = alignUp(size, nonCoherentAtomSize);
+  }
+
+  VkDeviceSize typeBlockSize = getBlockSize(allocation.memoryType);
+  if (size >= typeBlockSize / 2) {
+    void *mapped = nullptr;
+    allocation.memory = allocateMemory(size, allocation.memoryType, &mapped);
+    allocation.size = size;
+    allocation.mapped = mapped;
+    dedicatedCount++;
+    dedicatedBytes += size;
+    return allocation;
+  }
+
+  Util::TlsfAllocator::Range range;
+  u32 found = Allocation::DEDICATED;
+  for (u32 i = 0; i < blocks.size() && found == Allocation::DEDICATED; i++) {
+    Block &block = blocks[i];
+    if (block.memory != VK_NULL_HANDLE && block.memoryType == allocation.memoryType && block.linear == linear &&
+        block.ranges.allocate(size, alignment, range))
+      found = i;
+  }
+
+  if (found == Allocation::DEDICATED) {
+    found = createBlock(allocation.memoryType, linear);
+    if (!blocks[found].ranges.allocate(size, alignment, range))
+      Util::Error("MemoryAllocator: allocation doesn't fit in a new block");
+  }
+
+  const Block &block = blocks[found];
+  allocation.memory = block.memory;
+  allocation.offset = range.offset;
+  allocation.size = range.size;
+  allocation.block = found;
+  if (block.mapped)
+    allocation.mapped = static_cast<char *>(block.mapped) + range.offset;
+  return allocation;
+}
+
+void MemoryAllocator::free(Allocation &allocation) {
+  if (allocation.memory == VK_NULL_HANDLE)
+    return;
+
+  std::lock_guard<std::mutex> lock(mutex);
+  if (allocation.block == Allocation::DEDICATED) {
+    vkFreeMemory(device, allocation.memory, nullptr);
+    dedicatedCount--;
+    dedicatedBytes -= allocation.size;
+  } else {
+    blocks[allocation.block].ranges.free(allocation.offset);
+  }
+
+  allocation = {};
+}
+
+void MemoryAllocator::createBuffer(VkDeviceSize size, VkBufferUsageFlags usage, VkMemoryPropertyFlags properties,
+                                   VkBuffer &buffer, Allocation &allocation, const std::vector<u32> &queueFamilies) {
+  VkBufferCreateInfo bufferInfo{};
+  bufferInfo.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
+  bufferInfo.size = size;
+  bufferInfo.usage = usage;
+  bufferInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+  if (queueFamilies.size() > 1) {
+    bufferInfo.sharingMode = VK_SHARING_MODE_CONCURRENT;
+    bufferInfo.queueFamilyIndexCount = (u32)queueFamilies.size();
+    bufferInfo.pQueueFamilyIndices = queueFamilies.data();
+  }
+
+  if (vkCreateBuffer(device, &bufferInfo, nullptr, &buffer) != VK_SUCCESS)
+    Util::Error("Failed to create buffer");
+
+  VkMemoryRequirements requirements;
+  vkGetBufferMemoryRequirements(device, buffer, &requirements);
+
+  allocation = allocate(requirements, properties, true);
+  vkBindBufferMemory(device, buffer, allocation.memory, allocation.offset);
+}
+
+void MemoryAllocator::destroyBuffer(VkBuffer &buffer, Allocation &allocation) {
+  vkDestroyBuffer(device, buffer, nullptr);
+  buffer = VK_NULL_HANDLE;
+  free(allocation);
+}
+
+void MemoryAllocator::createImage(const VkImageCreateInfo &imageInfo, VkMemoryPropertyFlags properties,
+                                  VkImage &image, Allocation &allocation) {
+  if (vkCreateImage(device, &imageInfo, nullptr, &image) != VK_SUCCESS)
+    Util::Error("Failed to create image");
+
+  VkMemoryRequirements requirements;
+  vkGetImageMemoryRequirements(device, image, &requirements);
+
+  allocation = allocate(requirements, properties, imageInfo.tiling == VK_IMAGE_TILING_LINEAR);
+  vkBindImageMemory(device, image, allocation.memory, allocation.offset);
+}
+
+void MemoryAllocator::destroyImage(VkImage &image, Allocation &allocation) {
+  vkDestroyImage(device, image, nullptr);
+  image = VK_NULL_HANDLE;
+  free(allocation);
+}
+
+void MemoryAllocator::flush(const Allocation &allocation, VkDeviceSize offset, VkDeviceSize size) {
+  if (allocation.coherent || allocation.memory == VK_NULL_HANDLE)
+    return;
+
+  // the allocation starts and ends on an atom (see allocate), so widening the range stays inside it
+  VkDeviceSize end = size == VK_WHOLE_SIZE ? allocation.size : std::min(offset + size, allocation.size);
+  VkDeviceSize begin = alignDown(offset, nonCoherentAtomSize);
+  end = std::min(alignUp(end, nonCoherentAtomSize), allocation.size);
+  if (end <= begin)
+    return;
+
+  VkMappedMemoryRange range{};
+  range.sType = VK_STRUCTURE_TYPE_MAPPED_MEMORY_RANGE;
+  range.memory = allocation.memory;
+  range.offset = allocation.offset + begin;
+  range.size = end - begin;
+
+  vkFlushMappedMemoryRanges(device, 1, &range);
+}
+
+u32 MemoryAllocator::releaseEmptyBlocks() {
+  std::lock_guard<std::mutex> lock(mutex);
+
+  u32 released = 0;
+  for (u32 i = 0; i < blocks.size(); i++) {
+    Block &block = blocks[i];
+    if (block.memory == VK_NULL_HANDLE || block.ranges.getAllocationCount() > 0)
+      continue;
+
+    // keep the empty block when it's the pool's only one, short lived allocations would recreate it right away
+    bool others = false;
+    for (u32 k = 0; k < blocks.size() && !others; k++)
+      others = k != i && blocks[k].memory != VK_NULL_HANDLE && blocks[k].memoryType == block.memoryType &&
+               blocks[k].linear == block.linear;
+    if (!others)
+      continue;
+
+    vkFreeMemory(device, block.memory, nullptr);
+    block.memory = VK_NULL_HANDLE;
+    block.mapped = nullptr;
+    block.ranges.reset(0);
+    released++;
+  }
+
+  while (!blocks.empty() && blocks.back().memory == VK_NULL_HANDLE)
+    blocks.pop_back();
+  return released;
+}
+
+// ====================================================================================================================
+// Memory Types
+// ====================================================================================================================
+u32 MemoryAllocator::findMemoryType(u32 typeFilter, VkMemoryPropertyFlags properties) const {
+  for (u32 i = 0; i < memoryProperties.memoryTypeCount; i++) {
+    if ((typeFilter & (1 << i)) && (memoryProperties.memoryTypes[i].propertyFlags & properties) == properties)
+      return i;
+  }
+
+  Util::Error("Failed to find suitable memory type");
+  return 0;
+}
+
+VkDeviceSize MemoryAllocator::getBlockSize(u32 memoryType) const {
+  // small heaps (like the host visible window into device memory) get smaller blocks
+  VkDeviceSize heapSize = memoryProperties.memoryHeaps[memoryProperties.memoryTypes[memoryType].heapIndex].size;
+  return std::min(blockSize, std::max<VkDeviceSize>(heapSize / 8, 1 << 20));
+}
+
+bool MemoryAllocator::isHostVisible(u32 memoryType) const {
+  return memoryProperties.memoryTypes[memoryType].propertyFlags & VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT;
+}
+
+bool MemoryAllocator::isCoherent(u32 memoryType) const {
+  return memoryProperties.memoryTypes[memoryType].propertyFlags & VK_MEMORY_PROPERTY_HOST_COHERENT_BIT;
+}
+
+VkDeviceMemory MemoryAllocator::allocateMemory(VkDeviceSize size, u32 memoryType, void **mapped) {
+  VkMemoryAllocateInfo allocInfo{};
+  allocInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
+  allocInfo.allocationSize = size;
+  allocInfo.memoryTypeIndex = memoryType;
+
+  VkDeviceMemory memory;
+  if (vkAllocateMemory(device, &allocInfo, nullptr, &memory) != VK_SUCCESS)
+    Util::Error("Failed to allocate device memory");
+
+  *mapped = nullptr;
+  if (isHostVisible(memoryType) && vkMapMemory(device, memory, 0, VK_WHOLE_SIZE, 0, mapped) != VK_SUCCESS)
+    Util::Error("Failed to map device memory");
+
+  return memory;
+}
+
+u32 MemoryAllocator::createBlock(u32 memoryType, bool linear) {
+  u32 index = (u32)blocks.size();
+  for (u32 i = 0; i < blocks.size(); i++) {
+    if (blocks[i].memory == VK_NULL_HANDLE) {
+      index = i;
+      break;
+    }
+  }
+  if (index == blocks.size())
+    blocks.emplace_back();
+
+  VkDeviceSize size = getBlockSize(memoryType);
+  Block &block = blocks[index];
+  block.memory = allocateMemory(size, memoryType, &block.mapped);
+  block.ranges.reset(size);
+  block.memoryType = memoryType;
+  block.linear = linear;
+  return index;
+}
+
+// ====================================================================================================================
+// Stats
+// ====================================================================================================================
+MemoryStats MemoryAllocator::getStats() const {
+  std::lock_guard<std::mutex> lock(mutex);
+
+  MemoryStats stats;
+  stats.dedicated = dedicatedCount;
+  stats.allocations = dedicatedCount;
+  stats.reservedBytes = dedicatedBytes;
+  stats.usedBytes = dedicatedBytes;
+
+  u64 largestFreeTotal = 0;
+  for (const Block &block : blocks) {
+    if (block.memory == VK_NULL_HANDLE)
+      continue;
+
+    stats.blocks++;
+    stats.allocations += block.ranges.getAllocationCount();
+    stats.reservedBytes += block.ranges.getCapacity();
+    stats.usedBytes += block.ranges.getUsed();
+    stats.freeBytes += block.ranges.getCapacity() - block.ranges.getUsed();
+    stats.freeRanges += block.ranges.getFreeRangeCount();
+    largestFreeTotal += block.ranges.getLargestFree();
+  }
+
+  if (stats.freeBytes > 0)
+    stats.fragmentation = 1.0 - (f64)largestFreeTotal / stats.freeBytes;
+  return stats;
+}
+
+void MemoryAllocator::printStats() const {
+  MemoryStats stats = getStats();
+  std::cout << "Device memory: " << stats.allocations << " allocations in " << stats.blocks << " blocks + "
+            << stats.dedicated << " dedicated, " << toMiB(stats.usedBytes) << " MiB used of "
+            << toMiB(stats.reservedBytes) << " MiB, " << toMiB(stats.freeBytes) << " MiB free in " << stats.freeRanges
+            << " ranges (fragmentation " << stats.fragmentation << ")\n";
+}
+
+} // namespace Renderer
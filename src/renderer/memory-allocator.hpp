@@ -0,0 +1,145 @@
+/**
+ * @file memory-allocator.hpp
+ *
+ * @brief header file for the device memory allocator
+ *
+ * @details Resources get ranges of large blocks of device memory instead of
+ *          a vkAllocateMemory each, which stays far from
+ *          maxMemoryAllocationCount and lets freed ranges be reused. Blocks
+ *          are kept per memory type and split into buffers (and linear
+ *          images) and optimal images, so bufferImageGranularity never has
+ *          to be considered. Ranges are handed out with a TLSF allocator.
+ *
+ *          Resources of half a block or more get their own vkAllocateMemory.
+ *          Host visible blocks are mapped once for their whole life, so
+ *          allocations in them come with a pointer and never map themselves.
+ */
+
+#pragma once
+
+#include <vulkan/vulkan.h>
+
+#include "../util/defines.hpp"
+#include "../util/tlsf-allocator.hpp"
+
+#include <cstdint>
+#include <mutex>
+#include <vector>
+
+namespace Renderer {
+
+/**
+ * @brief A range of device memory a resource is bound to
+ */
+struct Allocation {
+  static constexpr u32 DEDICATED = UINT32_MAX;
+
+  VkDeviceMemory memory = VK_NULL_HANDLE;
+  VkDeviceSize offset = 0;
+  VkDeviceSize size = 0;
+  // host visible allocations stay mapped, this points at offset
+  void *mapped = nullptr;
+  u32 memoryType = 0;
+  // block the range is in, DEDICATED when the allocation owns memory
+  u32 block = DEDICATED;
+  // flushes can be skipped
+  bool coherent = false;
+};
+
+struct MemoryStats {
+  u64 blocks = 0;
+  u64 dedicated = 0;
+  u64 allocations = 0;
+  // memory held from the device (blocks and dedicated allocations)
+  u64 reservedBytes = 0;
+  u64 usedBytes = 0;
+  u64 freeBytes = 0;
+  u64 freeRanges = 0;
+  // 0 when each block's free space is one range, towards 1 as it's scattered in small pieces
+  f64 fragmentation = 0;
+};
+
+class MemoryAllocator {
+public:
+  MemoryAllocator() = default;
+  MemoryAllocator(const MemoryAllocator &other) = delete;
+  MemoryAllocator &operator=(const MemoryAllocator &other) = delete;
+
+  void init(VkPhysicalDevice physicalDevice, VkDevice device, VkDeviceSize blockSize = 64ull << 20);
+  /**
+   * @brief Give every block back to the device, everything allocated must be freed by now
+   */
+  void destroy();
+
+  /**
+   * @param linear buffers and linear images, false for optimal tiling images
+   */
+  Allocation allocate(const VkMemoryRequirements &requirements, VkMemoryPropertyFlags properties, bool linear);
+  void free(Allocation &allocation);
+
+  /**
+   * @brief Create a buffer and bind it to new memory, concurrent across queueFamilies when there are more than one
+   */
+  void createBuffer(VkDeviceSize size, VkBufferUsageFlags usage, VkMemoryPropertyFlags properties, VkBuffer &buffer,
+                    Allocation &allocation, const std::vector<u32> &queueFamilies = {});
+  void destroyBuffer(VkBuffer &buffer, Allocation &allocation);
+
+  /**
+   * @brief Create an image and bind it to new memory
+   */
+  void createImage(const VkImageCreateInfo &imageInfo, VkMemoryPropertyFlags properties, VkImage &image,
+                   Allocation &allocation);
+  void destroyImage(VkImage &image, Allocation &allocation);
+
+  /**
+   * @brief Make host writes to [offset, offset + size) of the allocation visible, no-op for coherent memory
+   */
+  void flush(const Allocation &allocation, VkDeviceSize offset = 0, VkDeviceSize size = VK_WHOLE_SIZE);
+
+  /**
+   * @brief Give blocks with nothing left in them back to the device, keeps one per pool
+   *
+   * @details Resources are never moved (their handles are baked into
+   *          descriptor sets and recorded commands), so this is the part of
+   *          defragmenting that is free: the TLSF allocator already merges
+   *          neighbouring free ranges, empty blocks are what's left over.
+   *
+   * @return blocks released
+   */
+  u32 releaseEmptyBlocks();
+
+  MemoryStats getStats() const;
+  void printStats() const;
+
+private:
+  struct Block {
+    VkDeviceMemory memory = VK_NULL_HANDLE;
+    void *mapped = nullptr;
+    Util::TlsfAllocator ranges;
+    u32 memoryType = 0;
+    bool linear = true;
+  };
+
+  u32 findMemoryType(u32 typeFilter, VkMemoryPropertyFlags properties) const;
+  VkDeviceSize getBlockSize(u32 memoryType) const;
+  bool isHostVisible(u32 memoryType) const;
+  bool isCoherent(u32 memoryType) const;
+
+  VkDeviceMemory allocateMemory(VkDeviceSize size, u32 memoryType, void **mapped);
+  u32 createBlock(u32 memoryType, bool linear);
+
+  VkPhysicalDevice physicalDevice = VK_NULL_HANDLE;
+  VkDevice device = VK_NULL_HANDLE;
+  VkPhysicalDeviceMemoryProperties memoryProperties{};
+  VkDeviceSize blockSize = 0;
+  VkDeviceSize nonCoherentAtomSize = 1;
+
+  // freed blocks leave an empty slot (memory == VK_NULL_HANDLE) so indices in allocations stay valid
+  std::vector<Block> blocks;
+  u64 dedicatedCount = 0;
+  u64 dedicatedBytes = 0;
+
+  mutable std::mutex mutex;
+};
+
+} // namespace Renderer
@@ -0,0 +1,165 @@
+/**
+ * @file pipeline-cache.cpp
+ */
+
+#include "pipeline-cache.hpp"
+#include "../util/util.hpp"
+
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <vector>
+
+namespace Renderer {
+
+namespace {
+u64 checksum(const char *data, size_t size) {
+  // FNV-1a
+  u64 hash = 14695981039346656037ull;
+  for (size_t i = 0; i < size; i++) {
+    hash ^= (unsigned char)data[i];
+    hash *= 1099511628211ull;
+  }
+  return hash;
+}
+} // namespace
+
+// ====================================================================================================================
+// Setup
+// ====================================================================================================================
+void PipelineCache::init(VkPhysicalDevice physicalDevice, VkDevice device, const std::string &path) {
+  this->device = device;
+  this->path = path;
+  vkGetPhysicalDeviceProperties(physicalDevice, &properties);
+
+  std::string data;
+  loadedSize = 0;
+  if (!path.empty() && readFile(data))
+    loadedSize = data.size();
+
+  VkPipelineCacheCreateInfo cacheInfo{};
+  cacheInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_CACHE_CREATE_INFO;
+  cacheInfo.initialDataSize = loadedSize;
+  cacheInfo.pInitialData = loadedSize > 0 ? data.data() : nullptr;
+
+  if (vkCreatePipelineCache(device, &cacheInfo, nullptr, &cache) != VK_SUCCESS) {
+    // drivers may still refuse data that passed the checks, start over without it
+    loadedSize = 0;
+    cacheInfo.initialDataSize = 0;
+    cacheInfo.pInitialData = nullptr;
+    if (vkCreatePipelineCache(device, &cacheInfo, nullptr, &cache) != VK_SUCCESS)
+      Util::Error("Failed to create pipeline cache");
+  }
+  storedSize = loadedSize;
+}
+
+void PipelineCache::destroy() {
+  if (device == VK_NULL_HANDLE)
+    return;
+
+  vkDestroyPipelineCache(device, cache, nullptr);
+  cache = VK_NULL_HANDLE;
+  device = VK_NULL_HANDLE;
+}
+
+VkPipelineCache PipelineCache::get() const { return cache; }
+
+bool PipelineCache::isWarm() const { return loadedSize > 0; }
+
+size_t PipelineCache::getLoadedSize() const { return loadedSize; }
+
+// ====================================================================================================================
+// File
+// ====================================================================================================================
+PipelineCache::FileHeader PipelineCache::makeHeader() const {
+  FileHeader header{};
+  header.magic = MAGIC;
+  header.version = VERSION;
+  header.vendorID = properties.vendorID;
+  header.deviceID = properties.deviceID;
+  header.driverVersion = properties.driverVersion;
+  std::memcpy(header.pipelineCacheUUID, properties.pipelineCacheUUID, VK_UUID_SIZE);
+  return header;
+}
+
+bool PipelineCache::readFile(std::string &data) const {
+  std::ifstream file(path, std::ios::binary);
+  if (!file.is_open())
+    return false;
+
+  FileHeader header;
+  if (!file.read(reinterpret_cast<char *>(&header), sizeof(header)))
+    return false;
+
+  FileHeader expected = makeHeader();
+  if (header.magic != expected.magic || header.version != expected.version ||
+      header.vendorID != expected.vendorID || header.deviceID != expected.deviceID ||
+      header.driverVersion != expected.driverVersion ||
+      std::memcmp(header.pipelineCacheUUID, expected.pipelineCacheUUID, VK_UUID_SIZE) != 0) {
+    std::cout << "Pipeline cache: " << path << " was written by another device or driver, ignoring it\n";
+    return false;
+  }
+
+  // caches are a few MiB at most, anything far bigger is a broken header
+  if (header.dataSize > (256ull << 20)) {
+    std::cout << "Pipeline cache: " << path << " is damaged, ignoring it\n";
+    return false;
+  }
+
+  data.resize(header.dataSize);
+  if (!file.read(data.data(), (std::streamsize)data.size()) || checksum(data.data(), data.size()) != header.checksum) {
+    std::cout << "Pipeline cache: " << path << " is damaged, ignoring it\n";
+    return false;
+  }
+
+  // the driver's own header leads the data, it has to agree too
+  VkPipelineCacheHeaderVersionOne driverHeader;
+  if (data.size() < sizeof(driverHeader))
+    return false;
+  std::memcpy(&driverHeader, data.data(), sizeof(driverHeader));
+  return driverHeader.headerVersion == VK_PIPELINE_CACHE_HEADER_VERSION_ONE &&
+         driverHeader.vendorID == properties.vendorID && driverHeader.deviceID == properties.deviceID &&
+         std::memcmp(driverHeader.pipelineCacheUUID, properties.pipelineCacheUUID, VK_UUID_SIZE) == 0;
+}
+
+void PipelineCache::save() {
+  if (path.empty() || cache == VK_NULL_HANDLE)
+    return;
+
+  size_t size = 0;
+  if (vkGetPipelineCacheData(device, cache, &size, nullptr) != VK_SUCCESS || size == 0)
+    return;
+  // the cache only ever grows, the same size means nothing new was compiled
+  if (size == storedSize)
+    return;
+
+  std::vector<char> data(size);
+  if (vkGetPipelineCacheData(device, cache, &size, data.data()) != VK_SUCCESS)
+    return;
+
+  FileHeader header = makeHeader();
+  header.dataSize = size;
+  header.checksum = checksum(data.data(), size);
+
+  // write next to the real file and swap it in, so a crash mid write never leaves a half file behind
+  std::string tempPath = path + ".tmp";
+  {
+    std::ofstream file(tempPath, std::ios::binary | std::ios::trunc);
+    if (!file.is_open() || !file.write(reinterpret_cast<const char *>(&header), sizeof(header)) ||
+        !file.write(data.data(), (std::streamsize)size)) {
+      std::cout << "Pipeline cache: failed to write " << tempPath << "\n";
+      return;
+    }
+  }
+
+  std::error_code error;
+  std::filesystem::rename(tempPath, path, error);
+  if (error) {
+    std::cout << "Pipeline cache: failed to replace " << path << ": " << error.message() << "\n";
+    return;
+  }
+  storedSize = size;
+}
+
+} // namespace Renderer
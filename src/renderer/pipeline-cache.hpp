@@ -0,0 +1,80 @@
+/**
+ * @file pipeline-cache.hpp
+ *
+ * @brief header file for the pipeline cache kept on disk
+ *
+ * @details Wraps a VkPipelineCache that is filled from a file at startup and
+ *          written back when pipeline creation added to it, so a second run
+ *          skips most of the driver's shader compilation.
+ *
+ *          The file starts with its own header: the vendor, device, driver
+ *          version and pipelineCacheUUID of the GPU that wrote it, the size of
+ *          the data and a checksum. Data from another GPU or driver, or a
+ *          truncated file, is thrown away and the cache starts empty. The
+ *          driver's own header inside the data is checked as well.
+ */
+
+#pragma once
+
+#include <vulkan/vulkan.h>
+
+#include "../util/defines.hpp"
+
+#include <cstdint>
+#include <string>
+
+namespace Renderer {
+
+class PipelineCache {
+public:
+  PipelineCache() = default;
+  PipelineCache(const PipelineCache &other) = delete;
+  PipelineCache &operator=(const PipelineCache &other) = delete;
+
+  /**
+   * @param path file to load from and save to, empty keeps the cache in memory only
+   */
+  void init(VkPhysicalDevice physicalDevice, VkDevice device, const std::string &path);
+  void destroy();
+
+  /**
+   * @brief Write the cache to its file if it holds more than what was loaded
+   */
+  void save();
+
+  VkPipelineCache get() const;
+
+  /**
+   * @brief The file matched this device and its data was used
+   */
+  bool isWarm() const;
+  size_t getLoadedSize() const;
+
+private:
+  struct FileHeader {
+    u32 magic;
+    u32 version;
+    u32 vendorID;
+    u32 deviceID;
+    u32 driverVersion;
+    uint8_t pipelineCacheUUID[VK_UUID_SIZE];
+    u64 dataSize;
+    u64 checksum;
+  };
+
+  static constexpr u32 MAGIC = 0x48435050; // "PPCH"
+  static constexpr u32 VERSION = 1;
+
+  FileHeader makeHeader() const;
+  bool readFile(std::string &data) const;
+
+  VkDevice device = VK_NULL_HANDLE;
+  VkPhysicalDeviceProperties properties{};
+  VkPipelineCache cache = VK_NULL_HANDLE;
+  std::string path;
+  size_t loadedSize = 0;
+  // what the file holds now, loaded or saved
+  size_t storedSize = 0;
+};
+
+} // namespace Renderer
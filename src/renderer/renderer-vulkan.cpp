@@ -4,21 +4,36 @@
 
 #include "renderer-vulkan.hpp"
 #include "../util/defines.hpp"
+#include "../threads/threads.hpp"
+#include "../util/profiler.hpp"
 #include "../util/util.hpp"
 
 #include <GLFW/glfw3.h>
 #include <vulkan/vulkan_core.h>
 
 #include <algorithm>
+#include <array>
+#include <chrono>
 #include <cmath>
 #include <cstdint>
 #include <cstring>
 #include <iostream>
 #include <limits>
 #include <set>
+#include <unordered_set>
 
 namespace Renderer {
 
+namespace {
+// room left in the mesh buffers for meshes spawned at runtime (at least as much again as the scene starts with)
+const u64 SPARE_VERTICES = 1 << 19;
+const u64 SPARE_INDICES = 1 << 20;
+// fewer draws than this are recorded on the calling thread, a task costs more than it saves
+const size_t MIN_DRAWS_PER_SECONDARY = 512;
+// texture table size cap, also bounded by the device's descriptor limits
+const u32 MAX_TEXTURES = 4096;
+} // namespace
+
 RendererVulkan::RendererVulkan(uint32_t width, uint32_t height) {
   WIDTH = width;
   HEIGHT = height;
@@ -34,27 +49,30 @@ RendererVulkan::~RendererVulkan() {
 
   cleanSwapchain();
 
-  for (size_t i = 0; i < textureSampler.size(); i++) {
-    vkDestroySampler(device, textureSampler[i], nullptr);
-    vkDestroyImageView(device, textureImageView[i], nullptr);
-
-    vkDestroyImage(device, textureImage[i], nullptr);
-    vkFreeMemory(device, textureImageMemory[i], nullptr);
-  }
+  vkDestroySampler(device, textureSampler, nullptr);
 
   vkDestroySampler(device, cubemapSampler, nullptr);
   vkDestroyImageView(device, cubemapImageView, nullptr);
   vkDestroyImage(device, cubemapImage, nullptr);
-  vkFreeMemory(device, cubemapImageMemory, nullptr);
+  allocator.free(cubemapImageMemory);
 
-  for (int i = 0; i < MAX_FRAMES_IN_FLIGHT; i++) {
+  for (u32 i = 0; i < framesInFlight; i++) {
     vkDestroyBuffer(device, blinn.uniformBuffers[i], nullptr);
-    vkFreeMemory(device, blinn.uniformBuffersMemory[i], nullptr);
+    allocator.free(blinn.uniformBuffersMemory[i]);
+
+    vkDestroyBuffer(device, instanceBuffers[i], nullptr);
+    allocator.free(instanceBuffersMemory[i]);
+
+    vkDestroyBuffer(device, indirectBuffers[i], nullptr);
+    allocator.free(indirectBuffersMemory[i]);
 
     vkDestroyBuffer(device, environmentMap.uniformBuffers[i], nullptr);
-    vkFreeMemory(device, environmentMap.uniformBuffersMemory[i], nullptr);
+    allocator.free(environmentMap.uniformBuffersMemory[i]);
   }
 
+  culling.destroy();
+  profiler.destroy();
+
   vkDestroyDescriptorPool(device, blinn.descriptorPool, nullptr);
   vkDestroyDescriptorSetLayout(device, blinn.descriptorSetLayout, nullptr);
 
@@ -62,21 +80,24 @@ RendererVulkan::~RendererVulkan() {
   vkDestroyDescriptorSetLayout(device, environmentMap.descriptorSetLayout, nullptr);
 
   vkDestroyBuffer(device, indexBuffer, nullptr);
-  vkFreeMemory(device, indexMemory, nullptr);
+  allocator.free(indexMemory);
 
   vkDestroyBuffer(device, meshBuffer, nullptr);
-  vkFreeMemory(device, meshMemory, nullptr);
+  allocator.free(meshMemory);
 
   vkDestroyBuffer(device, envBuffer, nullptr);
-  vkFreeMemory(device, envMemory, nullptr);
+  allocator.free(envMemory);
 
-  for (int i = 0; i < MAX_FRAMES_IN_FLIGHT; i++) {
+  for (u32 i = 0; i < framesInFlight; i++) {
     vkDestroySemaphore(device, imageAvailableSem[i], nullptr);
     vkDestroySemaphore(device, renderFinishedSem[i], nullptr);
     vkDestroyFence(device, inFlightFence[i], nullptr);
   }
 
   vkDestroyCommandPool(device, commandPool, nullptr);
+  for (auto &contexts : recordingContexts)
+    for (RecordingContext &context : contexts)
+      vkDestroyCommandPool(device, context.pool, nullptr);
 
   vkDestroyPipeline(device, blinn.pipeline, nullptr);
   vkDestroyPipelineLayout(device, blinn.pipelineLayout, nullptr);
@@ -86,18 +107,30 @@ RendererVulkan::~RendererVulkan() {
 
   vkDestroyRenderPass(device, colorAndDepthRenderPass, nullptr);
 
+  pipelineCache.destroy();
+  staging.destroy();
+  textureStreamer.destroy();
+  allocator.destroy();
+
   vkDestroyDevice(device, nullptr);
-  vkDestroySurfaceKHR(instance, surface, nullptr);
+  if (!config.headless)
+    vkDestroySurfaceKHR(instance, surface, nullptr);
   vkDestroyInstance(instance, nullptr);
 
-  glfwDestroyWindow(window);
+  if (window)
+    glfwDestroyWindow(window);
   glfwTerminate();
 }
 
 // ====================================================================================================================
 //     Initialization
 // ====================================================================================================================
-void RendererVulkan::init(GLFWwindow *window, uint32_t width, uint32_t height) {
+void RendererVulkan::init(GLFWwindow *window, uint32_t width, uint32_t height, RendererConfig config) {
+  this->config = config;
+  framesInFlight = std::clamp(config.framesInFlight, 1u, MAX_FRAMES_IN_FLIGHT);
+  if (framesInFlight != config.framesInFlight)
+    std::cout << "Frames in flight must be 1 to " << MAX_FRAMES_IN_FLIGHT << ", using " << framesInFlight << "\n";
+
   if (enableValidationLayers && !checkValidationLayerSupport())
     Util::Error("Validation layers requested, but failed to get");
 
@@ -116,114 +149,192 @@ void RendererVulkan::init(GLFWwindow *window, uint32_t width, uint32_t height) {
 
   initializeVulkan();
   minUniformSize = getMinUniformBufferOffsetAlignment();
+
+  // culled draws get their instance counts from the GPU, so they have to be indirect
+  if (this->config.gpuCulling && drawPath == DrawPath::DIRECT) {
+    std::cout << "GPU culling needs drawIndirectFirstInstance, culling is off\n";
+    this->config.gpuCulling = false;
+  }
 }
 
 void RendererVulkan::initializeVulkan() {
   createInstance();
-  createSurface();
+  if (!config.headless)
+    createSurface();
   pickPhysicalDevice();
   createDevice();
-  createSwapchain();
+  allocator.init(physicalDevice, device);
+  staging.init(device, allocator, queueFamily.graphics.value(), graphicsQueue,
+               queueFamily.transfer.value_or(queueFamily.graphics.value()), transferQueue);
+  textureStreamer.init(device, allocator, staging, framesInFlight, config.textureStreaming);
+  pipelineCache.init(physicalDevice, device, config.pipelineCachePath);
+  if (config.gpuProfiling)
+    profiler.init(physicalDevice, device, queueFamily.graphics.value(), framesInFlight, pipelineStatistics);
+  if (config.headless)
+    createOffscreenImages();
+  else
+    createSwapchain();
   createImageViews();
   createRenderPass();
   createCommandPool();
   createCommandBuffer();
+  createRecordingContexts();
   createDepthResources();
   createFrameBuffers();
   createSyncObjects();
 }
 
 void RendererVulkan::createAssets(Game::Scene *scene) {
+  PROFILE_FUNCTION();
   this->scene = scene;
 
   createVertexBuffer(environmentMapVertices, sizeof(environmentMapVertices), envBuffer, envMemory);
 
-  unsigned char *data[6];
-  int32_t width, height, channels;
-
-  Util::loadImage(scene->envMapImagePaths[0], data[0], width, height, channels);
-  Util::loadImage(scene->envMapImagePaths[1], data[1], width, height, channels);
-  Util::loadImage(scene->envMapImagePaths[2], data[2], width, height, channels);
-  Util::loadImage(scene->envMapImagePaths[3], data[3], width, height, channels);
-  Util::loadImage(scene->envMapImagePaths[4], data[4], width, height, channels);
-  Util::loadImage(scene->envMapImagePaths[5], data[5], width, height, channels);
-
-  createTextureImage((void **)data, width, height, cubemapImage, cubemapImageMemory, 6,
-                     VK_IMAGE_CREATE_CUBE_COMPATIBLE_BIT);
-  createTextureImageView(cubemapImage, VK_IMAGE_VIEW_TYPE_CUBE, cubemapImageView, 6);
-  createTextureSampler(cubemapSampler);
+  // a cubemap file keeps its format (decoded when the device can't sample it) and levels, six images and package
+  // faces are RGBA8
+  std::shared_ptr<const Util::TextureFile> cubemap = scene->loadEnvironmentTexture();
+  skyBox = scene->hasEnvironment();
+  if (cubemap && !canSample(cubemap->format))
+    cubemap = std::make_shared<const Util::TextureFile>(Util::decompressTexture(*cubemap));
+
+  u32 cubemapLevels = 1;
+  bool cubemapSrgb = true;
+  if (cubemap) {
+    std::vector<const void *> data;
+    for (u32 face = 0; face < 6; face++)
+      for (u32 level = 0; level < cubemap->levels; level++)
+        data.push_back(cubemap->getLevel(face, level));
+
+    cubemapFormat = cubemap->format;
+    cubemapLevels = cubemap->levels;
+    cubemapSrgb = cubemap->srgb;
+    cubemapBytes = cubemap->data.size();
+    cubemapUncompressedBytes = cubemap->getUncompressedSize();
+    createTextureImage(data.data(), cubemap->width, cubemap->height, cubemapFormat, cubemapSrgb, cubemapLevels,
+                       cubemapImage, cubemapImageMemory, 6, VK_IMAGE_CREATE_CUBE_COMPATIBLE_BIT);
+  } else if (skyBox) {
+    // scene packages hold their faces as pixels, borrowed from the mapping
+    const unsigned char *faces[6];
+    int32_t width, height;
+    scene->loadEnvironmentMap(faces, width, height);
+
+    const void *data[6];
+    std::copy(std::begin(faces), std::end(faces), data);
+    cubemapBytes = cubemapUncompressedBytes = (u64)width * height * 4 * 6;
+    createTextureImage(data, (uint32_t)width, (uint32_t)height, Util::TextureFormat::RGBA8, true, 1, cubemapImage,
+                       cubemapImageMemory, 6, VK_IMAGE_CREATE_CUBE_COMPATIBLE_BIT);
+  } else {
+    // no sky box is drawn, a black texel keeps its descriptor sets valid
+    const uint8_t black[4] = {0, 0, 0, 255};
+    const void *data[6] = {black, black, black, black, black, black};
+    cubemapBytes = cubemapUncompressedBytes = sizeof(black) * 6;
+    createTextureImage(data, 1, 1, Util::TextureFormat::RGBA8, true, 1, cubemapImage, cubemapImageMemory, 6,
+                       VK_IMAGE_CREATE_CUBE_COMPATIBLE_BIT);
+  }
+  createTextureImageView(cubemapImage, VK_IMAGE_VIEW_TYPE_CUBE, cubemapImageView, 6,
+                         TextureStreamer::getFormat(cubemapFormat, cubemapSrgb), cubemapLevels);
+  createTextureSampler(cubemapSampler, (f32)(cubemapLevels - 1));
 
-  OBJECT_COUNT = scene->objects.size();
-  blinnUBO.resize(OBJECT_COUNT);
+  OBJECT_COUNT = scene->getCapacity();
+  blinnUBO.resize(1);
   environmentMapUBO.resize(1);
 
   // Combine all data into one big buffer.
   // This provides good data locality.
-  size_t vertexDataSize = 0;
-  size_t indexDataSize = 0;
-  uint32_t offsetCount = 0;
-  int32_t vertexCount = 0;
+  // Objects sharing a mesh share its data, and the buffers get room for meshes spawned later
+  // so they never have to be reallocated.
   std::vector<Mesh::Vertex> vertexData;
   std::vector<u32> indexData;
+  std::vector<std::shared_ptr<const Mesh::Mesh>> meshes;
+  std::unordered_set<const Mesh::Mesh *> seen;
 
   for (auto &obj : scene->objects) {
-    auto v = obj.getMesh().getVertexData();
-    auto i = obj.getMesh().getIndices();
+    const auto &mesh = obj.getSharedMesh();
+    if (!seen.insert(mesh.get()).second)
+      continue;
 
-    vertexData.insert(vertexData.end(), v.begin(), v.end());
-    indexData.insert(indexData.end(), i.begin(), i.end());
+    meshes.push_back(mesh);
+    vertexData.insert(vertexData.end(), mesh->getVertexData().begin(), mesh->getVertexData().end());
+    indexData.insert(indexData.end(), mesh->getIndices().begin(), mesh->getIndices().end());
+  }
 
-    vertexDataSize += obj.getMesh().getVertexDataSize();
-    indexDataSize += obj.getMesh().getIndexDataSize();
+  const u64 vertexCapacity = vertexData.size() + std::max<u64>(vertexData.size(), SPARE_VERTICES);
+  const u64 indexCapacity = indexData.size() + std::max<u64>(indexData.size(), SPARE_INDICES);
+  vertexAllocator.reset(vertexCapacity);
+  indexAllocator.reset(indexCapacity);
 
-    indexOffsets.push_back(offsetCount);
-    indexCount.push_back((uint32_t)obj.getMesh().getVertexCount());
-    offsetCount += (uint32_t)obj.getMesh().getVertexCount();
+  createBuffer(vertexCapacity * sizeof(Mesh::Vertex),
+               VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_VERTEX_BUFFER_BIT,
+               VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, meshBuffer, meshMemory);
+  createBuffer(indexCapacity * sizeof(u32), VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_INDEX_BUFFER_BIT,
+               VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, indexBuffer, indexMemory);
 
-    vertexOffsets.push_back(vertexCount);
-    vertexCount += (int32_t)v.size();
+  // the allocators are empty, so the initial meshes are packed in the order they were combined
+  for (const auto &mesh : meshes) {
+    MeshAllocation &allocation = residentMeshes[mesh.get()];
+    allocation.mesh = mesh;
+    vertexAllocator.allocate(mesh->getVertexData().size(), allocation.vertices);
+    indexAllocator.allocate(mesh->getIndices().size(), allocation.indices);
   }
 
-  createVertexBuffer(vertexData.data(), vertexDataSize, meshBuffer, meshMemory);
-  createIndexBuffer(indexData.data(), indexDataSize);
-
-  // upload textures for objects
-  size_t textureCount = scene->getTextureCount();
+  if (!vertexData.empty()) {
+    uploadToBuffer(vertexData.data(), vertexData.size() * sizeof(Mesh::Vertex), meshBuffer, 0);
+    uploadToBuffer(indexData.data(), indexData.size() * sizeof(u32), indexBuffer, 0);
+  }
 
-  if (textureCount == 0) {
-    textureCount = 1;
-    textureImage.resize(textureCount);
-    textureImageMemory.resize(textureCount);
-    textureImageView.resize(textureCount);
-    textureSampler.resize(textureCount);
+  // upload textures for objects, objects sharing pixels share a slot in the texture table
+  // slot 0 is a default texture for untextured objects (and any that don't fit the table)
+  // every texture gets a full mip chain, only the levels the screen needs are kept on the GPU
+  // DDS/KTX2 textures bring their chain, in a format the device may not sample
+  createTextureSampler(textureSampler, VK_LOD_CLAMP_NONE);
+  textureStreamer.add(DEFAULT_IMAGE, 1, 1);
 
-    void *p[1] = {DEFAULT_IMAGE};
-    createTextureImage(p, 1, 1, textureImage[0], textureImageMemory[0], 1, 0);
-    createTextureImageView(textureImage[0], VK_IMAGE_VIEW_TYPE_2D, textureImageView[0], 1);
-    createTextureSampler(textureSampler[0]);
-  } else {
-    textureImage.resize(textureCount);
-    textureImageMemory.resize(textureCount);
-    textureImageView.resize(textureCount);
-    textureSampler.resize(textureCount);
-
-    size_t i = 0;
-    for (auto &obj : scene->objects) {
-      if (obj.hasTexture()) {
-        auto t = obj.getTextureData();
-        void *p[1] = {t.pixels};
-        createTextureImage(p, t.width, t.height, textureImage[i], textureImageMemory[i], 1, 0);
-        createTextureImageView(textureImage[i], VK_IMAGE_VIEW_TYPE_2D, textureImageView[i], 1);
-        createTextureSampler(textureSampler[i]);
-      }
-      i++;
+  textureSlots.clear();
+  for (auto &obj : scene->objects) {
+    if (!obj.hasTexture())
+      continue;
+
+    const auto &t = obj.getTextureData();
+    if (textureSlots.count(t.getKey()))
+      continue;
+    if (textureStreamer.getCount() == maxTextures) {
+      std::cerr << "Texture table is full (" << maxTextures << " textures), the rest use the default texture\n";
+      break;
     }
+
+    u32 slot = t.file ? textureStreamer.add(t.file, !canSample(t.file->format))
+                      : textureStreamer.add(t.pixels, (u32)t.width, (u32)t.height);
+    textureSlots.emplace(t.getKey(), slot);
   }
+
+  // the uploads run while the pipelines are built, the first frame is submitted after them on the same queue
+  staging.submit();
+  allocator.releaseEmptyBlocks();
 }
 
 void RendererVulkan::createPipelines() {
-  createEnvironmentMapPipeline();
-  createBlinnPipeline(scene->objects.size());
+  PROFILE_FUNCTION();
+  auto start = std::chrono::steady_clock::now();
+
+  // the graphics pipelines compile on the workers while their buffers and descriptor sets are set up here
+  PipelineBuilds builds;
+  try {
+    createEnvironmentMapPipeline(builds);
+    createBlinnPipeline(OBJECT_COUNT, builds);
+  } catch (...) {
+    // the builds still reference the pipelines and the group
+    Threads::ThreadPool::global().wait(builds.group);
+    throw;
+  }
+  Threads::ThreadPool::global().wait(builds.group);
+  if (builds.error)
+    std::rethrow_exception(builds.error);
+
+  pipelineCount = builds.count;
+  pipelineMs = std::chrono::duration<f64, std::milli>(std::chrono::steady_clock::now() - start).count();
+  pipelineCache.save();
+
+  invalidateCommands();
 }
 
 void RendererVulkan::createInstance() {
@@ -235,13 +346,24 @@ void RendererVulkan::createInstance() {
   appInfo.engineVersion = VK_MAKE_VERSION(1, 0, 0);
   appInfo.apiVersion = VK_API_VERSION_1_0;
 
+  // timeline semaphores (for the transfer queue) are core in 1.2, ask for it when the loader knows it
+  auto enumerateInstanceVersion =
+      (PFN_vkEnumerateInstanceVersion)vkGetInstanceProcAddr(nullptr, "vkEnumerateInstanceVersion");
+  uint32_t loaderVersion = VK_API_VERSION_1_0;
+  if (enumerateInstanceVersion && enumerateInstanceVersion(&loaderVersion) == VK_SUCCESS &&
+      loaderVersion >= VK_API_VERSION_1_2)
+    appInfo.apiVersion = VK_API_VERSION_1_2;
+  instanceVersion = appInfo.apiVersion;
+
   VkInstanceCreateInfo createInfo{};
   createInfo.sType = VK_STRUCTURE_TYPE_INSTANCE_CREATE_INFO;
   createInfo.pApplicationInfo = &appInfo;
 
+  // surface extensions for the window, none headless
   uint32_t glfwExtensionCount = 0;
-  const char **glfwExtensions;
-  glfwExtensions = glfwGetRequiredInstanceExtensions(&glfwExtensionCount);
+  const char **glfwExtensions = nullptr;
+  if (!config.headless)
+    glfwExtensions = glfwGetRequiredInstanceExtensions(&glfwExtensionCount);
 
   createInfo.enabledExtensionCount = glfwExtensionCount;
   createInfo.ppEnabledExtensionNames = glfwExtensions;
@@ -291,7 +413,51 @@ void RendererVulkan::createDevice() {
   queueFamily = setupQueueFamilies(physicalDevice);
 
   std::vector<VkDeviceQueueCreateInfo> queueCreateInfos;
+  VkPhysicalDeviceProperties properties;
+  vkGetPhysicalDeviceProperties(physicalDevice, &properties);
+
+  std::vector<const char *> extensions = config.headless ? std::vector<const char *>{} : deviceExtensions;
+
+  // descriptor indexing is core in 1.2, 1.1 devices may have it as an extension
+  bool indexingExtension = false;
+  if (properties.apiVersion < VK_API_VERSION_1_2) {
+    uint32_t extensionCount = 0;
+    vkEnumerateDeviceExtensionProperties(physicalDevice, nullptr, &extensionCount, nullptr);
+    std::vector<VkExtensionProperties> availableExtensions(extensionCount);
+    vkEnumerateDeviceExtensionProperties(physicalDevice, nullptr, &extensionCount, availableExtensions.data());
+    for (const auto &available : availableExtensions)
+      if (strcmp(available.extensionName, VK_EXT_DESCRIPTOR_INDEXING_EXTENSION_NAME) == 0)
+        indexingExtension = true;
+  }
+
+  // the transfer queue hands batches to the graphics queue with timeline semaphores,
+  // the bindless texture table needs descriptor indexing
+  VkPhysicalDeviceTimelineSemaphoreFeatures timelineFeatures{};
+  timelineFeatures.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_TIMELINE_SEMAPHORE_FEATURES;
+  VkPhysicalDeviceDescriptorIndexingFeatures indexingFeatures{};
+  indexingFeatures.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_DESCRIPTOR_INDEXING_FEATURES;
+  if (instanceVersion >= VK_API_VERSION_1_2 && properties.apiVersion >= VK_API_VERSION_1_1) {
+    VkPhysicalDeviceFeatures2 features2{};
+    features2.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2;
+    if (properties.apiVersion >= VK_API_VERSION_1_2) {
+      features2.pNext = &timelineFeatures;
+      timelineFeatures.pNext = &indexingFeatures;
+    } else if (indexingExtension) {
+      features2.pNext = &indexingFeatures;
+    }
+    vkGetPhysicalDeviceFeatures2(physicalDevice, &features2);
+  }
+
+  if (!config.transferQueue || !timelineFeatures.timelineSemaphore)
+    queueFamily.transfer.reset();
+  if (queueFamily.transfer.has_value())
+    std::cout << "Upload queue: transfer (family " << queueFamily.transfer.value() << ")\n";
+  else
+    std::cout << "Upload queue: graphics\n";
+
   std::set<uint32_t> unique = {queueFamily.graphics.value(), queueFamily.present.value()};
+  if (queueFamily.transfer.has_value())
+    unique.insert(queueFamily.transfer.value());
   float priority = 1.0f;
 
   for (const auto &family : unique) {
@@ -303,16 +469,102 @@ void RendererVulkan::createDevice() {
     queueCreateInfos.push_back(queueCreateInfo);
   }
 
+  VkPhysicalDeviceFeatures supportedFeatures;
+  vkGetPhysicalDeviceFeatures(physicalDevice, &supportedFeatures);
+
   VkPhysicalDeviceFeatures deviceFeatures{};
   deviceFeatures.samplerAnisotropy = VK_TRUE;
 
+  // indirect draws are optional, see DrawPath
+  deviceFeatures.drawIndirectFirstInstance = supportedFeatures.drawIndirectFirstInstance;
+  deviceFeatures.multiDrawIndirect = supportedFeatures.multiDrawIndirect;
+
+  if (supportedFeatures.drawIndirectFirstInstance)
+    drawPath = supportedFeatures.multiDrawIndirect ? DrawPath::MULTI_DRAW_INDIRECT : DrawPath::INDIRECT;
+
+  maxDrawIndirectCount = std::max(properties.limits.maxDrawIndirectCount, 1u);
+
+  const char *pathNames[] = {"direct", "indirect", "multi draw indirect"};
+  std::cout << "Draw submission: " << pathNames[(int)drawPath] << "\n";
+
+  // texture table, only the parts of descriptor indexing it uses are enabled
+  VkPhysicalDeviceDescriptorIndexingFeatures enabledIndexing{};
+  enabledIndexing.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_DESCRIPTOR_INDEXING_FEATURES;
+  deviceFeatures.shaderSampledImageArrayDynamicIndexing = supportedFeatures.shaderSampledImageArrayDynamicIndexing;
+
+  if (config.bindlessTextures && indexingFeatures.runtimeDescriptorArray &&
+      indexingFeatures.shaderSampledImageArrayNonUniformIndexing) {
+    texturePath = TexturePath::BINDLESS;
+    enabledIndexing.runtimeDescriptorArray = VK_TRUE;
+    enabledIndexing.shaderSampledImageArrayNonUniformIndexing = VK_TRUE;
+    if (indexingExtension)
+      extensions.push_back(VK_EXT_DESCRIPTOR_INDEXING_EXTENSION_NAME);
+  }
+
+  // the table is one combined image sampler binding in the fragment stage
+  const VkPhysicalDeviceLimits &limits = properties.limits;
+  maxTextures = std::min({limits.maxPerStageDescriptorSamplers, limits.maxPerStageDescriptorSampledImages,
+                          limits.maxDescriptorSetSamplers, limits.maxDescriptorSetSampledImages, MAX_TEXTURES});
+  // without dynamic indexing the array can only be indexed with constants, every object gets the default texture
+  if (texturePath == TexturePath::ARRAY && !supportedFeatures.shaderSampledImageArrayDynamicIndexing)
+    maxTextures = 1;
+
+  if (texturePath == TexturePath::BINDLESS)
+    std::cout << "Texture binding: bindless (up to " << maxTextures << " textures)\n";
+  else
+    std::cout << "Texture binding: array, one draw per mesh and texture (up to " << maxTextures << " textures)\n";
+
+  // statistics are queried around the render pass, so the secondaries inside it have to inherit the query
+  pipelineStatistics =
+      config.gpuProfiling && supportedFeatures.pipelineStatisticsQuery && supportedFeatures.inheritedQueries;
+  deviceFeatures.pipelineStatisticsQuery = pipelineStatistics;
+  deviceFeatures.inheritedQueries = pipelineStatistics;
+
+  // block compressed formats the device can sample with linear filtering
+  deviceFeatures.textureCompressionBC = config.textureCompression && supportedFeatures.textureCompressionBC;
+  sampledFormats = 1u << (u32)Util::TextureFormat::RGBA8;
+  std::string compressedNames;
+  for (auto format : {Util::TextureFormat::BC1, Util::TextureFormat::BC3, Util::TextureFormat::BC5,
+                      Util::TextureFormat::BC7}) {
+    if (!deviceFeatures.textureCompressionBC)
+      break;
+
+    const VkFormatFeatureFlags needed = VK_FORMAT_FEATURE_SAMPLED_IMAGE_BIT |
+                                        VK_FORMAT_FEATURE_SAMPLED_IMAGE_FILTER_LINEAR_BIT;
+    bool supported = true;
+    for (bool srgb : {false, true}) {
+      VkFormatProperties formatProperties;
+      vkGetPhysicalDeviceFormatProperties(physicalDevice, TextureStreamer::getFormat(format, srgb), &formatProperties);
+      supported = supported && (formatProperties.optimalTilingFeatures & needed) == needed;
+    }
+    if (supported) {
+      sampledFormats |= 1u << (u32)format;
+      compressedNames += std::string(" ") + Util::getFormatName(format);
+    }
+  }
+
+  if (compressedNames.empty())
+    std::cout << "Texture compression: none, compressed textures are decoded to RGBA8\n";
+  else
+    std::cout << "Texture compression:" << compressedNames << "\n";
+
   VkDeviceCreateInfo createInfo{};
   createInfo.sType = VK_STRUCTURE_TYPE_DEVICE_CREATE_INFO;
   createInfo.pQueueCreateInfos = queueCreateInfos.data();
   createInfo.queueCreateInfoCount = (uint32_t)queueCreateInfos.size();
   createInfo.pEnabledFeatures = &deviceFeatures;
-  createInfo.enabledExtensionCount = (uint32_t)deviceExtensions.size();
-  createInfo.ppEnabledExtensionNames = deviceExtensions.data();
+  void *next = nullptr;
+  if (texturePath == TexturePath::BINDLESS) {
+    enabledIndexing.pNext = next;
+    next = &enabledIndexing;
+  }
+  if (queueFamily.transfer.has_value()) {
+    timelineFeatures.pNext = next;
+    next = &timelineFeatures;
+  }
+  createInfo.pNext = next;
+  createInfo.enabledExtensionCount = (uint32_t)extensions.size();
+  createInfo.ppEnabledExtensionNames = extensions.data();
 
   // for back compatibility
   if (enableValidationLayers) {
@@ -329,12 +581,15 @@ void RendererVulkan::createDevice() {
   vkGetDeviceQueue(device, queueFamily.graphics.value(), 0, &graphicsQueue);
   // get present queue handle
   vkGetDeviceQueue(device, queueFamily.present.value(), 0, &presentQueue);
+  // get transfer queue handle
+  if (queueFamily.transfer.has_value())
+    vkGetDeviceQueue(device, queueFamily.transfer.value(), 0, &transferQueue);
 }
 
 void RendererVulkan::createSwapchain() {
   SwapchainSupportDetails swapchainSupport = querySwapchainSupport(physicalDevice);
   VkSurfaceFormatKHR surfaceFormat = chooseSwapSurfaceFormat(swapchainSupport.formats);
-  VkPresentModeKHR presentMode = chooseSwapPresentMode(swapchainSupport.presentModes);
+  presentMode = chooseSwapPresentMode(swapchainSupport.presentModes);
 
   extent = chooseSwapExtent(swapchainSupport.capabilities);
 
@@ -380,6 +635,20 @@ void RendererVulkan::createSwapchain() {
   swapchainExtent = extent;
 }
 
+void RendererVulkan::createOffscreenImages() {
+  presentMode = VK_PRESENT_MODE_IMMEDIATE_KHR;
+  extent = {WIDTH, HEIGHT};
+  swapchainExtent = extent;
+  swapchainImageFormat = VK_FORMAT_R8G8B8A8_SRGB;
+
+  swapchainImages.resize(framesInFlight);
+  offscreenImagesMemory.resize(framesInFlight);
+  for (u32 i = 0; i < framesInFlight; i++)
+    createImage(extent.width, extent.height, swapchainImageFormat, VK_IMAGE_TILING_OPTIMAL,
+                VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT | VK_IMAGE_USAGE_TRANSFER_SRC_BIT,
+                VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, swapchainImages[i], offscreenImagesMemory[i], 1, 0);
+}
+
 void RendererVulkan::createImageViews() {
   swapchainImageViews.resize(swapchainImages.size());
   for (size_t i = 0; i < swapchainImages.size(); i++)
@@ -396,7 +665,9 @@ void RendererVulkan::createRenderPass() {
   colorAttachment.stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
   colorAttachment.stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
   colorAttachment.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
-  colorAttachment.finalLayout = VK_IMAGE_LAYOUT_PRESENT_SRC_KHR;
+  // offscreen images are only ever copied out of
+  colorAttachment.finalLayout =
+      config.headless ? VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL : VK_IMAGE_LAYOUT_PRESENT_SRC_KHR;
 
   VkAttachmentReference colorAttachmentRef{};
   colorAttachmentRef.attachment = 0;
@@ -473,6 +744,18 @@ void RendererVulkan::createPipeline(Pipeline &pipeline) {
   fragmentShaderStageInfo.module = fragmentShaderModule;
   fragmentShaderStageInfo.pName = "main";
 
+  std::vector<VkSpecializationMapEntry> fragmentEntries(pipeline.fragmentConstants.size());
+  for (size_t i = 0; i < fragmentEntries.size(); i++)
+    fragmentEntries[i] = {(uint32_t)i, (uint32_t)(i * sizeof(u32)), sizeof(u32)};
+
+  VkSpecializationInfo fragmentSpecialization{};
+  fragmentSpecialization.mapEntryCount = (uint32_t)fragmentEntries.size();
+  fragmentSpecialization.pMapEntries = fragmentEntries.data();
+  fragmentSpecialization.dataSize = pipeline.fragmentConstants.size() * sizeof(u32);
+  fragmentSpecialization.pData = pipeline.fragmentConstants.data();
+  if (!pipeline.fragmentConstants.empty())
+    fragmentShaderStageInfo.pSpecializationInfo = &fragmentSpecialization;
+
   VkPipelineShaderStageCreateInfo shaderStages[] = {vertexShaderStageInfo, fragmentShaderStageInfo};
 
   // dynamic part of pipeline
@@ -604,12 +887,31 @@ void RendererVulkan::createPipeline(Pipeline &pipeline) {
   pipelineInfo.basePipelineHandle = VK_NULL_HANDLE;
   pipelineInfo.basePipelineIndex = -1;
 
-  if (vkCreateGraphicsPipelines(device, VK_NULL_HANDLE, 1, &pipelineInfo, nullptr, &pipeline.pipeline) != VK_SUCCESS)
-    Util::Error("Failed to create graphics pipeline");
+  VkResult result =
+      vkCreateGraphicsPipelines(device, pipelineCache.get(), 1, &pipelineInfo, nullptr, &pipeline.pipeline);
 
   // destroy modules after setup
   vkDestroyShaderModule(device, vertexShaderModule, nullptr);
   vkDestroyShaderModule(device, fragmentShaderModule, nullptr);
+
+  if (result != VK_SUCCESS)
+    Util::Error("Failed to create graphics pipeline");
+}
+
+void RendererVulkan::createPipelineAsync(Pipeline &pipeline, PipelineBuilds &builds) {
+  builds.count++;
+  // the pipeline cache is internally synchronized, so builds can share it
+  Threads::ThreadPool::global().submit(
+      [this, &pipeline, &builds]() {
+        try {
+          createPipeline(pipeline);
+        } catch (...) {
+          std::lock_guard<std::mutex> lock(builds.mutex);
+          if (!builds.error)
+            builds.error = std::current_exception();
+        }
+      },
+      &builds.group);
 }
 
 void RendererVulkan::createFrameBuffers() {
@@ -634,68 +936,26 @@ void RendererVulkan::createFrameBuffers() {
   }
 }
 
-void RendererVulkan::createVertexBuffer(void *vertexData, size_t size, VkBuffer &buffer, VkDeviceMemory &memory) {
-  VkDeviceSize bufferSize = size;
-
-  VkBuffer stagingBuffer;
-  VkDeviceMemory stagingMemory;
-
-  createBuffer(bufferSize, VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
-               VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, stagingBuffer,
-               stagingMemory);
-
-  void *data;
-  vkMapMemory(device, stagingMemory, 0, bufferSize, 0, &data);
-  memcpy(data, vertexData, (size_t)bufferSize);
-  vkUnmapMemory(device, stagingMemory);
-
-  createBuffer(bufferSize, VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_VERTEX_BUFFER_BIT,
+void RendererVulkan::createVertexBuffer(void *vertexData, size_t size, VkBuffer &buffer, Allocation &memory) {
+  createBuffer(size, VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_VERTEX_BUFFER_BIT,
                VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, buffer, memory);
 
-  copyBuffer(stagingBuffer, buffer, bufferSize);
-
-  vkDestroyBuffer(device, stagingBuffer, nullptr);
-  vkFreeMemory(device, stagingMemory, nullptr);
-}
-
-void RendererVulkan::createIndexBuffer(void *indexData, size_t size) {
-  VkDeviceSize bufferSize = size;
-
-  VkBuffer stagingBuffer;
-  VkDeviceMemory stagingMemory;
-
-  createBuffer(bufferSize, VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
-               VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, stagingBuffer,
-               stagingMemory);
-
-  void *data;
-  vkMapMemory(device, stagingMemory, 0, bufferSize, 0, &data);
-  memcpy(data, indexData, (size_t)bufferSize);
-  vkUnmapMemory(device, stagingMemory);
-
-  createBuffer(bufferSize, VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_INDEX_BUFFER_BIT,
-               VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, indexBuffer, indexMemory);
-
-  copyBuffer(stagingBuffer, indexBuffer, bufferSize);
-
-  vkDestroyBuffer(device, stagingBuffer, nullptr);
-  vkFreeMemory(device, stagingMemory, nullptr);
+  staging.copyToBuffer(vertexData, size, buffer, 0);
 }
 
 void RendererVulkan::createUniformBuffers(size_t objectCount, Pipeline &pipeline) {
   alignment = getUniformBufferAlignment(pipeline.uniformObjectSize, minUniformSize);
   dynamicUniformBufferSize = objectCount * alignment;
 
-  pipeline.uniformBuffers.resize(MAX_FRAMES_IN_FLIGHT);
-  pipeline.uniformBuffersMemory.resize(MAX_FRAMES_IN_FLIGHT);
-  pipeline.uniformBuffersMapped.resize(MAX_FRAMES_IN_FLIGHT);
+  pipeline.uniformBuffers.resize(framesInFlight);
+  pipeline.uniformBuffersMemory.resize(framesInFlight);
+  pipeline.uniformBuffersMapped.resize(framesInFlight);
 
-  for (int i = 0; i < MAX_FRAMES_IN_FLIGHT; i++) {
+  for (u32 i = 0; i < framesInFlight; i++) {
     createBuffer(dynamicUniformBufferSize, VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT,
                  pipeline.uniformBuffers[i], pipeline.uniformBuffersMemory[i]);
 
-    vkMapMemory(device, pipeline.uniformBuffersMemory[i], 0, dynamicUniformBufferSize, 0,
-                &pipeline.uniformBuffersMapped[i]);
+    pipeline.uniformBuffersMapped[i] = pipeline.uniformBuffersMemory[i].mapped;
   }
 }
 
@@ -704,22 +964,22 @@ void RendererVulkan::createDescriptorPool(Pipeline &pipeline) {
   poolInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
   poolInfo.poolSizeCount = (uint32_t)pipeline.descriptorPoolSize.size();
   poolInfo.pPoolSizes = pipeline.descriptorPoolSize.data();
-  poolInfo.maxSets = (uint32_t)MAX_FRAMES_IN_FLIGHT;
+  poolInfo.maxSets = framesInFlight;
 
   if (vkCreateDescriptorPool(device, &poolInfo, nullptr, &pipeline.descriptorPool) != VK_SUCCESS)
     Util::Error("Failed to create descriptor pool");
 }
 
 void RendererVulkan::createDescriptorSets(Pipeline &pipeline) {
-  std::vector<VkDescriptorSetLayout> layouts(MAX_FRAMES_IN_FLIGHT, pipeline.descriptorSetLayout);
+  std::vector<VkDescriptorSetLayout> layouts(framesInFlight, pipeline.descriptorSetLayout);
 
   VkDescriptorSetAllocateInfo allocInfo{};
   allocInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
   allocInfo.descriptorPool = pipeline.descriptorPool;
-  allocInfo.descriptorSetCount = (uint32_t)MAX_FRAMES_IN_FLIGHT;
+  allocInfo.descriptorSetCount = framesInFlight;
   allocInfo.pSetLayouts = layouts.data();
 
-  pipeline.descriptorSets.resize(MAX_FRAMES_IN_FLIGHT);
+  pipeline.descriptorSets.resize(framesInFlight);
 
   if (vkAllocateDescriptorSets(device, &allocInfo, pipeline.descriptorSets.data()) != VK_SUCCESS)
     Util::Error("Failed to allocate descriptor sets");
@@ -745,46 +1005,28 @@ void RendererVulkan::createDepthResources() {
                         VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL, 1);
 }
 
-void RendererVulkan::createTextureImage(void **textureData, int imageWidth, int imageHeight, VkImage &image,
-                                        VkDeviceMemory &imageMemory, uint32_t layers, VkImageCreateFlags flags) {
-  VkDeviceSize totalSize = imageWidth * imageHeight * 4 * layers;
-  VkDeviceSize layerSize = totalSize / layers;
-
-  VkBuffer stagingBuffer;
-  VkDeviceMemory stagingBufferMemory;
-
-  createBuffer(totalSize, VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
-               VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, stagingBuffer,
-               stagingBufferMemory);
-
-  void *data;
-  vkMapMemory(device, stagingBufferMemory, 0, totalSize, 0, &data);
-
-  for (int i = 0; i < layers; i++)
-    memcpy(static_cast<unsigned char *>(data) + (layerSize * i), textureData[i], (size_t)layerSize);
-
-  vkUnmapMemory(device, stagingBufferMemory);
-
-  createImage(imageWidth, imageHeight, VK_FORMAT_R8G8B8A8_SRGB, VK_IMAGE_TILING_OPTIMAL,
+void RendererVulkan::createTextureImage(const void *const *textureData, uint32_t imageWidth, uint32_t imageHeight,
+                                        Util::TextureFormat format, bool srgb, uint32_t levels, VkImage &image,
+                                        Allocation &imageMemory, uint32_t layers, VkImageCreateFlags flags) {
+  createImage(imageWidth, imageHeight, TextureStreamer::getFormat(format, srgb), VK_IMAGE_TILING_OPTIMAL,
               VK_IMAGE_USAGE_TRANSFER_DST_BIT | VK_IMAGE_USAGE_SAMPLED_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, image,
-              imageMemory, layers, flags);
-
-  transitionImageLayout(image, VK_FORMAT_R8G8B8A8_SRGB, VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
-                        layers);
-  copyBufferToImage(stagingBuffer, image, (uint32_t)imageWidth, (uint32_t)imageHeight, layers);
-  transitionImageLayout(image, VK_FORMAT_R8G8B8A8_SRGB, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
-                        VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, layers);
+              imageMemory, layers, flags, levels);
 
-  vkDestroyBuffer(device, stagingBuffer, nullptr);
-  vkFreeMemory(device, stagingBufferMemory, nullptr);
+  // the pixels are copied into the staging ring right away, so the caller can free them when this returns
+  staging.copyToImage(image, imageWidth, imageHeight, layers, Util::getBlockBytes(format), textureData, levels,
+                      Util::getBlockExtent(format));
 }
 
 void RendererVulkan::createTextureImageView(VkImage &image, VkImageViewType viewType, VkImageView &imageView,
-                                            uint32_t layers) {
-  imageView = createImageView(image, viewType, VK_FORMAT_R8G8B8A8_SRGB, VK_IMAGE_ASPECT_COLOR_BIT, layers);
+                                            uint32_t layers, VkFormat format, uint32_t levels) {
+  imageView = createImageView(image, viewType, format, VK_IMAGE_ASPECT_COLOR_BIT, layers, levels);
 }
 
-void RendererVulkan::createTextureSampler(VkSampler &sampler) {
+bool RendererVulkan::canSample(Util::TextureFormat format) const {
+  return (sampledFormats >> (u32)format) & 1;
+}
+
+void RendererVulkan::createTextureSampler(VkSampler &sampler, f32 maxLod) {
   VkPhysicalDeviceProperties properties{};
   vkGetPhysicalDeviceProperties(physicalDevice, &properties);
 
@@ -804,31 +1046,67 @@ void RendererVulkan::createTextureSampler(VkSampler &sampler) {
   samplerInfo.mipmapMode = VK_SAMPLER_MIPMAP_MODE_LINEAR;
   samplerInfo.mipLodBias = 0.0f;
   samplerInfo.minLod = 0.0f;
-  samplerInfo.maxLod = 0.0f;
+  samplerInfo.maxLod = maxLod;
 
   if (vkCreateSampler(device, &samplerInfo, nullptr, &sampler) != VK_SUCCESS)
     Util::Error("Failed to create texture sampler");
 }
 
 void RendererVulkan::createCommandBuffer() {
-  commandBuffers.resize(MAX_FRAMES_IN_FLIGHT);
-
-  // command buffer allocation
-  VkCommandBufferAllocateInfo allocInfo{};
-  allocInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
-  allocInfo.commandPool = commandPool;
-  allocInfo.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
-  allocInfo.commandBufferCount = (uint32_t)commandBuffers.size();
+  for (auto &buffers : commandBuffers)
+    vkFreeCommandBuffers(device, commandPool, (uint32_t)buffers.size(), buffers.data());
+
+  commandBuffers.assign(framesInFlight, std::vector<VkCommandBuffer>(swapchainImages.size()));
+  commandBufferVersions.assign(framesInFlight, std::vector<u64>(swapchainImages.size(), 0));
+  recordedFrames.resize(framesInFlight);
+
+  for (auto &buffers : commandBuffers) {
+    // command buffer allocation
+    VkCommandBufferAllocateInfo allocInfo{};
+    allocInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+    allocInfo.commandPool = commandPool;
+    allocInfo.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+    allocInfo.commandBufferCount = (uint32_t)buffers.size();
+
+    if (vkAllocateCommandBuffers(device, &allocInfo, buffers.data()) != VK_SUCCESS) {
+      Util::Error("Failed to create command buffer");
+    }
+  }
+}
 
-  if (vkAllocateCommandBuffers(device, &allocInfo, commandBuffers.data()) != VK_SUCCESS) {
-    Util::Error("Failed to create command buffer");
+void RendererVulkan::createRecordingContexts() {
+  u32 threads = config.recordThreads;
+  if (threads == 0)
+    threads = (u32)Threads::ThreadPool::global().size() + 1;
+
+  recordingContexts.resize(framesInFlight);
+  for (auto &contexts : recordingContexts) {
+    contexts.resize(threads);
+    for (RecordingContext &context : contexts) {
+      VkCommandPoolCreateInfo poolInfo{};
+      poolInfo.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
+      poolInfo.flags = VK_COMMAND_POOL_CREATE_TRANSIENT_BIT;
+      poolInfo.queueFamilyIndex = queueFamily.graphics.value();
+
+      if (vkCreateCommandPool(device, &poolInfo, nullptr, &context.pool) != VK_SUCCESS)
+        Util::Error("Failed to create recording command pool");
+
+      VkCommandBufferAllocateInfo allocInfo{};
+      allocInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+      allocInfo.commandPool = context.pool;
+      allocInfo.level = VK_COMMAND_BUFFER_LEVEL_SECONDARY;
+      allocInfo.commandBufferCount = 1;
+
+      if (vkAllocateCommandBuffers(device, &allocInfo, &context.commandBuffer) != VK_SUCCESS)
+        Util::Error("Failed to create secondary command buffer");
+    }
   }
 }
 
 void RendererVulkan::createSyncObjects() {
-  imageAvailableSem.resize(MAX_FRAMES_IN_FLIGHT);
-  renderFinishedSem.resize(MAX_FRAMES_IN_FLIGHT);
-  inFlightFence.resize(MAX_FRAMES_IN_FLIGHT);
+  imageAvailableSem.resize(framesInFlight);
+  renderFinishedSem.resize(framesInFlight);
+  inFlightFence.resize(framesInFlight);
 
   VkSemaphoreCreateInfo semaphoreInfo{};
   semaphoreInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO;
@@ -837,7 +1115,7 @@ void RendererVulkan::createSyncObjects() {
   fenceInfo.sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO;
   fenceInfo.flags = VK_FENCE_CREATE_SIGNALED_BIT;
 
-  for (int i = 0; i < MAX_FRAMES_IN_FLIGHT; i++) {
+  for (u32 i = 0; i < framesInFlight; i++) {
     if (vkCreateSemaphore(device, &semaphoreInfo, nullptr, &imageAvailableSem[i]) != VK_SUCCESS)
       Util::Error("Failed to create semaphore");
 
@@ -877,7 +1155,7 @@ VkFormat RendererVulkan::findSupportedFormat(const std::vector<VkFormat> &candid
 }
 
 VkImageView RendererVulkan::createImageView(VkImage image, VkImageViewType viewType, VkFormat format,
-                                            VkImageAspectFlags aspectFlags, uint32_t layers) {
+                                            VkImageAspectFlags aspectFlags, uint32_t layers, uint32_t levels) {
   VkImageViewCreateInfo viewInfo{};
   viewInfo.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
   viewInfo.image = image;
@@ -889,7 +1167,7 @@ VkImageView RendererVulkan::createImageView(VkImage image, VkImageViewType viewT
   viewInfo.components.a = VK_COMPONENT_SWIZZLE_IDENTITY;
   viewInfo.subresourceRange.aspectMask = aspectFlags;
   viewInfo.subresourceRange.baseMipLevel = 0;
-  viewInfo.subresourceRange.levelCount = 1;
+  viewInfo.subresourceRange.levelCount = levels;
   viewInfo.subresourceRange.baseArrayLayer = 0;
   viewInfo.subresourceRange.layerCount = layers;
 
@@ -900,26 +1178,6 @@ VkImageView RendererVulkan::createImageView(VkImage image, VkImageViewType viewT
   return imageView;
 }
 
-void RendererVulkan::copyBufferToImage(VkBuffer buffer, VkImage image, uint32_t width, uint32_t height,
-                                       uint32_t layers) {
-  VkCommandBuffer commandBuffer = beginSingleTimeCommands();
-
-  VkBufferImageCopy region{};
-  region.bufferOffset = 0;
-  region.bufferRowLength = 0;
-  region.bufferImageHeight = 0;
-  region.imageSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
-  region.imageSubresource.mipLevel = 0;
-  region.imageSubresource.baseArrayLayer = 0;
-  region.imageSubresource.layerCount = layers;
-  region.imageOffset = {0, 0, 0};
-  region.imageExtent = {width, height, 1};
-
-  vkCmdCopyBufferToImage(commandBuffer, buffer, image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 1, &region);
-
-  endSingleTimeCommands(commandBuffer);
-}
-
 void RendererVulkan::transitionImageLayout(VkImage image, VkFormat format, VkImageLayout oldLayout,
                                            VkImageLayout newLayout, uint32_t layers) {
   VkCommandBuffer commandBuffer = beginSingleTimeCommands();
@@ -1009,14 +1267,14 @@ void RendererVulkan::endSingleTimeCommands(VkCommandBuffer commandBuffer) {
 
 void RendererVulkan::createImage(uint32_t width, uint32_t height, VkFormat format, VkImageTiling tiling,
                                  VkImageUsageFlags usage, VkMemoryPropertyFlags properties, VkImage &image,
-                                 VkDeviceMemory &imageMemory, uint32_t layers, VkImageCreateFlags flags) {
+                                 Allocation &imageMemory, uint32_t layers, VkImageCreateFlags flags, uint32_t levels) {
   VkImageCreateInfo imageInfo{};
   imageInfo.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
   imageInfo.imageType = VK_IMAGE_TYPE_2D;
   imageInfo.extent.width = width;
   imageInfo.extent.height = height;
   imageInfo.extent.depth = 1;
-  imageInfo.mipLevels = 1;
+  imageInfo.mipLevels = levels;
   imageInfo.arrayLayers = layers;
   imageInfo.format = format;
   imageInfo.tiling = tiling;
@@ -1026,69 +1284,38 @@ void RendererVulkan::createImage(uint32_t width, uint32_t height, VkFormat forma
   imageInfo.samples = VK_SAMPLE_COUNT_1_BIT;
   imageInfo.flags = flags;
 
-  if (vkCreateImage(device, &imageInfo, nullptr, &image) != VK_SUCCESS)
-    Util::Error("Failed to create texture image");
-
-  VkMemoryRequirements memRequirements;
-  vkGetImageMemoryRequirements(device, image, &memRequirements);
-
-  VkMemoryAllocateInfo allocInfo{};
-  allocInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
-  allocInfo.allocationSize = memRequirements.size;
-  allocInfo.memoryTypeIndex = findMemoryType(memRequirements.memoryTypeBits, properties);
-
-  if (vkAllocateMemory(device, &allocInfo, nullptr, &imageMemory) != VK_SUCCESS)
-    Util::Error("Failed to allocate texture image memory");
-
-  vkBindImageMemory(device, image, imageMemory, 0);
+  allocator.createImage(imageInfo, properties, image, imageMemory);
 }
 
 void RendererVulkan::createBuffer(VkDeviceSize size, VkBufferUsageFlags usage, VkMemoryPropertyFlags properties,
-                                  VkBuffer &buffer, VkDeviceMemory &memory) {
-  VkBufferCreateInfo bufferInfo{};
-  bufferInfo.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
-  bufferInfo.size = size;
-  bufferInfo.usage = usage;
-  bufferInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
-
-  if (vkCreateBuffer(device, &bufferInfo, nullptr, &buffer) != VK_SUCCESS)
-    Util::Error("Failed to create vertex buffer");
-
-  VkMemoryRequirements mem;
-  vkGetBufferMemoryRequirements(device, buffer, &mem);
-
-  VkMemoryAllocateInfo allocInfo{};
-  allocInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
-  allocInfo.allocationSize = mem.size;
-  allocInfo.memoryTypeIndex = findMemoryType(mem.memoryTypeBits, properties);
-
-  if (vkAllocateMemory(device, &allocInfo, nullptr, &memory) != VK_SUCCESS)
-    Util::Error("Failed to allocate vertex buffer memory");
-
-  vkBindBufferMemory(device, buffer, memory, 0);
+                                  VkBuffer &buffer, Allocation &memory) {
+  // anything the staging ring copies into is written by the transfer family and read by the graphics family
+  std::vector<u32> queueFamilies;
+  if (usage & VK_BUFFER_USAGE_TRANSFER_DST_BIT)
+    queueFamilies = staging.getQueueFamilies();
+  allocator.createBuffer(size, usage, properties, buffer, memory, queueFamilies);
 }
 
-void RendererVulkan::copyBuffer(VkBuffer srcBuffer, VkBuffer dstBuffer, VkDeviceSize size) {
-  VkCommandBuffer commandBuffer = beginSingleTimeCommands();
-
-  VkBufferCopy copyRegion{};
-  copyRegion.srcOffset = 0;
-  copyRegion.dstOffset = 0;
-  copyRegion.size = size;
-
-  vkCmdCopyBuffer(commandBuffer, srcBuffer, dstBuffer, 1, &copyRegion);
-
-  endSingleTimeCommands(commandBuffer);
+void RendererVulkan::uploadToBuffer(const void *data, VkDeviceSize size, VkBuffer dstBuffer, VkDeviceSize dstOffset) {
+  staging.copyToBuffer(data, size, dstBuffer, dstOffset);
 }
 
 VkPresentModeKHR RendererVulkan::chooseSwapPresentMode(const std::vector<VkPresentModeKHR> &available) {
-  for (const auto &presentMode : available) {
-    if (presentMode == VK_PRESENT_MODE_IMMEDIATE_KHR)
-      return presentMode;
-
-    if (presentMode == VK_PRESENT_MODE_MAILBOX_KHR)
-      return presentMode;
+  std::vector<VkPresentModeKHR> preferred;
+  switch (config.presentPolicy) {
+  case PresentPolicy::IMMEDIATE:
+    preferred = {VK_PRESENT_MODE_IMMEDIATE_KHR, VK_PRESENT_MODE_MAILBOX_KHR};
+    break;
+  case PresentPolicy::MAILBOX:
+    preferred = {VK_PRESENT_MODE_MAILBOX_KHR};
+    break;
+  case PresentPolicy::FIFO:
+    break;
   }
+
+  for (VkPresentModeKHR mode : preferred)
+    if (std::find(available.begin(), available.end(), mode) != available.end())
+      return mode;
   return VK_PRESENT_MODE_FIFO_KHR;
 }
 
@@ -1196,9 +1423,10 @@ RendererVulkan::SwapchainSupportDetails RendererVulkan::querySwapchainSupport(Vk
 bool RendererVulkan::isDeviceCompatible(VkPhysicalDevice pDevice) {
   QueueFamily queue = setupQueueFamilies(pDevice);
 
-  bool extensionSupported = checkDeviceExtensionSupport(pDevice);
-  bool swapchainSupported = false;
-  if (extensionSupported) {
+  // headless needs neither the swapchain extension nor a surface
+  bool extensionSupported = config.headless || checkDeviceExtensionSupport(pDevice);
+  bool swapchainSupported = config.headless;
+  if (!config.headless && extensionSupported) {
     SwapchainSupportDetails swapchainSupport = querySwapchainSupport(pDevice);
     swapchainSupported = !swapchainSupport.presentModes.empty() && !swapchainSupport.formats.empty();
   }
@@ -1223,13 +1451,24 @@ RendererVulkan::QueueFamily RendererVulkan::setupQueueFamilies(VkPhysicalDevice
     if (family.queueFlags & VK_QUEUE_GRAPHICS_BIT)
       queue.graphics = i;
 
+    // prefer a family that only copies (the DMA engines) over a compute one
+    const VkQueueFlags work = VK_QUEUE_GRAPHICS_BIT | VK_QUEUE_COMPUTE_BIT | VK_QUEUE_TRANSFER_BIT;
+    if ((family.queueFlags & VK_QUEUE_TRANSFER_BIT) && !(family.queueFlags & VK_QUEUE_GRAPHICS_BIT) &&
+        (!queue.transfer.has_value() || (family.queueFlags & work) == VK_QUEUE_TRANSFER_BIT))
+      queue.transfer = i;
+
     presentSupport = false;
-    vkGetPhysicalDeviceSurfaceSupportKHR(pDevice, i, surface, &presentSupport);
+    if (!config.headless)
+      vkGetPhysicalDeviceSurfaceSupportKHR(pDevice, i, surface, &presentSupport);
     if (presentSupport)
       queue.present = i;
 
     i++;
   }
+
+  // nothing is presented headless, the graphics family stands in so the queue setup stays the same
+  if (config.headless)
+    queue.present = queue.graphics;
   return queue;
 }
 
@@ -1248,7 +1487,79 @@ VkShaderModule RendererVulkan::createShaderModule(std::vector<char> &shader) {
   return module;
 }
 
+VkCommandBuffer RendererVulkan::prepareCommandBuffer(uint32_t imageIndex) {
+  PROFILE_FUNCTION();
+  auto start = std::chrono::steady_clock::now();
+
+  RecordedFrame &recorded = recordedFrames[currentFrame];
+  bool changed = !config.cacheCommands || recorded.version == 0 || recorded.drawCount != draws.size() ||
+                 (config.gpuCulling && recorded.instanceCount != instanceObjects.size());
+  if (!changed && drawPath == DrawPath::DIRECT)
+    changed = memcmp(recorded.draws.data(), draws.data(), draws.size() * sizeof(VkDrawIndexedIndirectCommand)) != 0;
+
+  if (changed) {
+    recordSecondaries();
+    recorded.version = ++recordVersion;
+    recorded.drawCount = draws.size();
+    recorded.instanceCount = instanceObjects.size();
+    if (drawPath == DrawPath::DIRECT)
+      recorded.draws = draws;
+  }
+
+  // every image has its own primary, all of them go stale when the secondaries they execute are recorded again
+  VkCommandBuffer commandBuffer = commandBuffers[currentFrame][imageIndex];
+  u64 &version = commandBufferVersions[currentFrame][imageIndex];
+  if (version != recorded.version) {
+    vkResetCommandBuffer(commandBuffer, 0);
+    recordCommandBuffer(commandBuffer, imageIndex);
+    version = recorded.version;
+    recordStats.recorded++;
+  }
+
+  recordStats.frames++;
+  recordStats.recordMs +=
+      std::chrono::duration<f64, std::milli>(std::chrono::steady_clock::now() - start).count();
+  return commandBuffer;
+}
+
+void RendererVulkan::invalidateCommands() {
+  for (RecordedFrame &recorded : recordedFrames)
+    recorded.version = 0;
+  for (auto &versions : commandBufferVersions)
+    std::fill(versions.begin(), versions.end(), 0);
+}
+
+RecordStats RendererVulkan::getRecordStats() const { return recordStats; }
+
+const GpuProfiler &RendererVulkan::getProfiler() const { return profiler; }
+
+void RendererVulkan::recordSecondaries() {
+  PROFILE_FUNCTION();
+  // split the draws so every secondary gets enough work to be worth a task, the first one also draws the sky box
+  std::vector<RecordingContext> &contexts = recordingContexts[currentFrame];
+  size_t chunks = std::clamp<size_t>(draws.size() / MIN_DRAWS_PER_SECONDARY, 1, contexts.size());
+  size_t drawsPerChunk = (draws.size() + chunks - 1) / chunks;
+
+  auto recordChunk = [&](size_t chunk) {
+    size_t first = std::min(chunk * drawsPerChunk, draws.size());
+    size_t last = std::min(first + drawsPerChunk, draws.size());
+    recordDraws(contexts[chunk], first, last, chunk == 0, chunk + 1 == chunks);
+  };
+
+  if (chunks == 1) {
+    recordChunk(0);
+  } else {
+    Threads::ThreadPool::global().parallelFor(chunks, 1, [&](size_t begin, size_t end) {
+      for (size_t chunk = begin; chunk < end; chunk++)
+        recordChunk(chunk);
+    });
+  }
+
+  recordedFrames[currentFrame].secondaryCount = chunks;
+}
+
 void RendererVulkan::recordCommandBuffer(VkCommandBuffer commandBuffer, uint32_t imageIndex) {
+  PROFILE_FUNCTION();
   VkCommandBufferBeginInfo beginInfo{};
   beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
   beginInfo.flags = 0;
@@ -1257,6 +1568,9 @@ void RendererVulkan::recordCommandBuffer(VkCommandBuffer commandBuffer, uint32_t
   if (vkBeginCommandBuffer(commandBuffer, &beginInfo) != VK_SUCCESS)
     Util::Error("Failed to begin recording command buffer");
 
+  profiler.reset(commandBuffer, currentFrame);
+  profiler.begin(commandBuffer, currentFrame, GpuProfiler::FRAME);
+
   VkRenderPassBeginInfo renderPassInfo{};
   renderPassInfo.sType = VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO;
   renderPassInfo.renderPass = colorAndDepthRenderPass;
@@ -1270,6 +1584,54 @@ void RendererVulkan::recordCommandBuffer(VkCommandBuffer commandBuffer, uint32_t
   renderPassInfo.clearValueCount = (uint32_t)clearValues.size();
   renderPassInfo.pClearValues = clearValues.data();
 
+  // compute has to run outside the render pass
+  if (config.gpuCulling) {
+    profiler.begin(commandBuffer, currentFrame, GpuProfiler::CULLING);
+    culling.record(commandBuffer, currentFrame, (u32)instanceObjects.size());
+    profiler.end(commandBuffer, currentFrame, GpuProfiler::CULLING);
+  }
+
+  std::vector<RecordingContext> &contexts = recordingContexts[currentFrame];
+  std::vector<VkCommandBuffer> secondaries(recordedFrames[currentFrame].secondaryCount);
+  for (size_t i = 0; i < secondaries.size(); i++)
+    secondaries[i] = contexts[i].commandBuffer;
+
+  // the sky box and blinn scopes are written by the secondaries
+  profiler.beginStatistics(commandBuffer, currentFrame);
+  vkCmdBeginRenderPass(commandBuffer, &renderPassInfo, VK_SUBPASS_CONTENTS_SECONDARY_COMMAND_BUFFERS);
+  vkCmdExecuteCommands(commandBuffer, (uint32_t)secondaries.size(), secondaries.data());
+  vkCmdEndRenderPass(commandBuffer);
+  profiler.endStatistics(commandBuffer, currentFrame);
+  profiler.end(commandBuffer, currentFrame, GpuProfiler::FRAME);
+
+  if (vkEndCommandBuffer(commandBuffer) != VK_SUCCESS)
+    Util::Error("Failed to record command buffer");
+}
+
+void RendererVulkan::recordDraws(RecordingContext &context, size_t firstDraw, size_t lastDraw, bool firstChunk,
+                                 bool lastChunk) {
+  PROFILE_FUNCTION();
+  VkCommandBuffer commandBuffer = context.commandBuffer;
+
+  // the frame's fence has signaled, so last use of this pool is done
+  vkResetCommandPool(device, context.pool, 0);
+
+  // no framebuffer, the same secondaries are executed by the primaries of every swapchain image
+  VkCommandBufferInheritanceInfo inheritanceInfo{};
+  inheritanceInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_INHERITANCE_INFO;
+  inheritanceInfo.renderPass = colorAndDepthRenderPass;
+  inheritanceInfo.subpass = 0;
+  inheritanceInfo.framebuffer = VK_NULL_HANDLE;
+  inheritanceInfo.pipelineStatistics = profiler.getStatisticFlags();
+
+  VkCommandBufferBeginInfo beginInfo{};
+  beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+  beginInfo.flags = VK_COMMAND_BUFFER_USAGE_RENDER_PASS_CONTINUE_BIT;
+  beginInfo.pInheritanceInfo = &inheritanceInfo;
+
+  if (vkBeginCommandBuffer(commandBuffer, &beginInfo) != VK_SUCCESS)
+    Util::Error("Failed to begin recording secondary command buffer");
+
   VkViewport viewport{};
   viewport.x = 0.0f;
   viewport.y = 0.0f;
@@ -1287,78 +1649,124 @@ void RendererVulkan::recordCommandBuffer(VkCommandBuffer commandBuffer, uint32_t
   VkBuffer buffers[1];
   VkDeviceSize offsets[] = {0};
 
-  vkCmdBeginRenderPass(commandBuffer, &renderPassInfo, VK_SUBPASS_CONTENTS_INLINE);
+  // sky box, the first chunk draws it (when the scene has one) and starts the blinn scope
+  if (firstChunk) {
+    profiler.begin(commandBuffer, currentFrame, GpuProfiler::SKY_BOX);
+    if (skyBox) {
+      vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, environmentMap.pipeline);
 
-  // sky box
-  vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, environmentMap.pipeline);
+      buffers[0] = {envBuffer};
+      vkCmdBindVertexBuffers(commandBuffer, 0, 1, buffers, offsets);
 
-  buffers[0] = {envBuffer};
-  vkCmdBindVertexBuffers(commandBuffer, 0, 1, buffers, offsets);
-
-  vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, environmentMap.pipelineLayout, 0, 1,
-                          &environmentMap.descriptorSets[currentFrame], 0, 0);
-  vkCmdDraw(commandBuffer, 3, 1, 0, 0);
+      vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, environmentMap.pipelineLayout, 0, 1,
+                              &environmentMap.descriptorSets[currentFrame], 0, 0);
+      vkCmdDraw(commandBuffer, 3, 1, 0, 0);
+    }
+    profiler.end(commandBuffer, currentFrame, GpuProfiler::SKY_BOX);
+    profiler.begin(commandBuffer, currentFrame, GpuProfiler::BLINN);
+  }
 
-  // blinn
-  vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, blinn.pipeline);
+  if (firstDraw < lastDraw) {
+    // blinn
+    vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, blinn.pipeline);
 
-  buffers[0] = {meshBuffer};
-  vkCmdBindVertexBuffers(commandBuffer, 0, 1, buffers, offsets);
-  vkCmdBindIndexBuffer(commandBuffer, indexBuffer, 0, VK_INDEX_TYPE_UINT32);
+    buffers[0] = {meshBuffer};
+    vkCmdBindVertexBuffers(commandBuffer, 0, 1, buffers, offsets);
+    vkCmdBindIndexBuffer(commandBuffer, indexBuffer, 0, VK_INDEX_TYPE_UINT32);
 
-  for (size_t i = 0; i < OBJECT_COUNT; i++) {
-    uint32_t dOffset = (uint32_t)i * (uint32_t)alignment;
+    // per object data is indexed by instance, so the set is bound once and each mesh is a single draw
     vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, blinn.pipelineLayout, 0, 1,
-                            &blinn.descriptorSets[currentFrame], 1, &dOffset);
-
-    vkCmdDrawIndexed(commandBuffer, indexCount[i], 1, indexOffsets[i], vertexOffsets[i], 0);
+                            &blinn.descriptorSets[currentFrame], 0, nullptr);
+
+    const uint32_t stride = sizeof(VkDrawIndexedIndirectCommand);
+    switch (drawPath) {
+    case DrawPath::MULTI_DRAW_INDIRECT:
+      // the commands are written to the indirect buffer in updateUniformBuffer, before submit
+      for (size_t first = firstDraw; first < lastDraw; first += maxDrawIndirectCount) {
+        uint32_t count = (uint32_t)std::min<size_t>(lastDraw - first, maxDrawIndirectCount);
+        vkCmdDrawIndexedIndirect(commandBuffer, indirectBuffers[currentFrame], first * stride, count, stride);
+      }
+      break;
+    case DrawPath::INDIRECT:
+      for (size_t i = firstDraw; i < lastDraw; i++)
+        vkCmdDrawIndexedIndirect(commandBuffer, indirectBuffers[currentFrame], i * stride, 1, stride);
+      break;
+    case DrawPath::DIRECT:
+      for (size_t i = firstDraw; i < lastDraw; i++) {
+        const VkDrawIndexedIndirectCommand &draw = draws[i];
+        vkCmdDrawIndexed(commandBuffer, draw.indexCount, draw.instanceCount, draw.firstIndex, draw.vertexOffset,
+                         draw.firstInstance);
+      }
+      break;
+    }
   }
 
-  vkCmdEndRenderPass(commandBuffer);
+  if (lastChunk)
+    profiler.end(commandBuffer, currentFrame, GpuProfiler::BLINN);
 
   if (vkEndCommandBuffer(commandBuffer) != VK_SUCCESS)
-    Util::Error("Failed to record command buffer");
+    Util::Error("Failed to record secondary command buffer");
 }
 
 void RendererVulkan::drawScene() {
-  vkWaitForFences(device, 1, &inFlightFence[currentFrame], VK_TRUE, UINT64_MAX);
-
-  uint32_t imageIndex;
-  VkResult result = vkAcquireNextImageKHR(device, swapchain, UINT64_MAX, imageAvailableSem[currentFrame],
-                                          VK_NULL_HANDLE, &imageIndex);
-
-  if (result == VK_ERROR_OUT_OF_DATE_KHR) {
-    recreateSwapchain();
-    return;
-  } else if (result != VK_SUCCESS && result != VK_SUBOPTIMAL_KHR)
-    Util::Error("Failed to acquire swap chain image");
+  PROFILE_FUNCTION();
+  {
+    PROFILE_ZONE("wait for frame");
+    vkWaitForFences(device, 1, &inFlightFence[currentFrame], VK_TRUE, UINT64_MAX);
+  }
+  profiler.collect(currentFrame);
+
+  // headless, each frame in flight has its own image and nothing is acquired or presented
+  uint32_t imageIndex = currentFrame;
+  if (!config.headless) {
+    VkResult result = vkAcquireNextImageKHR(device, swapchain, UINT64_MAX, imageAvailableSem[currentFrame],
+                                            VK_NULL_HANDLE, &imageIndex);
+
+    if (result == VK_ERROR_OUT_OF_DATE_KHR) {
+      recreateSwapchain();
+      return;
+    } else if (result != VK_SUCCESS && result != VK_SUBOPTIMAL_KHR)
+      Util::Error("Failed to acquire swap chain image");
+  }
 
   vkResetFences(device, 1, &inFlightFence[currentFrame]);
 
-  vkResetCommandBuffer(commandBuffers[currentFrame], 0);
-
-  recordCommandBuffer(commandBuffers[currentFrame], imageIndex);
+  prepareDraws();
+  streamTextures();
+  // textures the streamer evicted (and buffers destroyed since last frame) can leave blocks empty, give them back
+  allocator.releaseEmptyBlocks();
+  VkCommandBuffer commandBuffer = prepareCommandBuffer(imageIndex);
 
   updateUniformBuffer(currentFrame);
 
+  // meshes uploaded while preparing the draws go first, their batch's barrier covers this frame's reads
+  staging.submit();
+
   VkSubmitInfo submitInfo{};
   submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
 
   VkSemaphore waitSemaphores[] = {imageAvailableSem[currentFrame]};
   VkPipelineStageFlags waitStages[] = {VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT};
 
-  submitInfo.waitSemaphoreCount = 1;
+  submitInfo.waitSemaphoreCount = config.headless ? 0 : 1;
   submitInfo.pWaitSemaphores = waitSemaphores;
   submitInfo.pWaitDstStageMask = waitStages;
   submitInfo.commandBufferCount = 1;
-  submitInfo.pCommandBuffers = &commandBuffers[currentFrame];
+  submitInfo.pCommandBuffers = &commandBuffer;
 
   VkSemaphore signalSemaphores[] = {renderFinishedSem[currentFrame]};
-  submitInfo.signalSemaphoreCount = 1;
+  submitInfo.signalSemaphoreCount = config.headless ? 0 : 1;
   submitInfo.pSignalSemaphores = signalSemaphores;
 
   if (vkQueueSubmit(graphicsQueue, 1, &submitInfo, inFlightFence[currentFrame]) != VK_SUCCESS)
     Util::Error("Failed to submit draw command buffer");
+  profiler.submitted(currentFrame);
+  lastImageIndex = imageIndex;
+
+  if (config.headless) {
+    currentFrame = (currentFrame + 1) % framesInFlight;
+    return;
+  }
 
   VkPresentInfoKHR presentInfo{};
   presentInfo.sType = VK_STRUCTURE_TYPE_PRESENT_INFO_KHR;
@@ -1371,63 +1779,382 @@ void RendererVulkan::drawScene() {
   presentInfo.pImageIndices = &imageIndex;
   presentInfo.pResults = nullptr;
 
-  result = vkQueuePresentKHR(presentQueue, &presentInfo);
+  VkResult result;
+  {
+    PROFILE_ZONE("present");
+    result = vkQueuePresentKHR(presentQueue, &presentInfo);
+  }
   if (result == VK_ERROR_OUT_OF_DATE_KHR || result == VK_SUBOPTIMAL_KHR || resized) {
     resized = false;
     recreateSwapchain();
   } else if (result != VK_SUCCESS)
     Util::Error("Failed to present swap chain image");
 
-  currentFrame = (currentFrame + 1) % MAX_FRAMES_IN_FLIGHT;
+  currentFrame = (currentFrame + 1) % framesInFlight;
+}
+
+void RendererVulkan::setFrame(const Game::FramePacket *packet, f32 alpha) {
+  frame = packet;
+  interpolation = alpha;
+}
+
+// ====================================================================================================================
+// Mesh Residency
+// ====================================================================================================================
+void RendererVulkan::cullObjects() {
+  visibleObjects.clear();
+  objectModels.resize(frame->objects.size());
+
+  // the culling pass tests on the GPU, its counts arrive once the frame's fence has signaled
+  if (config.gpuCulling) {
+    for (u32 i : frame->visible) {
+      if (!frame->objects[i].mesh)
+        continue;
+      objectModels[i] = frame->objects[i].getModelMatrix(interpolation);
+      visibleObjects.push_back(i);
+    }
+
+    cullStats.drawn = std::min(culling.getVisibleCount(currentFrame), (u32)visibleObjects.size());
+    cullStats.culled = (u32)frame->objects.size() - cullStats.drawn;
+    return;
+  }
+
+  // the packet only lists candidates the scene's spatial index found, each is tested with the same matrix the
+  // instance is drawn with
+  const Math::Frustum frustum = Math::Frustum::fromMatrix(proj * view);
+  for (u32 i : frame->visible) {
+    const Game::ObjectState &object = frame->objects[i];
+    if (!object.mesh)
+      continue;
+
+    objectModels[i] = object.getModelMatrix(interpolation);
+
+    const auto &box = object.mesh->getBoundingBox();
+    if (frustum.intersects(Math::AABB(box.min, box.max).transform(objectModels[i])))
+      visibleObjects.push_back(i);
+  }
+
+  cullStats.drawn = (u32)visibleObjects.size();
+  cullStats.culled = (u32)frame->objects.size() - cullStats.drawn;
+}
+
+CullStats RendererVulkan::getCullStats() const { return cullStats; }
+
+const Math::Matrix4 &RendererVulkan::getProjection() const { return proj; }
+
+void RendererVulkan::printPipelineStats() const {
+  std::cout << "Pipelines: " << pipelineCount << " created in " << pipelineMs << " ms, ";
+  if (pipelineCache.isWarm())
+    std::cout << "warm cache (" << pipelineCache.getLoadedSize() / 1024.0 << " KiB loaded)\n";
+  else
+    std::cout << "cold cache\n";
+}
+
+void RendererVulkan::printPresentStats() const {
+  if (config.headless) {
+    std::cout << "Presenting: headless, " << framesInFlight << " frames in flight into offscreen images\n";
+    return;
+  }
+  const char *mode = presentMode == VK_PRESENT_MODE_IMMEDIATE_KHR ? "immediate"
+                     : presentMode == VK_PRESENT_MODE_MAILBOX_KHR ? "mailbox"
+                                                                  : "fifo";
+  std::cout << "Presenting: " << mode << ", " << framesInFlight << " frames in flight, " << swapchainImages.size()
+            << " swapchain images\n";
+}
+
+void RendererVulkan::waitIdle() { vkDeviceWaitIdle(device); }
+
+void RendererVulkan::saveFrame(const std::string &path) {
+  // swapchain images aren't created for copying out of
+  if (!config.headless)
+    Util::Error("Frames can only be saved when rendering headless");
+  vkDeviceWaitIdle(device);
+
+  VkDeviceSize size = (VkDeviceSize)extent.width * extent.height * 4;
+  VkBuffer buffer;
+  Allocation memory;
+  createBuffer(size, VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+               VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, buffer, memory);
+
+  VkCommandBuffer commandBuffer = beginSingleTimeCommands();
+
+  // the render pass wrote the image, and left it for copying, in an earlier submission
+  VkImageMemoryBarrier barrier{};
+  barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+  barrier.srcAccessMask = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT;
+  barrier.dstAccessMask = VK_ACCESS_TRANSFER_READ_BIT;
+  barrier.oldLayout = VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL;
+  barrier.newLayout = VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL;
+  barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+  barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+  barrier.image = swapchainImages[lastImageIndex];
+  barrier.subresourceRange = {VK_IMAGE_ASPECT_COLOR_BIT, 0, 1, 0, 1};
+  vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT,
+                       0, 0, nullptr, 0, nullptr, 1, &barrier);
+
+  VkBufferImageCopy region{};
+  region.imageSubresource = {VK_IMAGE_ASPECT_COLOR_BIT, 0, 0, 1};
+  region.imageExtent = {extent.width, extent.height, 1};
+  vkCmdCopyImageToBuffer(commandBuffer, swapchainImages[lastImageIndex], VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, buffer,
+                         1, &region);
+
+  // make the copy visible to the host
+  VkMemoryBarrier hostBarrier{};
+  hostBarrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+  hostBarrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+  hostBarrier.dstAccessMask = VK_ACCESS_HOST_READ_BIT;
+  vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_HOST_BIT, 0, 1, &hostBarrier,
+                       0, nullptr, 0, nullptr);
+  endSingleTimeCommands(commandBuffer);
+
+  // offscreen images are RGBA8 already
+  std::vector<uint8_t> pixels((size_t)size);
+  std::memcpy(pixels.data(), memory.mapped, pixels.size());
+  allocator.destroyBuffer(buffer, memory);
+
+  Util::savePNG(path, pixels.data(), extent.width, extent.height);
+}
+
+void RendererVulkan::printMemoryStats() const {
+  allocator.printStats();
+  staging.printStats();
+  textureStreamer.printStats();
+
+  auto mib = [](u64 bytes) { return (f64)bytes / (1024.0 * 1024.0); };
+  std::cout << "Environment map: " << mib(cubemapBytes) << " MiB " << Util::getFormatName(cubemapFormat) << " ("
+            << mib(cubemapUncompressedBytes) << " MiB as RGBA8)\n";
+}
+
+void RendererVulkan::prepareDraws() {
+  PROFILE_FUNCTION();
+  frameNumber++;
+  view = frame->camera.getInterpolatedViewMatrix(interpolation);
+  draws.clear();
+  visibleDraws.clear();
+  textureDraws.clear();
+
+  cullObjects();
+  objectTextures.resize(frame->objects.size());
+
+  // one draw per mesh, found through the mesh's allocation so grouping stays O(visible)
+  for (u32 i : visibleObjects) {
+    const auto &mesh = frame->objects[i].mesh;
+    if (!mesh || visibleDraws.size() == OBJECT_COUNT)
+      continue;
+
+    u32 texture = 0;
+    if (frame->objects[i].texture) {
+      auto slot = textureSlots.find(frame->objects[i].texture);
+      if (slot != textureSlots.end())
+        texture = slot->second;
+    }
+    objectTextures[i] = texture;
+    if (texture != 0)
+      textureStreamer.request(texture, projectedSize(frame->objects[i], objectModels[i]));
+
+    auto it = residentMeshes.find(mesh.get());
+    if (it == residentMeshes.end()) {
+      if (!uploadMesh(mesh))
+        continue;
+      it = residentMeshes.find(mesh.get());
+    }
+
+    MeshAllocation &allocation = it->second;
+    if (allocation.lastUsedFrame != frameNumber) {
+      allocation.lastUsedFrame = frameNumber;
+      allocation.draw = (u32)draws.size();
+      allocation.drawTexture = texture;
+      draws.push_back({(u32)allocation.indices.size, 0, (u32)allocation.indices.offset,
+                       (i32)allocation.vertices.offset, 0});
+    }
+
+    // the array texture path needs one slot per draw, other textures of the mesh get draws of their own
+    u32 draw = allocation.draw;
+    if (texturePath == TexturePath::ARRAY && texture != allocation.drawTexture) {
+      auto [entry, added] = textureDraws.try_emplace(((u64)allocation.draw << 32) | texture, (u32)draws.size());
+      if (added) {
+        VkDrawIndexedIndirectCommand split = draws[allocation.draw];
+        split.instanceCount = 0;
+        draws.push_back(split);
+      }
+      draw = entry->second;
+    }
+
+    draws[draw].instanceCount++;
+    visibleDraws.emplace_back(i, draw);
+  }
+
+  // lay the instances of each draw out next to each other
+  u32 firstInstance = 0;
+  for (VkDrawIndexedIndirectCommand &draw : draws) {
+    draw.firstInstance = firstInstance;
+    firstInstance += draw.instanceCount;
+    draw.instanceCount = 0;
+  }
+
+  instanceObjects.resize(visibleDraws.size());
+  for (const auto &[object, index] : visibleDraws) {
+    VkDrawIndexedIndirectCommand &draw = draws[index];
+    instanceObjects[draw.firstInstance + draw.instanceCount++] = object;
+  }
+
+  releaseUnusedMeshes();
+}
+
+bool RendererVulkan::uploadMesh(const std::shared_ptr<const Mesh::Mesh> &mesh) {
+  const auto &vertices = mesh->getVertexData();
+  const auto &indices = mesh->getIndices();
+  if (vertices.empty() || indices.empty())
+    return false;
+
+  MeshAllocation allocation;
+  allocation.mesh = mesh;
+
+  if (!vertexAllocator.allocate(vertices.size(), allocation.vertices)) {
+    allocation.vertices = {};
+  } else if (!indexAllocator.allocate(indices.size(), allocation.indices)) {
+    vertexAllocator.free(allocation.vertices);
+    allocation.vertices = {};
+  }
+
+  if (allocation.vertices.size == 0) {
+    if (!meshBuffersFullReported)
+      std::cerr << "Mesh buffers are full, new meshes won't be drawn until others are despawned\n";
+    meshBuffersFullReported = true;
+    return false;
+  }
+
+  // freed ranges are only reused once no frame in flight reads them, so this can't race the GPU
+  uploadToBuffer(vertices.data(), vertices.size() * sizeof(Mesh::Vertex), meshBuffer,
+                 allocation.vertices.offset * sizeof(Mesh::Vertex));
+  uploadToBuffer(indices.data(), indices.size() * sizeof(u32), indexBuffer, allocation.indices.offset * sizeof(u32));
+
+  residentMeshes.emplace(mesh.get(), std::move(allocation));
+  return true;
+}
+
+void RendererVulkan::releaseUnusedMeshes() {
+  for (auto it = residentMeshes.begin(); it != residentMeshes.end();) {
+    MeshAllocation &allocation = it->second;
+
+    // nothing else holds the mesh (so no packet can bring it back) and the frames that drew it are done
+    if (allocation.mesh.use_count() == 1 && allocation.lastUsedFrame + framesInFlight <= frameNumber) {
+      vertexAllocator.free(allocation.vertices);
+      indexAllocator.free(allocation.indices);
+      it = residentMeshes.erase(it);
+      meshBuffersFullReported = false;
+    } else {
+      ++it;
+    }
+  }
 }
 
-void RendererVulkan::updateUniformBuffer(uint32_t frame) {
-  const Math::Matrix4 view = scene->camera.getViewMatrix();
+f32 RendererVulkan::projectedSize(const Game::ObjectState &object, const Math::Matrix4 &model) const {
+  const auto &box = object.mesh->getBoundingBox();
+  Math::AABB world = Math::AABB(box.min, box.max).transform(model);
+  Math::Vector3 center = world.center();
+  f32 radius = world.extents().length();
+
+  // distance in front of the camera, which looks down -z in view space
+  f32 depth = -(view(2, 0) * center.x + view(2, 1) * center.y + view(2, 2) * center.z + view(2, 3));
+  if (depth <= radius)
+    return std::numeric_limits<f32>::max();
+  return radius / depth * std::abs(proj(1, 1)) * (f32)extent.height;
+}
+
+void RendererVulkan::streamTextures() {
+  PROFILE_FUNCTION();
+  textureStreamer.update(frameNumber);
+  textureStreamer.takeChanged(currentFrame, changedTextures);
+  if (changedTextures.empty())
+    return;
+
+  // this frame's set isn't in use anymore, the other frames pick the new views up when their turn comes
+  std::vector<VkDescriptorImageInfo> imageInfos(changedTextures.size());
+  std::vector<VkWriteDescriptorSet> writes(changedTextures.size());
+  for (size_t i = 0; i < changedTextures.size(); i++) {
+    imageInfos[i].imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+    imageInfos[i].imageView = textureStreamer.getView(changedTextures[i]);
+    imageInfos[i].sampler = textureSampler;
+
+    writes[i].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+    writes[i].dstSet = blinn.descriptorSets[currentFrame];
+    writes[i].dstBinding = 1;
+    writes[i].dstArrayElement = changedTextures[i];
+    writes[i].descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+    writes[i].descriptorCount = 1;
+    writes[i].pImageInfo = &imageInfos[i];
+  }
+  vkUpdateDescriptorSets(device, (uint32_t)writes.size(), writes.data(), 0, nullptr);
+
+  // updating a set invalidates the command buffers it's bound in
+  invalidateCommands();
+}
 
+void RendererVulkan::updateUniformBuffer(uint32_t frameIndex) {
+  PROFILE_FUNCTION();
   // sky box -----
   Math::Matrix4 viewNoTranslation(view.toMatrix3x3());
   environmentMapUBO[0].mvp = proj * viewNoTranslation;
   environmentMapUBO[0].mvp.inverse();
 
-  memcpy(environmentMap.uniformBuffersMapped[frame], environmentMapUBO.data(),
+  memcpy(environmentMap.uniformBuffersMapped[frameIndex], environmentMapUBO.data(),
          sizeof(EnvironmentMapUniformBufferObject));
 
-  VkMappedMemoryRange memoryRangeEnv{};
-  memoryRangeEnv.sType = VK_STRUCTURE_TYPE_MAPPED_MEMORY_RANGE;
-  memoryRangeEnv.memory = environmentMap.uniformBuffersMemory[frame];
-  memoryRangeEnv.size = sizeof(EnvironmentMapUniformBufferObject);
-  memoryRangeEnv.offset = 0;
-  memoryRangeEnv.pNext = nullptr;
-
-  vkFlushMappedMemoryRanges(device, 1, &memoryRangeEnv);
+  allocator.flush(environmentMap.uniformBuffersMemory[frameIndex], 0, sizeof(EnvironmentMapUniformBufferObject));
 
   // objects -----
-  for (size_t i = 0; i < OBJECT_COUNT; i++) {
-    blinnUBO[i].view = view;
-    blinnUBO[i].proj = proj;
-    blinnUBO[i].model = scene->objects[i].getModelMatrix();
+  blinnUBO[0].view = view;
+  blinnUBO[0].proj = proj;
+
+  memcpy(blinn.uniformBuffersMapped[frameIndex], blinnUBO.data(), sizeof(BlinnUniformBufferObject));
+
+  // written straight into the mapped buffer in instance order
+  InstanceData *instances = static_cast<InstanceData *>(instanceBuffersMapped[frameIndex]);
+  for (size_t i = 0; i < instanceObjects.size(); i++) {
+    const Math::Matrix4 &model = objectModels[instanceObjects[i]];
 
-    blinnUBO[i].mvn = (view * blinnUBO[i].model).toMatrix3x3();
-    blinnUBO[i].mvn.inverse();
-    blinnUBO[i].mvn.transpose();
+    Math::Matrix3 normal = (view * model).toMatrix3x3();
+    normal.inverse();
+    normal.transpose();
+
+    instances[i].model = model;
+    instances[i].normal = Math::Matrix4(normal);
+    instances[i].texture = objectTextures[instanceObjects[i]];
   }
 
-  memcpy(blinn.uniformBuffersMapped[frame], blinnUBO.data(), dynamicUniformBufferSize);
+  auto *commands = static_cast<VkDrawIndexedIndirectCommand *>(indirectBuffersMapped[frameIndex]);
+  if (!draws.empty())
+    memcpy(commands, draws.data(), draws.size() * sizeof(VkDrawIndexedIndirectCommand));
+
+  if (config.gpuCulling) {
+    culling.setFrustum(frameIndex, Math::Frustum::fromMatrix(proj * view), (u32)instanceObjects.size());
 
-  VkMappedMemoryRange memoryRangeBlinn{};
-  memoryRangeBlinn.sType = VK_STRUCTURE_TYPE_MAPPED_MEMORY_RANGE;
-  memoryRangeBlinn.memory = blinn.uniformBuffersMemory[frame];
-  memoryRangeBlinn.size = dynamicUniformBufferSize;
-  memoryRangeBlinn.offset = 0;
-  memoryRangeBlinn.pNext = nullptr;
+    // the culling pass counts the instances that survive and lists them
+    for (size_t i = 0; i < draws.size(); i++)
+      commands[i].instanceCount = 0;
 
-  vkFlushMappedMemoryRanges(device, 1, &memoryRangeBlinn);
+    GpuCulling::Bounds *bounds = culling.getBounds(frameIndex);
+    for (size_t i = 0; i < draws.size(); i++) {
+      const VkDrawIndexedIndirectCommand &draw = draws[i];
+      for (u32 k = draw.firstInstance; k < draw.firstInstance + draw.instanceCount; k++) {
+        const auto &box = frame->objects[instanceObjects[k]].mesh->getBoundingBox();
+        bounds[k] = {{box.min.x, box.min.y, box.min.z}, (u32)i, {box.max.x, box.max.y, box.max.z}, 0};
+      }
+    }
+  } else {
+    culling.writeIdentity(frameIndex, (u32)instanceObjects.size());
+  }
+
+  allocator.flush(blinn.uniformBuffersMemory[frameIndex], 0, sizeof(BlinnUniformBufferObject));
+  allocator.flush(instanceBuffersMemory[frameIndex], 0, instanceObjects.size() * sizeof(InstanceData));
+  allocator.flush(indirectBuffersMemory[frameIndex], 0, draws.size() * sizeof(VkDrawIndexedIndirectCommand));
 }
 
 void RendererVulkan::cleanSwapchain() {
   vkDestroyImageView(device, depthImageView, nullptr);
   vkDestroyImage(device, depthImage, nullptr);
-  vkFreeMemory(device, depthImageMemory, nullptr);
+  allocator.free(depthImageMemory);
 
   for (auto framebuffer : framebuffers)
     vkDestroyFramebuffer(device, framebuffer, nullptr);
@@ -1435,6 +2162,11 @@ void RendererVulkan::cleanSwapchain() {
   for (auto imageView : swapchainImageViews)
     vkDestroyImageView(device, imageView, nullptr);
 
+  if (config.headless) {
+    for (size_t i = 0; i < swapchainImages.size(); i++)
+      allocator.destroyImage(swapchainImages[i], offscreenImagesMemory[i]);
+    return;
+  }
   vkDestroySwapchainKHR(device, swapchain, nullptr);
 }
 
@@ -1461,6 +2193,10 @@ void RendererVulkan::recreateSwapchain() {
   createImageViews();
   createDepthResources();
   createFrameBuffers();
+
+  // the image count may have changed and recorded commands hold the old extent and framebuffers
+  createCommandBuffer();
+  invalidateCommands();
 }
 
 void RendererVulkan::resize() { resized = true; }
@@ -1478,18 +2214,6 @@ VkDeviceSize RendererVulkan::getUniformBufferAlignment(VkDeviceSize instanceSize
   return instanceSize;
 }
 
-uint32_t RendererVulkan::findMemoryType(uint32_t typeFilter, VkMemoryPropertyFlags properties) {
-  VkPhysicalDeviceMemoryProperties mem;
-  vkGetPhysicalDeviceMemoryProperties(physicalDevice, &mem);
-
-  for (uint32_t i = 0; i < mem.memoryTypeCount; i++)
-    if (typeFilter & (1 << i) && (mem.memoryTypes[i].propertyFlags & properties) == properties)
-      return i;
-
-  Util::Error("Failed to find suitable memory type");
-  return UINT32_MAX;
-}
-
 Math::Matrix4 RendererVulkan::perspectiveMatrix(f32 fov, f32 aspect) {
   f32 fovy = TO_RADIANS(fov);
   f32 focalLength = (f32)1.0 / std::tan(fovy * 0.5);
@@ -1504,7 +2228,7 @@ Math::Matrix4 RendererVulkan::perspectiveMatrix(f32 fov, f32 aspect) {
 // ==================================================================================================================
 // Pipeline(s)
 // ==================================================================================================================
-void RendererVulkan::createEnvironmentMapPipeline() {
+void RendererVulkan::createEnvironmentMapPipeline(PipelineBuilds &builds) {
   environmentMap.vertexShaderPath = "src/shaders/env-vertex.spv";
   environmentMap.fragmentShaderPath = "src/shaders/env-fragment.spv";
 
@@ -1528,10 +2252,10 @@ void RendererVulkan::createEnvironmentMapPipeline() {
 
   environmentMap.descriptorPoolSize.resize(2);
   environmentMap.descriptorPoolSize[0].type = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
-  environmentMap.descriptorPoolSize[0].descriptorCount = (uint32_t)MAX_FRAMES_IN_FLIGHT;
+  environmentMap.descriptorPoolSize[0].descriptorCount = framesInFlight;
 
   environmentMap.descriptorPoolSize[1].type = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
-  environmentMap.descriptorPoolSize[1].descriptorCount = (uint32_t)MAX_FRAMES_IN_FLIGHT;
+  environmentMap.descriptorPoolSize[1].descriptorCount = framesInFlight;
 
   environmentMap.uniformObjectSize = sizeof(EnvironmentMapUniformBufferObject);
 
@@ -1552,13 +2276,13 @@ void RendererVulkan::createEnvironmentMapPipeline() {
   environmentMap.bindingDescription = bindingDescription;
 
   createDescriptorSetLayout(environmentMap);
-  createPipeline(environmentMap);
+  createPipelineAsync(environmentMap, builds);
   createUniformBuffers(1, environmentMap);
   createDescriptorPool(environmentMap);
   createDescriptorSets(environmentMap);
 
   // after creating descriptor sets you bind them to the uniform buffers/samplers
-  for (int i = 0; i < MAX_FRAMES_IN_FLIGHT; i++) {
+  for (u32 i = 0; i < framesInFlight; i++) {
     VkDescriptorBufferInfo bufferInfo{};
     bufferInfo.buffer = environmentMap.uniformBuffers[i];
     bufferInfo.offset = 0;
@@ -1594,16 +2318,23 @@ void RendererVulkan::createEnvironmentMapPipeline() {
   }
 }
 
-void RendererVulkan::createBlinnPipeline(size_t objectCount) {
+void RendererVulkan::createBlinnPipeline(size_t objectCount, PipelineBuilds &builds) {
   // Blinn Shading Setup
   blinn.vertexShaderPath = "src/shaders/blinn-vertex.spv";
-  blinn.fragmentShaderPath = "src/shaders/blinn-fragment.spv";
+  if (texturePath == TexturePath::BINDLESS)
+    blinn.fragmentShaderPath = "src/shaders/blinn-fragment.spv";
+  else
+    blinn.fragmentShaderPath = "src/shaders/blinn-fragment-array.spv";
+
+  // the whole texture table is one binding, the array shader takes its size as constant_id 0
+  const u32 textureCount = textureStreamer.getCount();
+  blinn.fragmentConstants = {textureCount};
 
   blinn.depthTest = true;
 
   VkDescriptorSetLayoutBinding uniformBindingBlinn{};
   uniformBindingBlinn.binding = 0;
-  uniformBindingBlinn.descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC;
+  uniformBindingBlinn.descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
   uniformBindingBlinn.descriptorCount = 1;
   uniformBindingBlinn.stageFlags = VK_SHADER_STAGE_VERTEX_BIT;
   uniformBindingBlinn.pImmutableSamplers = nullptr;
@@ -1611,18 +2342,31 @@ void RendererVulkan::createBlinnPipeline(size_t objectCount) {
   VkDescriptorSetLayoutBinding samplerBindingBlinn{};
   samplerBindingBlinn.binding = 1;
   samplerBindingBlinn.descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
-  samplerBindingBlinn.descriptorCount = 1;
+  samplerBindingBlinn.descriptorCount = textureCount;
   samplerBindingBlinn.stageFlags = VK_SHADER_STAGE_FRAGMENT_BIT;
   samplerBindingBlinn.pImmutableSamplers = nullptr;
 
-  blinn.layoutBindings = {uniformBindingBlinn, samplerBindingBlinn};
+  VkDescriptorSetLayoutBinding instanceBindingBlinn{};
+  instanceBindingBlinn.binding = 2;
+  instanceBindingBlinn.descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+  instanceBindingBlinn.descriptorCount = 1;
+  instanceBindingBlinn.stageFlags = VK_SHADER_STAGE_VERTEX_BIT;
+  instanceBindingBlinn.pImmutableSamplers = nullptr;
+
+  VkDescriptorSetLayoutBinding visibleBindingBlinn = instanceBindingBlinn;
+  visibleBindingBlinn.binding = 3;
 
-  blinn.descriptorPoolSize.resize(2);
-  blinn.descriptorPoolSize[0].type = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC;
-  blinn.descriptorPoolSize[0].descriptorCount = (uint32_t)MAX_FRAMES_IN_FLIGHT;
+  blinn.layoutBindings = {uniformBindingBlinn, samplerBindingBlinn, instanceBindingBlinn, visibleBindingBlinn};
+
+  blinn.descriptorPoolSize.resize(3);
+  blinn.descriptorPoolSize[0].type = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
+  blinn.descriptorPoolSize[0].descriptorCount = framesInFlight;
 
   blinn.descriptorPoolSize[1].type = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
-  blinn.descriptorPoolSize[1].descriptorCount = (uint32_t)MAX_FRAMES_IN_FLIGHT;
+  blinn.descriptorPoolSize[1].descriptorCount = framesInFlight * textureCount;
+
+  blinn.descriptorPoolSize[2].type = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+  blinn.descriptorPoolSize[2].descriptorCount = framesInFlight * 2;
 
   blinn.uniformObjectSize = sizeof(BlinnUniformBufferObject);
 
@@ -1630,29 +2374,50 @@ void RendererVulkan::createBlinnPipeline(size_t objectCount) {
   blinn.bindingDescription = Mesh::Mesh::getBindingDescriptions();
 
   createDescriptorSetLayout(blinn);
-  createPipeline(blinn);
-  createUniformBuffers(objectCount, blinn);
+  createPipelineAsync(blinn, builds);
+  createUniformBuffers(1, blinn);
+  createInstanceBuffers(objectCount);
+  // at most one draw per object
+  createIndirectBuffers(objectCount);
+  culling.init(device, allocator, framesInFlight, objectCount, config.gpuCulling, pipelineCache.get());
+  if (config.gpuCulling)
+    builds.count++;
   createDescriptorPool(blinn);
   createDescriptorSets(blinn);
 
+  std::vector<VkDescriptorImageInfo> imageInfos(textureCount);
+  for (u32 slot = 0; slot < textureCount; slot++) {
+    imageInfos[slot].imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+    imageInfos[slot].imageView = textureStreamer.getView(slot);
+    imageInfos[slot].sampler = textureSampler;
+  }
+
   // after creating descriptor sets you bind them to the uniform buffers/samplers
-  for (int i = 0; i < MAX_FRAMES_IN_FLIGHT; i++) {
+  for (u32 i = 0; i < framesInFlight; i++) {
     VkDescriptorBufferInfo bufferInfo{};
     bufferInfo.buffer = blinn.uniformBuffers[i];
     bufferInfo.offset = 0;
     bufferInfo.range = blinn.uniformObjectSize;
 
-    VkDescriptorImageInfo imageInfo{};
-    imageInfo.imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
-    imageInfo.imageView = textureImageView[0];
-    imageInfo.sampler = textureSampler[0];
+    VkDescriptorBufferInfo instanceInfo{};
+    instanceInfo.buffer = instanceBuffers[i];
+    instanceInfo.offset = 0;
+    instanceInfo.range = VK_WHOLE_SIZE;
 
-    std::array<VkWriteDescriptorSet, 2> descriptorWrites{};
+    if (config.gpuCulling)
+      culling.setBuffers((u32)i, instanceBuffers[i], indirectBuffers[i]);
+
+    VkDescriptorBufferInfo visibleInfo{};
+    visibleInfo.buffer = culling.getVisibleBuffer((u32)i);
+    visibleInfo.offset = 0;
+    visibleInfo.range = VK_WHOLE_SIZE;
+
+    std::array<VkWriteDescriptorSet, 4> descriptorWrites{};
     descriptorWrites[0].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
     descriptorWrites[0].dstSet = blinn.descriptorSets[i];
     descriptorWrites[0].dstBinding = 0;
     descriptorWrites[0].dstArrayElement = 0;
-    descriptorWrites[0].descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC;
+    descriptorWrites[0].descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
     descriptorWrites[0].descriptorCount = 1;
     descriptorWrites[0].pBufferInfo = &bufferInfo;
     descriptorWrites[0].pImageInfo = nullptr;
@@ -1663,13 +2428,58 @@ void RendererVulkan::createBlinnPipeline(size_t objectCount) {
     descriptorWrites[1].dstBinding = 1;
     descriptorWrites[1].dstArrayElement = 0;
     descriptorWrites[1].descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
-    descriptorWrites[1].descriptorCount = 1;
+    descriptorWrites[1].descriptorCount = textureCount;
     descriptorWrites[1].pBufferInfo = nullptr;
-    descriptorWrites[1].pImageInfo = &imageInfo;
+    descriptorWrites[1].pImageInfo = imageInfos.data();
     descriptorWrites[1].pTexelBufferView = nullptr;
 
+    descriptorWrites[2].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+    descriptorWrites[2].dstSet = blinn.descriptorSets[i];
+    descriptorWrites[2].dstBinding = 2;
+    descriptorWrites[2].dstArrayElement = 0;
+    descriptorWrites[2].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+    descriptorWrites[2].descriptorCount = 1;
+    descriptorWrites[2].pBufferInfo = &instanceInfo;
+    descriptorWrites[2].pImageInfo = nullptr;
+    descriptorWrites[2].pTexelBufferView = nullptr;
+
+    descriptorWrites[3] = descriptorWrites[2];
+    descriptorWrites[3].dstBinding = 3;
+    descriptorWrites[3].pBufferInfo = &visibleInfo;
+
     vkUpdateDescriptorSets(device, descriptorWrites.size(), descriptorWrites.data(), 0, nullptr);
   }
 }
 
+void RendererVulkan::createInstanceBuffers(size_t objectCount) {
+  VkDeviceSize size = std::max<size_t>(objectCount, 1) * sizeof(InstanceData);
+
+  instanceBuffers.resize(framesInFlight);
+  instanceBuffersMemory.resize(framesInFlight);
+  instanceBuffersMapped.resize(framesInFlight);
+
+  for (u32 i = 0; i < framesInFlight; i++) {
+    createBuffer(size, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT, instanceBuffers[i],
+                 instanceBuffersMemory[i]);
+
+    instanceBuffersMapped[i] = instanceBuffersMemory[i].mapped;
+  }
+}
+
+void RendererVulkan::createIndirectBuffers(size_t maxDraws) {
+  VkDeviceSize size = std::max<size_t>(maxDraws, 1) * sizeof(VkDrawIndexedIndirectCommand);
+
+  indirectBuffers.resize(framesInFlight);
+  indirectBuffersMemory.resize(framesInFlight);
+  indirectBuffersMapped.resize(framesInFlight);
+
+  for (u32 i = 0; i < framesInFlight; i++) {
+    // storage so the culling pass can fill in instance counts
+    createBuffer(size, VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT | VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
+                 VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT, indirectBuffers[i], indirectBuffersMemory[i]);
+
+    indirectBuffersMapped[i] = indirectBuffersMemory[i].mapped;
+  }
+}
+
 } // namespace Renderer
@@ -14,13 +14,91 @@
 #include <vulkan/vulkan_core.h>
 
 #include <cstdint>
+#include <exception>
+#include <memory>
+#include <mutex>
 #include <optional>
 #include <string>
+#include <unordered_map>
+#include <utility>
 #include <vector>
 
 #include "../game/scene.hpp"
+#include "../threads/threads.hpp"
+#include "../util/range-allocator.hpp"
+#include "../util/texture-file.hpp"
+#include "gpu-culling.hpp"
+#include "gpu-profiler.hpp"
+#include "memory-allocator.hpp"
+#include "pipeline-cache.hpp"
+#include "staging-ring.hpp"
+#include "texture-streamer.hpp"
 
 namespace Renderer {
+/**
+ * @brief Present mode the swapchain asks for, FIFO (always supported) when the surface lacks it
+ */
+enum class PresentPolicy {
+  // frames go out as soon as they're done and may tear, falls back to MAILBOX first
+  IMMEDIATE,
+  // the newest finished frame goes out at each vblank, no tearing and rendering isn't throttled
+  MAILBOX,
+  // frames queue for vblank, throttled to the refresh rate
+  FIFO,
+};
+
+/**
+ * @brief Renderer options picked at startup
+ */
+struct RendererConfig {
+  // cull objects against the frustum in a compute pass (needs indirect draws with firstInstance)
+  bool gpuCulling = false;
+  // threads recording draws into secondary command buffers, 0 picks one per pool worker plus the caller
+  u32 recordThreads = 0;
+  // submit recorded command buffers again until what they were recorded from changes
+  bool cacheCommands = true;
+  // run uploads on a transfer only queue family when the device has one (and timeline semaphores)
+  bool transferQueue = true;
+  // pipeline cache file, empty to compile every pipeline from scratch each run
+  std::string pipelineCachePath = "pipeline-cache.bin";
+  // index every texture from one array in the shader when the device has descriptor indexing,
+  // otherwise draws are split per texture
+  bool bindlessTextures = true;
+  // keep only the mip levels textures need on screen resident, false uploads every level once
+  bool textureStreaming = true;
+  // sample block compressed textures as they are when the device supports their format,
+  // false decodes them to RGBA8 like on devices that don't
+  bool textureCompression = true;
+  // frames the CPU may record ahead of the GPU (1 to 4), fewer cut input latency, more smooth out stalls
+  u32 framesInFlight = 2;
+  PresentPolicy presentPolicy = PresentPolicy::IMMEDIATE;
+  // frames per second the window thread starts at most, 0 doesn't limit (see FramePacer)
+  f64 frameRateCap = 0.0;
+  // render into offscreen images without a window, surface or swapchain (init gets no window),
+  // for benchmarks and software drivers on machines without a display
+  bool headless = false;
+  // timestamp scopes around the passes and pipeline statistics around the render pass (see GpuProfiler)
+  bool gpuProfiling = true;
+};
+
+/**
+ * @brief Command recording totals since startup, recording time includes checking whether a frame can be reused
+ */
+struct RecordStats {
+  u64 frames = 0;
+  u64 recorded = 0;
+  f64 recordMs = 0;
+};
+
+/**
+ * @brief Objects of the last drawn frame that passed and failed the frustum test
+ */
+struct CullStats {
+  u32 drawn = 0;
+  // left out by the scene's spatial index or the frustum test here
+  u32 culled = 0;
+};
+
 // ====================================================================================================================
 // Render Vulkan Class
 // ====================================================================================================================
@@ -30,7 +108,10 @@ public:
   RendererVulkan(uint32_t width, uint32_t height);
   ~RendererVulkan();
 
-  void init(GLFWwindow *window, uint32_t width, uint32_t height);
+  /**
+   * @param window nullptr when config.headless is set
+   */
+  void init(GLFWwindow *window, uint32_t width, uint32_t height, RendererConfig config = {});
 
   void createAssets(Game::Scene *scene);
   void createPipelines();
@@ -44,6 +125,47 @@ public:
    */
   void resize();
 
+  /**
+   * Frame packet to draw next and the blend factor between its two ticks
+   */
+  void setFrame(const Game::FramePacket *packet, f32 alpha);
+
+  /**
+   * With GPU culling the numbers come back with the frame's fence, so they lag a few frames behind
+   */
+  CullStats getCullStats() const;
+  /**
+   * @brief Projection frames are drawn with, the scene culls its frame packets against it
+   */
+  const Math::Matrix4 &getProjection() const;
+  RecordStats getRecordStats() const;
+  /**
+   * @brief Per pass GPU times and pipeline statistics, a frame in flight behind
+   */
+  const GpuProfiler &getProfiler() const;
+
+  /**
+   * @brief Blocks, used and free device memory and how fragmented it is, and what went through the staging ring
+   */
+  void printMemoryStats() const;
+  /**
+   * @brief How long the pipelines took to create and whether the cache file was used
+   */
+  void printPipelineStats() const;
+  /**
+   * @brief The present mode the swapchain got, frames in flight and swapchain images
+   */
+  void printPresentStats() const;
+
+  /**
+   * @brief Block until the GPU finished every submitted frame
+   */
+  void waitIdle();
+  /**
+   * @brief Headless only, wait for the GPU, then write the last drawn frame to a PNG file
+   */
+  void saveFrame(const std::string &path);
+
 private:
   // ==================================================================================================================
   // Internal Structs
@@ -51,15 +173,42 @@ private:
   /**
    * @brief QueueFamily struct
    *
-   * @details We will need graphics and present families
+   * @details We will need graphics and present families, a transfer family
+   *          without graphics is optional
    */
   struct QueueFamily {
     std::optional<uint32_t> graphics;
     std::optional<uint32_t> present;
+    std::optional<uint32_t> transfer;
 
     bool compatible() { return graphics.has_value() && present.has_value(); }
   };
 
+  /**
+   * @brief Secondary command buffer of one recording thread
+   *
+   * @details Command pools are externally synchronized, so every recording
+   *          thread gets its own
+   */
+  struct RecordingContext {
+    VkCommandPool pool = VK_NULL_HANDLE;
+    VkCommandBuffer commandBuffer = VK_NULL_HANDLE;
+  };
+
+  /**
+   * @brief Graphics pipelines compiling on the thread pool
+   *
+   * @details The first error thrown by a build is kept and rethrown by the
+   *          thread that waits on the group
+   */
+  struct PipelineBuilds {
+    // pipelines created, graphics and compute
+    u32 count = 0;
+    Threads::ThreadPool::TaskGroup group;
+    std::mutex mutex;
+    std::exception_ptr error;
+  };
+
   /**
    * @brief Swapchain details struct
    *
@@ -90,7 +239,7 @@ private:
     std::vector<VkDescriptorPoolSize> descriptorPoolSize;
 
     std::vector<VkBuffer> uniformBuffers;
-    std::vector<VkDeviceMemory> uniformBuffersMemory;
+    std::vector<Allocation> uniformBuffersMemory;
     std::vector<void *> uniformBuffersMapped;
 
     std::vector<VkVertexInputAttributeDescription> attributeDescriptions;
@@ -101,6 +250,9 @@ private:
     bool depthTest;
 
     VkDeviceSize uniformObjectSize;
+
+    // fragment shader specialization constants, constant_id i is fragmentConstants[i]
+    std::vector<u32> fragmentConstants;
   };
 
   // ==================================================================================================================
@@ -109,13 +261,11 @@ private:
 
   /* Blinn Shading */
   /**
-   * @brief Blinn uniform object struct
+   * @brief Blinn uniform object struct (shared by every object in the frame)
    */
   struct BlinnUniformBufferObject {
-    alignas(16) Math::Matrix4 model;
     alignas(16) Math::Matrix4 view;
     alignas(16) Math::Matrix4 proj;
-    alignas(32) Math::Matrix3 mvn;
   };
 
   /**
@@ -128,17 +278,79 @@ private:
    */
   Pipeline blinn{};
 
-  void createBlinnPipeline(size_t objectCount);
+  /**
+   * @brief Instance storage buffers for Blinn pipeline, one per frame in flight, persistently mapped
+   */
+  std::vector<VkBuffer> instanceBuffers;
+  std::vector<Allocation> instanceBuffersMemory;
+  std::vector<void *> instanceBuffersMapped;
+
+  void createBlinnPipeline(size_t objectCount, PipelineBuilds &builds);
+
+  void createInstanceBuffers(size_t objectCount);
+
+  /**
+   * @brief Indirect draw buffers for Blinn pipeline, one per frame in flight, persistently mapped
+   */
+  std::vector<VkBuffer> indirectBuffers;
+  std::vector<Allocation> indirectBuffersMemory;
+  std::vector<void *> indirectBuffersMapped;
+
+  void createIndirectBuffers(size_t maxDraws);
+
+  /**
+   * @brief Frustum culling pass, also owns the visible list the blinn vertex shader reads instances through
+   */
+  GpuCulling culling;
+  GpuProfiler profiler;
+  // pipelineStatisticsQuery and inheritedQueries are enabled
+  bool pipelineStatistics = false;
+
+  /**
+   * @brief How draws are submitted, picked from the device features
+   *
+   * @details Indirect commands with a non zero firstInstance need
+   *          drawIndirectFirstInstance, without it draws are recorded
+   *          directly. Without multiDrawIndirect every command is its own
+   *          indirect draw.
+   */
+  enum class DrawPath { DIRECT, INDIRECT, MULTI_DRAW_INDIRECT } drawPath = DrawPath::DIRECT;
+  uint32_t maxDrawIndirectCount = 1;
+
+  /**
+   * @brief How the texture table is indexed, picked from the device features
+   *
+   * @details Every object's texture lives in one array bound once per frame,
+   *          instances carry their slot in it. BINDLESS indexes the array with
+   *          the instance's slot directly (non uniform indexing from
+   *          descriptor indexing), so objects sharing a mesh stay one draw
+   *          whatever their textures. ARRAY only has dynamic indexing, which
+   *          needs the same slot across a draw, so draws are split per mesh
+   *          and texture.
+   */
+  enum class TexturePath { BINDLESS, ARRAY } texturePath = TexturePath::ARRAY;
+  // size limit of the texture table
+  u32 maxTextures = 1;
+  // bit per Util::TextureFormat the device samples, compressed textures in other formats are decoded to RGBA8
+  u32 sampledFormats = 1u << (u32)Util::TextureFormat::RGBA8;
+
+  bool canSample(Util::TextureFormat format) const;
 
   /* Environment Map */
 
   VkImage cubemapImage;
-  VkDeviceMemory cubemapImageMemory;
+  Allocation cubemapImageMemory;
   VkImageView cubemapImageView;
   VkSampler cubemapSampler;
+  Util::TextureFormat cubemapFormat = Util::TextureFormat::RGBA8;
+  // device memory of every face and level, and what it would take as RGBA8
+  u64 cubemapBytes = 0;
+  u64 cubemapUncompressedBytes = 0;
+  // the scene has an environment map, without one the cubemap is a black placeholder and isn't drawn
+  bool skyBox = true;
 
   VkBuffer envBuffer;
-  VkDeviceMemory envMemory;
+  Allocation envMemory;
 
   f32 environmentMapVertices[9] = {-1.0, 1.0,  0.999, //
                                    3.0,  1.0,  0.999, //
@@ -161,7 +373,7 @@ private:
    */
   Pipeline environmentMap{};
 
-  void createEnvironmentMapPipeline();
+  void createEnvironmentMapPipeline(PipelineBuilds &builds);
 
   // ==================================================================================================================
   // Vulkan Initilization
@@ -195,6 +407,10 @@ private:
    * @brief Create a Vulkan swapchain object
    */
   void createSwapchain();
+  /**
+   * @brief Headless, color images the frames render into in place of the swapchain's
+   */
+  void createOffscreenImages();
 
   /**
    * @brief Create a Vulkan ImageView object
@@ -214,37 +430,59 @@ private:
 
   void createPipeline(Pipeline &pipeline);
 
+  /**
+   * @brief createPipeline on a worker, the pipeline's descriptor set layout has to exist already
+   *
+   * @details Only pipelineLayout and pipeline are written, so the caller can
+   *          keep setting up the rest of the Pipeline meanwhile
+   */
+  void createPipelineAsync(Pipeline &pipeline, PipelineBuilds &builds);
+
   void createFrameBuffers();
 
   void createCommandPool();
 
   void createDepthResources();
 
-  void createTextureImage(void **textureData, int width, int height, VkImage &image, VkDeviceMemory &imageMemory,
-                          uint32_t layers, VkImageCreateFlags flags);
+  /**
+   * @param textureData level l of layer i is textureData[i * levels + l]
+   */
+  void createTextureImage(const void *const *textureData, uint32_t width, uint32_t height, Util::TextureFormat format,
+                          bool srgb, uint32_t levels, VkImage &image, Allocation &imageMemory, uint32_t layers,
+                          VkImageCreateFlags flags);
 
-  void createTextureImageView(VkImage &image, VkImageViewType viewType, VkImageView &imageView, uint32_t layers);
+  void createTextureImageView(VkImage &image, VkImageViewType viewType, VkImageView &imageView, uint32_t layers,
+                              VkFormat format = VK_FORMAT_R8G8B8A8_SRGB, uint32_t levels = 1);
 
-  void createTextureSampler(VkSampler &sampler);
+  /**
+   * @param maxLod VK_LOD_CLAMP_NONE to sample every mip level the image has
+   */
+  void createTextureSampler(VkSampler &sampler, f32 maxLod = 0.0f);
 
   void createDescriptorSets(Pipeline &pipeline);
 
-  void createVertexBuffer(void *vertexData, size_t size, VkBuffer &buffer, VkDeviceMemory &memory);
-
-  void createIndexBuffer(void *indexData, size_t size);
+  void createVertexBuffer(void *vertexData, size_t size, VkBuffer &buffer, Allocation &memory);
 
   void createUniformBuffers(size_t objectCount, Pipeline &pipeline);
 
   void createDescriptorPool(Pipeline &pipeline);
 
+  /**
+   * @brief A primary command buffer per frame in flight and swapchain image, (re)allocated with the swapchain
+   */
   void createCommandBuffer();
 
+  /**
+   * @brief A command pool and secondary command buffer per frame in flight and recording thread
+   */
+  void createRecordingContexts();
+
   void createSyncObjects();
 
   // ==================================================================================================================
   // Helper Methods
   // ==================================================================================================================
-  void createTexture(void *textureData, int width, int height, VkImage &image, VkDeviceMemory &imageMemory,
+  void createTexture(void *textureData, int width, int height, VkImage &image, Allocation &imageMemory,
                      VkImageView &imageView, VkSampler sampler);
 
   bool hasStencilComponent(VkFormat format);
@@ -254,9 +492,7 @@ private:
   VkFormat findSupportedFormat(const std::vector<VkFormat> &candidates, VkImageTiling tiling,
                                VkFormatFeatureFlags features);
   VkImageView createImageView(VkImage image, VkImageViewType viewType, VkFormat format, VkImageAspectFlags aspectFlags,
-                              uint32_t layers);
-
-  void copyBufferToImage(VkBuffer buffer, VkImage image, uint32_t width, uint32_t height, uint32_t layers);
+                              uint32_t layers, uint32_t levels = 1);
 
   void transitionImageLayout(VkImage image, VkFormat format, VkImageLayout oldLayout, VkImageLayout newLayout,
                              uint32_t layers);
@@ -266,17 +502,56 @@ private:
   void endSingleTimeCommands(VkCommandBuffer commandBuffer);
 
   void createImage(uint32_t width, uint32_t height, VkFormat format, VkImageTiling tiling, VkImageUsageFlags usage,
-                   VkMemoryPropertyFlags properties, VkImage &image, VkDeviceMemory &imageMemory, uint32_t layers,
-                   VkImageCreateFlags flags);
+                   VkMemoryPropertyFlags properties, VkImage &image, Allocation &imageMemory, uint32_t layers,
+                   VkImageCreateFlags flags, uint32_t levels = 1);
 
-  void updateUniformBuffer(uint32_t frame);
+  void updateUniformBuffer(uint32_t frameIndex);
 
   bool checkValidationLayerSupport();
 
   void createBuffer(VkDeviceSize size, VkBufferUsageFlags usage, VkMemoryPropertyFlags properties, VkBuffer &buffer,
-                    VkDeviceMemory &memory);
+                    Allocation &memory);
+
+  /**
+   * @brief Copy host data into part of a device local buffer through the staging ring
+   *
+   * @details Only recorded, the copy reaches the GPU with the next staging.submit()
+   */
+  void uploadToBuffer(const void *data, VkDeviceSize size, VkBuffer dstBuffer, VkDeviceSize dstOffset);
+
+  // ==================================================================================================================
+  // Mesh Residency
+  // ==================================================================================================================
+  /**
+   * @brief Test the current packet's objects against the interpolated camera frustum, fills visibleObjects
+   */
+  void cullObjects();
+
+  /**
+   * @brief Upload meshes the current packet draws for the first time and build this frame's draw list,
+   *        one instanced draw per mesh (per mesh and texture on the array texture path)
+   */
+  void prepareDraws();
+
+  /**
+   * @brief Suballocate a mesh from the mesh buffers and upload it, false when they're full
+   */
+  bool uploadMesh(const std::shared_ptr<const Mesh::Mesh> &mesh);
 
-  void copyBuffer(VkBuffer srcBuffer, VkBuffer dstBuffer, VkDeviceSize size);
+  /**
+   * @brief Give back the ranges of meshes no packet references and no frame in flight draws
+   */
+  void releaseUnusedMeshes();
+
+  /**
+   * @brief About how many pixels across the object covers on screen, from its bounding box
+   */
+  f32 projectedSize(const Game::ObjectState &object, const Math::Matrix4 &model) const;
+
+  /**
+   * @brief Stream the mip levels prepareDraws asked for and point this frame's descriptor set at changed textures
+   */
+  void streamTextures();
 
   QueueFamily setupQueueFamilies(VkPhysicalDevice physicalDevice);
 
@@ -303,9 +578,38 @@ private:
 
   VkShaderModule createShaderModule(std::vector<char> &shader);
 
+  /**
+   * @brief Command buffer to submit for the current frame, recorded again only when something it depends on changed
+   *
+   * @details Per frame data (matrices, indirect draws, the culling
+   *          frustum) goes through mapped buffers, so the commands only
+   *          depend on the number of draws (their contents too on the direct
+   *          path), the culled instance count, the swapchain and pipelines.
+   */
+  VkCommandBuffer prepareCommandBuffer(uint32_t imageIndex);
+
+  /**
+   * @brief Forget every recorded command buffer, after the swapchain or pipelines changed
+   */
+  void invalidateCommands();
+
+  /**
+   * @brief Record the current frame's draws into its secondary command buffers
+   */
+  void recordSecondaries();
+
   void recordCommandBuffer(VkCommandBuffer commandBuffer, uint32_t imageIndex);
 
-  uint32_t findMemoryType(uint32_t typeFilter, VkMemoryPropertyFlags properties);
+  /**
+   * @brief Record draws [firstDraw, lastDraw) into a secondary command buffer that continues the render pass
+   *
+   * @details Secondary command buffers inherit no state, so each one binds
+   *          its own pipeline, buffers and viewport. Safe to call from
+   *          several threads at once with different contexts. The first
+   *          chunk also draws the sky box, the first and last open and close
+   *          the profiler's blinn scope.
+   */
+  void recordDraws(RecordingContext &context, size_t firstDraw, size_t lastDraw, bool firstChunk, bool lastChunk);
 
   VkDeviceSize getMinUniformBufferOffsetAlignment();
 
@@ -318,15 +622,26 @@ private:
   // ==================================================================================================================
   GLFWwindow *window;
   VkInstance instance;
+  // API version the instance was created with
+  uint32_t instanceVersion = VK_API_VERSION_1_0;
   VkPhysicalDevice physicalDevice = VK_NULL_HANDLE;
   QueueFamily queueFamily;
   VkDevice device;
+  // every buffer and image gets its memory from here
+  MemoryAllocator allocator;
+  // every upload is copied through here
+  StagingRing staging;
   VkSurfaceKHR surface;
   VkSwapchainKHR swapchain;
   VkExtent2D swapchainExtent;
   std::vector<VkImageView> swapchainImageViews;
   std::vector<VkImage> swapchainImages;
   VkFormat swapchainImageFormat;
+  // headless, the images stand in for the swapchain's, one per frame in flight
+  std::vector<Allocation> offscreenImagesMemory;
+  // image the last submitted frame rendered into
+  uint32_t lastImageIndex = 0;
+  VkPresentModeKHR presentMode = VK_PRESENT_MODE_FIFO_KHR;
   VkExtent2D extent;
 
   VkRenderPass colorAndDepthRenderPass;
@@ -336,15 +651,41 @@ private:
   VkDeviceSize minUniformSize;
 
   std::vector<VkFramebuffer> framebuffers;
-  std::vector<VkCommandBuffer> commandBuffers;
+  // [frame in flight][swapchain image]
+  std::vector<std::vector<VkCommandBuffer>> commandBuffers;
+  // version of the recorded frame each command buffer holds, 0 when it holds nothing usable
+  std::vector<std::vector<u64>> commandBufferVersions;
   VkCommandPool commandPool;
 
+  // what the secondaries of a frame in flight were last recorded from
+  struct RecordedFrame {
+    u64 version = 0;
+    size_t drawCount = 0;
+    size_t instanceCount = 0;
+    size_t secondaryCount = 0;
+    // only compared on the direct path, the indirect paths read draws from memory
+    std::vector<VkDrawIndexedIndirectCommand> draws;
+  };
+  std::vector<RecordedFrame> recordedFrames;
+  u64 recordVersion = 0;
+  RecordStats recordStats;
+
+  // loaded before the pipelines are created, saved after
+  PipelineCache pipelineCache;
+  u32 pipelineCount = 0;
+  f64 pipelineMs = 0;
+
+  // [frame in flight][thread]
+  std::vector<std::vector<RecordingContext>> recordingContexts;
+
   std::vector<VkSemaphore> imageAvailableSem;
   std::vector<VkSemaphore> renderFinishedSem;
   std::vector<VkFence> inFlightFence;
 
   VkQueue graphicsQueue;
   VkQueue presentQueue;
+  // VK_NULL_HANDLE when uploads share the graphics queue
+  VkQueue transferQueue = VK_NULL_HANDLE;
   uint32_t currentFrame = 0;
   bool resized = false;
 
@@ -352,33 +693,69 @@ private:
    * Depth needed for 3D rendering
    */
   VkImage depthImage;
-  VkDeviceMemory depthImageMemory;
+  Allocation depthImageMemory;
   VkImageView depthImageView;
 
   /**
    * Vertex data
-   *  (we'll combine scene mesh data into one big buffer)
+   *  (all meshes live in one big vertex and index buffer, allocated once with room to spare
+   *   and suballocated as meshes come and go)
    */
   VkBuffer meshBuffer;
-  VkDeviceMemory meshMemory;
+  Allocation meshMemory;
   VkBuffer indexBuffer;
-  VkDeviceMemory indexMemory;
+  Allocation indexMemory;
 
-  // data needed to be able to index into individual models from our big mesh buffer
-  std::vector<int32_t> vertexOffsets;
-  std::vector<uint32_t> indexOffsets;
-  std::vector<uint32_t> indexCount;
+  /**
+   * @brief Where a mesh lives in the mesh buffers (in vertices and indices)
+   */
+  struct MeshAllocation {
+    // when this is the last reference no packet can draw the mesh anymore
+    std::shared_ptr<const Mesh::Mesh> mesh;
+    Util::RangeAllocator::Range vertices;
+    Util::RangeAllocator::Range indices;
+    u64 lastUsedFrame = 0;
+    // the mesh's draw in the current frame
+    u32 draw = 0;
+    // texture slot of that draw (the array texture path splits draws per texture)
+    u32 drawTexture = 0;
+  };
+
+  std::unordered_map<const Mesh::Mesh *, MeshAllocation> residentMeshes;
+  Util::RangeAllocator vertexAllocator;
+  Util::RangeAllocator indexAllocator;
+  // one instanced draw per mesh (and texture on the array texture path),
+  // instances of a draw are instanceObjects[firstInstance, firstInstance + instanceCount)
+  std::vector<VkDrawIndexedIndirectCommand> draws;
+  // packet object index of every instance, grouped by draw
+  std::vector<u32> instanceObjects;
+  // (object, draw) of every visible object in packet order, used while grouping
+  std::vector<std::pair<u32, u32>> visibleDraws;
+  // draws of meshes with more than one texture this frame, keyed by the mesh's first draw and the texture slot
+  std::unordered_map<u64, u32> textureDraws;
+  // texture slot of every visible object, indexed like the packet's objects
+  std::vector<u32> objectTextures;
+  // packet objects inside the frustum, in packet order
+  std::vector<u32> visibleObjects;
+  // interpolated model matrix of every visible object, indexed like the packet's objects
+  std::vector<Math::Matrix4> objectModels;
+  CullStats cullStats;
+  u64 frameNumber = 0;
+  bool meshBuffersFullReported = false;
 
   VkDeviceSize alignment;
   VkDeviceSize dynamicUniformBufferSize;
 
   /**
    * Texture
+   *  (every texture in the table, mipmapped and streamed, all sampled through one sampler)
    */
-  std::vector<VkImage> textureImage;
-  std::vector<VkDeviceMemory> textureImageMemory;
-  std::vector<VkImageView> textureImageView;
-  std::vector<VkSampler> textureSampler;
+  TextureStreamer textureStreamer;
+  VkSampler textureSampler;
+  // textures whose views this frame's descriptor set has to pick up
+  std::vector<u32> changedTextures;
+  // slot in the texture table of each texture's pixels (see Game::ObjectState::texture), slot 0 is DEFAULT_IMAGE
+  std::unordered_map<const void *, u32> textureSlots;
 
   // Projection matrix
   Math::Matrix4 proj;
@@ -391,6 +768,16 @@ private:
    */
   Game::Scene *scene;
 
+  /**
+   * Snapshot of the scene being drawn, the live scene is only touched while creating assets
+   */
+  const Game::FramePacket *frame = nullptr;
+  f32 interpolation = 1.0f;
+  // interpolated camera of the frame being built
+  Math::Matrix4 view;
+
+  RendererConfig config;
+
   /**
    * List of wanted validation layers
    */
@@ -415,14 +802,15 @@ private:
   uint32_t HEIGHT;
 
   /**
-   * Number of objects to render
+   * Most objects that can be drawn at once (the scene capacity)
    */
   size_t OBJECT_COUNT = 0;
 
   /**
-   * Number of frames in flight at a time (2 is double buffering)
+   * Number of frames in flight at a time (2 is double buffering), from the config
    */
-  const int MAX_FRAMES_IN_FLIGHT = 2;
+  u32 framesInFlight = 2;
+  static constexpr u32 MAX_FRAMES_IN_FLIGHT = 4;
 
   /**
    * Enable validation layers in debug mode
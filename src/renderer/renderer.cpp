@@ -1,15 +1,24 @@
 #include <GLFW/glfw3.h>
 
 #include "../game/scene.hpp"
+#include "../game/texture-loader.hpp"
+#include "../util/profiler.hpp"
 #include "../util/util.hpp"
 #include "input.hpp"
 #include "renderer.hpp"
 
+#include <algorithm>
+#include <chrono>
 #include <cmath>
+#include <iostream>
+#include <unordered_set>
+#include <utility>
 
 namespace Renderer {
 
-Renderer::Renderer(int w, int h, Game::Scene &scene) {
+Renderer::Renderer(int w, int h, Game::Scene &&scene, Game::GameLoop::Config loopConfig,
+                   RendererConfig rendererConfig)
+    : scene(std::move(scene)), loop(loopConfig) {
   WIDTH = w;
   HEIGHT = h;
 
@@ -17,49 +26,187 @@ Renderer::Renderer(int w, int h, Game::Scene &scene) {
   my = h / 2.0;
 
   state = State::RUNNING;
+  headless = rendererConfig.headless;
 
-  glfwInit();
+  // headless there's no window, input or events, GLFW isn't even initialized
+  this->window = nullptr;
+  if (!headless) {
+    glfwInit();
 
-  glfwWindowHint(GLFW_CLIENT_API, GLFW_NO_API);
-  glfwWindowHint(GLFW_RESIZABLE, GLFW_FALSE);
-  /* glfwWindowHint(GLFW_RESIZABLE, GLFW_TRUE); */
-  this->window = glfwCreateWindow(WIDTH, HEIGHT, "Vulkan Engine", nullptr, nullptr);
-  this->scene = scene;
+    glfwWindowHint(GLFW_CLIENT_API, GLFW_NO_API);
+    glfwWindowHint(GLFW_RESIZABLE, GLFW_FALSE);
+    /* glfwWindowHint(GLFW_RESIZABLE, GLFW_TRUE); */
+    this->window = glfwCreateWindow(WIDTH, HEIGHT, "Vulkan Engine", nullptr, nullptr);
+  }
+  auto start = std::chrono::steady_clock::now();
   this->scene.init();
+  auto sceneLoaded = std::chrono::steady_clock::now();
+
+  if (!headless) {
+    glfwSetInputMode(window, GLFW_CURSOR, GLFW_CURSOR_DISABLED);
+    glfwSetWindowUserPointer(window, this);
+    glfwSetKeyCallback(window, keyCallback);
+    glfwSetCursorPosCallback(window, mousePointerCallback);
+    glfwSetFramebufferSizeCallback(window, resizeCallback);
+  }
 
-  glfwSetInputMode(window, GLFW_CURSOR, GLFW_CURSOR_DISABLED);
-  glfwSetWindowUserPointer(window, this);
-  glfwSetKeyCallback(window, keyCallback);
-  glfwSetCursorPosCallback(window, mousePointerCallback);
-  glfwSetFramebufferSizeCallback(window, resizeCallback);
-
-  rendererbackend.init(this->window, WIDTH, HEIGHT);
+  rendererbackend.init(this->window, WIDTH, HEIGHT, rendererConfig);
+  pacer.setFrameRateCap(rendererConfig.frameRateCap);
   rendererbackend.createAssets(&this->scene);
   rendererbackend.createPipelines();
+  auto assetsLoaded = std::chrono::steady_clock::now();
+
+  using Ms = std::chrono::duration<double, std::milli>;
+  startupReport(Ms(sceneLoaded - start).count(), Ms(assetsLoaded - sceneLoaded).count());
+
+  // packets only list what the spatial index finds in view
+  this->scene.setProjection(rendererbackend.getProjection());
+
+  // the renderer needs a packet before the first tick
+  this->scene.extract(packets.beginWrite(), 0);
+  packets.publish();
+
+  loop.start([this](f64 dt) { tick(dt); });
+}
+
+void Renderer::startupReport(double sceneMs, double assetsMs) {
+  // shared meshes count once
+  size_t meshBytes = 0;
+  std::unordered_set<const Mesh::Mesh *> seen;
+  for (auto &obj : scene.objects) {
+    const Mesh::Mesh &mesh = obj.getMesh();
+    if (seen.insert(&mesh).second)
+      meshBytes += mesh.getVertexDataSize() + mesh.getIndexDataSize();
+  }
+
+  const f64 MB = 1024.0 * 1024.0;
+  std::cout << "---------------- STARTUP ----------------\n";
+  std::cout << "Scene init: " << sceneMs << " ms (" << scene.objects.size() << " objects, " << meshBytes / MB
+            << " MB of mesh data)\n";
+  std::cout << "GPU assets + pipelines: " << assetsMs << " ms\n";
+  std::cout << "Mesh copies: " << Mesh::Mesh::getCopyCount() << " (" << Mesh::Mesh::getCopiedBytes() / MB
+            << " MB)\n";
+  std::cout << "Peak memory: " << Util::peakMemoryUsage() / MB << " MB\n";
+  Game::TextureLoader::global().printStats();
+  rendererbackend.printPipelineStats();
+  rendererbackend.printPresentStats();
+  if (pacer.getFrameRateCap() > 0.0)
+    std::cout << "Frame rate cap: " << pacer.getFrameRateCap() << " fps\n";
+  rendererbackend.printMemoryStats();
+  std::cout << "-----------------------------------------\n";
 }
 
 void Renderer::draw() {
   if (state != State::RUNNING)
     return;
 
-  f32 speed = 0.0007;
+  f32 alpha = (f32)loop.frame();
+  rendererbackend.setFrame(&packets.acquire(), alpha);
+  rendererbackend.drawScene();
+  pacer.markPresent();
+  Util::Profiler::global().frameMark();
+}
+
+void Renderer::runHeadless(u32 frameCount, const std::string &imagePath) {
+  using Ms = std::chrono::duration<f64, std::milli>;
+  std::vector<f64> frameMs;
+  frameMs.reserve(frameCount);
+  RecordStats recordStart = rendererbackend.getRecordStats();
+
+  auto start = std::chrono::steady_clock::now();
+  for (u32 i = 0; i < frameCount && running(); i++) {
+    auto frameStart = std::chrono::steady_clock::now();
+    poll();
+    draw();
+    frameMs.push_back(Ms(std::chrono::steady_clock::now() - frameStart).count());
+  }
+  // the total counts the GPU finishing the last frames too
+  rendererbackend.waitIdle();
+  f64 totalMs = Ms(std::chrono::steady_clock::now() - start).count();
+
+  std::vector<f64> sorted = frameMs;
+  std::sort(sorted.begin(), sorted.end());
+  auto percentile = [&](f64 p) { return sorted.empty() ? 0.0 : sorted[(size_t)(p * (sorted.size() - 1))]; };
+  f64 sum = 0.0;
+  for (f64 ms : frameMs)
+    sum += ms;
+
+  RecordStats record = rendererbackend.getRecordStats();
+  u64 recordFrames = record.frames - recordStart.frames;
+
+  std::cout << "---------------- HEADLESS ----------------\n";
+  std::cout << "Frames: " << frameMs.size() << " in " << totalMs << " ms ("
+            << (totalMs > 0.0 ? frameMs.size() * 1000.0 / totalMs : 0.0) << " fps)\n";
+  std::cout << "CPU frame: " << (frameMs.empty() ? 0.0 : sum / frameMs.size()) << " ms average, " << percentile(0.5)
+            << " median, " << percentile(0.99) << " p99, " << percentile(1.0) << " max\n";
+  if (recordFrames > 0)
+    std::cout << "Command recording: " << (record.recordMs - recordStart.recordMs) / recordFrames
+              << " ms per frame, recorded " << record.recorded - recordStart.recorded << "/" << recordFrames << "\n";
+  CullStats cull = rendererbackend.getCullStats();
+  std::cout << "Last frame: drawn " << cull.drawn << " culled " << cull.culled << "\n";
+  Util::Profiler::global().printFrameSummary(std::cout);
+  std::cout << "------------------------------------------\n";
+
+  if (!imagePath.empty()) {
+    rendererbackend.saveFrame(imagePath);
+    std::cout << "Saved the last frame to " << imagePath << "\n";
+  }
+}
+
+void Renderer::gpuReport(const std::string &csvPath) {
+  const GpuProfiler &profiler = rendererbackend.getProfiler();
+  profiler.print(std::cout);
+  if (!csvPath.empty()) {
+    profiler.exportCSV(csvPath);
+    std::cout << "Wrote the GPU profile to " << csvPath << "\n";
+  }
+}
+
+void Renderer::tick(f64 dt) {
+  PROFILE_FUNCTION();
+  // rates are per second so behavior doesn't depend on the tick or frame rate
+  const f32 spinSpeed = 0.042;
+  const f32 moveSpeed = 5.4;
+
+  for (auto &obj : scene.objects)
+    obj.storePreviousState();
+  scene.camera.storePreviousState();
+
   if (spin) {
     for (auto &obj : scene.objects) {
-      f32 dx = Util::randomFloat(0.0, 360.0) * speed;
-      f32 dy = Util::randomFloat(0.0, 360.0) * speed;
-      f32 dz = Util::randomFloat(0.0, 360.0) * speed;
+      f32 dx = Util::randomFloat(0.0, 360.0) * spinSpeed * (f32)dt;
+      f32 dy = Util::randomFloat(0.0, 360.0) * spinSpeed * (f32)dt;
+      f32 dz = Util::randomFloat(0.0, 360.0) * spinSpeed * (f32)dt;
       obj.moveRotation({dx, dy, dz});
     }
+    scene.updateSpatialIndex(Threads::ThreadPool::global());
   }
 
-  rendererbackend.drawScene();
+  f32 step = moveSpeed * (f32)dt;
+  if (input.isPressed(Keys::KEY_W))
+    scene.camera.movePosition(scene.camera.getForwardVector() * (step * -1.0));
+  if (input.isPressed(Keys::KEY_A))
+    scene.camera.movePosition(scene.camera.getRightVector() * (step * -1.0));
+  if (input.isPressed(Keys::KEY_S))
+    scene.camera.movePosition(scene.camera.getForwardVector() * step);
+  if (input.isPressed(Keys::KEY_D))
+    scene.camera.movePosition(scene.camera.getRightVector() * step);
+  scene.camera.update();
+
+  // extract phase, the renderer draws from the packet while the next tick runs
+  scene.extract(packets.beginWrite(), ++tickCount);
+  packets.publish();
 }
 
 void Renderer::poll() {
   if (state != State::RUNNING)
     return;
 
-  glfwPollEvents();
+  // the cap's wait comes before polling, so the next frame starts from the newest input
+  pacer.waitForNextFrame();
+  if (!headless)
+    glfwPollEvents();
+  pacer.markInput();
   handleInput();
 }
 
@@ -73,14 +220,38 @@ void Renderer::resize() {
 }
 
 void Renderer::FPS() {
-  if (state != State::RUNNING)
+  if (state != State::RUNNING || headless)
     return;
 
   currTime = glfwGetTime();
   double diff = currTime - prevTime;
   frames++;
   if (diff >= 1.0 / 30.0) {
-    std::string FPS = std::to_string((1.0 / diff) * frames);
+    CullStats stats = rendererbackend.getCullStats();
+    std::string FPS = std::to_string((1.0 / diff) * frames) + " | drawn " + std::to_string(stats.drawn) + " culled " +
+                      std::to_string(stats.culled);
+
+    // command recording cost per frame and how many frames had to record, compare with --no-command-cache
+    RecordStats record = rendererbackend.getRecordStats();
+    u64 recordFrames = record.frames - prevRecordStats.frames;
+    if (recordFrames > 0) {
+      f64 ms = (record.recordMs - prevRecordStats.recordMs) / recordFrames;
+      u64 recorded = record.recorded - prevRecordStats.recorded;
+      FPS += " | cmd " + std::to_string(ms) + " ms, recorded " + std::to_string(recorded) + "/" +
+             std::to_string(recordFrames);
+    }
+    prevRecordStats = record;
+
+    // poll to present, compare frames in flight and present modes
+    FramePacerStats pacing = pacer.getStats();
+    u64 pacedFrames = pacing.frames - prevPacerStats.frames;
+    if (pacedFrames > 0)
+      FPS += " | latency " + std::to_string((pacing.latencyMs - prevPacerStats.latencyMs) / pacedFrames) + " ms";
+    prevPacerStats = pacing;
+
+    const GpuProfiler &profiler = rendererbackend.getProfiler();
+    if (profiler.hasTimestamps())
+      FPS += " | gpu " + std::to_string(profiler.getAverageMs(GpuProfiler::FRAME)) + " ms";
     glfwSetWindowTitle(window, FPS.c_str());
     prevTime = currTime;
     frames = 0;
@@ -88,25 +259,9 @@ void Renderer::FPS() {
 }
 
 void Renderer::handleInput() {
-  f32 speed = 0.09;
-
-  if (input.isPressed(Keys::KEY_W)) {
-    scene.camera.movePosition(scene.camera.getForwardVector() * (speed * -1.0));
-    scene.camera.update();
-  }
-  if (input.isPressed(Keys::KEY_A)) {
-    scene.camera.movePosition(scene.camera.getRightVector() * (speed * -1.0));
-    scene.camera.update();
-  }
-  if (input.isPressed(Keys::KEY_S)) {
-    scene.camera.movePosition(scene.camera.getForwardVector() * speed);
-    scene.camera.update();
-  }
-  if (input.isPressed(Keys::KEY_D)) {
-    scene.camera.movePosition(scene.camera.getRightVector() * speed);
-    scene.camera.update();
-  }
+  // movement keys are applied by the simulation tick, only toggles are handled here
   if (input.isPressed(Keys::KEY_C)) {
+    std::lock_guard<std::mutex> lock(loop.getStateMutex());
     scene.camera.toggleFreecam();
     input.setUnpressed(Keys::KEY_C);
     scene.camera.update();
@@ -114,7 +269,33 @@ void Renderer::handleInput() {
   if (input.isPressed(Keys::KEY_R)) {
     spin = !spin;
     input.setUnpressed(Keys::KEY_R);
-    scene.camera.update();
+  }
+  if (input.isPressed(Keys::KEY_E)) {
+    std::lock_guard<std::mutex> lock(loop.getStateMutex());
+    // drop a copy of the first object in front of the camera, it shares the mesh so nothing is uploaded
+    if (!scene.objects.empty()) {
+      Game::Object copy = scene.objects[0];
+      copy.setPosition(scene.camera.position + scene.camera.getForwardVector() * -5.0);
+      copy.storePreviousState();
+
+      Game::ObjectHandle handle = scene.spawn(copy);
+      if (handle.valid())
+        spawned.push_back(handle);
+    }
+    input.setUnpressed(Keys::KEY_E);
+  }
+  if (input.isPressed(Keys::KEY_X)) {
+    std::lock_guard<std::mutex> lock(loop.getStateMutex());
+    if (!spawned.empty()) {
+      scene.despawn(spawned.back());
+      spawned.pop_back();
+    }
+    input.setUnpressed(Keys::KEY_X);
+  }
+
+  if (input.isPressed(Keys::KEY_P)) {
+    Util::Profiler::global().printFrameSummary(std::cout);
+    input.setUnpressed(Keys::KEY_P);
   }
 }
 
@@ -141,6 +322,8 @@ void Renderer::mousePointerCallback(GLFWwindow *window, double x, double y) {
   dx *= sens;
   dy *= sens;
 
+  std::lock_guard<std::mutex> lock(app->loop.getStateMutex());
+
   app->scene.camera.yaw += dx;
   app->scene.camera.pitch += dy;
 
@@ -190,6 +373,15 @@ void Renderer::keyCallback(GLFWwindow *window, int key, int scancode, int action
   if (key == GLFW_KEY_R && action == GLFW_PRESS) {
     app->input.setPressed(Keys::KEY_R);
   }
+  if (key == GLFW_KEY_E && action == GLFW_PRESS) {
+    app->input.setPressed(Keys::KEY_E);
+  }
+  if (key == GLFW_KEY_X && action == GLFW_PRESS) {
+    app->input.setPressed(Keys::KEY_X);
+  }
+  if (key == GLFW_KEY_P && action == GLFW_PRESS) {
+    app->input.setPressed(Keys::KEY_P);
+  }
 
   if (key == GLFW_KEY_W && action == GLFW_RELEASE) {
     app->input.setUnpressed(Keys::KEY_W);
@@ -11,18 +11,32 @@
 #include "renderer-vulkan.hpp"
 #include <GLFW/glfw3.h>
 
+#include "../game/game-loop.hpp"
 #include "../game/scene.hpp"
+#include "frame-pacer.hpp"
 #include "input.hpp"
 
+#include <string>
+
 namespace Renderer {
 class Renderer {
 public:
-  Renderer(int w, int h, Game::Scene &scene);
+  Renderer(int w, int h, Game::Scene &&scene, Game::GameLoop::Config loopConfig = {},
+           RendererConfig rendererConfig = {});
   bool running();
   void poll();
   void draw();
   void resize();
   void FPS();
+  /**
+   * @brief Headless, draw frameCount frames as fast as possible, print their timing and save the last one as PNG
+   *        (when imagePath isn't empty)
+   */
+  void runHeadless(u32 frameCount, const std::string &imagePath = {});
+  /**
+   * @brief Print the GPU pass times and pipeline statistics, and write them as CSV when csvPath isn't empty
+   */
+  void gpuReport(const std::string &csvPath = {});
 
 private:
   enum State { RUNNING, STOPPED } state;
@@ -31,11 +45,17 @@ private:
   static void mousePointerCallback(GLFWwindow *window, double x, double y);
 
   void handleInput();
+  void tick(f64 dt);
+  void startupReport(double sceneMs, double assetsMs);
 
   RendererVulkan rendererbackend;
   GLFWwindow *window;
   Game::Scene scene;
+  Game::FramePacketBuffer packets;
+  // declared after the scene so the simulation thread stops before the scene goes away
+  Game::GameLoop loop;
   int WIDTH, HEIGHT;
+  bool headless = false;
 
   double mx = 0, my = 0;
 
@@ -44,8 +64,17 @@ private:
   double prevTime = 0;
   double currTime = 0;
   uint32_t frames = 0;
+  u64 tickCount = 0;
+  // totals at the last title update
+  RecordStats prevRecordStats;
+  FramePacerStats prevPacerStats;
+
+  FramePacer pacer;
+
+  std::atomic<bool> spin{false};
 
-  bool spin = false;
+  // objects added with E, removed newest first with X
+  std::vector<Game::ObjectHandle> spawned;
 
   bool firstMouse = true;
 };
@@ -0,0 +1,490 @@
+/**
+ * @file staging-ring.cpp
+ */
+
+#include "staging-ring.hpp"
+#include "../util/util.hpp"
+
+#include <algorithm>
+#include <cstring>
+#include <iostream>
+
+namespace Renderer {
+
+namespace {
+VkDeviceSize alignUp(VkDeviceSize value, VkDeviceSize alignment) {
+  return (value + alignment - 1) / alignment * alignment;
+}
+
+// buffer to image copies need offsets on a multiple of 4 and of the texel or block size, 16 covers every format used
+constexpr VkDeviceSize COPY_ALIGNMENT = 16;
+
+// everything that reads uploaded buffers
+constexpr VkAccessFlags BUFFER_READS = VK_ACCESS_VERTEX_ATTRIBUTE_READ_BIT | VK_ACCESS_INDEX_READ_BIT |
+                                       VK_ACCESS_INDIRECT_COMMAND_READ_BIT | VK_ACCESS_UNIFORM_READ_BIT |
+                                       VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_TRANSFER_READ_BIT;
+constexpr VkPipelineStageFlags BUFFER_READ_STAGES =
+    VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT | VK_PIPELINE_STAGE_VERTEX_INPUT_BIT | VK_PIPELINE_STAGE_VERTEX_SHADER_BIT |
+    VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT | VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT | VK_PIPELINE_STAGE_TRANSFER_BIT;
+
+VkSemaphore createTimeline(VkDevice device) {
+  VkSemaphoreTypeCreateInfo typeInfo{};
+  typeInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_TYPE_CREATE_INFO;
+  typeInfo.semaphoreType = VK_SEMAPHORE_TYPE_TIMELINE;
+  typeInfo.initialValue = 0;
+
+  VkSemaphoreCreateInfo semaphoreInfo{};
+  semaphoreInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO;
+  semaphoreInfo.pNext = &typeInfo;
+
+  VkSemaphore semaphore;
+  if (vkCreateSemaphore(device, &semaphoreInfo, nullptr, &semaphore) != VK_SUCCESS)
+    Util::Error("StagingRing: failed to create timeline semaphore");
+  return semaphore;
+}
+
+VkCommandPool createPool(VkDevice device, u32 family) {
+  VkCommandPoolCreateInfo poolInfo{};
+  poolInfo.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
+  poolInfo.flags = VK_COMMAND_POOL_CREATE_TRANSIENT_BIT | VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT;
+  poolInfo.queueFamilyIndex = family;
+
+  VkCommandPool pool;
+  if (vkCreateCommandPool(device, &poolInfo, nullptr, &pool) != VK_SUCCESS)
+    Util::Error("StagingRing: failed to create command pool");
+  return pool;
+}
+
+VkCommandBuffer allocateCommandBuffer(VkDevice device, VkCommandPool pool) {
+  VkCommandBufferAllocateInfo allocInfo{};
+  allocInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+  allocInfo.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+  allocInfo.commandPool = pool;
+  allocInfo.commandBufferCount = 1;
+
+  VkCommandBuffer commandBuffer;
+  if (vkAllocateCommandBuffers(device, &allocInfo, &commandBuffer) != VK_SUCCESS)
+    Util::Error("StagingRing: failed to allocate command buffer");
+  return commandBuffer;
+}
+
+void beginCommandBuffer(VkCommandBuffer commandBuffer) {
+  VkCommandBufferBeginInfo beginInfo{};
+  beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+  beginInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+  if (vkBeginCommandBuffer(commandBuffer, &beginInfo) != VK_SUCCESS)
+    Util::Error("StagingRing: failed to begin upload command buffer");
+}
+} // namespace
+
+// ====================================================================================================================
+// Setup
+// ====================================================================================================================
+void StagingRing::init(VkDevice device, MemoryAllocator &allocator, u32 graphicsFamily, VkQueue graphicsQueue,
+                       u32 transferFamily, VkQueue transferQueue, VkDeviceSize capacity) {
+  this->device = device;
+  this->allocator = &allocator;
+  this->graphicsFamily = graphicsFamily;
+  this->graphicsQueue = graphicsQueue;
+  this->transferFamily = transferFamily;
+  this->transferQueue = transferQueue;
+  this->capacity = capacity;
+  async = transferQueue != VK_NULL_HANDLE && transferFamily != graphicsFamily;
+  head = 0;
+  used = 0;
+
+  commandPool = createPool(device, async ? transferFamily : graphicsFamily);
+  if (async) {
+    acquirePool = createPool(device, graphicsFamily);
+    copiedTimeline = createTimeline(device);
+    acquiredTimeline = createTimeline(device);
+    timelineValue = 0;
+  }
+
+  allocator.createBuffer(capacity, VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
+                         VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, buffer, memory);
+  if (!memory.mapped)
+    Util::Error("StagingRing: staging memory isn't mapped");
+}
+
+void StagingRing::destroy() {
+  if (device == VK_NULL_HANDLE)
+    return;
+
+  wait();
+  for (Batch &batch : spare)
+    if (batch.fence != VK_NULL_HANDLE)
+      vkDestroyFence(device, batch.fence, nullptr);
+  spare.clear();
+  if (current.fence != VK_NULL_HANDLE)
+    vkDestroyFence(device, current.fence, nullptr);
+  current = Batch{};
+
+  // destroying the pools frees every command buffer in them
+  vkDestroyCommandPool(device, commandPool, nullptr);
+  if (async) {
+    vkDestroyCommandPool(device, acquirePool, nullptr);
+    vkDestroySemaphore(device, copiedTimeline, nullptr);
+    vkDestroySemaphore(device, acquiredTimeline, nullptr);
+  }
+  allocator->destroyBuffer(buffer, memory);
+  device = VK_NULL_HANDLE;
+}
+
+bool StagingRing::isAsync() const { return async; }
+
+std::vector<u32> StagingRing::getQueueFamilies() const {
+  if (!async)
+    return {};
+  return {graphicsFamily, transferFamily};
+}
+
+// ====================================================================================================================
+// Uploads
+// ====================================================================================================================
+void StagingRing::copyToBuffer(const void *data, VkDeviceSize size, VkBuffer dstBuffer, VkDeviceSize dstOffset) {
+  // big uploads go in pieces, so they never need more than part of the ring at once
+  const VkDeviceSize maxChunk = capacity / 4;
+  const char *src = static_cast<const char *>(data);
+
+  for (VkDeviceSize done = 0; done < size;) {
+    VkDeviceSize chunk = std::min(size - done, maxChunk);
+    VkDeviceSize offset = reserve(chunk, COPY_ALIGNMENT);
+    std::memcpy(static_cast<char *>(memory.mapped) + offset, src + done, chunk);
+
+    VkBufferCopy copyRegion{};
+    copyRegion.srcOffset = offset;
+    copyRegion.dstOffset = dstOffset + done;
+    copyRegion.size = chunk;
+    vkCmdCopyBuffer(getCommandBuffer(), buffer, dstBuffer, 1, &copyRegion);
+
+    done += chunk;
+  }
+  stats.bytes += size;
+
+  // the buffer is concurrent across both families, no ownership changes hands. chunks that went out in an earlier
+  // batch ran before this one on the same queue, so this batch's acquire covers them too
+  if (size > 0)
+    bufferWrites = true;
+}
+
+void StagingRing::copyToImage(VkImage image, u32 width, u32 height, u32 layers, u32 texelSize,
+                              const void *const *data, u32 levels, u32 blockExtent) {
+  const VkDeviceSize maxChunk = capacity / 4;
+  if ((VkDeviceSize)(width + blockExtent - 1) / blockExtent * texelSize > maxChunk)
+    Util::Error("StagingRing: image row doesn't fit in the staging ring");
+
+  VkImageMemoryBarrier barrier{};
+  barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+  barrier.oldLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+  barrier.newLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+  barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+  barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+  barrier.image = image;
+  barrier.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+  barrier.subresourceRange.baseMipLevel = 0;
+  barrier.subresourceRange.levelCount = levels;
+  barrier.subresourceRange.baseArrayLayer = 0;
+  barrier.subresourceRange.layerCount = layers;
+  barrier.srcAccessMask = 0;
+  barrier.dstAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+  vkCmdPipelineBarrier(getCommandBuffer(), VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT, 0, 0,
+                       nullptr, 0, nullptr, 1, &barrier);
+
+  // a full ring submits the batch in the middle of the image, the copies still run in order on the queue
+  for (u32 layer = 0; layer < layers; layer++) {
+    for (u32 level = 0; level < levels; level++) {
+      const char *src = static_cast<const char *>(data[layer * levels + level]);
+      const u32 levelWidth = std::max(width >> level, 1u);
+      const u32 levelHeight = std::max(height >> level, 1u);
+      // rows of blocks, a row of texels when blocks are 1x1
+      const u32 blockRows = (levelHeight + blockExtent - 1) / blockExtent;
+      const VkDeviceSize rowSize = (VkDeviceSize)((levelWidth + blockExtent - 1) / blockExtent) * texelSize;
+      const u32 rowsPerChunk = (u32)std::min<VkDeviceSize>(blockRows, maxChunk / rowSize);
+
+      for (u32 row = 0; row < blockRows; row += rowsPerChunk) {
+        u32 rows = std::min(rowsPerChunk, blockRows - row);
+        VkDeviceSize chunk = rowSize * rows;
+        VkDeviceSize offset = reserve(chunk, COPY_ALIGNMENT);
+        std::memcpy(static_cast<char *>(memory.mapped) + offset, src + rowSize * row, chunk);
+
+        VkBufferImageCopy region{};
+        region.bufferOffset = offset;
+        region.bufferRowLength = 0;
+        region.bufferImageHeight = 0;
+        region.imageSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+        region.imageSubresource.mipLevel = level;
+        region.imageSubresource.baseArrayLayer = layer;
+        region.imageSubresource.layerCount = 1;
+        // partial blocks at the edges are copied whole, the extent stops at the edge of the level
+        region.imageOffset = {0, (i32)(row * blockExtent), 0};
+        region.imageExtent = {levelWidth, std::min(rows * blockExtent, levelHeight - row * blockExtent), 1};
+        vkCmdCopyBufferToImage(getCommandBuffer(), buffer, image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 1, &region);
+
+        stats.bytes += chunk;
+      }
+    }
+  }
+
+  barrier.oldLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+  barrier.newLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+  barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+  barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+
+  // the layout change happens as part of the ownership transfer, released and acquired with the same layouts
+  if (async) {
+    barrier.srcQueueFamilyIndex = transferFamily;
+    barrier.dstQueueFamilyIndex = graphicsFamily;
+    imageTransfers.push_back(barrier);
+    return;
+  }
+
+  vkCmdPipelineBarrier(getCommandBuffer(), VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, 0,
+                       0, nullptr, 0, nullptr, 1, &barrier);
+}
+
+// ====================================================================================================================
+// Submission
+// ====================================================================================================================
+void StagingRing::submit() {
+  if (!current.recording)
+    return;
+
+  if (async) {
+    submitAsync();
+    return;
+  }
+
+  // one barrier for everything in the batch instead of one per copy
+  VkMemoryBarrier barrier{};
+  barrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+  barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+  barrier.dstAccessMask = BUFFER_READS | VK_ACCESS_TRANSFER_WRITE_BIT;
+  vkCmdPipelineBarrier(current.commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, BUFFER_READ_STAGES, 0, 1, &barrier, 0,
+                       nullptr, 0, nullptr);
+
+  if (vkEndCommandBuffer(current.commandBuffer) != VK_SUCCESS)
+    Util::Error("StagingRing: failed to record upload command buffer");
+
+  VkSubmitInfo submitInfo{};
+  submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+  submitInfo.commandBufferCount = 1;
+  submitInfo.pCommandBuffers = &current.commandBuffer;
+  if (vkQueueSubmit(graphicsQueue, 1, &submitInfo, current.fence) != VK_SUCCESS)
+    Util::Error("StagingRing: failed to submit uploads");
+
+  current.recording = false;
+  pending.push_back(current);
+  current = Batch{};
+  stats.submits++;
+}
+
+void StagingRing::submitAsync() {
+  // release the images on the transfer queue, the second half of each barrier is ignored there
+  for (VkImageMemoryBarrier &barrier : imageTransfers) {
+    barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+    barrier.dstAccessMask = 0;
+  }
+  if (!imageTransfers.empty())
+    vkCmdPipelineBarrier(current.commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT,
+                         0, 0, nullptr, 0, nullptr, (u32)imageTransfers.size(), imageTransfers.data());
+
+  if (vkEndCommandBuffer(current.commandBuffer) != VK_SUCCESS)
+    Util::Error("StagingRing: failed to record upload command buffer");
+
+  current.value = ++timelineValue;
+
+  VkTimelineSemaphoreSubmitInfo copiedValues{};
+  copiedValues.sType = VK_STRUCTURE_TYPE_TIMELINE_SEMAPHORE_SUBMIT_INFO;
+  copiedValues.signalSemaphoreValueCount = 1;
+  copiedValues.pSignalSemaphoreValues = &current.value;
+
+  VkSubmitInfo submitInfo{};
+  submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+  submitInfo.pNext = &copiedValues;
+  submitInfo.commandBufferCount = 1;
+  submitInfo.pCommandBuffers = &current.commandBuffer;
+  submitInfo.signalSemaphoreCount = 1;
+  submitInfo.pSignalSemaphores = &copiedTimeline;
+  if (vkQueueSubmit(transferQueue, 1, &submitInfo, VK_NULL_HANDLE) != VK_SUCCESS)
+    Util::Error("StagingRing: failed to submit uploads");
+
+  // acquire on the graphics queue, the first half of each barrier is ignored there.
+  // the semaphore wait makes the copies available and blocks the transfer stage, which the barriers then chain from
+  for (VkImageMemoryBarrier &barrier : imageTransfers) {
+    barrier.srcAccessMask = 0;
+    barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+  }
+  VkMemoryBarrier bufferBarrier{};
+  bufferBarrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+  bufferBarrier.srcAccessMask = 0;
+  bufferBarrier.dstAccessMask = BUFFER_READS;
+
+  if (current.acquireCommandBuffer == VK_NULL_HANDLE)
+    current.acquireCommandBuffer = allocateCommandBuffer(device, acquirePool);
+  beginCommandBuffer(current.acquireCommandBuffer);
+  if (bufferWrites || !imageTransfers.empty())
+    vkCmdPipelineBarrier(current.acquireCommandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, BUFFER_READ_STAGES, 0,
+                         bufferWrites ? 1 : 0, &bufferBarrier, 0, nullptr, (u32)imageTransfers.size(),
+                         imageTransfers.data());
+  if (vkEndCommandBuffer(current.acquireCommandBuffer) != VK_SUCCESS)
+    Util::Error("StagingRing: failed to record acquire command buffer");
+
+  VkPipelineStageFlags waitStage = VK_PIPELINE_STAGE_TRANSFER_BIT;
+  VkTimelineSemaphoreSubmitInfo acquiredValues{};
+  acquiredValues.sType = VK_STRUCTURE_TYPE_TIMELINE_SEMAPHORE_SUBMIT_INFO;
+  acquiredValues.waitSemaphoreValueCount = 1;
+  acquiredValues.pWaitSemaphoreValues = &current.value;
+  acquiredValues.signalSemaphoreValueCount = 1;
+  acquiredValues.pSignalSemaphoreValues = &current.value;
+
+  VkSubmitInfo acquireInfo{};
+  acquireInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+  acquireInfo.pNext = &acquiredValues;
+  acquireInfo.waitSemaphoreCount = 1;
+  acquireInfo.pWaitSemaphores = &copiedTimeline;
+  acquireInfo.pWaitDstStageMask = &waitStage;
+  acquireInfo.commandBufferCount = 1;
+  acquireInfo.pCommandBuffers = &current.acquireCommandBuffer;
+  acquireInfo.signalSemaphoreCount = 1;
+  acquireInfo.pSignalSemaphores = &acquiredTimeline;
+  if (vkQueueSubmit(graphicsQueue, 1, &acquireInfo, VK_NULL_HANDLE) != VK_SUCCESS)
+    Util::Error("StagingRing: failed to submit acquire");
+
+  bufferWrites = false;
+  imageTransfers.clear();
+
+  current.recording = false;
+  pending.push_back(current);
+  current = Batch{};
+  stats.submits++;
+}
+
+void StagingRing::wait() {
+  submit();
+  while (!pending.empty())
+    retire(true);
+}
+
+VkDeviceSize StagingRing::reserve(VkDeviceSize size, VkDeviceSize alignment) {
+  if (size > capacity)
+    Util::Error("StagingRing: upload is bigger than the staging ring");
+
+  retire(false);
+  while (true) {
+    if (used == 0)
+      head = 0;
+
+    // used bytes end at head, so the free space is what's between head and where they start
+    VkDeviceSize tail = (head + capacity - used % capacity) % capacity;
+    VkDeviceSize aligned = alignUp(head, alignment);
+    VkDeviceSize offset = capacity;
+    VkDeviceSize taken = 0;
+
+    if (used == 0 || head > tail) {
+      if (aligned + size <= capacity) {
+        offset = aligned;
+        taken = aligned - head + size;
+      } else if (size <= tail) {
+        // skip the end of the ring and start over at 0
+        offset = 0;
+        taken = capacity - head + size;
+      }
+    } else if (head < tail && aligned + size <= tail) {
+      offset = aligned;
+      taken = aligned - head + size;
+    }
+
+    if (offset != capacity) {
+      head = (offset + size) % capacity;
+      used += taken;
+      current.bytes += taken;
+      return offset;
+    }
+
+    // full, what the current batch holds can only come back after it is submitted
+    submit();
+    stats.stalls++;
+    retire(true);
+  }
+}
+
+VkCommandBuffer StagingRing::getCommandBuffer() {
+  if (current.recording)
+    return current.commandBuffer;
+
+  VkDeviceSize bytes = current.bytes;
+  if (current.commandBuffer == VK_NULL_HANDLE) {
+    if (!spare.empty()) {
+      current = spare.back();
+      spare.pop_back();
+    } else {
+      current.commandBuffer = allocateCommandBuffer(device, commandPool);
+      if (!async) {
+        VkFenceCreateInfo fenceInfo{};
+        fenceInfo.sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO;
+        if (vkCreateFence(device, &fenceInfo, nullptr, &current.fence) != VK_SUCCESS)
+          Util::Error("StagingRing: failed to create fence");
+      }
+    }
+  }
+  // ring space may have been reserved before the first command
+  current.bytes = bytes;
+
+  beginCommandBuffer(current.commandBuffer);
+  current.recording = true;
+  return current.commandBuffer;
+}
+
+bool StagingRing::isDone(const Batch &batch) const {
+  if (!async)
+    return vkGetFenceStatus(device, batch.fence) == VK_SUCCESS;
+
+  uint64_t value = 0;
+  vkGetSemaphoreCounterValue(device, acquiredTimeline, &value);
+  return value >= batch.value;
+}
+
+void StagingRing::retire(bool waitForOldest) {
+  if (waitForOldest && !pending.empty()) {
+    const Batch &oldest = pending.front();
+    if (async) {
+      VkSemaphoreWaitInfo waitInfo{};
+      waitInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_WAIT_INFO;
+      waitInfo.semaphoreCount = 1;
+      waitInfo.pSemaphores = &acquiredTimeline;
+      waitInfo.pValues = &oldest.value;
+      vkWaitSemaphores(device, &waitInfo, UINT64_MAX);
+    } else {
+      vkWaitForFences(device, 1, &oldest.fence, VK_TRUE, UINT64_MAX);
+    }
+  }
+
+  // batches finish in submission order, so the ring frees from its tail
+  while (!pending.empty() && isDone(pending.front())) {
+    Batch batch = pending.front();
+    pending.pop_front();
+
+    used -= batch.bytes;
+    batch.bytes = 0;
+    if (!async)
+      vkResetFences(device, 1, &batch.fence);
+    vkResetCommandBuffer(batch.commandBuffer, 0);
+    if (batch.acquireCommandBuffer != VK_NULL_HANDLE)
+      vkResetCommandBuffer(batch.acquireCommandBuffer, 0);
+    spare.push_back(batch);
+  }
+}
+
+// ====================================================================================================================
+// Stats
+// ====================================================================================================================
+UploadStats StagingRing::getStats() const { return stats; }
+
+void StagingRing::printStats() const {
+  std::cout << "Uploads: " << stats.bytes / (1024.0 * 1024.0) << " MiB staged in " << stats.submits
+            << " submissions on the " << (async ? "transfer" : "graphics") << " queue, " << stats.stalls
+            << " waits for ring space\n";
+}
+
+} // namespace Renderer
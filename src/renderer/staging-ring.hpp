@@ -0,0 +1,167 @@
+/**
+ * @file staging-ring.hpp
+ *
+ * @brief header file for the upload staging ring
+ *
+ * @details One persistently mapped host buffer that every upload is copied
+ *          through. Data is written at the ring's head and the copy out of it
+ *          is recorded into the current batch's command buffer. Batches are
+ *          submitted without waiting and give their part of the ring back once
+ *          the GPU is done with them. Uploads only wait when the ring is full,
+ *          and then only for the oldest batch.
+ *
+ *          With a transfer queue the copies run there, alongside the frames
+ *          rendering on the graphics queue. Buffers copied into are created
+ *          concurrent across both families (see getQueueFamilies), since the
+ *          graphics family keeps reading the rest of a buffer while a batch
+ *          writes part of it. Images are released by the batch that wrote them
+ *          to the graphics family. A small graphics submission waits on the
+ *          batch's timeline semaphore value, acquires the images and makes the
+ *          buffer writes visible to the stages that read them. The
+ *          copies never stall the graphics queue, only the acquire waits, so
+ *          later frames see the data and earlier ones keep rendering.
+ *
+ *          Without one, batches run on the graphics queue, tracked by fences,
+ *          and end with a barrier that makes their writes visible to the
+ *          stages that read them. Not thread safe, uploads happen on the
+ *          render thread.
+ */
+
+#pragma once
+
+#include <vulkan/vulkan.h>
+
+#include "../util/defines.hpp"
+#include "memory-allocator.hpp"
+
+#include <cstdint>
+#include <deque>
+#include <vector>
+
+namespace Renderer {
+
+struct UploadStats {
+  u64 bytes = 0;
+  u64 submits = 0;
+  // times an upload had to wait for the GPU to free ring space
+  u64 stalls = 0;
+};
+
+class StagingRing {
+public:
+  StagingRing() = default;
+  StagingRing(const StagingRing &other) = delete;
+  StagingRing &operator=(const StagingRing &other) = delete;
+
+  /**
+   * @param transferQueue VK_NULL_HANDLE to copy on the graphics queue, otherwise a queue of another family
+   *                      (needs timeline semaphores)
+   */
+  void init(VkDevice device, MemoryAllocator &allocator, u32 graphicsFamily, VkQueue graphicsQueue, u32 transferFamily,
+            VkQueue transferQueue, VkDeviceSize capacity = 32ull << 20);
+  /**
+   * @brief Waits for every submitted upload
+   */
+  void destroy();
+
+  /**
+   * @brief Queue families a buffer copyToBuffer writes to has to be created concurrent across, empty when the
+   *        copies run on the graphics queue (exclusive is fine then)
+   */
+  std::vector<u32> getQueueFamilies() const;
+
+  /**
+   * @brief Copy size bytes of data to dstBuffer at dstOffset
+   */
+  void copyToBuffer(const void *data, VkDeviceSize size, VkBuffer dstBuffer, VkDeviceSize dstOffset);
+
+  /**
+   * @brief Fill every layer and mip level of an image and leave it in SHADER_READ_ONLY_OPTIMAL
+   *
+   * @param data tightly packed rows of each layer's levels, level l of layer i is data[i * levels + l] and
+   *             max(width >> l, 1) by max(height >> l, 1) texels
+   * @param texelSize bytes of a texel, or of a block for block compressed formats
+   * @param blockExtent texels across a block, rows are rows of blocks then
+   */
+  void copyToImage(VkImage image, u32 width, u32 height, u32 layers, u32 texelSize, const void *const *data,
+                   u32 levels = 1, u32 blockExtent = 1);
+
+  /**
+   * @brief Submit what was recorded since the last submit, doesn't wait
+   *
+   * @details Graphics work submitted after this sees the uploads
+   */
+  void submit();
+
+  /**
+   * @brief Submit and block until every upload is done
+   */
+  void wait();
+
+  /**
+   * @brief Copies run on their own queue
+   */
+  bool isAsync() const;
+
+  UploadStats getStats() const;
+  void printStats() const;
+
+private:
+  struct Batch {
+    // on the transfer family when async
+    VkCommandBuffer commandBuffer = VK_NULL_HANDLE;
+    // graphics family, takes ownership of what the batch wrote (async only)
+    VkCommandBuffer acquireCommandBuffer = VK_NULL_HANDLE;
+    // signaled when the batch is done (graphics queue only)
+    VkFence fence = VK_NULL_HANDLE;
+    // done once the acquire timeline reaches it (async only)
+    uint64_t value = 0;
+    // ring bytes the batch holds, including alignment and wrap padding
+    VkDeviceSize bytes = 0;
+    bool recording = false;
+  };
+
+  /**
+   * @brief Ring space for size bytes, submits and waits for old batches when the ring is full
+   */
+  VkDeviceSize reserve(VkDeviceSize size, VkDeviceSize alignment);
+  VkCommandBuffer getCommandBuffer();
+  void submitAsync();
+  bool isDone(const Batch &batch) const;
+  void retire(bool waitForOldest);
+
+  VkDevice device = VK_NULL_HANDLE;
+  MemoryAllocator *allocator = nullptr;
+  u32 graphicsFamily = 0;
+  u32 transferFamily = 0;
+  VkQueue graphicsQueue = VK_NULL_HANDLE;
+  VkQueue transferQueue = VK_NULL_HANDLE;
+  bool async = false;
+
+  VkCommandPool commandPool = VK_NULL_HANDLE;
+  VkCommandPool acquirePool = VK_NULL_HANDLE;
+
+  // async only: the transfer queue signals copiedTimeline, the graphics acquire acquiredTimeline
+  VkSemaphore copiedTimeline = VK_NULL_HANDLE;
+  VkSemaphore acquiredTimeline = VK_NULL_HANDLE;
+  uint64_t timelineValue = 0;
+
+  // image ownership transfers of the current batch, recorded as releases and again as acquires
+  std::vector<VkImageMemoryBarrier> imageTransfers;
+  // the current batch copied into a buffer, the acquire makes the writes visible to the graphics reads
+  bool bufferWrites = false;
+
+  VkBuffer buffer = VK_NULL_HANDLE;
+  Allocation memory;
+  VkDeviceSize capacity = 0;
+  VkDeviceSize head = 0;
+  VkDeviceSize used = 0;
+
+  Batch current;
+  std::deque<Batch> pending;
+  std::vector<Batch> spare;
+
+  UploadStats stats;
+};
+
+} // namespace Renderer
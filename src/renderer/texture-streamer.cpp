@@ -0,0 +1,272 @@
+/**
+ * @file texture-streamer.cpp
+ */
+
+#include "texture-streamer.hpp"
+#include "../util/mipmap.hpp"
+#include "../util/util.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <iostream>
+
+namespace Renderer {
+
+// ====================================================================================================================
+// Setup
+// ====================================================================================================================
+void TextureStreamer::init(VkDevice device, MemoryAllocator &allocator, StagingRing &staging, u32 framesInFlight,
+                           bool streaming) {
+  this->device = device;
+  this->allocator = &allocator;
+  this->staging = &staging;
+  this->framesInFlight = framesInFlight;
+  this->streaming = streaming;
+  changed.assign(framesInFlight, {});
+}
+
+void TextureStreamer::destroy() {
+  if (device == VK_NULL_HANDLE)
+    return;
+
+  for (Retired &old : retired) {
+    vkDestroyImageView(device, old.view, nullptr);
+    allocator->destroyImage(old.image, old.memory);
+  }
+  retired.clear();
+
+  for (Texture &texture : textures) {
+    vkDestroyImageView(device, texture.view, nullptr);
+    allocator->destroyImage(texture.image, texture.memory);
+  }
+  textures.clear();
+  device = VK_NULL_HANDLE;
+}
+
+u32 TextureStreamer::add(const void *pixels, u32 width, u32 height) {
+  Texture texture;
+  texture.width = std::max(width, 1u);
+  texture.height = std::max(height, 1u);
+  texture.levelCount = Util::mipLevelCount(texture.width, texture.height);
+  texture.levels.push_back(static_cast<const uint8_t *>(pixels));
+
+  // each level is filtered from the one above it
+  texture.mips.resize(texture.levelCount - 1);
+  for (u32 level = 1; level < texture.levelCount; level++) {
+    u32 w = std::max(texture.width >> level, 1u);
+    u32 h = std::max(texture.height >> level, 1u);
+    texture.mips[level - 1].resize((size_t)w * h * 4);
+    Util::downsampleRGBA8(texture.levels[level - 1], std::max(texture.width >> (level - 1), 1u),
+                          std::max(texture.height >> (level - 1), 1u), texture.mips[level - 1].data(), true);
+    texture.levels.push_back(texture.mips[level - 1].data());
+  }
+
+  return insert(std::move(texture));
+}
+
+u32 TextureStreamer::add(std::shared_ptr<const Util::TextureFile> file, bool decompress) {
+  if (file->faces != 1)
+    Util::Error("TextureStreamer: cubemaps can't be used as object textures");
+  if (decompress && Util::isCompressed(file->format))
+    file = std::make_shared<const Util::TextureFile>(Util::decompressTexture(*file));
+
+  Texture texture;
+  texture.format = file->format;
+  texture.imageFormat = getFormat(file->format, file->srgb);
+  texture.width = file->width;
+  texture.height = file->height;
+  texture.levelCount = file->levels;
+  for (u32 level = 0; level < file->levels; level++)
+    texture.levels.push_back(file->getLevel(0, level));
+  texture.file = std::move(file);
+
+  return insert(std::move(texture));
+}
+
+u32 TextureStreamer::insert(Texture &&texture) {
+  while (texture.coarsestLevel + 1 < texture.levelCount &&
+         std::max(texture.width, texture.height) >> texture.coarsestLevel > INITIAL_SIZE)
+    texture.coarsestLevel++;
+  if (!streaming)
+    texture.coarsestLevel = 0;
+  texture.requestedLevel = texture.coarsestLevel;
+
+  u32 index = (u32)textures.size();
+  textures.push_back(std::move(texture));
+  const Texture &added = textures.back();
+  stats.textures++;
+  stats.compressed += Util::isCompressed(added.format) ? 1 : 0;
+  stats.fullBytes += chainSize(added, 0, added.format);
+  stats.uncompressedBytes += chainSize(added, 0, Util::TextureFormat::RGBA8);
+
+  makeResident(index, added.coarsestLevel);
+  return index;
+}
+
+VkFormat TextureStreamer::getFormat(Util::TextureFormat format, bool srgb) {
+  switch (format) {
+  case Util::TextureFormat::BC1:
+    return srgb ? VK_FORMAT_BC1_RGBA_SRGB_BLOCK : VK_FORMAT_BC1_RGBA_UNORM_BLOCK;
+  case Util::TextureFormat::BC3:
+    return srgb ? VK_FORMAT_BC3_SRGB_BLOCK : VK_FORMAT_BC3_UNORM_BLOCK;
+  case Util::TextureFormat::BC5:
+    return VK_FORMAT_BC5_UNORM_BLOCK;
+  case Util::TextureFormat::BC7:
+    return srgb ? VK_FORMAT_BC7_SRGB_BLOCK : VK_FORMAT_BC7_UNORM_BLOCK;
+  default:
+    return srgb ? VK_FORMAT_R8G8B8A8_SRGB : VK_FORMAT_R8G8B8A8_UNORM;
+  }
+}
+
+u32 TextureStreamer::getCount() const { return (u32)textures.size(); }
+
+VkImageView TextureStreamer::getView(u32 texture) const { return textures[texture].view; }
+
+// ====================================================================================================================
+// Streaming
+// ====================================================================================================================
+void TextureStreamer::request(u32 index, f32 size) {
+  if (!streaming || index >= textures.size() || !(size > 0.0f))
+    return;
+
+  // the level about as many texels across as the texture covers pixels
+  Texture &texture = textures[index];
+  f32 texelsPerPixel = (f32)std::max(texture.width, texture.height) / size;
+  u32 level = texelsPerPixel <= 1.0f ? 0 : (u32)std::floor(std::log2(texelsPerPixel));
+  texture.requestedLevel = std::min({texture.requestedLevel, level, texture.levelCount - 1});
+}
+
+void TextureStreamer::update(u64 frameNumber) {
+  this->frameNumber = frameNumber;
+
+  // the frames that could still sample these are done
+  while (!retired.empty() && retired.front().frame + framesInFlight <= frameNumber) {
+    Retired &old = retired.front();
+    vkDestroyImageView(device, old.view, nullptr);
+    allocator->destroyImage(old.image, old.memory);
+    retired.pop_front();
+  }
+
+  if (!streaming)
+    return;
+
+  VkDeviceSize budget = UPLOAD_BUDGET;
+  bool uploaded = false;
+  for (u32 index = 0; index < textures.size(); index++) {
+    Texture &texture = textures[index];
+    u32 wanted = texture.requestedLevel;
+    texture.requestedLevel = texture.coarsestLevel;
+
+    if (wanted <= texture.residentLevel)
+      texture.lastNeeded = frameNumber;
+
+    // more detail right away, less once the finer levels have gone unused for a while
+    u32 target = texture.residentLevel;
+    if (wanted < texture.residentLevel)
+      target = wanted;
+    else if (wanted > texture.residentLevel && texture.lastNeeded + KEEP_FRAMES <= frameNumber)
+      target = wanted;
+    if (target == texture.residentLevel)
+      continue;
+
+    VkDeviceSize size = chainSize(texture, target, texture.format);
+    if (uploaded && size > budget)
+      continue;
+    budget -= std::min(size, budget);
+    uploaded = true;
+
+    if (target < texture.residentLevel)
+      stats.streamedIn++;
+    else
+      stats.streamedOut++;
+    makeResident(index, target);
+  }
+}
+
+void TextureStreamer::takeChanged(u32 frame, std::vector<u32> &indices) {
+  indices.swap(changed[frame]);
+  changed[frame].clear();
+}
+
+void TextureStreamer::makeResident(u32 index, u32 level) {
+  Texture &texture = textures[index];
+  const u32 levels = texture.levelCount - level;
+  const u32 width = std::max(texture.width >> level, 1u);
+  const u32 height = std::max(texture.height >> level, 1u);
+
+  VkImageCreateInfo imageInfo{};
+  imageInfo.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
+  imageInfo.imageType = VK_IMAGE_TYPE_2D;
+  imageInfo.extent.width = width;
+  imageInfo.extent.height = height;
+  imageInfo.extent.depth = 1;
+  imageInfo.mipLevels = levels;
+  imageInfo.arrayLayers = 1;
+  imageInfo.format = texture.imageFormat;
+  imageInfo.tiling = VK_IMAGE_TILING_OPTIMAL;
+  imageInfo.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+  imageInfo.usage = VK_IMAGE_USAGE_TRANSFER_DST_BIT | VK_IMAGE_USAGE_SAMPLED_BIT;
+  imageInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+  imageInfo.samples = VK_SAMPLE_COUNT_1_BIT;
+
+  VkImage image;
+  Allocation memory;
+  allocator->createImage(imageInfo, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, image, memory);
+
+  std::vector<const void *> data(texture.levels.begin() + level, texture.levels.end());
+  staging->copyToImage(image, width, height, 1, Util::getBlockBytes(texture.format), data.data(), levels,
+                       Util::getBlockExtent(texture.format));
+
+  VkImageViewCreateInfo viewInfo{};
+  viewInfo.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
+  viewInfo.image = image;
+  viewInfo.viewType = VK_IMAGE_VIEW_TYPE_2D;
+  viewInfo.format = texture.imageFormat;
+  viewInfo.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+  viewInfo.subresourceRange.baseMipLevel = 0;
+  viewInfo.subresourceRange.levelCount = levels;
+  viewInfo.subresourceRange.baseArrayLayer = 0;
+  viewInfo.subresourceRange.layerCount = 1;
+
+  VkImageView view;
+  if (vkCreateImageView(device, &viewInfo, nullptr, &view) != VK_SUCCESS) {
+    allocator->destroyImage(image, memory);
+    Util::Error("TextureStreamer: failed to create image view");
+  }
+
+  if (texture.image != VK_NULL_HANDLE) {
+    stats.residentBytes -= chainSize(texture, texture.residentLevel, texture.format);
+    retired.push_back({texture.image, texture.memory, texture.view, frameNumber});
+    for (auto &frame : changed)
+      frame.push_back(index);
+  }
+
+  texture.image = image;
+  texture.memory = memory;
+  texture.view = view;
+  texture.residentLevel = level;
+  texture.lastNeeded = frameNumber;
+  stats.residentBytes += chainSize(texture, level, texture.format);
+}
+
+// ====================================================================================================================
+// Levels
+// ====================================================================================================================
+VkDeviceSize TextureStreamer::chainSize(const Texture &texture, u32 firstLevel, Util::TextureFormat format) {
+  VkDeviceSize size = 0;
+  for (u32 level = firstLevel; level < texture.levelCount; level++)
+    size += Util::getImageSize(format, std::max(texture.width >> level, 1u), std::max(texture.height >> level, 1u));
+  return size;
+}
+
+TextureStats TextureStreamer::getStats() const { return stats; }
+
+void TextureStreamer::printStats() const {
+  auto mib = [](u64 bytes) { return (f64)bytes / (1024.0 * 1024.0); };
+  std::cout << "Textures: " << stats.textures << " (" << stats.compressed << " block compressed), "
+            << mib(stats.residentBytes) << " MiB resident of " << mib(stats.fullBytes) << " MiB with every level ("
+            << mib(stats.uncompressedBytes) << " MiB as RGBA8), " << stats.streamedIn << " streamed in, "
+            << stats.streamedOut << " streamed out\n";
+}
+
+} // namespace Renderer
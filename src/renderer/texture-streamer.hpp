@@ -0,0 +1,176 @@
+/**
+ * @file texture-streamer.hpp
+ *
+ * @brief header file for mipmapped textures with streamed mip residency
+ *
+ * @details Every texture gets a full mip chain when it's added, filtered on
+ *          the CPU (Util::downsampleRGBA8) and kept there. Only the levels the
+ *          screen needs live on the GPU: each frame the renderer reports how
+ *          many pixels across each texture covers, and update() recreates the
+ *          textures whose finest needed level changed with just that level and
+ *          the ones below it, uploaded through the staging ring. Detail comes
+ *          in as soon as it's needed and goes again once it hasn't been for a
+ *          while, so textures don't flicker between levels.
+ *
+ *          Textures loaded from DDS/KTX2 files bring their own chain in the
+ *          format they were compressed to (Util::TextureFile), and are decoded
+ *          to RGBA8 once when the device can't sample it.
+ *
+ *          A recreated texture has a new image view. The old image is kept
+ *          until no frame in flight can sample it, and each frame in flight
+ *          collects the textures that changed with takeChanged() to rewrite
+ *          its descriptor set once its previous submission is done. Not
+ *          thread safe, used from the render thread.
+ */
+
+#pragma once
+
+#include <vulkan/vulkan.h>
+
+#include "../util/defines.hpp"
+#include "../util/texture-file.hpp"
+#include "memory-allocator.hpp"
+#include "staging-ring.hpp"
+
+#include <cstdint>
+#include <deque>
+#include <memory>
+#include <vector>
+
+namespace Renderer {
+
+struct TextureStats {
+  u32 textures = 0;
+  // textures sampled in a block compressed format
+  u32 compressed = 0;
+  // device memory of the resident levels, and what every texture's full chain would take
+  u64 residentBytes = 0;
+  u64 fullBytes = 0;
+  // what every full chain would take as RGBA8
+  u64 uncompressedBytes = 0;
+  // times a texture gained or dropped levels
+  u64 streamedIn = 0;
+  u64 streamedOut = 0;
+};
+
+class TextureStreamer {
+public:
+  TextureStreamer() = default;
+  TextureStreamer(const TextureStreamer &other) = delete;
+  TextureStreamer &operator=(const TextureStreamer &other) = delete;
+
+  /**
+   * @param streaming false keeps every level resident and ignores requests
+   */
+  void init(VkDevice device, MemoryAllocator &allocator, StagingRing &staging, u32 framesInFlight,
+            bool streaming = true);
+  /**
+   * @brief The GPU has to be done with every texture
+   */
+  void destroy();
+
+  /**
+   * @brief Add an RGBA8 sRGB texture and build its mip chain
+   *
+   * @details Starts with the levels up to INITIAL_SIZE texels across resident.
+   *
+   * @param pixels level 0, read again when the full level streams in, so it has to outlive the streamer
+   * @return the texture's index, indices count up from 0
+   */
+  u32 add(const void *pixels, u32 width, u32 height);
+  /**
+   * @brief Add a 2D texture loaded from a file, with the levels it has
+   *
+   * @param decompress decode it to RGBA8 first, for devices that can't sample its format
+   */
+  u32 add(std::shared_ptr<const Util::TextureFile> file, bool decompress);
+
+  /**
+   * @brief The image format for a texture format
+   */
+  static VkFormat getFormat(Util::TextureFormat format, bool srgb);
+
+  u32 getCount() const;
+  VkImageView getView(u32 texture) const;
+
+  /**
+   * @brief The texture covers about size pixels across on screen this frame
+   */
+  void request(u32 texture, f32 size);
+
+  /**
+   * @brief Bring this frame's requests in, within UPLOAD_BUDGET bytes, and free images no frame can use anymore
+   *
+   * @param frameNumber frames started so far, the previous ones up to framesInFlight back may still be running
+   */
+  void update(u64 frameNumber);
+
+  /**
+   * @brief Textures with a new view since the last call for this frame in flight, in no particular order
+   */
+  void takeChanged(u32 frame, std::vector<u32> &textures);
+
+  TextureStats getStats() const;
+  void printStats() const;
+
+private:
+  struct Texture {
+    // every level's data, level 0 of an added RGBA8 image belongs to the caller
+    std::vector<const uint8_t *> levels;
+    // levels filtered by the streamer, or the file they point into
+    std::vector<std::vector<uint8_t>> mips;
+    std::shared_ptr<const Util::TextureFile> file;
+    Util::TextureFormat format = Util::TextureFormat::RGBA8;
+    VkFormat imageFormat = VK_FORMAT_R8G8B8A8_SRGB;
+    u32 width = 1;
+    u32 height = 1;
+    u32 levelCount = 1;
+
+    // first level on the GPU, the image holds it and every coarser one
+    u32 residentLevel = 0;
+    // finest level requested this frame, coarsestLevel when nothing asked
+    u32 requestedLevel = 0;
+    // finest level streaming drops to when the texture isn't needed
+    u32 coarsestLevel = 0;
+    // the resident level was last needed then
+    u64 lastNeeded = 0;
+
+    VkImage image = VK_NULL_HANDLE;
+    Allocation memory;
+    VkImageView view = VK_NULL_HANDLE;
+  };
+
+  struct Retired {
+    VkImage image;
+    Allocation memory;
+    VkImageView view;
+    u64 frame;
+  };
+
+  // textures start with at most this many texels across resident
+  static constexpr u32 INITIAL_SIZE = 256;
+  // levels stay this many frames after they were last needed
+  static constexpr u64 KEEP_FRAMES = 120;
+  // bytes streamed in per frame, one texture always goes through
+  static constexpr VkDeviceSize UPLOAD_BUDGET = 16ull << 20;
+
+  u32 insert(Texture &&texture);
+  static VkDeviceSize chainSize(const Texture &texture, u32 firstLevel, Util::TextureFormat format);
+  void makeResident(u32 index, u32 level);
+
+  VkDevice device = VK_NULL_HANDLE;
+  MemoryAllocator *allocator = nullptr;
+  StagingRing *staging = nullptr;
+  u32 framesInFlight = 1;
+  bool streaming = true;
+  u64 frameNumber = 0;
+
+  std::vector<Texture> textures;
+  std::deque<Retired> retired;
+  // [frame in flight] textures with a new view
+  std::vector<std::vector<u32>> changed;
+
+  TextureStats stats;
+};
+
+} // namespace Renderer
@@ -1,17 +1,28 @@
 #version 450
 
-layout(binding = 1) uniform sampler2D texSampler;
+// texture table, built twice (see run.sh)
+#ifdef BINDLESS
+// sized by the descriptor set layout, any instance can index any slot
+#extension GL_EXT_nonuniform_qualifier : require
+layout(binding = 1) uniform sampler2D textures[];
+#define TABLE(slot) textures[nonuniformEXT(slot)]
+#else
+// sized by the renderer, the slot has to be the same across a draw (draws are split per texture)
+layout(constant_id = 0) const uint TEXTURE_COUNT = 1;
+layout(binding = 1) uniform sampler2D textures[TEXTURE_COUNT];
+#define TABLE(slot) textures[slot]
+#endif
 
 layout(location = 0) in vec3 normal;
 layout(location = 1) in vec2 texCoord;
 layout(location = 2) in vec3 viewDirection;
+layout(location = 3) flat in uint textureSlot;
 
 layout(location = 0) out vec4 outColor;
 
 vec3 blinn();
 
 void main() {
-    // vec4 tColor = texture(texSampler, texCoord);
     //outColor = vec4(normalize(normal), 1.0);
     outColor = vec4(blinn(), 1.0);
 }
@@ -22,7 +33,9 @@ vec3 blinn() {
     vec3 I = vec3(1.0, 1.0, 1.0); // Light color
     vec3 I_a = vec3(0.3, 0.3, 0.3); // Ambient light color
 
-    vec3 K_d = vec3(1.0, 0.0, 0.0); // Material diffuse color
+    // slot 0 is the default texture, untextured objects keep the material color
+    vec3 texel = texture(TABLE(textureSlot), texCoord).rgb;
+    vec3 K_d = textureSlot == 0u ? vec3(1.0, 0.0, 0.0) : texel; // Material diffuse color
     vec3 K_s = vec3(1.0, 1.0, 1.0); // Specular color
     vec3 K_a = K_d;
 
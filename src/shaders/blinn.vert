@@ -1,11 +1,26 @@
 #version 450
 
-layout(binding = 0) uniform UniformBufferObject {
-    mat4 model;
+layout(binding = 0) uniform FrameUniforms {
     mat4 view;
     mat4 proj;
-    mat3 mvn;
-} ubo;
+} frame;
+
+// one entry per drawn object, instanced draws of a mesh find theirs through gl_InstanceIndex
+// (which starts at the draw's firstInstance)
+struct Instance {
+    mat4 model;
+    mat4 normal; // mat3 padded out to a mat4
+    uint texture; // slot in the texture table, 0 when untextured
+};
+
+layout(std430, binding = 2) readonly buffer Instances {
+    Instance instances[];
+};
+
+// draw instance -> instance, compacted by the culling pass (or 0, 1, 2, ... without it)
+layout(std430, binding = 3) readonly buffer Visible {
+    uint visible[];
+};
 
 layout(location = 0) in vec3 pos;
 layout(location = 1) in vec3 nor;
@@ -14,12 +29,16 @@ layout(location = 2) in vec2 uv;
 layout(location = 0) out vec3 normal;
 layout(location = 1) out vec2 texCoord;
 layout(location = 2) out vec3 viewDirection;
+layout(location = 3) flat out uint textureSlot;
 
 void main() {
-    gl_Position = ubo.proj * ubo.view * ubo.model * vec4(pos, 1.0);
-    normal = ubo.mvn * nor;
+    Instance instance = instances[visible[gl_InstanceIndex]];
+
+    vec4 mvPos = frame.view * instance.model * vec4(pos, 1.0);
+    gl_Position = frame.proj * mvPos;
+    normal = mat3(instance.normal) * nor;
     texCoord = uv;
+    textureSlot = instance.texture;
 
-    vec4 mvPos = ubo.view * ubo.model * vec4(pos, 1.0);
     viewDirection = -1.0 * mvPos.xyz;
 }
@@ -4,4 +4,113 @@
 
 #include "threads.hpp"
 
-namespace Threads {} // namespace Threads
+#include <algorithm>
+
+namespace Threads {
+ThreadPool::ThreadPool(size_t threadCount) {
+  if (threadCount == 0) {
+    size_t hardware = std::thread::hardware_concurrency();
+    threadCount = hardware > 1 ? hardware - 1 : 1;
+  }
+
+  workers.reserve(threadCount);
+  for (size_t i = 0; i < threadCount; i++)
+    workers.emplace_back([this]() { workerLoop(); });
+}
+
+ThreadPool::~ThreadPool() {
+  {
+    std::lock_guard<std::mutex> lock(queueMutex);
+    stopping = true;
+  }
+  queueCondition.notify_all();
+
+  for (auto &worker : workers)
+    worker.join();
+}
+
+void ThreadPool::submit(std::function<void()> task, TaskGroup *group) {
+  if (group)
+    group->pending.fetch_add(1, std::memory_order_relaxed);
+
+  {
+    std::lock_guard<std::mutex> lock(queueMutex);
+    queue.push_back({std::move(task), group});
+  }
+  queueCondition.notify_one();
+}
+
+void ThreadPool::wait(TaskGroup &group) {
+  while (!group.done()) {
+    // help out instead of sleeping, this also keeps nested waits from deadlocking
+    if (!runOne())
+      std::this_thread::yield();
+  }
+}
+
+void ThreadPool::parallelFor(size_t count, size_t grain, const std::function<void(size_t, size_t)> &fn) {
+  if (count == 0)
+    return;
+
+  grain = std::max<size_t>(grain, 1);
+  if (count <= grain) {
+    fn(0, count);
+    return;
+  }
+
+  TaskGroup group;
+  for (size_t begin = grain; begin < count; begin += grain) {
+    size_t end = std::min(begin + grain, count);
+    submit([&fn, begin, end]() { fn(begin, end); }, &group);
+  }
+
+  // caller takes the first range
+  fn(0, grain);
+  wait(group);
+}
+
+size_t ThreadPool::size() const { return workers.size(); }
+
+ThreadPool &ThreadPool::global() {
+  static ThreadPool pool;
+  return pool;
+}
+
+void ThreadPool::workerLoop() {
+  while (true) {
+    Task task;
+    {
+      std::unique_lock<std::mutex> lock(queueMutex);
+      queueCondition.wait(lock, [this]() { return stopping || !queue.empty(); });
+
+      if (stopping && queue.empty())
+        return;
+
+      task = std::move(queue.front());
+      queue.pop_front();
+    }
+
+    task.work();
+    if (task.group)
+      task.group->pending.fetch_sub(1, std::memory_order_acq_rel);
+  }
+}
+
+bool ThreadPool::runOne() {
+  Task task;
+  {
+    std::lock_guard<std::mutex> lock(queueMutex);
+    if (queue.empty())
+      return false;
+
+    task = std::move(queue.front());
+    queue.pop_front();
+  }
+
+  task.work();
+  if (task.group)
+    task.group->pending.fetch_sub(1, std::memory_order_acq_rel);
+
+  return true;
+}
+} // namespace Threads
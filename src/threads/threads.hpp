@@ -3,13 +3,91 @@
  *
  * @brief header file for threads class
  *
+ * @details A small fixed size thread pool. Work is pushed on a shared
+ *          queue and picked up by the worker threads. The thread that
+ *          waits on work helps run it, so it is safe to wait from inside
+ *          a task.
  */
 
 #pragma once
 
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
 namespace Threads {
-class Threads {
+class ThreadPool {
 public:
+  /**
+   * @brief Tracks a group of tasks so the caller can wait on just those
+   */
+  class TaskGroup {
+  public:
+    TaskGroup() = default;
+    ~TaskGroup() = default;
+    TaskGroup(const TaskGroup &other) = delete;
+    TaskGroup &operator=(const TaskGroup &other) = delete;
+
+    bool done() const { return pending.load(std::memory_order_acquire) == 0; }
+
+  private:
+    friend class ThreadPool;
+    std::atomic<size_t> pending{0};
+  };
+
+  /**
+   * @param threadCount number of workers, 0 picks one less than the hardware thread count
+   */
+  explicit ThreadPool(size_t threadCount = 0);
+  ~ThreadPool();
+  ThreadPool(const ThreadPool &other) = delete;
+  ThreadPool &operator=(const ThreadPool &other) = delete;
+
+  /**
+   * @brief Queue a task, optionally as part of a group
+   */
+  void submit(std::function<void()> task, TaskGroup *group = nullptr);
+
+  /**
+   * @brief Block until every task in the group is finished (runs queued tasks while waiting)
+   */
+  void wait(TaskGroup &group);
+
+  /**
+   * @brief Split [0, count) in ranges of at most grain items and run fn(begin, end) on each range
+   *
+   * @details Blocks until all ranges are done
+   */
+  void parallelFor(size_t count, size_t grain, const std::function<void(size_t begin, size_t end)> &fn);
+
+  /**
+   * @brief Number of worker threads (not counting callers that help out while waiting)
+   */
+  size_t size() const;
+
+  /**
+   * @brief Shared pool used by engine subsystems
+   */
+  static ThreadPool &global();
+
 private:
+  struct Task {
+    std::function<void()> work;
+    TaskGroup *group;
+  };
+
+  void workerLoop();
+  bool runOne();
+
+  std::vector<std::thread> workers;
+  std::deque<Task> queue;
+  std::mutex queueMutex;
+  std::condition_variable queueCondition;
+  bool stopping = false;
 };
 } // namespace Threads
@@ -0,0 +1,595 @@
+/**
+ * @file block-compression.cpp
+ */
+
+#include "block-compression.hpp"
+#include "util.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <string>
+
+namespace Util {
+
+namespace {
+using Texels = uint8_t[16][4];
+
+// ====================================================================================================================
+// Blocks
+// ====================================================================================================================
+void loadBlock(const uint8_t *rgba, u32 width, u32 height, u32 blockX, u32 blockY, Texels &texels) {
+  for (u32 y = 0; y < 4; y++) {
+    u32 row = std::min(blockY * 4 + y, height - 1);
+    for (u32 x = 0; x < 4; x++) {
+      u32 column = std::min(blockX * 4 + x, width - 1);
+      std::memcpy(texels[y * 4 + x], rgba + ((size_t)row * width + column) * 4, 4);
+    }
+  }
+}
+
+void storeBlock(const Texels &texels, u32 width, u32 height, u32 blockX, u32 blockY, uint8_t *rgba) {
+  for (u32 y = 0; y < 4 && blockY * 4 + y < height; y++)
+    for (u32 x = 0; x < 4 && blockX * 4 + x < width; x++)
+      std::memcpy(rgba + ((size_t)(blockY * 4 + y) * width + blockX * 4 + x) * 4, texels[y * 4 + x], 4);
+}
+
+/**
+ * @brief Mean and direction of largest spread of the first channels of the texels
+ *
+ * @details Power iteration on the covariance, started from the bounding box diagonal. The axis is zero when every
+ *          texel is the same.
+ */
+void principalAxis(const Texels &texels, u32 channels, f32 mean[4], f32 axis[4]) {
+  f32 lo[4], hi[4];
+  for (u32 c = 0; c < channels; c++) {
+    mean[c] = 0.0f;
+    lo[c] = 255.0f;
+    hi[c] = 0.0f;
+    for (const auto &texel : texels) {
+      mean[c] += texel[c];
+      lo[c] = std::min(lo[c], (f32)texel[c]);
+      hi[c] = std::max(hi[c], (f32)texel[c]);
+    }
+    mean[c] /= 16.0f;
+  }
+
+  f32 covariance[4][4] = {};
+  for (const auto &texel : texels)
+    for (u32 i = 0; i < channels; i++)
+      for (u32 j = 0; j < channels; j++)
+        covariance[i][j] += (texel[i] - mean[i]) * (texel[j] - mean[j]);
+
+  for (u32 c = 0; c < channels; c++)
+    axis[c] = hi[c] - lo[c];
+
+  for (u32 iteration = 0; iteration < 8; iteration++) {
+    f32 next[4] = {};
+    f32 length = 0.0f;
+    for (u32 i = 0; i < channels; i++) {
+      for (u32 j = 0; j < channels; j++)
+        next[i] += covariance[i][j] * axis[j];
+      length = std::max(length, std::fabs(next[i]));
+    }
+    if (length < 1e-6f)
+      break;
+    for (u32 c = 0; c < channels; c++)
+      axis[c] = next[c] / length;
+  }
+
+  f32 length = 0.0f;
+  for (u32 c = 0; c < channels; c++)
+    length += axis[c] * axis[c];
+  length = std::sqrt(length);
+  for (u32 c = 0; c < channels; c++)
+    axis[c] = length > 1e-6f ? axis[c] / length : 0.0f;
+}
+
+/**
+ * @brief The points along the axis through the mean that bound the texels
+ */
+void axisEndpoints(const Texels &texels, u32 channels, f32 start[4], f32 end[4]) {
+  f32 mean[4], axis[4];
+  principalAxis(texels, channels, mean, axis);
+
+  f32 lo = 0.0f, hi = 0.0f;
+  for (const auto &texel : texels) {
+    f32 t = 0.0f;
+    for (u32 c = 0; c < channels; c++)
+      t += (texel[c] - mean[c]) * axis[c];
+    lo = std::min(lo, t);
+    hi = std::max(hi, t);
+  }
+
+  for (u32 c = 0; c < channels; c++) {
+    start[c] = std::clamp(mean[c] + axis[c] * lo, 0.0f, 255.0f);
+    end[c] = std::clamp(mean[c] + axis[c] * hi, 0.0f, 255.0f);
+  }
+}
+
+/**
+ * @brief Endpoints that best fit the texels for fixed interpolation weights (least squares)
+ *
+ * @details The texel at weight w is start * (1 - w) + end * w. Returns false when all weights are the same and
+ *          there's nothing to solve.
+ */
+bool fitEndpoints(const Texels &texels, const f32 weights[16], u32 channels, f32 start[4], f32 end[4]) {
+  f32 a = 0.0f, b = 0.0f, c = 0.0f;
+  f32 x[4] = {}, y[4] = {};
+  for (u32 i = 0; i < 16; i++) {
+    f32 w = weights[i];
+    a += (1.0f - w) * (1.0f - w);
+    b += (1.0f - w) * w;
+    c += w * w;
+    for (u32 channel = 0; channel < channels; channel++) {
+      x[channel] += (1.0f - w) * texels[i][channel];
+      y[channel] += w * texels[i][channel];
+    }
+  }
+
+  f32 determinant = a * c - b * b;
+  if (std::fabs(determinant) < 1e-6f)
+    return false;
+
+  for (u32 channel = 0; channel < channels; channel++) {
+    start[channel] = std::clamp((c * x[channel] - b * y[channel]) / determinant, 0.0f, 255.0f);
+    end[channel] = std::clamp((a * y[channel] - b * x[channel]) / determinant, 0.0f, 255.0f);
+  }
+  return true;
+}
+
+// ====================================================================================================================
+// BC1 color
+// ====================================================================================================================
+uint16_t pack565(const f32 color[3]) {
+  u32 r = (u32)std::lround(color[0] * 31.0f / 255.0f);
+  u32 g = (u32)std::lround(color[1] * 63.0f / 255.0f);
+  u32 b = (u32)std::lround(color[2] * 31.0f / 255.0f);
+  return (uint16_t)((r << 11) | (g << 5) | b);
+}
+
+void unpack565(uint16_t packed, i32 color[3]) {
+  i32 r = (packed >> 11) & 31, g = (packed >> 5) & 63, b = packed & 31;
+  color[0] = (r << 3) | (r >> 2);
+  color[1] = (g << 2) | (g >> 4);
+  color[2] = (b << 3) | (b >> 2);
+}
+
+/**
+ * @brief The four colors of a block, black (and transparent) fourth in three color mode
+ */
+void colorPalette(uint16_t color0, uint16_t color1, bool fourColor, i32 palette[4][4]) {
+  unpack565(color0, palette[0]);
+  unpack565(color1, palette[1]);
+  palette[0][3] = palette[1][3] = 255;
+  for (u32 c = 0; c < 3; c++) {
+    if (fourColor) {
+      palette[2][c] = (2 * palette[0][c] + palette[1][c]) / 3;
+      palette[3][c] = (palette[0][c] + 2 * palette[1][c]) / 3;
+    } else {
+      palette[2][c] = (palette[0][c] + palette[1][c]) / 2;
+      palette[3][c] = 0;
+    }
+  }
+  palette[2][3] = 255;
+  palette[3][3] = fourColor ? 255 : 0;
+}
+
+u32 chooseColorIndices(const Texels &texels, uint16_t color0, uint16_t color1, u32 indices[16]) {
+  i32 palette[4][4];
+  colorPalette(color0, color1, true, palette);
+
+  u32 error = 0;
+  for (u32 i = 0; i < 16; i++) {
+    u32 best = ~0u;
+    for (u32 entry = 0; entry < 4; entry++) {
+      u32 distance = 0;
+      for (u32 c = 0; c < 3; c++) {
+        i32 d = palette[entry][c] - texels[i][c];
+        distance += (u32)(d * d);
+      }
+      if (distance < best) {
+        best = distance;
+        indices[i] = entry;
+      }
+    }
+    error += best;
+  }
+  return error;
+}
+
+void encodeColorBlock(const Texels &texels, uint8_t *out) {
+  f32 start[4], end[4];
+  axisEndpoints(texels, 3, start, end);
+
+  // the end with more of the larger channels goes first, 4 color mode wants color0 > color1
+  uint16_t color0 = pack565(end), color1 = pack565(start);
+  u32 indices[16];
+  u32 error = chooseColorIndices(texels, color0, color1, indices);
+
+  // one refinement against the weights the first pass picked
+  static constexpr f32 WEIGHTS[4] = {0.0f, 1.0f, 1.0f / 3.0f, 2.0f / 3.0f};
+  f32 weights[16];
+  for (u32 i = 0; i < 16; i++)
+    weights[i] = WEIGHTS[indices[i]];
+  if (fitEndpoints(texels, weights, 3, start, end)) {
+    uint16_t fitted0 = pack565(start), fitted1 = pack565(end);
+    u32 fittedIndices[16];
+    u32 fittedError = chooseColorIndices(texels, fitted0, fitted1, fittedIndices);
+    if (fittedError < error) {
+      color0 = fitted0;
+      color1 = fitted1;
+      std::copy(fittedIndices, fittedIndices + 16, indices);
+    }
+  }
+
+  if (color0 < color1) {
+    std::swap(color0, color1);
+    for (u32 &index : indices)
+      index ^= 1;
+  } else if (color0 == color1) {
+    std::fill(indices, indices + 16, 0u);
+  }
+
+  u32 bits = 0;
+  for (u32 i = 0; i < 16; i++)
+    bits |= indices[i] << (2 * i);
+  out[0] = (uint8_t)color0;
+  out[1] = (uint8_t)(color0 >> 8);
+  out[2] = (uint8_t)color1;
+  out[3] = (uint8_t)(color1 >> 8);
+  std::memcpy(out + 4, &bits, 4);
+}
+
+void decodeColorBlock(const uint8_t *in, bool alwaysFourColor, Texels &texels) {
+  uint16_t color0 = (uint16_t)(in[0] | in[1] << 8);
+  uint16_t color1 = (uint16_t)(in[2] | in[3] << 8);
+  i32 palette[4][4];
+  colorPalette(color0, color1, alwaysFourColor || color0 > color1, palette);
+
+  u32 bits;
+  std::memcpy(&bits, in + 4, 4);
+  for (u32 i = 0; i < 16; i++)
+    for (u32 c = 0; c < 4; c++)
+      texels[i][c] = (uint8_t)palette[(bits >> (2 * i)) & 3][c];
+}
+
+// ====================================================================================================================
+// BC4 single channel (BC3 alpha, BC5 red and green)
+// ====================================================================================================================
+void channelPalette(u32 value0, u32 value1, u32 palette[8]) {
+  palette[0] = value0;
+  palette[1] = value1;
+  if (value0 > value1) {
+    for (u32 i = 2; i < 8; i++)
+      palette[i] = ((8 - i) * value0 + (i - 1) * value1 + 3) / 7;
+  } else {
+    for (u32 i = 2; i < 6; i++)
+      palette[i] = ((6 - i) * value0 + (i - 1) * value1 + 2) / 5;
+    palette[6] = 0;
+    palette[7] = 255;
+  }
+}
+
+void encodeChannelBlock(const Texels &texels, u32 channel, uint8_t *out) {
+  u32 lo = 255, hi = 0;
+  for (const auto &texel : texels) {
+    lo = std::min<u32>(lo, texel[channel]);
+    hi = std::max<u32>(hi, texel[channel]);
+  }
+
+  // 8 value mode with the maximum first, equal ends leave every index on the first
+  u32 palette[8];
+  channelPalette(hi, lo, palette);
+
+  u64 bits = 0;
+  for (u32 i = 0; i < 16 && hi != lo; i++) {
+    u32 best = ~0u, index = 0;
+    for (u32 entry = 0; entry < 8; entry++) {
+      u32 distance = (u32)std::abs((i32)palette[entry] - (i32)texels[i][channel]);
+      if (distance < best) {
+        best = distance;
+        index = entry;
+      }
+    }
+    bits |= (u64)index << (3 * i);
+  }
+
+  out[0] = (uint8_t)hi;
+  out[1] = (uint8_t)lo;
+  for (u32 i = 0; i < 6; i++)
+    out[2 + i] = (uint8_t)(bits >> (8 * i));
+}
+
+void decodeChannelBlock(const uint8_t *in, u32 channel, Texels &texels) {
+  u32 palette[8];
+  channelPalette(in[0], in[1], palette);
+
+  u64 bits = 0;
+  for (u32 i = 0; i < 6; i++)
+    bits |= (u64)in[2 + i] << (8 * i);
+  for (u32 i = 0; i < 16; i++)
+    texels[i][channel] = (uint8_t)palette[(bits >> (3 * i)) & 7];
+}
+
+// ====================================================================================================================
+// BC7 mode 6
+// ====================================================================================================================
+constexpr u32 BC7_WEIGHTS[16] = {0, 4, 9, 13, 17, 21, 26, 30, 34, 38, 43, 47, 51, 55, 60, 64};
+
+struct Bc7Endpoint {
+  u32 value[4];
+  u32 pbit;
+
+  u32 expand(u32 channel) const { return (value[channel] << 1) | pbit; }
+};
+
+/**
+ * @brief The 7 bit endpoint and p-bit closest to an RGBA point
+ */
+Bc7Endpoint quantizeBc7(const f32 point[4]) {
+  Bc7Endpoint best{};
+  f32 bestError = -1.0f;
+  for (u32 pbit = 0; pbit < 2; pbit++) {
+    Bc7Endpoint candidate{};
+    candidate.pbit = pbit;
+    f32 error = 0.0f;
+    for (u32 c = 0; c < 4; c++) {
+      candidate.value[c] = (u32)std::clamp((i32)std::lround((point[c] - (f32)pbit) / 2.0f), 0, 127);
+      f32 d = (f32)candidate.expand(c) - point[c];
+      error += d * d;
+    }
+    if (bestError < 0.0f || error < bestError) {
+      best = candidate;
+      bestError = error;
+    }
+  }
+  return best;
+}
+
+u32 chooseBc7Indices(const Texels &texels, const Bc7Endpoint &start, const Bc7Endpoint &end, u32 indices[16]) {
+  i32 palette[16][4];
+  for (u32 entry = 0; entry < 16; entry++)
+    for (u32 c = 0; c < 4; c++)
+      palette[entry][c] =
+          (i32)(((64 - BC7_WEIGHTS[entry]) * start.expand(c) + BC7_WEIGHTS[entry] * end.expand(c) + 32) >> 6);
+
+  u32 error = 0;
+  for (u32 i = 0; i < 16; i++) {
+    u32 best = ~0u;
+    for (u32 entry = 0; entry < 16; entry++) {
+      u32 distance = 0;
+      for (u32 c = 0; c < 4; c++) {
+        i32 d = palette[entry][c] - texels[i][c];
+        distance += (u32)(d * d);
+      }
+      if (distance < best) {
+        best = distance;
+        indices[i] = entry;
+      }
+    }
+    error += best;
+  }
+  return error;
+}
+
+class BitWriter {
+public:
+  explicit BitWriter(uint8_t *out) : out(out) { std::memset(out, 0, 16); }
+
+  void write(u32 value, u32 bits) {
+    for (u32 i = 0; i < bits; i++, position++)
+      out[position / 8] |= (uint8_t)(((value >> i) & 1) << (position % 8));
+  }
+
+private:
+  uint8_t *out;
+  u32 position = 0;
+};
+
+class BitReader {
+public:
+  explicit BitReader(const uint8_t *in) : in(in) {}
+
+  u32 read(u32 bits) {
+    u32 value = 0;
+    for (u32 i = 0; i < bits; i++, position++)
+      value |= (u32)((in[position / 8] >> (position % 8)) & 1) << i;
+    return value;
+  }
+
+private:
+  const uint8_t *in;
+  u32 position = 0;
+};
+
+void encodeBc7Block(const Texels &texels, uint8_t *out) {
+  f32 start[4], end[4];
+  axisEndpoints(texels, 4, start, end);
+
+  Bc7Endpoint endpoint0 = quantizeBc7(start), endpoint1 = quantizeBc7(end);
+  u32 indices[16];
+  u32 error = chooseBc7Indices(texels, endpoint0, endpoint1, indices);
+
+  f32 weights[16];
+  for (u32 i = 0; i < 16; i++)
+    weights[i] = (f32)BC7_WEIGHTS[indices[i]] / 64.0f;
+  if (fitEndpoints(texels, weights, 4, start, end)) {
+    Bc7Endpoint fitted0 = quantizeBc7(start), fitted1 = quantizeBc7(end);
+    u32 fittedIndices[16];
+    u32 fittedError = chooseBc7Indices(texels, fitted0, fitted1, fittedIndices);
+    if (fittedError < error) {
+      endpoint0 = fitted0;
+      endpoint1 = fitted1;
+      std::copy(fittedIndices, fittedIndices + 16, indices);
+    }
+  }
+
+  // the first index is stored without its top bit, so it has to be below 8
+  if (indices[0] >= 8) {
+    std::swap(endpoint0, endpoint1);
+    for (u32 &index : indices)
+      index = 15 - index;
+  }
+
+  BitWriter writer(out);
+  writer.write(1u << 6, 7);
+  for (u32 c = 0; c < 4; c++) {
+    writer.write(endpoint0.value[c], 7);
+    writer.write(endpoint1.value[c], 7);
+  }
+  writer.write(endpoint0.pbit, 1);
+  writer.write(endpoint1.pbit, 1);
+  writer.write(indices[0], 3);
+  for (u32 i = 1; i < 16; i++)
+    writer.write(indices[i], 4);
+}
+
+void decodeBc7Block(const uint8_t *in, Texels &texels) {
+  // the mode is the number of zero bits before the first one
+  u32 mode = 0;
+  while (mode < 8 && !((in[0] >> mode) & 1))
+    mode++;
+  if (mode == 8) {
+    // reserved, decodes to transparent black
+    std::memset(texels, 0, sizeof(Texels));
+    return;
+  }
+  if (mode != 6)
+    Util::Error("BC7 blocks in mode " + std::to_string(mode) + " can't be decoded on the CPU, only mode 6");
+
+  BitReader reader(in);
+  reader.read(7);
+  Bc7Endpoint endpoint0{}, endpoint1{};
+  for (u32 c = 0; c < 4; c++) {
+    endpoint0.value[c] = reader.read(7);
+    endpoint1.value[c] = reader.read(7);
+  }
+  endpoint0.pbit = reader.read(1);
+  endpoint1.pbit = reader.read(1);
+
+  for (u32 i = 0; i < 16; i++) {
+    u32 weight = BC7_WEIGHTS[reader.read(i == 0 ? 3 : 4)];
+    for (u32 c = 0; c < 4; c++)
+      texels[i][c] = (uint8_t)(((64 - weight) * endpoint0.expand(c) + weight * endpoint1.expand(c) + 32) >> 6);
+  }
+}
+} // namespace
+
+// ====================================================================================================================
+// Formats
+// ====================================================================================================================
+const char *getFormatName(TextureFormat format) {
+  switch (format) {
+  case TextureFormat::RGBA8:
+    return "RGBA8";
+  case TextureFormat::BC1:
+    return "BC1";
+  case TextureFormat::BC3:
+    return "BC3";
+  case TextureFormat::BC5:
+    return "BC5";
+  case TextureFormat::BC7:
+    return "BC7";
+  }
+  return "unknown";
+}
+
+bool isCompressed(TextureFormat format) { return format != TextureFormat::RGBA8; }
+
+u32 getBlockExtent(TextureFormat format) { return isCompressed(format) ? 4 : 1; }
+
+u32 getBlockBytes(TextureFormat format) {
+  switch (format) {
+  case TextureFormat::RGBA8:
+    return 4;
+  case TextureFormat::BC1:
+    return 8;
+  default:
+    return 16;
+  }
+}
+
+size_t getImageSize(TextureFormat format, u32 width, u32 height) {
+  u32 extent = getBlockExtent(format);
+  return (size_t)((width + extent - 1) / extent) * ((height + extent - 1) / extent) * getBlockBytes(format);
+}
+
+// ====================================================================================================================
+// Images
+// ====================================================================================================================
+void compressImage(TextureFormat format, const uint8_t *rgba, u32 width, u32 height, uint8_t *dst) {
+  if (format == TextureFormat::RGBA8) {
+    std::memcpy(dst, rgba, getImageSize(format, width, height));
+    return;
+  }
+
+  const u32 blocksWide = (width + 3) / 4, blocksHigh = (height + 3) / 4;
+  const u32 blockBytes = getBlockBytes(format);
+  Texels texels;
+  for (u32 blockY = 0; blockY < blocksHigh; blockY++) {
+    for (u32 blockX = 0; blockX < blocksWide; blockX++) {
+      loadBlock(rgba, width, height, blockX, blockY, texels);
+      uint8_t *out = dst + ((size_t)blockY * blocksWide + blockX) * blockBytes;
+      switch (format) {
+      case TextureFormat::BC1:
+        encodeColorBlock(texels, out);
+        break;
+      case TextureFormat::BC3:
+        encodeChannelBlock(texels, 3, out);
+        encodeColorBlock(texels, out + 8);
+        break;
+      case TextureFormat::BC5:
+        encodeChannelBlock(texels, 0, out);
+        encodeChannelBlock(texels, 1, out + 8);
+        break;
+      case TextureFormat::BC7:
+        encodeBc7Block(texels, out);
+        break;
+      default:
+        break;
+      }
+    }
+  }
+}
+
+void decompressImage(TextureFormat format, const uint8_t *src, u32 width, u32 height, uint8_t *rgba) {
+  if (format == TextureFormat::RGBA8) {
+    std::memcpy(rgba, src, getImageSize(format, width, height));
+    return;
+  }
+
+  const u32 blocksWide = (width + 3) / 4, blocksHigh = (height + 3) / 4;
+  const u32 blockBytes = getBlockBytes(format);
+  Texels texels;
+  for (u32 blockY = 0; blockY < blocksHigh; blockY++) {
+    for (u32 blockX = 0; blockX < blocksWide; blockX++) {
+      const uint8_t *in = src + ((size_t)blockY * blocksWide + blockX) * blockBytes;
+      switch (format) {
+      case TextureFormat::BC1:
+        decodeColorBlock(in, false, texels);
+        break;
+      case TextureFormat::BC3:
+        decodeColorBlock(in + 8, true, texels);
+        decodeChannelBlock(in, 3, texels);
+        break;
+      case TextureFormat::BC5:
+        for (auto &texel : texels) {
+          texel[2] = 0;
+          texel[3] = 255;
+        }
+        decodeChannelBlock(in, 0, texels);
+        decodeChannelBlock(in + 8, 1, texels);
+        break;
+      case TextureFormat::BC7:
+        decodeBc7Block(in, texels);
+        break;
+      default:
+        break;
+      }
+      storeBlock(texels, width, height, blockX, blockY, rgba);
+    }
+  }
+}
+
+} // namespace Util
@@ -0,0 +1,66 @@
+/**
+ * @file block-compression.hpp
+ *
+ * @brief header file for BCn texture block encoding and decoding
+ *
+ * @details Block compressed formats store every 4x4 texel block in a fixed
+ *          number of bytes, and GPUs sample them as is:
+ *
+ *            BC1  8 bytes, RGB (4:1 against RGBA8 + 1 bit alpha, unused here)
+ *            BC3  16 bytes, RGB like BC1 plus a separate alpha block
+ *            BC5  16 bytes, two independent channels (normal maps)
+ *            BC7  16 bytes, RGBA at the best quality of the four
+ *
+ *          The encoders are for the offline compressor (texture-compressor):
+ *          BC1/BC3/BC5 fit endpoints along each block's principal axis and BC7
+ *          only writes mode 6 (one subset, RGBA endpoints with a p-bit each,
+ *          4 bit indices). The decoders are the fallback for GPUs that can't
+ *          sample BCn. They read everything the encoders write and any
+ *          BC1/BC3/BC5 block; BC7 blocks in modes other than 6 are rejected.
+ *
+ *          Images are tightly packed RGBA8 rows, blocks run left to right and
+ *          top to bottom. Sizes that aren't multiples of 4 pad the last row
+ *          and column of blocks by repeating edge texels.
+ */
+
+#pragma once
+
+#include "defines.hpp"
+
+#include <cstddef>
+#include <cstdint>
+
+namespace Util {
+
+enum class TextureFormat : u32 { RGBA8, BC1, BC3, BC5, BC7 };
+
+const char *getFormatName(TextureFormat format);
+bool isCompressed(TextureFormat format);
+
+/**
+ * @brief Texels across a block, 1 for RGBA8 and 4 for BCn
+ */
+u32 getBlockExtent(TextureFormat format);
+/**
+ * @brief Bytes of one block (or texel for RGBA8)
+ */
+u32 getBlockBytes(TextureFormat format);
+/**
+ * @brief Bytes of a width by height image
+ */
+size_t getImageSize(TextureFormat format, u32 width, u32 height);
+
+/**
+ * @brief Encode a whole image, dst has room for getImageSize(format, width, height) bytes
+ *
+ * @details A horizontal strip a multiple of 4 rows high encodes to the matching rows of blocks, so an image can be
+ *          split into strips and encoded in parallel.
+ */
+void compressImage(TextureFormat format, const uint8_t *rgba, u32 width, u32 height, uint8_t *dst);
+
+/**
+ * @brief Decode a whole image into RGBA8, BC5's second channel goes to green and blue is 0
+ */
+void decompressImage(TextureFormat format, const uint8_t *src, u32 width, u32 height, uint8_t *rgba);
+
+} // namespace Util
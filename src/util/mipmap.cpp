@@ -0,0 +1,113 @@
+/**
+ * @file mipmap.cpp
+ */
+
+#include "mipmap.hpp"
+
+#include <algorithm>
+#include <cmath>
+
+namespace Util {
+
+namespace {
+// linear values are looked up in this many steps on the way back to sRGB
+constexpr u32 SRGB_STEPS = 4096;
+
+struct Tables {
+  f32 srgbToLinear[256];
+  f32 unormToFloat[256];
+  uint8_t linearToSrgb[SRGB_STEPS];
+
+  Tables() {
+    for (u32 i = 0; i < 256; i++) {
+      f32 c = (f32)i / 255.0f;
+      unormToFloat[i] = c;
+      srgbToLinear[i] = c <= 0.04045f ? c / 12.92f : std::pow((c + 0.055f) / 1.055f, 2.4f);
+    }
+    for (u32 i = 0; i < SRGB_STEPS; i++) {
+      f32 c = (f32)i / (f32)(SRGB_STEPS - 1);
+      f32 s = c <= 0.0031308f ? c * 12.92f : 1.055f * std::pow(c, 1.0f / 2.4f) - 0.055f;
+      linearToSrgb[i] = (uint8_t)std::clamp(s * 255.0f + 0.5f, 0.0f, 255.0f);
+    }
+  }
+};
+
+const Tables &tables() {
+  static const Tables instance;
+  return instance;
+}
+
+/**
+ * @brief Source texels along one side that dst texel i covers, returns how many (1 to 3) are written to out
+ */
+inline u32 footprint(u32 i, u32 size, u32 dstSize, u32 *out) {
+  if (size == 1) {
+    out[0] = 0;
+    return 1;
+  }
+
+  u32 count = 0;
+  out[count++] = 2 * i;
+  out[count++] = 2 * i + 1;
+  // an odd side's leftover texel goes to the last one
+  if (size % 2 == 1 && i == dstSize - 1)
+    out[count++] = 2 * i + 2;
+  return count;
+}
+
+inline uint8_t encode(f32 value, bool srgb) {
+  if (srgb)
+    return tables().linearToSrgb[(u32)(std::clamp(value, 0.0f, 1.0f) * (SRGB_STEPS - 1) + 0.5f)];
+  return (uint8_t)(std::clamp(value, 0.0f, 1.0f) * 255.0f + 0.5f);
+}
+} // namespace
+
+u32 mipLevelCount(u32 width, u32 height) {
+  u32 size = std::max(width, height);
+  u32 levels = 1;
+  while (size > 1) {
+    size >>= 1;
+    levels++;
+  }
+  return levels;
+}
+
+void downsampleRGBA8(const uint8_t *src, u32 width, u32 height, uint8_t *dst, bool srgb) {
+  const Tables &t = tables();
+  const f32 *color = srgb ? t.srgbToLinear : t.unormToFloat;
+  const f32 *alpha = t.unormToFloat;
+
+  const u32 dstWidth = std::max(width / 2, 1u);
+  const u32 dstHeight = std::max(height / 2, 1u);
+
+  u32 columns[3];
+  u32 rows[3];
+  for (u32 y = 0; y < dstHeight; y++) {
+    const u32 rowCount = footprint(y, height, dstHeight, rows);
+    uint8_t *out = dst + (size_t)y * dstWidth * 4;
+
+    for (u32 x = 0; x < dstWidth; x++) {
+      const u32 columnCount = footprint(x, width, dstWidth, columns);
+
+      f32 sum[4] = {0.0f, 0.0f, 0.0f, 0.0f};
+      for (u32 r = 0; r < rowCount; r++) {
+        const uint8_t *row = src + (size_t)rows[r] * width * 4;
+        for (u32 c = 0; c < columnCount; c++) {
+          const uint8_t *p = row + (size_t)columns[c] * 4;
+          sum[0] += color[p[0]];
+          sum[1] += color[p[1]];
+          sum[2] += color[p[2]];
+          sum[3] += alpha[p[3]];
+        }
+      }
+
+      const f32 scale = 1.0f / (f32)(rowCount * columnCount);
+      out[x * 4 + 0] = encode(sum[0] * scale, srgb);
+      out[x * 4 + 1] = encode(sum[1] * scale, srgb);
+      out[x * 4 + 2] = encode(sum[2] * scale, srgb);
+      out[x * 4 + 3] = encode(sum[3] * scale, false);
+    }
+  }
+}
+
+} // namespace Util
@@ -0,0 +1,34 @@
+/**
+ * @file mipmap.hpp
+ *
+ * @brief header file for building mip chains on the CPU
+ *
+ * @details Every level halves the one above it (rounding down) with a 2x2
+ *          box filter. When a side is odd the last texel along it averages
+ *          three rows or columns instead of two, so none are dropped, and a
+ *          side of 1 stays 1. Color is averaged in linear space so sRGB
+ *          textures don't get darker further down the chain, alpha is
+ *          averaged as is.
+ */
+
+#pragma once
+
+#include "defines.hpp"
+
+#include <cstdint>
+
+namespace Util {
+
+/**
+ * @brief Levels of a full chain down to 1x1
+ */
+u32 mipLevelCount(u32 width, u32 height);
+
+/**
+ * @brief Filter RGBA8 texels into the next level, dst has room for max(width / 2, 1) * max(height / 2, 1) texels
+ *
+ * @param srgb the color channels are sRGB encoded
+ */
+void downsampleRGBA8(const uint8_t *src, u32 width, u32 height, uint8_t *dst, bool srgb);
+
+} // namespace Util
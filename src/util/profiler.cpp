@@ -0,0 +1,210 @@
+/**
+ * @file profiler.cpp
+ */
+
+#include "profiler.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+
+namespace Util {
+
+namespace {
+const std::chrono::steady_clock::time_point START = std::chrono::steady_clock::now();
+
+void writeJSONString(std::ostream &out, const char *text) {
+  out << '"';
+  for (const char *c = text; *c; c++) {
+    if (*c == '"' || *c == '\\')
+      out << '\\' << *c;
+    else if ((unsigned char)*c < 0x20)
+      out << ' ';
+    else
+      out << *c;
+  }
+  out << '"';
+}
+} // namespace
+
+// ====================================================================================================================
+// Setup
+// ====================================================================================================================
+Profiler &Profiler::global() {
+  static Profiler profiler;
+  return profiler;
+}
+
+bool Profiler::isEnabled() {
+#ifdef ENABLE_PROFILER
+  return true;
+#else
+  return false;
+#endif
+}
+
+u64 Profiler::now() {
+  return (u64)std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - START).count();
+}
+
+Profiler::ThreadRing &Profiler::getThreadRing() {
+  // the lock is only taken once per thread, the ring stays in rings after the thread exits
+  thread_local ThreadRing *ring = nullptr;
+  if (!ring) {
+    std::lock_guard<std::mutex> lock(ringsMutex);
+    rings.push_back(std::make_unique<ThreadRing>());
+    ring = rings.back().get();
+    ring->id = (u32)rings.size() - 1;
+    ring->name = "thread " + std::to_string(ring->id);
+  }
+  return *ring;
+}
+
+void Profiler::setThreadName(const std::string &name) {
+  if (!isEnabled())
+    return;
+
+  ThreadRing &ring = getThreadRing();
+  std::lock_guard<std::mutex> lock(ringsMutex);
+  ring.name = name;
+}
+
+// ====================================================================================================================
+// Recording
+// ====================================================================================================================
+void Profiler::record(const char *name, u64 startNs, u64 endNs) {
+  ThreadRing &ring = getThreadRing();
+  u64 head = ring.head.load(std::memory_order_relaxed);
+  ring.events[head % RING_SIZE] = {name, startNs, endNs};
+  ring.head.store(head + 1, std::memory_order_release);
+}
+
+u64 Profiler::readRing(const ThreadRing &ring, u64 first, std::vector<Event> &out) {
+  u64 head = ring.head.load(std::memory_order_acquire);
+  first = std::max(first, head > RING_SIZE ? head - RING_SIZE : 0);
+
+  size_t start = out.size();
+  for (u64 i = first; i < head; i++)
+    out.push_back(ring.events[i % RING_SIZE]);
+
+  // the owner may have lapped the copy, events it could have been writing over meanwhile are dropped
+  std::atomic_thread_fence(std::memory_order_acquire);
+  u64 after = ring.head.load(std::memory_order_relaxed);
+  if (after >= RING_SIZE && after - RING_SIZE + 1 > first) {
+    u64 overwritten = std::min(after - RING_SIZE + 1, head) - first;
+    out.erase(out.begin() + start, out.begin() + start + overwritten);
+  }
+  return head;
+}
+
+// ====================================================================================================================
+// Frame summary
+// ====================================================================================================================
+void Profiler::frameMark() {
+  std::vector<ThreadRing *> current;
+  {
+    std::lock_guard<std::mutex> lock(ringsMutex);
+    for (auto &ring : rings)
+      current.push_back(ring.get());
+  }
+
+  std::vector<Event> events;
+  for (ThreadRing *ring : current)
+    ring->summarized = readRing(*ring, ring->summarized, events);
+
+  // the same name can come from different pointers (one literal per translation unit), totals merge by text
+  std::vector<ZoneTotal> totals;
+  for (const Event &event : events) {
+    auto found = std::find_if(totals.begin(), totals.end(), [&](const ZoneTotal &total) {
+      return total.name == event.name || std::strcmp(total.name, event.name) == 0;
+    });
+    if (found == totals.end())
+      found = totals.insert(totals.end(), ZoneTotal{event.name, 0.0, 0});
+    found->ms += (event.endNs - event.startNs) / 1e6;
+    found->count++;
+  }
+  std::sort(totals.begin(), totals.end(), [](const ZoneTotal &a, const ZoneTotal &b) { return a.ms > b.ms; });
+
+  u64 frameNs = now();
+  std::lock_guard<std::mutex> lock(summaryMutex);
+  frameSummary = std::move(totals);
+  frameMs = lastFrameNs > 0 ? (frameNs - lastFrameNs) / 1e6 : 0.0;
+  lastFrameNs = frameNs;
+}
+
+std::vector<ZoneTotal> Profiler::getFrameSummary() const {
+  std::lock_guard<std::mutex> lock(summaryMutex);
+  return frameSummary;
+}
+
+void Profiler::printFrameSummary(std::ostream &out) const {
+  if (!isEnabled()) {
+    out << "CPU zones: profiler compiled out, configure with -DENABLE_PROFILER=ON\n";
+    return;
+  }
+
+  std::lock_guard<std::mutex> lock(summaryMutex);
+  out << "CPU zones (last frame, " << frameMs << " ms):";
+  for (const ZoneTotal &total : frameSummary) {
+    out << "\n  " << total.name << " " << total.ms << " ms";
+    if (total.count > 1)
+      out << " (" << total.count << " times)";
+  }
+  out << "\n";
+}
+
+// ====================================================================================================================
+// Trace export
+// ====================================================================================================================
+void Profiler::exportChromeTrace(const std::string &path) const {
+  if (!isEnabled()) {
+    std::cout << "CPU trace: profiler compiled out, nothing written to " << path << "\n";
+    return;
+  }
+
+  std::ofstream file(path);
+  if (!file) {
+    std::cout << "CPU trace: failed to write " << path << "\n";
+    return;
+  }
+
+  std::vector<std::pair<u32, std::string>> threads;
+  std::vector<std::pair<u32, std::vector<Event>>> events;
+  {
+    std::lock_guard<std::mutex> lock(ringsMutex);
+    for (auto &ring : rings) {
+      threads.emplace_back(ring->id, ring->name);
+      events.emplace_back(ring->id, std::vector<Event>{});
+      readRing(*ring, 0, events.back().second);
+    }
+  }
+
+  // complete events ("X") in microseconds, nesting follows from the times
+  size_t written = 0;
+  char number[64];
+  file << "{\"displayTimeUnit\":\"ns\",\"traceEvents\":[";
+  for (const auto &[id, name] : threads) {
+    file << (written++ > 0 ? ",\n" : "\n") << "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":0,\"tid\":" << id
+         << ",\"args\":{\"name\":";
+    writeJSONString(file, name.c_str());
+    file << "}}";
+  }
+  for (const auto &[id, threadEvents] : events) {
+    for (const Event &event : threadEvents) {
+      file << ",\n{\"name\":";
+      writeJSONString(file, event.name);
+      std::snprintf(number, sizeof(number), "%.3f,\"dur\":%.3f", event.startNs / 1e3,
+                    (event.endNs - event.startNs) / 1e3);
+      file << ",\"ph\":\"X\",\"pid\":0,\"tid\":" << id << ",\"ts\":" << number << "}";
+      written++;
+    }
+  }
+  file << "\n]}\n";
+
+  std::cout << "Wrote " << written - threads.size() << " CPU zones to " << path << "\n";
+}
+
+} // namespace Util
@@ -0,0 +1,153 @@
+/**
+ * @file profiler.hpp
+ *
+ * @brief header file for the CPU frame profiler
+ *
+ * @details PROFILE_ZONE("name") times the rest of the enclosing scope,
+ *          PROFILE_FUNCTION() does the same named after the function. The name
+ *          must outlive the program (a string literal), only the pointer is
+ *          kept.
+ *
+ *          Each thread writes its zones to its own fixed size ring of events
+ *          (name, start and end in nanoseconds), so recording takes no lock and
+ *          nothing is shared between threads: the owner writes the event and
+ *          then publishes it by bumping the ring's head. The ring is registered
+ *          once, under a lock, the first time the thread records a zone, and
+ *          outlives the thread. When a thread records more than the ring holds
+ *          between two reads, the oldest events are dropped.
+ *
+ *          Readers (the per frame summary and the trace export) copy events
+ *          from the rings while threads keep recording, and throw away the ones
+ *          that may have been overwritten during the copy.
+ *
+ *          Without ENABLE_PROFILER (the CMake option of the same name) the
+ *          macros expand to nothing and the profiler records nothing, the
+ *          reports say so.
+ */
+
+#pragma once
+
+#include "defines.hpp"
+
+#include <array>
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <ostream>
+#include <string>
+#include <vector>
+
+#ifdef ENABLE_PROFILER
+#define PROFILE_CONCAT_INNER(a, b) a##b
+#define PROFILE_CONCAT(a, b) PROFILE_CONCAT_INNER(a, b)
+#define PROFILE_ZONE(name) ::Util::ProfileZone PROFILE_CONCAT(profileZone, __LINE__)(name)
+#define PROFILE_FUNCTION() PROFILE_ZONE(__func__)
+#else
+#define PROFILE_ZONE(name)
+#define PROFILE_FUNCTION()
+#endif
+
+namespace Util {
+
+/**
+ * @brief One zone's time in one frame, summed over every thread and every time it ran
+ */
+struct ZoneTotal {
+  const char *name = nullptr;
+  f64 ms = 0.0;
+  u64 count = 0;
+};
+
+class Profiler {
+public:
+  // events a thread can record between two reads
+  static constexpr u32 RING_SIZE = 1 << 15;
+
+  struct Event {
+    const char *name;
+    u64 startNs;
+    u64 endNs;
+  };
+
+  /**
+   * @brief A thread's events, written only by that thread
+   */
+  struct ThreadRing {
+    std::array<Event, RING_SIZE> events;
+    // events ever written, the newest is at (head - 1) % RING_SIZE
+    std::atomic<u64> head{0};
+    // first event the frame summary hasn't counted yet, used by the thread that calls frameMark
+    u64 summarized = 0;
+    u32 id = 0;
+    std::string name;
+  };
+
+  static Profiler &global();
+  static bool isEnabled();
+
+  /**
+   * @brief Nanoseconds since the profiler started
+   */
+  static u64 now();
+
+  /**
+   * @brief Name the calling thread in the trace, threads without one are "thread <id>"
+   */
+  void setThreadName(const std::string &name);
+
+  /**
+   * @brief Record a finished zone for the calling thread
+   */
+  void record(const char *name, u64 startNs, u64 endNs);
+
+  /**
+   * @brief End of a frame, sums the zones every thread finished since the last mark into the frame summary
+   *
+   * @details Call from one thread only, the main loop's
+   */
+  void frameMark();
+  /**
+   * @brief Zones of the last marked frame, longest first
+   */
+  std::vector<ZoneTotal> getFrameSummary() const;
+  void printFrameSummary(std::ostream &out) const;
+
+  /**
+   * @brief Write every event still in the rings as Chrome trace_event JSON (chrome://tracing, Perfetto)
+   */
+  void exportChromeTrace(const std::string &path) const;
+
+private:
+  Profiler() = default;
+
+  ThreadRing &getThreadRing();
+  /**
+   * @brief Copy the ring's events in [first, head) that are still intact to out, returns the head it read up to
+   */
+  static u64 readRing(const ThreadRing &ring, u64 first, std::vector<Event> &out);
+
+  mutable std::mutex ringsMutex;
+  std::vector<std::unique_ptr<ThreadRing>> rings;
+
+  mutable std::mutex summaryMutex;
+  std::vector<ZoneTotal> frameSummary;
+  f64 frameMs = 0.0;
+  u64 lastFrameNs = 0;
+};
+
+/**
+ * @brief Records its lifetime as a zone, use through PROFILE_ZONE
+ */
+class ProfileZone {
+public:
+  explicit ProfileZone(const char *name) : name(name), startNs(Profiler::now()) {}
+  ~ProfileZone() { Profiler::global().record(name, startNs, Profiler::now()); }
+  ProfileZone(const ProfileZone &other) = delete;
+  ProfileZone &operator=(const ProfileZone &other) = delete;
+
+private:
+  const char *name;
+  u64 startNs;
+};
+
+} // namespace Util
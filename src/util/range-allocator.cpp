@@ -0,0 +1,77 @@
+/**
+ * @file range-allocator.cpp
+ */
+
+#include "range-allocator.hpp"
+#include "util.hpp"
+
+namespace Util {
+
+RangeAllocator::RangeAllocator(u64 capacity) : capacity(capacity) {}
+
+void RangeAllocator::reset(u64 capacity) {
+  this->capacity = capacity;
+  top = 0;
+  used = 0;
+  freeRanges.clear();
+}
+
+bool RangeAllocator::allocate(u64 size, Range &range) {
+  if (size == 0)
+    Util::Error("RangeAllocator: can't allocate an empty range");
+
+  auto it = freeRanges.find(size);
+  if (it != freeRanges.end() && !it->second.empty()) {
+    range = {it->second.back(), size};
+    it->second.pop_back();
+  } else if (capacity - top >= size) {
+    range = {top, size};
+    top += size;
+  } else if (!splitLarger(size, range)) {
+    return false;
+  }
+
+  used += size;
+  return true;
+}
+
+void RangeAllocator::free(const Range &range) {
+  if (range.size == 0)
+    return;
+
+  used -= range.size;
+
+  // ranges at the top give the space back to the bump pointer
+  if (range.offset + range.size == top) {
+    top = range.offset;
+    return;
+  }
+
+  freeRanges[range.size].push_back(range.offset);
+}
+
+bool RangeAllocator::splitLarger(u64 size, Range &range) {
+  // smallest free range that fits, only reached once the top is exhausted
+  auto best = freeRanges.end();
+  for (auto it = freeRanges.begin(); it != freeRanges.end(); ++it) {
+    if (it->first > size && !it->second.empty() && (best == freeRanges.end() || it->first < best->first))
+      best = it;
+  }
+
+  if (best == freeRanges.end())
+    return false;
+
+  u64 offset = best->second.back();
+  u64 remainder = best->first - size;
+  best->second.pop_back();
+
+  range = {offset, size};
+  freeRanges[remainder].push_back(offset + size);
+  return true;
+}
+
+u64 RangeAllocator::getCapacity() const { return capacity; }
+
+u64 RangeAllocator::getUsed() const { return used; }
+
+} // namespace Util
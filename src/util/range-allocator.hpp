@@ -0,0 +1,57 @@
+/**
+ * @file range-allocator.hpp
+ *
+ * @brief header file for the range allocator
+ *
+ * @details Hands out ranges of a fixed size address space (elements of a
+ *          GPU buffer, slots of an array) without owning any memory itself.
+ *          Freed ranges go on a free list per size, so the common runtime
+ *          pattern of releasing and requesting ranges of the same few sizes
+ *          (the same meshes spawning over and over) is O(1). Everything else
+ *          is bumped off the top, and only when the top is exhausted are
+ *          larger free ranges split.
+ */
+
+#pragma once
+
+#include "defines.hpp"
+
+#include <unordered_map>
+#include <vector>
+
+namespace Util {
+
+class RangeAllocator {
+public:
+  struct Range {
+    u64 offset = 0;
+    u64 size = 0;
+  };
+
+  explicit RangeAllocator(u64 capacity = 0);
+
+  /**
+   * @brief Forget every allocation and start over with a new capacity
+   */
+  void reset(u64 capacity);
+
+  /**
+   * @brief Returns false (and leaves range alone) when no free range is big enough
+   */
+  bool allocate(u64 size, Range &range);
+  void free(const Range &range);
+
+  u64 getCapacity() const;
+  u64 getUsed() const;
+
+private:
+  bool splitLarger(u64 size, Range &range);
+
+  u64 capacity = 0;
+  u64 top = 0;
+  u64 used = 0;
+  // size -> offsets of free ranges of exactly that size
+  std::unordered_map<u64, std::vector<u64>> freeRanges;
+};
+
+} // namespace Util
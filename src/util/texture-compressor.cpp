@@ -0,0 +1,178 @@
+/**
+ * @file texture-compressor.cpp
+ *
+ * @brief Compresses images into block compressed DDS textures with their mip chain
+ *
+ * @details usage: texture-compressor [--format bc1|bc3|bc5|bc7|rgba8] [--linear] [--no-mips] <image>... <output.dds>
+ *
+ *          One image makes a 2D texture, six make a cubemap with the faces in
+ *          the order given (the order of a scene's environment line). BC7 is
+ *          the default, BC1 halves its size for opaque textures without fine
+ *          color detail and BC5 keeps the red and green channels of normal
+ *          maps. --linear marks the color as not sRGB encoded, BC5 always is.
+ */
+
+#include "../threads/threads.hpp"
+#include "block-compression.hpp"
+#include "mipmap.hpp"
+#include "stb_image.h"
+#include "texture-file.hpp"
+#include "util.hpp"
+
+#include <algorithm>
+#include <cctype>
+#include <chrono>
+#include <cmath>
+#include <exception>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <vector>
+
+namespace {
+void usage(const char *program) {
+  std::cerr << "usage: " << program
+            << " [--format bc1|bc3|bc5|bc7|rgba8] [--linear] [--no-mips] <image>... <output.dds>" << std::endl;
+}
+
+Util::TextureFormat parseFormat(const std::string &name) {
+  for (auto format : {Util::TextureFormat::RGBA8, Util::TextureFormat::BC1, Util::TextureFormat::BC3,
+                      Util::TextureFormat::BC5, Util::TextureFormat::BC7}) {
+    std::string formatName = Util::getFormatName(format);
+    std::string lower;
+    for (char c : formatName)
+      lower += (char)std::tolower((unsigned char)c);
+    if (name == lower)
+      return format;
+  }
+  Util::Error("Unknown format: " + name);
+  return Util::TextureFormat::RGBA8;
+}
+
+size_t fileSize(const std::string &path) {
+  std::ifstream file(path, std::ios::ate | std::ios::binary);
+  return file ? (size_t)file.tellg() : 0;
+}
+
+f64 mib(size_t bytes) { return (f64)bytes / (1024.0 * 1024.0); }
+} // namespace
+
+int main(int argc, char **argv) {
+  Util::TextureFormat format = Util::TextureFormat::BC7;
+  bool srgb = true;
+  bool mips = true;
+  std::vector<std::string> paths;
+
+  try {
+    for (int i = 1; i < argc; i++) {
+      std::string arg = argv[i];
+      if (arg == "--format" && i + 1 < argc)
+        format = parseFormat(argv[++i]);
+      else if (arg == "--linear")
+        srgb = false;
+      else if (arg == "--no-mips")
+        mips = false;
+      else
+        paths.push_back(arg);
+    }
+  } catch (std::exception &e) {
+    std::cerr << e.what() << std::endl;
+    return -1;
+  }
+
+  if (paths.size() != 2 && paths.size() != 7) {
+    usage(argv[0]);
+    return -1;
+  }
+  const std::string output = paths.back();
+  paths.pop_back();
+  if (format == Util::TextureFormat::BC5)
+    srgb = false;
+
+  try {
+    auto start = std::chrono::steady_clock::now();
+
+    std::vector<unsigned char *> images(paths.size());
+    int width = 0, height = 0;
+    size_t sourceBytes = 0;
+    for (size_t i = 0; i < paths.size(); i++) {
+      int w, h, channels;
+      Util::loadImage(paths[i], images[i], w, h, channels);
+      if (i > 0 && (w != width || h != height))
+        Util::Error("Cubemap faces have different sizes: " + paths[i]);
+      width = w;
+      height = h;
+      sourceBytes += fileSize(paths[i]);
+    }
+
+    Util::TextureFile texture;
+    texture.format = format;
+    texture.srgb = srgb;
+    texture.width = (u32)width;
+    texture.height = (u32)height;
+    texture.levels = mips ? Util::mipLevelCount(texture.width, texture.height) : 1;
+    texture.faces = (u32)images.size();
+    Util::allocateTextureFile(texture);
+
+    Threads::ThreadPool &pool = Threads::ThreadPool::global();
+    // the error counts the channels the format keeps
+    const u32 channels = format == Util::TextureFormat::BC5 ? 2 : format == Util::TextureFormat::BC1 ? 3 : 4;
+    f64 squaredError = 0.0;
+    for (u32 face = 0; face < texture.faces; face++) {
+      std::vector<uint8_t> level(images[face], images[face] + (size_t)width * height * 4);
+      std::vector<uint8_t> next;
+      stbi_image_free(images[face]);
+
+      for (u32 l = 0; l < texture.levels; l++) {
+        const u32 w = texture.getLevelWidth(l), h = texture.getLevelHeight(l);
+        uint8_t *dst = texture.data.data() + texture.offsets[face * texture.levels + l];
+
+        // strips of block rows encode independently
+        const u32 blockRows = (h + 3) / 4;
+        const size_t stripBytes = Util::getImageSize(format, w, 4);
+        pool.parallelFor(blockRows, 8, [&](size_t begin, size_t end) {
+          const u32 firstRow = (u32)begin * 4;
+          const u32 rows = std::min((u32)end * 4, h) - firstRow;
+          Util::compressImage(format, level.data() + (size_t)firstRow * w * 4, w, rows,
+                              dst + (Util::isCompressed(format) ? begin * stripBytes : (size_t)firstRow * w * 4));
+        });
+
+        if (l == 0) {
+          std::vector<uint8_t> decoded(level.size());
+          Util::decompressImage(format, dst, w, h, decoded.data());
+          for (size_t i = 0; i < level.size(); i++) {
+            f64 d = (f64)level[i] - decoded[i];
+            squaredError += i % 4 < channels ? d * d : 0.0;
+          }
+        }
+
+        if (l + 1 < texture.levels) {
+          next.resize((size_t)texture.getLevelWidth(l + 1) * texture.getLevelHeight(l + 1) * 4);
+          Util::downsampleRGBA8(level.data(), w, h, next.data(), srgb);
+          level.swap(next);
+        }
+      }
+    }
+
+    Util::saveTextureFile(texture, output);
+    auto done = std::chrono::steady_clock::now();
+
+    const f64 meanSquaredError = squaredError / ((f64)width * height * channels * texture.faces);
+    const f64 psnr = meanSquaredError > 0.0 ? 10.0 * std::log10(255.0 * 255.0 / meanSquaredError) : 99.0;
+
+    std::cout << "Compressed " << paths.size() << (texture.faces == 6 ? " cubemap faces" : " image") << " ("
+              << width << "x" << height << ", " << texture.levels << " levels) to "
+              << Util::getFormatName(format) << (srgb ? " sRGB" : "") << " in "
+              << std::chrono::duration<f64, std::milli>(done - start).count() << " ms\n";
+    std::cout << "  source files:  " << mib(sourceBytes) << " MiB\n";
+    std::cout << "  as RGBA8:      " << mib(texture.getUncompressedSize()) << " MiB of GPU memory\n";
+    std::cout << "  compressed:    " << mib(texture.data.size()) << " MiB (" << output << ", " << mib(fileSize(output))
+              << " MiB on disk)\n";
+    std::cout << "  level 0 PSNR:  " << psnr << " dB\n";
+  } catch (std::exception &e) {
+    std::cerr << e.what() << std::endl;
+    return -1;
+  }
+
+  return 0;
+}
@@ -0,0 +1,340 @@
+/**
+ * @file texture-file.cpp
+ */
+
+#include "texture-file.hpp"
+#include "mipmap.hpp"
+#include "util.hpp"
+
+#include <algorithm>
+#include <cctype>
+#include <cstring>
+#include <fstream>
+
+namespace Util {
+
+namespace {
+// ====================================================================================================================
+// DDS
+// ====================================================================================================================
+constexpr u32 fourCC(char a, char b, char c, char d) {
+  return (u32)(uint8_t)a | (u32)(uint8_t)b << 8 | (u32)(uint8_t)c << 16 | (u32)(uint8_t)d << 24;
+}
+
+constexpr u32 DDS_MAGIC = fourCC('D', 'D', 'S', ' ');
+
+struct DdsPixelFormat {
+  u32 size;
+  u32 flags;
+  u32 fourCC;
+  u32 rgbBitCount;
+  u32 rMask, gMask, bMask, aMask;
+};
+
+struct DdsHeader {
+  u32 size;
+  u32 flags;
+  u32 height;
+  u32 width;
+  u32 pitchOrLinearSize;
+  u32 depth;
+  u32 mipMapCount;
+  u32 reserved1[11];
+  DdsPixelFormat pixelFormat;
+  u32 caps;
+  u32 caps2;
+  u32 caps3;
+  u32 caps4;
+  u32 reserved2;
+};
+static_assert(sizeof(DdsHeader) == 124, "DDS header is 124 bytes");
+
+struct DdsHeaderDx10 {
+  u32 dxgiFormat;
+  u32 resourceDimension;
+  u32 miscFlag;
+  u32 arraySize;
+  u32 miscFlags2;
+};
+
+constexpr u32 DDSD_CAPS = 0x1, DDSD_HEIGHT = 0x2, DDSD_WIDTH = 0x4, DDSD_PIXELFORMAT = 0x1000,
+              DDSD_MIPMAPCOUNT = 0x20000, DDSD_LINEARSIZE = 0x80000;
+constexpr u32 DDPF_ALPHAPIXELS = 0x1, DDPF_FOURCC = 0x4, DDPF_RGB = 0x40;
+constexpr u32 DDSCAPS_COMPLEX = 0x8, DDSCAPS_TEXTURE = 0x1000, DDSCAPS_MIPMAP = 0x400000;
+constexpr u32 DDSCAPS2_CUBEMAP = 0x200, DDSCAPS2_CUBEMAP_ALLFACES = 0xFC00, DDSCAPS2_VOLUME = 0x200000;
+constexpr u32 DDS_DIMENSION_TEXTURE2D = 3;
+constexpr u32 DDS_RESOURCE_MISC_TEXTURECUBE = 0x4;
+
+struct DxgiFormat {
+  u32 value;
+  TextureFormat format;
+  bool srgb;
+};
+
+constexpr DxgiFormat DXGI_FORMATS[] = {
+    {28, TextureFormat::RGBA8, false}, {29, TextureFormat::RGBA8, true}, {71, TextureFormat::BC1, false},
+    {72, TextureFormat::BC1, true},    {77, TextureFormat::BC3, false},  {78, TextureFormat::BC3, true},
+    {83, TextureFormat::BC5, false},   {98, TextureFormat::BC7, false},  {99, TextureFormat::BC7, true},
+};
+
+// ====================================================================================================================
+// KTX2
+// ====================================================================================================================
+constexpr uint8_t KTX2_IDENTIFIER[12] = {0xAB, 'K', 'T', 'X', ' ', '2', '0', 0xBB, '\r', '\n', 0x1A, '\n'};
+// identifier, 9 header words, 4 index words and 2 index u64s
+constexpr size_t KTX2_LEVEL_INDEX = 12 + 9 * 4 + 4 * 4 + 2 * 8;
+
+struct VkFormatEntry {
+  u32 value;
+  TextureFormat format;
+  bool srgb;
+};
+
+// VkFormat values, the RGB and RGBA variants of BC1 load the same
+constexpr VkFormatEntry VK_FORMATS[] = {
+    {37, TextureFormat::RGBA8, false}, {43, TextureFormat::RGBA8, true}, {131, TextureFormat::BC1, false},
+    {132, TextureFormat::BC1, true},   {133, TextureFormat::BC1, false}, {134, TextureFormat::BC1, true},
+    {137, TextureFormat::BC3, false},  {138, TextureFormat::BC3, true},  {141, TextureFormat::BC5, false},
+    {145, TextureFormat::BC7, false},  {146, TextureFormat::BC7, true},
+};
+
+// ====================================================================================================================
+// Reading
+// ====================================================================================================================
+template <typename T> T read(const std::vector<char> &bytes, size_t offset, const std::string &path) {
+  if (offset + sizeof(T) > bytes.size())
+    Util::Error("Texture file is truncated: " + path);
+  T value;
+  std::memcpy(&value, bytes.data() + offset, sizeof(T));
+  return value;
+}
+
+void checkTexture(const TextureFile &texture, const std::string &path) {
+  if (texture.width == 0 || texture.height == 0 || texture.width > 16384 || texture.height > 16384)
+    Util::Error("Texture file has a bad size: " + path);
+  if (texture.levels == 0 || texture.levels > mipLevelCount(texture.width, texture.height) ||
+      (texture.faces != 1 && texture.faces != 6))
+    Util::Error("Texture file has bad levels or faces: " + path);
+}
+
+TextureFile loadDds(const std::vector<char> &bytes, const std::string &path) {
+  DdsHeader header = read<DdsHeader>(bytes, 4, path);
+  size_t dataOffset = 4 + sizeof(DdsHeader);
+  if (header.size != sizeof(DdsHeader))
+    Util::Error("DDS file has a bad header: " + path);
+
+  TextureFile texture;
+  texture.width = header.width;
+  texture.height = header.height;
+  texture.levels = (header.flags & DDSD_MIPMAPCOUNT) && header.mipMapCount > 0 ? header.mipMapCount : 1;
+
+  if (header.caps2 & DDSCAPS2_VOLUME)
+    Util::Error("DDS volume textures aren't supported: " + path);
+  if (header.caps2 & DDSCAPS2_CUBEMAP) {
+    if ((header.caps2 & DDSCAPS2_CUBEMAP_ALLFACES) != DDSCAPS2_CUBEMAP_ALLFACES)
+      Util::Error("DDS cubemap doesn't have all six faces: " + path);
+    texture.faces = 6;
+  }
+
+  const DdsPixelFormat &pixelFormat = header.pixelFormat;
+  if ((pixelFormat.flags & DDPF_FOURCC) && pixelFormat.fourCC == fourCC('D', 'X', '1', '0')) {
+    DdsHeaderDx10 dx10 = read<DdsHeaderDx10>(bytes, dataOffset, path);
+    dataOffset += sizeof(DdsHeaderDx10);
+
+    const DxgiFormat *found = std::find_if(std::begin(DXGI_FORMATS), std::end(DXGI_FORMATS),
+                                           [&](const DxgiFormat &entry) { return entry.value == dx10.dxgiFormat; });
+    if (found == std::end(DXGI_FORMATS))
+      Util::Error("DDS file has an unsupported DXGI format " + std::to_string(dx10.dxgiFormat) + ": " + path);
+    if (dx10.resourceDimension != DDS_DIMENSION_TEXTURE2D || dx10.arraySize > 1)
+      Util::Error("DDS file isn't a single 2D texture or cubemap: " + path);
+
+    texture.format = found->format;
+    texture.srgb = found->srgb;
+    if (dx10.miscFlag & DDS_RESOURCE_MISC_TEXTURECUBE)
+      texture.faces = 6;
+  } else if (pixelFormat.flags & DDPF_FOURCC) {
+    // the legacy header doesn't say, color formats are assumed to be sRGB
+    if (pixelFormat.fourCC == fourCC('D', 'X', 'T', '1')) {
+      texture.format = TextureFormat::BC1;
+    } else if (pixelFormat.fourCC == fourCC('D', 'X', 'T', '5')) {
+      texture.format = TextureFormat::BC3;
+    } else if (pixelFormat.fourCC == fourCC('A', 'T', 'I', '2') || pixelFormat.fourCC == fourCC('B', 'C', '5', 'U')) {
+      texture.format = TextureFormat::BC5;
+      texture.srgb = false;
+    } else {
+      Util::Error("DDS file has an unsupported format: " + path);
+    }
+  } else if ((pixelFormat.flags & DDPF_RGB) && (pixelFormat.flags & DDPF_ALPHAPIXELS) &&
+             pixelFormat.rgbBitCount == 32 && pixelFormat.rMask == 0xFF && pixelFormat.gMask == 0xFF00 &&
+             pixelFormat.bMask == 0xFF0000 && pixelFormat.aMask == 0xFF000000) {
+    texture.format = TextureFormat::RGBA8;
+  } else {
+    Util::Error("DDS file has an unsupported format: " + path);
+  }
+
+  checkTexture(texture, path);
+  allocateTextureFile(texture);
+  if (dataOffset + texture.data.size() > bytes.size())
+    Util::Error("DDS file is truncated: " + path);
+
+  // every face's whole chain one after the other, the same layout as ours
+  std::memcpy(texture.data.data(), bytes.data() + dataOffset, texture.data.size());
+  return texture;
+}
+
+TextureFile loadKtx2(const std::vector<char> &bytes, const std::string &path) {
+  auto word = [&](u32 index) { return read<u32>(bytes, 12 + index * 4, path); };
+  const u32 vkFormat = word(0), width = word(2), height = word(3), depth = word(4), layers = word(5),
+            faces = word(6), levels = word(7), supercompression = word(8);
+
+  const VkFormatEntry *found = std::find_if(std::begin(VK_FORMATS), std::end(VK_FORMATS),
+                                            [&](const VkFormatEntry &entry) { return entry.value == vkFormat; });
+  if (found == std::end(VK_FORMATS))
+    Util::Error("KTX2 file has an unsupported VkFormat " + std::to_string(vkFormat) + ": " + path);
+  if (supercompression != 0)
+    Util::Error("KTX2 file is supercompressed, that isn't supported: " + path);
+  if (depth > 1 || layers > 1)
+    Util::Error("KTX2 file isn't a single 2D texture or cubemap: " + path);
+
+  TextureFile texture;
+  texture.format = found->format;
+  texture.srgb = found->srgb;
+  texture.width = width;
+  texture.height = std::max(height, 1u);
+  texture.faces = faces;
+  // 0 means the writer left generating the chain to the reader, which isn't done here: only the base level is loaded
+  texture.levels = levels == 0 ? 1 : levels;
+  checkTexture(texture, path);
+  allocateTextureFile(texture);
+
+  // levels are indexed separately, each holds its faces one after the other
+  for (u32 level = 0; level < texture.levels; level++) {
+    const size_t entry = KTX2_LEVEL_INDEX + (size_t)level * 24;
+    const u64 offset = read<u64>(bytes, entry, path);
+    const u64 length = read<u64>(bytes, entry + 8, path);
+    const size_t faceSize = texture.getLevelSize(level);
+    if (length < faceSize * texture.faces || offset + length > bytes.size())
+      Util::Error("KTX2 file has a bad level " + std::to_string(level) + ": " + path);
+
+    for (u32 face = 0; face < texture.faces; face++)
+      std::memcpy(texture.data.data() + texture.offsets[face * texture.levels + level],
+                  bytes.data() + offset + face * faceSize, faceSize);
+  }
+  return texture;
+}
+
+bool endsWith(const std::string &path, const std::string &suffix) {
+  if (path.size() < suffix.size())
+    return false;
+  return std::equal(suffix.rbegin(), suffix.rend(), path.rbegin(),
+                    [](char a, char b) { return a == std::tolower((unsigned char)b); });
+}
+} // namespace
+
+// ====================================================================================================================
+// Texture file
+// ====================================================================================================================
+u32 TextureFile::getLevelWidth(u32 level) const { return std::max(width >> level, 1u); }
+
+u32 TextureFile::getLevelHeight(u32 level) const { return std::max(height >> level, 1u); }
+
+size_t TextureFile::getLevelSize(u32 level) const {
+  return getImageSize(format, getLevelWidth(level), getLevelHeight(level));
+}
+
+const uint8_t *TextureFile::getLevel(u32 face, u32 level) const {
+  return data.data() + offsets[face * levels + level];
+}
+
+size_t TextureFile::getUncompressedSize() const {
+  size_t size = 0;
+  for (u32 level = 0; level < levels; level++)
+    size += getImageSize(TextureFormat::RGBA8, getLevelWidth(level), getLevelHeight(level));
+  return size * faces;
+}
+
+bool isTextureFile(const std::string &path) { return endsWith(path, ".dds") || endsWith(path, ".ktx2"); }
+
+TextureFile loadTextureFile(const std::string &path) {
+  std::vector<char> bytes = Util::readFile(path);
+
+  if (read<u32>(bytes, 0, path) == DDS_MAGIC)
+    return loadDds(bytes, path);
+  if (bytes.size() >= sizeof(KTX2_IDENTIFIER) && std::memcmp(bytes.data(), KTX2_IDENTIFIER, 12) == 0)
+    return loadKtx2(bytes, path);
+
+  Util::Error("Not a DDS or KTX2 file: " + path);
+  return {};
+}
+
+void saveTextureFile(const TextureFile &texture, const std::string &path) {
+  const DxgiFormat *found = std::find_if(std::begin(DXGI_FORMATS), std::end(DXGI_FORMATS), [&](const DxgiFormat &e) {
+    return e.format == texture.format && (e.srgb == texture.srgb || texture.format == TextureFormat::BC5);
+  });
+
+  DdsHeader header{};
+  header.size = sizeof(DdsHeader);
+  header.flags = DDSD_CAPS | DDSD_HEIGHT | DDSD_WIDTH | DDSD_PIXELFORMAT | DDSD_MIPMAPCOUNT | DDSD_LINEARSIZE;
+  header.height = texture.height;
+  header.width = texture.width;
+  header.pitchOrLinearSize = (u32)texture.getLevelSize(0);
+  header.mipMapCount = texture.levels;
+  header.pixelFormat.size = sizeof(DdsPixelFormat);
+  header.pixelFormat.flags = DDPF_FOURCC;
+  header.pixelFormat.fourCC = fourCC('D', 'X', '1', '0');
+  header.caps = DDSCAPS_TEXTURE;
+  if (texture.levels > 1)
+    header.caps |= DDSCAPS_MIPMAP | DDSCAPS_COMPLEX;
+  if (texture.faces == 6) {
+    header.caps |= DDSCAPS_COMPLEX;
+    header.caps2 = DDSCAPS2_CUBEMAP | DDSCAPS2_CUBEMAP_ALLFACES;
+  }
+
+  DdsHeaderDx10 dx10{};
+  dx10.dxgiFormat = found->value;
+  dx10.resourceDimension = DDS_DIMENSION_TEXTURE2D;
+  dx10.miscFlag = texture.faces == 6 ? DDS_RESOURCE_MISC_TEXTURECUBE : 0;
+  dx10.arraySize = 1;
+
+  std::ofstream out(path, std::ios::binary);
+  if (!out)
+    Util::Error("Failed to open texture file for writing: " + path);
+  out.write(reinterpret_cast<const char *>(&DDS_MAGIC), sizeof(DDS_MAGIC));
+  out.write(reinterpret_cast<const char *>(&header), sizeof(header));
+  out.write(reinterpret_cast<const char *>(&dx10), sizeof(dx10));
+  out.write(reinterpret_cast<const char *>(texture.data.data()), (std::streamsize)texture.data.size());
+  if (!out)
+    Util::Error("Failed to write texture file: " + path);
+}
+
+void allocateTextureFile(TextureFile &texture) {
+  texture.offsets.resize((size_t)texture.faces * texture.levels);
+  size_t size = 0;
+  for (u32 face = 0; face < texture.faces; face++) {
+    for (u32 level = 0; level < texture.levels; level++) {
+      texture.offsets[face * texture.levels + level] = size;
+      size += texture.getLevelSize(level);
+    }
+  }
+  texture.data.resize(size);
+}
+
+TextureFile decompressTexture(const TextureFile &texture) {
+  TextureFile decoded;
+  decoded.format = TextureFormat::RGBA8;
+  decoded.srgb = texture.srgb;
+  decoded.width = texture.width;
+  decoded.height = texture.height;
+  decoded.levels = texture.levels;
+  decoded.faces = texture.faces;
+  allocateTextureFile(decoded);
+
+  for (u32 face = 0; face < texture.faces; face++)
+    for (u32 level = 0; level < texture.levels; level++)
+      decompressImage(texture.format, texture.getLevel(face, level), texture.getLevelWidth(level),
+                      texture.getLevelHeight(level),
+                      decoded.data.data() + decoded.offsets[face * decoded.levels + level]);
+  return decoded;
+}
+
+} // namespace Util
@@ -0,0 +1,77 @@
+/**
+ * @file texture-file.hpp
+ *
+ * @brief header file for DDS and KTX2 texture files
+ *
+ * @details Texture files hold images already in the format the GPU samples,
+ *          with their mip chain, so nothing is decoded or filtered at load
+ *          time. Reads:
+ *
+ *            DDS   BC1 (DXT1), BC3 (DXT5), BC5 (ATI2/BC5U) with the legacy
+ *                  header, BC1/BC3/BC5/BC7 and RGBA8 with the DX10 header,
+ *                  cubemaps with all six faces
+ *            KTX2  BC1/BC3/BC5/BC7 and RGBA8 without supercompression,
+ *                  1 or 6 faces
+ *
+ *          Texture arrays and volume textures aren't supported. Written files
+ *          (texture-compressor) are always DDS with the DX10 header.
+ *
+ *          Faces keep the order they have in the file, for cubemaps that's
+ *          the layer order of the cube image.
+ */
+
+#pragma once
+
+#include "block-compression.hpp"
+#include "defines.hpp"
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace Util {
+
+struct TextureFile {
+  TextureFormat format = TextureFormat::RGBA8;
+  // the color channels are sRGB encoded
+  bool srgb = true;
+  u32 width = 1;
+  u32 height = 1;
+  u32 levels = 1;
+  // 1, or 6 for a cubemap
+  u32 faces = 1;
+
+  // every face's levels, level l of face f starts at offsets[f * levels + l]
+  std::vector<uint8_t> data;
+  std::vector<size_t> offsets;
+
+  u32 getLevelWidth(u32 level) const;
+  u32 getLevelHeight(u32 level) const;
+  size_t getLevelSize(u32 level) const;
+  const uint8_t *getLevel(u32 face, u32 level) const;
+
+  /**
+   * @brief Bytes every face and level would take as RGBA8
+   */
+  size_t getUncompressedSize() const;
+};
+
+/**
+ * @brief The path names a DDS or KTX2 file (by extension)
+ */
+bool isTextureFile(const std::string &path);
+
+TextureFile loadTextureFile(const std::string &path);
+void saveTextureFile(const TextureFile &texture, const std::string &path);
+
+/**
+ * @brief Lay out offsets and size data for the format, size, levels and faces already set
+ */
+void allocateTextureFile(TextureFile &texture);
+
+/**
+ * @brief The same texture decoded to RGBA8, every face and level
+ */
+TextureFile decompressTexture(const TextureFile &texture);
+
+} // namespace Util
@@ -0,0 +1,248 @@
+/**
+ * @file tlsf-allocator.cpp
+ */
+
+#include "tlsf-allocator.hpp"
+#include "util.hpp"
+
+#include <algorithm>
+
+namespace Util {
+
+namespace {
+u32 highestBit(u64 value) { return 63 - (u32)__builtin_clzll(value); }
+
+u32 lowestBit(u64 value) { return (u32)__builtin_ctzll(value); }
+
+u64 alignUp(u64 value, u64 alignment) { return (value + alignment - 1) & ~(alignment - 1); }
+} // namespace
+
+TlsfAllocator::TlsfAllocator(u64 capacity) { reset(capacity); }
+
+void TlsfAllocator::reset(u64 capacity) {
+  this->capacity = capacity & ~(GRANULARITY - 1);
+  used = 0;
+  freeRanges = 0;
+
+  nodes.clear();
+  unusedNodes.clear();
+  allocated.clear();
+  flBitmap = 0;
+  std::fill(std::begin(slBitmap), std::end(slBitmap), 0);
+  for (auto &lists : heads)
+    std::fill(std::begin(lists), std::end(lists), NONE);
+
+  if (this->capacity > 0)
+    insertFree(createNode(0, this->capacity));
+}
+
+// ====================================================================================================================
+// Allocation
+// ====================================================================================================================
+bool TlsfAllocator::allocate(u64 size, u64 alignment, Range &range) {
+  if (size == 0)
+    Util::Error("TlsfAllocator: can't allocate an empty range");
+  if (alignment & (alignment - 1))
+    Util::Error("TlsfAllocator: alignment has to be a power of two");
+
+  size = alignUp(size, GRANULARITY);
+  alignment = std::max(alignment, GRANULARITY);
+
+  // nodes start on GRANULARITY, so this much extra covers any alignment padding
+  u32 fl, sl;
+  if (!findFree(size + alignment - GRANULARITY, fl, sl))
+    return false;
+
+  u32 node = heads[fl][sl];
+  removeFree(node);
+
+  u64 padding = alignUp(nodes[node].offset, alignment) - nodes[node].offset;
+  if (padding > 0) {
+    split(node, padding);
+    u32 aligned = nodes[node].nextPhysical;
+    insertFree(node);
+    node = aligned;
+  }
+
+  if (nodes[node].size > size) {
+    split(node, size);
+    insertFree(nodes[node].nextPhysical);
+  }
+
+  nodes[node].free = false;
+  allocated[nodes[node].offset] = node;
+  used += size;
+
+  range = {nodes[node].offset, size};
+  return true;
+}
+
+void TlsfAllocator::free(u64 offset) {
+  auto it = allocated.find(offset);
+  if (it == allocated.end())
+    Util::Error("TlsfAllocator: freeing a range that was not allocated");
+
+  u32 node = it->second;
+  allocated.erase(it);
+  used -= nodes[node].size;
+  nodes[node].free = true;
+
+  // free neighbours are merged right away, so a free node never has a free neighbour
+  u32 next = nodes[node].nextPhysical;
+  if (next != NONE && nodes[next].free) {
+    removeFree(next);
+    merge(node, next);
+  }
+
+  u32 prev = nodes[node].prevPhysical;
+  if (prev != NONE && nodes[prev].free) {
+    removeFree(prev);
+    merge(prev, node);
+    node = prev;
+  }
+
+  insertFree(node);
+}
+
+// ====================================================================================================================
+// Size Classes
+// ====================================================================================================================
+void TlsfAllocator::mapping(u64 size, u32 &fl, u32 &sl) {
+  if (size < SMALL_SIZE) {
+    fl = 0;
+    sl = (u32)(size >> GRANULARITY_BITS);
+  } else {
+    u32 log = highestBit(size);
+    sl = (u32)((size >> (log - SL_BITS)) ^ SL_COUNT);
+    fl = log - FL_SHIFT + 1;
+  }
+}
+
+bool TlsfAllocator::findFree(u64 size, u32 &fl, u32 &sl) const {
+  // round up to the next list, so any range in the list found is big enough
+  if (size >= SMALL_SIZE)
+    size += (u64(1) << (highestBit(size) - SL_BITS)) - 1;
+  mapping(size, fl, sl);
+  if (fl >= FL_COUNT)
+    return false;
+
+  u32 slMap = sl < SL_COUNT ? slBitmap[fl] & (~0u << sl) : 0;
+  if (slMap == 0) {
+    u64 flMap = fl + 1 < 64 ? flBitmap & (~u64(0) << (fl + 1)) : 0;
+    if (flMap == 0)
+      return false;
+
+    fl = lowestBit(flMap);
+    slMap = slBitmap[fl];
+  }
+
+  sl = lowestBit(slMap);
+  return true;
+}
+
+// ====================================================================================================================
+// Nodes
+// ====================================================================================================================
+u32 TlsfAllocator::createNode(u64 offset, u64 size) {
+  u32 index;
+  if (!unusedNodes.empty()) {
+    index = unusedNodes.back();
+    unusedNodes.pop_back();
+  } else {
+    index = (u32)nodes.size();
+    nodes.emplace_back();
+  }
+
+  nodes[index] = {offset, size, NONE, NONE, NONE, NONE, true};
+  return index;
+}
+
+void TlsfAllocator::destroyNode(u32 node) { unusedNodes.push_back(node); }
+
+void TlsfAllocator::insertFree(u32 node) {
+  u32 fl, sl;
+  mapping(nodes[node].size, fl, sl);
+
+  u32 head = heads[fl][sl];
+  nodes[node].free = true;
+  nodes[node].prevFree = NONE;
+  nodes[node].nextFree = head;
+  if (head != NONE)
+    nodes[head].prevFree = node;
+
+  heads[fl][sl] = node;
+  flBitmap |= u64(1) << fl;
+  slBitmap[fl] |= 1u << sl;
+  freeRanges++;
+}
+
+void TlsfAllocator::removeFree(u32 node) {
+  u32 fl, sl;
+  mapping(nodes[node].size, fl, sl);
+
+  u32 prev = nodes[node].prevFree;
+  u32 next = nodes[node].nextFree;
+  if (prev != NONE)
+    nodes[prev].nextFree = next;
+  if (next != NONE)
+    nodes[next].prevFree = prev;
+
+  if (heads[fl][sl] == node) {
+    heads[fl][sl] = next;
+    if (next == NONE) {
+      slBitmap[fl] &= ~(1u << sl);
+      if (slBitmap[fl] == 0)
+        flBitmap &= ~(u64(1) << fl);
+    }
+  }
+  freeRanges--;
+}
+
+void TlsfAllocator::split(u32 node, u64 size) {
+  u32 tail = createNode(nodes[node].offset + size, nodes[node].size - size);
+  nodes[node].size = size;
+
+  u32 next = nodes[node].nextPhysical;
+  nodes[tail].prevPhysical = node;
+  nodes[tail].nextPhysical = next;
+  nodes[node].nextPhysical = tail;
+  if (next != NONE)
+    nodes[next].prevPhysical = tail;
+}
+
+void TlsfAllocator::merge(u32 node, u32 next) {
+  nodes[node].size += nodes[next].size;
+
+  u32 after = nodes[next].nextPhysical;
+  nodes[node].nextPhysical = after;
+  if (after != NONE)
+    nodes[after].prevPhysical = node;
+
+  destroyNode(next);
+}
+
+// ====================================================================================================================
+// Stats
+// ====================================================================================================================
+u64 TlsfAllocator::getCapacity() const { return capacity; }
+
+u64 TlsfAllocator::getUsed() const { return used; }
+
+u64 TlsfAllocator::getAllocationCount() const { return allocated.size(); }
+
+u64 TlsfAllocator::getLargestFree() const {
+  if (flBitmap == 0)
+    return 0;
+
+  // ranges in a list span a size class, look through the top one
+  u32 fl = highestBit(flBitmap);
+  u32 sl = highestBit(slBitmap[fl]);
+  u64 largest = 0;
+  for (u32 node = heads[fl][sl]; node != NONE; node = nodes[node].nextFree)
+    largest = std::max(largest, nodes[node].size);
+  return largest;
+}
+
+u64 TlsfAllocator::getFreeRangeCount() const { return freeRanges; }
+
+} // namespace Util
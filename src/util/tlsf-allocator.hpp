@@ -0,0 +1,115 @@
+/**
+ * @file tlsf-allocator.hpp
+ *
+ * @brief header file for the two level segregated fit allocator
+ *
+ * @details Hands out aligned ranges of a fixed size address space (a block
+ *          of device memory) without owning any memory itself. Free ranges
+ *          are kept in lists by size class: the first level splits sizes by
+ *          power of two, the second level splits each power of two into
+ *          SL_COUNT linear steps. Two bitmaps record which lists are non
+ *          empty, so finding a fitting range and freeing one (which merges it
+ *          with free neighbours) are both O(1).
+ *
+ *          Unlike RangeAllocator this handles arbitrary sizes and alignments
+ *          and never leaves two free neighbours unmerged, which is what
+ *          memory that lives for the whole run needs.
+ */
+
+#pragma once
+
+#include "defines.hpp"
+
+#include <cstdint>
+#include <unordered_map>
+#include <vector>
+
+namespace Util {
+
+class TlsfAllocator {
+public:
+  struct Range {
+    u64 offset = 0;
+    u64 size = 0;
+  };
+
+  explicit TlsfAllocator(u64 capacity = 0);
+
+  /**
+   * @brief Forget every allocation and start over with a new capacity
+   */
+  void reset(u64 capacity);
+
+  /**
+   * @brief Returns false (and leaves range alone) when no free range fits
+   *
+   * @param alignment power of two
+   */
+  bool allocate(u64 size, u64 alignment, Range &range);
+
+  /**
+   * @brief Free the range that starts at offset
+   */
+  void free(u64 offset);
+
+  u64 getCapacity() const;
+  u64 getUsed() const;
+  u64 getAllocationCount() const;
+
+  /**
+   * @brief Largest range that could be allocated right now (with no alignment)
+   */
+  u64 getLargestFree() const;
+
+  /**
+   * @brief Number of free ranges, a single one means no fragmentation
+   */
+  u64 getFreeRangeCount() const;
+
+private:
+  static constexpr u32 SL_BITS = 5;
+  static constexpr u32 SL_COUNT = 1 << SL_BITS;
+  // sizes below SMALL_SIZE share the first list, split in steps of GRANULARITY
+  static constexpr u32 GRANULARITY_BITS = 3;
+  static constexpr u64 GRANULARITY = 1 << GRANULARITY_BITS;
+  static constexpr u32 FL_SHIFT = SL_BITS + GRANULARITY_BITS;
+  static constexpr u64 SMALL_SIZE = u64(1) << FL_SHIFT;
+  static constexpr u32 FL_COUNT = 64 - FL_SHIFT + 1;
+  static constexpr u32 NONE = UINT32_MAX;
+
+  // a range of the address space, free or used, linked to its physical neighbours
+  struct Node {
+    u64 offset;
+    u64 size;
+    u32 prevPhysical;
+    u32 nextPhysical;
+    u32 prevFree;
+    u32 nextFree;
+    bool free;
+  };
+
+  static void mapping(u64 size, u32 &fl, u32 &sl);
+  bool findFree(u64 size, u32 &fl, u32 &sl) const;
+
+  u32 createNode(u64 offset, u64 size);
+  void destroyNode(u32 node);
+  void insertFree(u32 node);
+  void removeFree(u32 node);
+  // cut the node at offset + size, the tail becomes a new free node
+  void split(u32 node, u64 size);
+  void merge(u32 node, u32 next);
+
+  u64 capacity = 0;
+  u64 used = 0;
+  u64 freeRanges = 0;
+
+  std::vector<Node> nodes;
+  std::vector<u32> unusedNodes;
+  u64 flBitmap = 0;
+  u32 slBitmap[FL_COUNT]{};
+  u32 heads[FL_COUNT][SL_COUNT];
+  // offset -> node of every allocated range
+  std::unordered_map<u64, u32> allocated;
+};
+
+} // namespace Util
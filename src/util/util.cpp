@@ -7,6 +7,20 @@
 #define STB_IMAGE_IMPLEMENTATION
 #include "stb_image.h"
 
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#include <psapi.h>
+#else
+#include <sys/resource.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#include <algorithm>
 #include <fstream>
 #include <stdexcept>
 #include <string>
@@ -41,4 +55,187 @@ void loadImage(std::string filePath, unsigned char *&data, int &width, int &heig
     Util::Error("Failed to load texture image: " + filePath);
 }
 
+namespace {
+u32 crc32(const uint8_t *data, size_t size, u32 crc = 0) {
+  crc = ~crc;
+  for (size_t i = 0; i < size; i++) {
+    crc ^= data[i];
+    for (int bit = 0; bit < 8; bit++)
+      crc = (crc >> 1) ^ (0xEDB88320u & (0u - (crc & 1u)));
+  }
+  return ~crc;
+}
+
+void appendU32(std::vector<uint8_t> &out, u32 value) {
+  for (int shift = 24; shift >= 0; shift -= 8)
+    out.push_back((uint8_t)(value >> shift));
+}
+
+void appendChunk(std::vector<uint8_t> &out, const char type[4], const std::vector<uint8_t> &data) {
+  appendU32(out, (u32)data.size());
+  size_t start = out.size();
+  out.insert(out.end(), type, type + 4);
+  out.insert(out.end(), data.begin(), data.end());
+  appendU32(out, crc32(out.data() + start, out.size() - start));
+}
+} // namespace
+
+void savePNG(const std::string &filePath, const uint8_t *rgba, u32 width, u32 height) {
+  std::vector<uint8_t> header;
+  appendU32(header, width);
+  appendU32(header, height);
+  // 8 bit RGBA, deflate, adaptive filtering, no interlace
+  header.insert(header.end(), {8, 6, 0, 0, 0});
+
+  // every row starts with filter type 0, the zlib stream holds them in stored (uncompressed) blocks
+  const size_t rowBytes = (size_t)width * 4;
+  std::vector<uint8_t> raw;
+  raw.reserve((rowBytes + 1) * height);
+  for (u32 y = 0; y < height; y++) {
+    raw.push_back(0);
+    raw.insert(raw.end(), rgba + y * rowBytes, rgba + (y + 1) * rowBytes);
+  }
+
+  std::vector<uint8_t> zlib = {0x78, 0x01};
+  for (size_t offset = 0; offset < raw.size(); offset += 65535) {
+    const size_t length = std::min(raw.size() - offset, (size_t)65535);
+    zlib.push_back(offset + length == raw.size() ? 1 : 0);
+    zlib.insert(zlib.end(), {(uint8_t)length, (uint8_t)(length >> 8), (uint8_t)~length, (uint8_t)(~length >> 8)});
+    zlib.insert(zlib.end(), raw.begin() + offset, raw.begin() + offset + length);
+  }
+  u32 a = 1, b = 0;
+  for (uint8_t byte : raw) {
+    a = (a + byte) % 65521;
+    b = (b + a) % 65521;
+  }
+  appendU32(zlib, (b << 16) | a);
+
+  std::vector<uint8_t> png = {0x89, 'P', 'N', 'G', '\r', '\n', 0x1A, '\n'};
+  appendChunk(png, "IHDR", header);
+  appendChunk(png, "IDAT", zlib);
+  appendChunk(png, "IEND", {});
+
+  std::ofstream file(filePath, std::ios::binary);
+  if (!file.write(reinterpret_cast<const char *>(png.data()), (std::streamsize)png.size()))
+    Util::Error("Failed to write image: " + filePath);
+}
+
+size_t peakMemoryUsage() {
+#ifdef _WIN32
+  PROCESS_MEMORY_COUNTERS counters{};
+  if (!GetProcessMemoryInfo(GetCurrentProcess(), &counters, sizeof(counters)))
+    return 0;
+  return counters.PeakWorkingSetSize;
+#else
+  struct rusage usage {};
+  if (getrusage(RUSAGE_SELF, &usage) != 0)
+    return 0;
+#ifdef __APPLE__
+  return (size_t)usage.ru_maxrss; // bytes
+#else
+  return (size_t)usage.ru_maxrss * 1024; // kilobytes
+#endif
+#endif
+}
+
+MappedFile::MappedFile(const std::string &filename) {
+#ifdef _WIN32
+  file = CreateFileA(filename.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING,
+                     FILE_ATTRIBUTE_NORMAL | FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+  if (file == INVALID_HANDLE_VALUE) {
+    file = nullptr;
+    Util::Error("Failed to open file for mapping: " + filename);
+  }
+
+  LARGE_INTEGER fileSize;
+  GetFileSizeEx(file, &fileSize);
+  length = (size_t)fileSize.QuadPart;
+
+  mapping = CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+  if (!mapping) {
+    unmap();
+    Util::Error("Failed to map file: " + filename);
+  }
+
+  bytes = static_cast<const unsigned char *>(MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0));
+  if (!bytes) {
+    unmap();
+    Util::Error("Failed to map file: " + filename);
+  }
+#else
+  int fd = open(filename.c_str(), O_RDONLY);
+  if (fd < 0)
+    Util::Error("Failed to open file for mapping: " + filename);
+
+  struct stat info;
+  if (fstat(fd, &info) != 0 || info.st_size == 0) {
+    close(fd);
+    Util::Error("Failed to map file: " + filename);
+  }
+  length = (size_t)info.st_size;
+
+  void *address = mmap(nullptr, length, PROT_READ, MAP_PRIVATE, fd, 0);
+  // the mapping keeps its own reference to the file
+  close(fd);
+
+  if (address == MAP_FAILED) {
+    length = 0;
+    Util::Error("Failed to map file: " + filename);
+  }
+
+  bytes = static_cast<const unsigned char *>(address);
+#endif
+}
+
+MappedFile::~MappedFile() { unmap(); }
+
+MappedFile::MappedFile(MappedFile &&other) noexcept : bytes(other.bytes), length(other.length) {
+#ifdef _WIN32
+  file = other.file;
+  mapping = other.mapping;
+  other.file = nullptr;
+  other.mapping = nullptr;
+#endif
+  other.bytes = nullptr;
+  other.length = 0;
+}
+
+MappedFile &MappedFile::operator=(MappedFile &&other) noexcept {
+  if (this == &other)
+    return *this;
+
+  unmap();
+
+  this->bytes = other.bytes;
+  this->length = other.length;
+#ifdef _WIN32
+  this->file = other.file;
+  this->mapping = other.mapping;
+  other.file = nullptr;
+  other.mapping = nullptr;
+#endif
+  other.bytes = nullptr;
+  other.length = 0;
+
+  return *this;
+}
+
+void MappedFile::unmap() {
+#ifdef _WIN32
+  if (bytes)
+    UnmapViewOfFile(bytes);
+  if (mapping)
+    CloseHandle(mapping);
+  if (file)
+    CloseHandle(file);
+  file = nullptr;
+  mapping = nullptr;
+#else
+  if (bytes)
+    munmap(const_cast<unsigned char *>(bytes), length);
+#endif
+  bytes = nullptr;
+  length = 0;
+}
+
 } // namespace Util
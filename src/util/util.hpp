@@ -9,6 +9,7 @@
 
 #include "defines.hpp"
 
+#include <cstdint>
 #include <string>
 #include <vector>
 
@@ -17,4 +18,39 @@ std::vector<char> readFile(const std::string &filename);
 void Error(const std::string &message);
 f32 randomFloat(f32 lo, f32 hi);
 void loadImage(std::string filePath, unsigned char *&data, int &width, int &height, int &channels);
+/**
+ * @brief Write RGBA8 pixels (rows top to bottom, no padding) as a PNG file, uncompressed
+ */
+void savePNG(const std::string &filePath, const uint8_t *rgba, u32 width, u32 height);
+/**
+ * @brief Peak resident memory of the process in bytes (0 if unknown)
+ */
+size_t peakMemoryUsage();
+
+/**
+ * @brief Read-only memory mapping of a whole file
+ */
+class MappedFile {
+public:
+  MappedFile() = default;
+  explicit MappedFile(const std::string &filename);
+  ~MappedFile();
+  MappedFile(const MappedFile &other) = delete;
+  MappedFile &operator=(const MappedFile &other) = delete;
+  MappedFile(MappedFile &&other) noexcept;
+  MappedFile &operator=(MappedFile &&other) noexcept;
+
+  const unsigned char *data() const { return bytes; }
+  size_t size() const { return length; }
+
+private:
+  void unmap();
+
+  const unsigned char *bytes = nullptr;
+  size_t length = 0;
+#ifdef _WIN32
+  void *file = nullptr;
+  void *mapping = nullptr;
+#endif
+};
 } // namespace Util